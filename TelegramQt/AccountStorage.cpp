@@ -32,8 +32,9 @@ public:
     quint32 m_contentRelatedMessagesNumber = 0;
     qint32 m_deltaTime = 0;
     DcOption m_dcInfo;
+    UpdatesState m_updatesState;
 
-    static constexpr quint32 c_formatVersion = 1;
+    static constexpr quint32 c_formatVersion = 2;
     static const QByteArray c_signature;
 };
 
@@ -165,6 +166,16 @@ void AccountStorage::setDcInfo(const DcOption &newDcInfo)
     d->m_dcInfo = newDcInfo;
 }
 
+UpdatesState AccountStorage::updatesState() const
+{
+    return d->m_updatesState;
+}
+
+void AccountStorage::setUpdatesState(const UpdatesState &state)
+{
+    d->m_updatesState = state;
+}
+
 bool AccountStorage::sync()
 {
     emit synced();
@@ -250,6 +261,10 @@ bool FileAccountStorage::saveData() const
     stream << d->m_authId;
     stream << d->m_sessionId;
     stream << d->m_contentRelatedMessagesNumber;
+    stream << d->m_updatesState.pts;
+    stream << d->m_updatesState.qts;
+    stream << d->m_updatesState.seq;
+    stream << d->m_updatesState.date;
     qCDebug(c_clientAccountStorage) << Q_FUNC_INFO << "Saved key" << QString::number(authId(), 0x10);
     return true;
 }
@@ -289,6 +304,12 @@ bool FileAccountStorage::loadData()
     stream >> d->m_authId;
     stream >> d->m_sessionId;
     stream >> d->m_contentRelatedMessagesNumber;
+    if (format >= 2) {
+        stream >> d->m_updatesState.pts;
+        stream >> d->m_updatesState.qts;
+        stream >> d->m_updatesState.seq;
+        stream >> d->m_updatesState.date;
+    }
 
     qCDebug(c_clientAccountStorage) << Q_FUNC_INFO << "Loaded key" << QString::number(authId(), 0x10);
     return !stream.error();
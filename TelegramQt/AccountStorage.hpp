@@ -44,6 +44,9 @@ public:
     DcOption dcInfo() const;
     void setDcInfo(const DcOption &newDcInfo);
 
+    UpdatesState updatesState() const;
+    void setUpdatesState(const UpdatesState &state);
+
 public slots:
     virtual bool saveData() const { return false; }
     virtual bool loadData() { return false; }
@@ -229,6 +229,18 @@ quint64 timeStampToMSecsSinceEpoch(quint64 ts)
     return secs * 1000 + msecs;
 }
 
+quint32 updateHash(quint32 hash, quint32 value)
+{
+    static const quint64 c_hashModulo = 0x80000000ull;
+    return static_cast<quint32>((hash * 20261ull + c_hashModulo + value) % c_hashModulo);
+}
+
+quint32 updateMessagesHash(quint32 hash, const TLMessage &message)
+{
+    hash = updateHash(hash, message.id);
+    return updateHash(hash, message.editDate);
+}
+
 } // Utils namespace
 
 } // Telegram namespace
@@ -49,6 +49,10 @@ TELEGRAMQT_EXPORT quint64 timeStampToMSecsSinceEpoch(quint64 ts);
 
 TELEGRAMQT_EXPORT quint32 getCurrentTime();
 
+// Incremental hash used by the *NotModified replies (messages.getHistory, contacts.getContacts)
+TELEGRAMQT_EXPORT quint32 updateHash(quint32 hash, quint32 value);
+TELEGRAMQT_EXPORT quint32 updateMessagesHash(quint32 hash, const TLMessage &message);
+
 } // Utils namespace
 
 } // Telegram namespace
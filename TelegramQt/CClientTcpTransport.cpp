@@ -33,7 +33,7 @@ Q_LOGGING_CATEGORY(c_loggingTranport, "telegram.client.transport", QtWarningMsg)
 
 static const quint8 c_abridgedVersionByte = 0xef;
 static const quint32 c_intermediateVersionBytes = 0xeeeeeeeeu;
-static const quint32 c_obfucsatedProcotolIdentifier = 0xefefefefu;
+static const quint32 c_paddedIntermediateVersionBytes = 0xddddddddu;
 
 TcpTransport::TcpTransport(QObject *parent) :
     BaseTcpTransport(parent),
@@ -54,12 +54,12 @@ void TcpTransport::setPreferedSessionType(const BaseTcpTransport::SessionType se
     m_preferedSessionType = sessionType;
 }
 
-void TcpTransport::startObfuscatedSession()
+void TcpTransport::startObfuscatedSession(PacketFraming::Mode framingMode)
 {
     qCDebug(c_loggingTranport) << "Start the session in Obfuscated format";
     // prepare random part
     const QVector<quint32> headerFirstWordBlackList = {
-        0x44414548u, 0x54534f50u, 0x20544547u, 0x20544547u, c_intermediateVersionBytes,
+        0x44414548u, 0x54534f50u, 0x20544547u, 0x20544547u, c_intermediateVersionBytes, c_paddedIntermediateVersionBytes,
     };
     const QVector<quint32> headerSecondWordBlackList = {
         0x0,
@@ -83,6 +83,7 @@ void TcpTransport::startObfuscatedSession()
     // first, next,       AES (key + Ivec),     protocol id, random 4 bytes; 64 bytes in total
     //      4      8                          56            60    64
     // xxxx | xxxx | xxxx ... xxxx (48 bytes) | 0xefefefefU | xxxx |
+    // The protocol id selects the framing: 0xefefefef (abridged), 0xeeeeeeee or 0xdddddddd (padded intermediate)
     const quint32 trailingRandom = RandomGenerator::instance()->generate<quint32>();
 
     CRawStream raw(CRawStream::WriteOnly);
@@ -90,10 +91,11 @@ void TcpTransport::startObfuscatedSession()
     raw << next4Bytes;
     raw << aesSourceData;
     m_socket->write(raw.getData());
-    raw << c_obfucsatedProcotolIdentifier;
+    raw << PacketFraming::protocolIdentifier(framingMode);
     raw << trailingRandom;
     QByteArray encrypted = m_writeAesContext->crypt(raw.getData());
     m_socket->write(encrypted.mid(56, 8));
+    m_framing.setMode(framingMode);
     setSessionType(Obfuscated);
 }
 
@@ -101,9 +103,20 @@ void TcpTransport::startAbridgedSession()
 {
     qCDebug(c_loggingTranport) << "Start the session in Abridged format";
     m_socket->putChar(c_abridgedVersionByte);
+    m_framing.setMode(PacketFraming::Mode::Abridged);
     setSessionType(Abridged);
 }
 
+void TcpTransport::startIntermediateSession(PacketFraming::Mode framingMode)
+{
+    const bool padded = framingMode == PacketFraming::Mode::PaddedIntermediate;
+    qCDebug(c_loggingTranport) << "Start the session in" << (padded ? "Padded Intermediate" : "Intermediate") << "format";
+    const quint32 versionBytes = padded ? c_paddedIntermediateVersionBytes : c_intermediateVersionBytes;
+    m_socket->write(reinterpret_cast<const char *>(&versionBytes), sizeof(versionBytes));
+    m_framing.setMode(padded ? PacketFraming::Mode::PaddedIntermediate : PacketFraming::Mode::Intermediate);
+    setSessionType(padded ? PaddedIntermediate : Intermediate);
+}
+
 bool TcpTransport::setProxy(const QNetworkProxy &proxy)
 {
     if (m_socket->isOpen()) {
@@ -154,6 +167,15 @@ void TcpTransport::writeEvent()
     case Abridged:
         startAbridgedSession();
         break;
+    case Intermediate:
+        startIntermediateSession(PacketFraming::Mode::Intermediate);
+        break;
+    case PaddedIntermediate:
+        startIntermediateSession(PacketFraming::Mode::PaddedIntermediate);
+        break;
+    case ObfuscatedPaddedIntermediate:
+        startObfuscatedSession(PacketFraming::Mode::PaddedIntermediate);
+        break;
     default:
         qCCritical(c_loggingTranport) << Q_FUNC_INFO << "The selected session type" << m_preferedSessionType << "is not supported";
         break;
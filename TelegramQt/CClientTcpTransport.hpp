@@ -36,8 +36,9 @@ public:
     SessionType preferredSessionType() const { return m_preferedSessionType; }
     void setPreferedSessionType(const SessionType sessionType);
 
-    void startObfuscatedSession();
+    void startObfuscatedSession(PacketFraming::Mode framingMode = PacketFraming::Mode::Abridged);
     void startAbridgedSession();
+    void startIntermediateSession(PacketFraming::Mode framingMode = PacketFraming::Mode::Intermediate);
     bool setProxy(const QNetworkProxy &proxy);
 
 protected:
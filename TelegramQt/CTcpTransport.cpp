@@ -78,7 +78,7 @@ void BaseTcpTransport::disconnectFromHost()
     }
     m_readBuffer.clear();
     m_packetNumber = 0;
-    m_expectedLength = 0;
+    m_framing.reset();
     m_sessionType = Unknown;
 }
 
@@ -91,17 +91,7 @@ void BaseTcpTransport::sendPacketImplementation(const QByteArray &payload)
 {
     qCDebug(c_loggingTcpTransport) << this << __func__ << payload.size();
 
-    // quint32 length (included length itself + packet number + crc32 + payload (MUST be divisible by 4)
-    // quint32 packet number
-    // quint32 CRC32 (length, quint32 packet number, payload)
-    // Payload
-
-    // Abridged version:
-    // quint8: 0xef
-    // DataLength / 4 < 0x7f ?
-    //      (quint8: Packet length / 4) :
-    //      (quint8: 0x7f, quint24: Packet length / 4)
-    // Payload
+    // The packet is framed according to the session type (see PacketFraming)
 
     if (payload.length() % 4) {
         qCCritical(c_loggingTcpTransport) << this << __func__
@@ -110,15 +100,7 @@ void BaseTcpTransport::sendPacketImplementation(const QByteArray &payload)
     }
 
     QByteArray packet;
-    packet.reserve(payload.size() + 4);
-    const quint32 length = payload.length() / 4;
-    if (length < 0x7f) {
-        packet.append(char(length));
-    } else {
-        packet.append(char(0x7f));
-        packet.append(reinterpret_cast<const char *>(&length), 3);
-    }
-    packet.append(payload);
+    m_framing.appendPacket(&packet, payload);
 
     if (m_writeAesContext && m_writeAesContext->hasKey()) {
         packet = m_writeAesContext->crypt(packet);
@@ -181,7 +163,7 @@ void BaseTcpTransport::setState(QAbstractSocket::SocketState newState)
 {
     qCDebug(c_loggingTcpTransport) << this << __func__ << newState;
     if (newState == QAbstractSocket::ConnectedState) {
-        m_expectedLength = 0;
+        m_framing.reset();
         setSessionType(Unknown);
     }
     BaseTransport::setState(newState);
@@ -192,7 +174,7 @@ void BaseTcpTransport::onReadyRead()
     qCDebug(c_loggingTcpTransport) << this << __func__ << m_socket->bytesAvailable();
     readEvent();
     if (m_sessionType == Unknown) {
-        qCCritical(c_loggingTcpTransport) << this << "Unknown session type!";
+        // Wait for the rest of the session header; readEvent() reports and drops an unsupported session
         return;
     }
     if (m_socket->bytesAvailable() > 0) {
@@ -202,38 +184,27 @@ void BaseTcpTransport::onReadyRead()
         }
         m_readBuffer.append(allData);
     }
-    while (m_readBuffer.size() >= 4) {
-        if (m_expectedLength == 0) {
-            const quint8 *data = reinterpret_cast<const quint8*>(m_readBuffer.constData());
-            quint8 length_t1 = data[0];
-            if (length_t1 < 0x7fu) {
-                m_expectedLength = length_t1 * 4;
-                m_readBuffer = m_readBuffer.mid(1);
-            } else if (length_t1 == 0x7fu) {
-                m_expectedLength = data[1] + data[2] * 256 + data[3] * 256 * 256;
-                m_expectedLength *= 4;
-                m_readBuffer = m_readBuffer.mid(4);
-            } else {
-                qCWarning(c_loggingTcpTransport) << this << __func__ << "Invalid packet size byte"
-                                                 << hex << showbase << length_t1;
-                setError(QAbstractSocket::UnknownSocketError, QStringLiteral("Invalid read operation"));
-                qCDebug(c_loggingTcpTransport) << this << __func__ << "close socket" << m_socket;
-                disconnectFromHost();
-                return;
-            }
-        }
-        if (m_readBuffer.size() < static_cast<int>(m_expectedLength)) {
+    QByteArray payload;
+    while (true) {
+        switch (m_framing.takePacket(&m_readBuffer, &payload)) {
+        case PacketFraming::ReadStatus::Packet:
+            qCDebug(c_loggingTcpTransport) << this << Q_FUNC_INFO
+                                             << "Received a packet (" << payload.size() << " bytes)";
+            emit packetReceived(payload);
+            break;
+        case PacketFraming::ReadStatus::Incomplete:
             qCDebug(c_loggingTcpTransport) << this << Q_FUNC_INFO << "Ready read, but only "
                                            << m_readBuffer.size() << "bytes available ("
-                                           << m_expectedLength << "bytes expected)";
+                                           << m_framing.expectedLength() << "bytes expected)";
+            return;
+        case PacketFraming::ReadStatus::Invalid:
+            qCWarning(c_loggingTcpTransport) << this << __func__ << "Invalid packet size byte"
+                                             << hex << showbase << quint8(m_readBuffer.at(0));
+            setError(QAbstractSocket::UnknownSocketError, QStringLiteral("Invalid read operation"));
+            qCDebug(c_loggingTcpTransport) << this << __func__ << "close socket" << m_socket;
+            disconnectFromHost();
             return;
         }
-        const QByteArray payload = m_readBuffer.left(static_cast<int>(m_expectedLength));
-        m_readBuffer = m_readBuffer.mid(static_cast<int>(m_expectedLength));
-        m_expectedLength = 0;
-        qCDebug(c_loggingTcpTransport) << this << Q_FUNC_INFO
-                                         << "Received a packet (" << payload.size() << " bytes)";
-        emit packetReceived(payload);
     }
 }
 
@@ -19,6 +19,7 @@
 #define CTCPTRANSPORT_HPP
 
 #include "CTelegramTransport.hpp"
+#include "PacketFraming.hpp"
 
 class CRawStream;
 
@@ -38,7 +39,10 @@ public:
         Unknown,
         Abridged, // char(0xef)
         FullSize,
-        Obfuscated,
+        Obfuscated, // The framing is given in the encrypted header
+        Intermediate, // 0xeeeeeeee
+        PaddedIntermediate, // 0xdddddddd
+        ObfuscatedPaddedIntermediate, // Only a preferred type; the started session is Obfuscated
         Default = Unknown,
     };
     Q_ENUM(SessionType)
@@ -58,6 +62,7 @@ public:
     void disconnectFromHost() override;
 
     SessionType sessionType() const;
+    PacketFraming::Mode framingMode() const { return m_framing.mode(); }
 
 protected slots:
     void setState(QAbstractSocket::SocketState newState) override;
@@ -74,7 +79,7 @@ protected:
     void setCryptoKeysSourceData(const QByteArray &source, SourceRevertion revertion);
 
     quint32 m_packetNumber = 0;
-    quint32 m_expectedLength = 0;
+    PacketFraming m_framing;
     SessionType m_sessionType = Unknown;
 
     QAbstractSocket *m_socket = nullptr;
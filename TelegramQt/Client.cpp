@@ -77,7 +77,7 @@ DataStorage *Client::dataStorage() const
 void Client::setDataStorage(DataStorage *storage)
 {
     Q_D(Client);
-    d->m_dataStorage = storage;
+    d->setDataStorage(storage);
 }
 
 ConnectionApi *Client::connectionApi() const
@@ -92,6 +92,12 @@ ContactsApi *Client::contactsApi() const
     return d->m_contactsApi;
 }
 
+FilesApi *Client::filesApi() const
+{
+    Q_D(const Client);
+    return d->m_filesApi;
+}
+
 MessagingApi *Client::messagingApi() const
 {
     Q_D(const Client);
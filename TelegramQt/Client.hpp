@@ -37,6 +37,7 @@ using AppInformation = ::CAppInformation;
 
 class ConnectionApi;
 class ContactsApi;
+class FilesApi;
 class MessagingApi;
 
 class ClientPrivate;
@@ -65,6 +66,7 @@ public:
 
     ConnectionApi *connectionApi() const;
     ContactsApi *contactsApi() const;
+    FilesApi *filesApi() const;
     MessagingApi *messagingApi() const;
 
 Q_SIGNALS:
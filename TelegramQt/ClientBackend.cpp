@@ -5,11 +5,15 @@
 #include "ConnectionApi_p.hpp"
 #include "ContactsApi.hpp"
 #include "ContactsApi_p.hpp"
+#include "FilesApi.hpp"
 #include "ClientConnection.hpp"
 #include "Client.hpp"
 #include "ClientRpcLayer.hpp"
+#include "ClientRpcScheduler.hpp"
 #include "DataStorage.hpp"
+#include "DataStorage_p.hpp"
 #include "MessagingApi.hpp"
+#include "MessagingApi_p.hpp"
 #include "RpcError.hpp"
 #include "Debug_p.hpp"
 #include "UpdatesLayer.hpp"
@@ -54,12 +58,21 @@ Backend::Backend(Client *parent) :
     BaseRpcLayerExtension::RpcProcessingMethod rpcProcessMethod = [b](PendingRpcOperation *operation) mutable {
         qCDebug(c_clientBackendCategory) << "Default processing for" << operation
                                          << TLValue::firstFromArray(operation->requestData());
-        Connection *connection = b->getDefaultConnection();
+        if (operation->priority() == PendingRpcOperation::Priority::Default) {
+            operation->setPriority(RpcScheduler::priorityForRequest(TLValue::firstFromArray(operation->requestData())));
+        }
+        Connection *connection = nullptr;
+        if (operation->priority() == PendingRpcOperation::Priority::Bulk) {
+            connection = b->bulkConnection();
+        }
+        if (!connection) {
+            connection = b->getDefaultConnection();
+        }
         if (!connection) {
             qCWarning(c_clientBackendCategory) << "No connection for processMethod";
             return;
         }
-        connection->rpcLayer()->sendRpc(operation);
+        connection->rpcLayer()->scheduler()->schedule(operation);
     };
 
     // Generated low-level layer initialization
@@ -104,6 +117,9 @@ Backend::Backend(Client *parent) :
     m_messagingApi = new MessagingApi(this);
     ClientApiPrivate::get(m_messagingApi)->setBackend(this);
 
+    m_filesApi = new FilesApi(this);
+    ClientApiPrivate::get(m_filesApi)->setBackend(this);
+
     m_updatesApi = new UpdatesInternalApi(this);
     m_updatesApi->setBackend(this);
 }
@@ -113,6 +129,19 @@ bool Backend::isSignedIn() const
     return m_connectionApi->isSignedIn();
 }
 
+void Backend::setDataStorage(DataStorage *storage)
+{
+    MessagingApiPrivate *messagingApi = MessagingApiPrivate::get(m_messagingApi);
+    if (m_dataStorage) {
+        disconnect(DataInternalApi::get(m_dataStorage), nullptr, messagingApi, nullptr);
+    }
+    m_dataStorage = storage;
+    if (m_dataStorage) {
+        connect(DataInternalApi::get(m_dataStorage), &DataInternalApi::messageRequired,
+                messagingApi, &MessagingApiPrivate::onMessageRequired);
+    }
+}
+
 PendingOperation *Backend::getDcConfig()
 {
     if (m_getConfigOperation) {
@@ -136,13 +165,43 @@ PendingOperation *Backend::getDcConfig()
 
 PendingOperation *Backend::sync()
 {
+    PendingOperation *operation = new PendingOperation("Backend::sync", this);
     if (!m_contactsApi->selfContactId()) {
         ContactsApiPrivate *privateApi = ContactsApiPrivate::get(m_contactsApi);
-        return privateApi->sync();
+        PendingOperation *contactsOperation = privateApi->sync();
+        contactsOperation->connectToFinished(this, &Backend::onSyncContactsFinished, operation, contactsOperation);
+    } else {
+        syncUpdates(operation);
+    }
+    return operation;
+}
+
+/*
+    The returned operation is deleted once it is finished, so the result
+    should be tracked via the finished signals.
+*/
+PendingOperation *Backend::getPeerInfo(const Peer &peer)
+{
+    if (!peer.isValid()) {
+        return PendingOperation::failOperation(QStringLiteral("Invalid peer for getPeerInfo()"), this);
+    }
+    PendingOperation *operation = m_peerLookups.value(peer);
+    if (operation) {
+        // The peer is already requested
+        return operation;
+    }
+    operation = new PendingOperation("Backend::getPeerInfo", this);
+    operation->deleteOnFinished();
+    if (hasPeerInfo(peer)) {
+        operation->setDelayedFinished();
+        return operation;
+    }
+    if (m_requiredPeers.isEmpty()) {
+        QTimer::singleShot(0, this, &Backend::fetchRequiredPeers);
     }
-    PendingOperation *op = new SucceededPendingOperation(this);
-    op->setObjectName(QLatin1String("Backend/Sync"));
-    return op;
+    m_requiredPeers.append(peer);
+    m_peerLookups.insert(peer, operation);
+    return operation;
 }
 
 Connection *Backend::getDefaultConnection()
@@ -151,12 +210,33 @@ Connection *Backend::getDefaultConnection()
     return privateApi->getDefaultConnection();
 }
 
+Connection *Backend::bulkConnection() const
+{
+    return m_bulkConnection;
+}
+
+/*!
+  Sets the \a connection for the bulk RPC operations such as file parts transfer.
+  The connection must be authorized for the account of the default connection.
+  The bulk operations go to the default connection if there is no bulk connection.
+*/
+void Backend::setBulkConnection(Connection *connection)
+{
+    m_bulkConnection = connection;
+}
+
 Connection *Backend::ensureConnection(const ConnectionSpec &dcSpec)
 {
     ConnectionApiPrivate *privateApi = ConnectionApiPrivate::get(m_connectionApi);
     return privateApi->ensureConnection(dcSpec);
 }
 
+ConnectionPool *Backend::getConnectionPool(const ConnectionSpec &dcSpec)
+{
+    ConnectionApiPrivate *privateApi = ConnectionApiPrivate::get(m_connectionApi);
+    return privateApi->getConnectionPool(dcSpec);
+}
+
 void Backend::onGetDcConfigurationFinished(PendingOperation *operation)
 {
     if (!operation->isSucceeded()) {
@@ -165,6 +245,129 @@ void Backend::onGetDcConfigurationFinished(PendingOperation *operation)
     }
 }
 
+void Backend::syncUpdates(PendingOperation *syncOperation)
+{
+    // The updates state is synced after the self user to process the received messages properly
+    PendingOperation *updatesOperation = m_updatesApi->sync();
+    updatesOperation->connectToFinished(this, &Backend::onSyncUpdatesFinished, syncOperation, updatesOperation);
+}
+
+void Backend::onSyncContactsFinished(PendingOperation *syncOperation, PendingOperation *contactsOperation)
+{
+    if (!contactsOperation->isSucceeded()) {
+        syncOperation->setFinishedWithError(contactsOperation->errorDetails());
+        return;
+    }
+    syncUpdates(syncOperation);
+}
+
+void Backend::onSyncUpdatesFinished(PendingOperation *syncOperation, PendingOperation *updatesOperation)
+{
+    if (!updatesOperation->isSucceeded()) {
+        syncOperation->setFinishedWithError(updatesOperation->errorDetails());
+        return;
+    }
+    syncOperation->setFinished();
+}
+
+bool Backend::hasPeerInfo(const Peer &peer) const
+{
+    const DataInternalApi *dataApi = DataInternalApi::get(m_dataStorage);
+    if (peer.type == Peer::User) {
+        return dataApi->users().contains(peer.id);
+    }
+    return dataApi->chats().contains(peer.id);
+}
+
+void Backend::fetchRequiredPeers()
+{
+    const PeerList requiredPeers = m_requiredPeers;
+    m_requiredPeers.clear();
+
+    PeerList users;
+    PeerList chats;
+    PeerList channels;
+    TLVector<TLInputUser> inputUsers;
+    TLVector<quint32> chatIds;
+    TLVector<TLInputChannel> inputChannels;
+    for (const Peer &peer : requiredPeers) {
+        if (hasPeerInfo(peer)) {
+            // Received with some other data while the request was pending
+            m_peerLookups.take(peer)->setFinished();
+            continue;
+        }
+        switch (peer.type) {
+        case Peer::User: {
+            // The access hash is not known for the users missing in the storage
+            TLInputUser inputUser;
+            inputUser.tlType = TLValue::InputUser;
+            inputUser.userId = peer.id;
+            inputUsers.append(inputUser);
+            users.append(peer);
+            break;
+        }
+        case Peer::Chat:
+            chatIds.append(peer.id);
+            chats.append(peer);
+            break;
+        case Peer::Channel: {
+            TLInputChannel inputChannel;
+            inputChannel.tlType = TLValue::InputChannel;
+            inputChannel.channelId = peer.id;
+            inputChannels.append(inputChannel);
+            channels.append(peer);
+            break;
+        }
+        }
+    }
+
+    if (!users.isEmpty()) {
+        PendingRpcOperation *rpcOperation = usersLayer()->getUsers(inputUsers);
+        rpcOperation->connectToFinished(this, &Backend::onPeersFetched, users, rpcOperation);
+    }
+    if (!chats.isEmpty()) {
+        PendingRpcOperation *rpcOperation = messagesLayer()->getChats(chatIds);
+        rpcOperation->connectToFinished(this, &Backend::onPeersFetched, chats, rpcOperation);
+    }
+    if (!channels.isEmpty()) {
+        PendingRpcOperation *rpcOperation = channelsLayer()->getChannels(inputChannels);
+        rpcOperation->connectToFinished(this, &Backend::onPeersFetched, channels, rpcOperation);
+    }
+}
+
+void Backend::onPeersFetched(const PeerList &peers, PendingRpcOperation *rpcOperation)
+{
+    if (rpcOperation->isSucceeded()) {
+        DataInternalApi *dataApi = DataInternalApi::get(m_dataStorage);
+        if (peers.first().type == Peer::User) {
+            TLVector<TLUser> users;
+            static_cast<UsersRpcLayer::PendingUserVector *>(rpcOperation)->getResult(&users);
+            dataApi->processData(users);
+        } else {
+            TLMessagesChats chats;
+            static_cast<MessagesRpcLayer::PendingMessagesChats *>(rpcOperation)->getResult(&chats);
+            dataApi->processData(chats.chats);
+        }
+    } else {
+        qCWarning(c_clientBackendCategory) << Q_FUNC_INFO << "Unable to get peers" << peers << rpcOperation->errorDetails();
+    }
+
+    for (const Peer &peer : peers) {
+        PendingOperation *operation = m_peerLookups.take(peer);
+        if (!operation) {
+            continue;
+        }
+        if (rpcOperation->isFailed()) {
+            operation->setFinishedWithError(rpcOperation->errorDetails());
+        } else if (hasPeerInfo(peer)) {
+            operation->setFinished();
+        } else {
+            operation->setFinishedWithError({{ PendingOperation::c_text(), QStringLiteral("Peer is not available") }});
+        }
+    }
+    rpcOperation->deleteLater();
+}
+
 bool Backend::syncAccountToStorage()
 {
     ConnectionApiPrivate *privateApi = ConnectionApiPrivate::get(m_connectionApi);
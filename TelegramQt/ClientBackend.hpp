@@ -1,7 +1,9 @@
 #ifndef TELEGRAM_CLIENT_BACKEND_HPP
 #define TELEGRAM_CLIENT_BACKEND_HPP
 
+#include <QHash>
 #include <QObject>
+#include <QPointer>
 #include <QVector>
 
 #include "TelegramNamespace.hpp"
@@ -17,6 +19,7 @@ struct DcOption;
 namespace Client {
 
 class Connection;
+class ConnectionPool;
 class Client;
 class Settings;
 class AccountStorage;
@@ -24,6 +27,7 @@ using AppInformation = ::CAppInformation;
 class DataStorage;
 class ConnectionApi;
 class ContactsApi;
+class FilesApi;
 class MessagingApi;
 class PendingRpcOperation;
 class UpdatesInternalApi;
@@ -62,11 +66,18 @@ public:
 
     PendingOperation *sync();
 
+    // Lookups requested within one event loop iteration are sent as a single request per peer type
+    PendingOperation *getPeerInfo(const Telegram::Peer &peer);
+
     Connection *getDefaultConnection();
+    Connection *bulkConnection() const;
+    void setBulkConnection(Connection *connection);
     Connection *ensureConnection(const ConnectionSpec &dcSpec);
+    ConnectionPool *getConnectionPool(const ConnectionSpec &dcSpec);
 
     DataStorage *dataStorage() { return m_dataStorage; }
     const DataStorage *dataStorage() const { return m_dataStorage; }
+    void setDataStorage(DataStorage *storage);
 
     ConnectionApi *connectionApi() const { return m_connectionApi; }
     MessagingApi *messagingApi() const { return m_messagingApi; }
@@ -98,6 +109,7 @@ public:
     DataStorage *m_dataStorage = nullptr;
     ConnectionApi *m_connectionApi = nullptr;
     ContactsApi *m_contactsApi = nullptr;
+    FilesApi *m_filesApi = nullptr;
     MessagingApi *m_messagingApi = nullptr;
 
     // Generated low-level layer members
@@ -124,9 +136,18 @@ public:
 
 protected:
     void onGetDcConfigurationFinished(PendingOperation *operation);
+    void syncUpdates(PendingOperation *syncOperation);
+    void onSyncContactsFinished(PendingOperation *syncOperation, PendingOperation *contactsOperation);
+    void onSyncUpdatesFinished(PendingOperation *syncOperation, PendingOperation *updatesOperation);
+    bool hasPeerInfo(const Telegram::Peer &peer) const;
+    void fetchRequiredPeers();
+    void onPeersFetched(const Telegram::PeerList &peers, PendingRpcOperation *rpcOperation);
 
     PendingOperation *m_getConfigOperation = nullptr;
     UpdatesInternalApi *m_updatesApi = nullptr;
+    QPointer<Connection> m_bulkConnection;
+    Telegram::PeerList m_requiredPeers; // Not requested yet
+    QHash<Telegram::Peer, PendingOperation *> m_peerLookups; // Required and in-flight lookups
 
 };
 
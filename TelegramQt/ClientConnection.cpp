@@ -42,6 +42,12 @@ public:
 
     void sendPackage(const QByteArray &package) override
     {
+        // The RPC layer keeps the messages until they're answered
+        // and resends them once the connection is resumed
+        if (m_connection->transport()->state() != QAbstractSocket::ConnectedState) {
+            qCDebug(c_clientConnectionCategory) << Q_FUNC_INFO << "The transport is not connected; the package is not sent";
+            return;
+        }
         return m_connection->transport()->sendPacket(package);
     }
 };
@@ -108,9 +114,9 @@ ConnectOperation *Connection::connectToDc()
 
     qCDebug(c_clientConnectionCategory) << this << __func__ << m_dcOption.id << m_dcOption.address << m_dcOption.port;
 
-    if (m_transport->state() != QAbstractSocket::UnconnectedState) {
-        m_transport->disconnectFromHost(); // Ensure that there is no connection
-    }
+    // Ensure that there is no connection and reset the framing state left
+    // by a connection which is lost (e.g. on the main connection resume)
+    m_transport->disconnectFromHost();
 
     setStatus(Status::Connecting, StatusReason::Local);
     ConnectOperation *op = new ConnectOperation(this);
@@ -0,0 +1,351 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include "ClientConnectionPool.hpp"
+
+#include "ClientBackend.hpp"
+#include "ClientConnection.hpp"
+#include "ClientRpcLayer.hpp"
+#include "ClientRpcScheduler.hpp"
+#include "ClientSettings.hpp"
+#include "ConnectionApi_p.hpp"
+#include "CTelegramTransport.hpp"
+
+#include "Operations/ClientPingOperation.hpp"
+#include "RpcLayers/ClientRpcAuthLayer.hpp"
+
+#include <QLoggingCategory>
+#include <QPointer>
+#include <QTimer>
+
+Q_LOGGING_CATEGORY(c_clientConnectionPoolCategory, "telegram.client.connectionpool", QtWarningMsg)
+
+namespace Telegram {
+
+namespace Client {
+
+constexpr int ConnectionPool::c_minRefillDelay;
+constexpr int ConnectionPool::c_maxRefillDelay;
+
+ConnectionPool::ConnectionPool(ConnectionApiPrivate *api, const ConnectionSpec &spec) :
+    QObject(api),
+    m_api(api),
+    m_spec(spec),
+    m_maintenanceTimer(new QTimer(this)),
+    m_refillTimer(new QTimer(this))
+{
+    connect(m_maintenanceTimer, &QTimer::timeout, this, &ConnectionPool::onMaintenanceTimeout);
+    m_refillTimer->setSingleShot(true);
+    connect(m_refillTimer, &QTimer::timeout, this, &ConnectionPool::warmUp);
+    setIdleTimeout(Settings::defaultIdleConnectionTimeout());
+}
+
+void ConnectionPool::setStandbyCount(int count)
+{
+    m_standbyCount = qMax(0, count);
+}
+
+void ConnectionPool::setIdleTimeout(int msecs)
+{
+    m_idleTimeout = qMax(0, msecs);
+    // Check the connections a few times within the timeout
+    m_maintenanceTimer->setInterval(qBound(10, m_idleTimeout / 4, 15000));
+}
+
+int ConnectionPool::signedCount() const
+{
+    int result = 0;
+    for (const Entry &entry : m_entries) {
+        if (entry.connection->status() == Connection::Status::Signed) {
+            ++result;
+        }
+    }
+    return result;
+}
+
+Connection *ConnectionPool::connection()
+{
+    Entry *bestEntry = nullptr;
+    int bestLoad = 0;
+    for (Entry &entry : m_entries) {
+        if (entry.connection->status() != Connection::Status::Signed) {
+            continue;
+        }
+        const int load = getLoad(entry.connection);
+        if (!bestEntry || (load < bestLoad)) {
+            bestEntry = &entry;
+            bestLoad = load;
+        }
+    }
+    if (bestEntry) {
+        bestEntry->lastUse.start();
+        return bestEntry->connection;
+    }
+    if (m_entries.isEmpty() && !m_refillTimer->isActive()) {
+        addConnection();
+    }
+    return nullptr;
+}
+
+void ConnectionPool::schedule(PendingRpcOperation *operation)
+{
+    Connection *signedConnection = connection();
+    if (signedConnection) {
+        signedConnection->rpcLayer()->scheduler()->schedule(operation);
+        return;
+    }
+    m_pendingOperations.append(operation);
+}
+
+void ConnectionPool::warmUp()
+{
+    if (m_refillTimer->isActive()) {
+        // Wait for the delay after a failure
+        return;
+    }
+    // The queued operations need a connection even if no standby connection is kept
+    const int targetCount = m_pendingOperations.isEmpty() ? m_standbyCount : qMax(m_standbyCount, 1);
+    while (m_entries.count() < targetCount) {
+        if (!addConnection()) {
+            return;
+        }
+    }
+}
+
+void ConnectionPool::clear()
+{
+    m_refillTimer->stop();
+    while (!m_entries.isEmpty()) {
+        removeConnection(m_entries.last().connection);
+    }
+    const QVector<QPointer<PendingRpcOperation>> pendingOperations = m_pendingOperations;
+    m_pendingOperations.clear();
+    for (PendingRpcOperation *operation : pendingOperations) {
+        if (operation && !operation->isFinished()) {
+            operation->setFinishedWithError({{ PendingOperation::c_text(), QStringLiteral("Connection pool is closed") }});
+        }
+    }
+}
+
+void ConnectionPool::onMaintenanceTimeout()
+{
+    // Close the unused connections over the standby count starting from the most recently added
+    int excess = m_entries.count() - m_standbyCount;
+    for (int i = m_entries.count() - 1; (i >= 0) && (excess > 0); --i) {
+        const Entry &entry = m_entries.at(i);
+        if ((entry.lastUse.elapsed() < m_idleTimeout) || getLoad(entry.connection)) {
+            continue;
+        }
+        qCDebug(c_clientConnectionPoolCategory) << this << __func__ << "Close idle connection" << entry.connection;
+        removeConnection(entry.connection);
+        --excess;
+    }
+    warmUp();
+}
+
+bool ConnectionPool::addConnection()
+{
+    ConnectionSpec optionSpec = m_spec;
+    optionSpec.flags |= ConnectionSpec::RequestFlag::Ipv4Only; // Enable only ipv4 for now
+    const DcOption dcOption = m_api->getDcOption(optionSpec);
+    if (!dcOption.isValid()) {
+        qCWarning(c_clientConnectionPoolCategory) << this << __func__ << "Unable to find suitable DC" << m_spec.dcId;
+        return false;
+    }
+    Connection *connection = m_api->createConnection(dcOption);
+    // The pool manages the connection on its own
+    disconnect(connection, nullptr, m_api, nullptr);
+    connection->setParent(this);
+
+    Entry entry;
+    entry.connection = connection;
+    entry.lastUse.start();
+    m_entries.append(entry);
+
+    connect(connection, &BaseConnection::statusChanged, this,
+            [this, connection](BaseConnection::Status status) {
+        onConnectionStatusChanged(connection, status);
+    });
+
+    qCDebug(c_clientConnectionPoolCategory) << this << __func__ << connection
+                                            << dcOption.id << dcOption.address << dcOption.port;
+    if (!m_maintenanceTimer->isActive()) {
+        m_maintenanceTimer->start();
+    }
+    connection->connectToDc();
+    return true;
+}
+
+void ConnectionPool::removeConnection(Connection *connection)
+{
+    const int index = indexOf(connection);
+    if (index < 0) {
+        return;
+    }
+    const Entry entry = m_entries.takeAt(index);
+    disconnect(connection, nullptr, this, nullptr);
+    if (entry.keepAlive) {
+        // The ping operation is deleted along with the connection, which can be not immediate
+        disconnect(entry.keepAlive, nullptr, this, nullptr);
+    }
+    connection->rpcLayer()->onConnectionFailed();
+    connection->transport()->disconnectFromHost();
+    connection->deleteLater();
+
+    if (m_entries.isEmpty()) {
+        m_maintenanceTimer->stop();
+    }
+}
+
+void ConnectionPool::onConnectionFailed(Connection *connection)
+{
+    ++m_failedAttempts;
+    int delay = c_minRefillDelay;
+    for (int i = 1; (i < m_failedAttempts) && (delay < c_maxRefillDelay); ++i) {
+        delay *= 2;
+    }
+    // Start the delay first: the failed operations of the connection can be retried right on the removal
+    m_refillTimer->start(qMin(delay, c_maxRefillDelay));
+    removeConnection(connection);
+}
+
+void ConnectionPool::onConnectionStatusChanged(Connection *connection, BaseConnection::Status status)
+{
+    qCDebug(c_clientConnectionPoolCategory) << this << __func__ << connection << status;
+    switch (status) {
+    case BaseConnection::Status::HasDhKey:
+        authorize(connection);
+        break;
+    case BaseConnection::Status::Signed:
+    {
+        m_failedAttempts = 0;
+        Settings *settings = m_api->backend()->settings();
+        if (settings->pingInterval()) {
+            Entry &entry = m_entries[indexOf(connection)];
+            entry.keepAlive = new PingOperation(connection);
+            entry.keepAlive->setSettings(settings);
+            entry.keepAlive->setRpcLayer(connection->rpcLayer());
+            entry.keepAlive->setTransport(connection->transport());
+            connect(entry.keepAlive, &PingOperation::pingFailed, this, [this, connection]() {
+                qCWarning(c_clientConnectionPoolCategory) << this << "Keep alive failed for" << connection;
+                onConnectionFailed(connection);
+            });
+            entry.keepAlive->ensureActive();
+        }
+        schedulePendingOperations(connection);
+        emit connectionSigned(connection);
+    }
+        break;
+    case BaseConnection::Status::Disconnected:
+    case BaseConnection::Status::Failed:
+        onConnectionFailed(connection);
+        break;
+    default:
+        break;
+    }
+}
+
+void ConnectionPool::authorize(Connection *connection)
+{
+    // The main connection is authorized for the account; transfer the authorization to the DC
+    AuthRpcLayer::PendingAuthExportedAuthorization *exportOperation
+            = m_api->backend()->authLayer()->exportAuthorization(m_spec.dcId);
+    QPointer<Connection> connectionPointer = connection;
+    connect(exportOperation, &PendingOperation::finished, this, [this, connectionPointer, exportOperation]() {
+        exportOperation->deleteLater();
+        if (!connectionPointer || (indexOf(connectionPointer) < 0)) {
+            return;
+        }
+        TLAuthExportedAuthorization exportedAuthorization;
+        if (!exportOperation->getResult(&exportedAuthorization)) {
+            qCWarning(c_clientConnectionPoolCategory) << this << "Unable to export the authorization to DC"
+                                                      << m_spec.dcId << exportOperation->errorDetails();
+            onConnectionFailed(connectionPointer);
+            return;
+        }
+        importAuthorization(connectionPointer, exportedAuthorization.id, exportedAuthorization.bytes);
+    });
+}
+
+void ConnectionPool::importAuthorization(Connection *connection, quint32 userId, const QByteArray &bytes)
+{
+    Entry &entry = m_entries[indexOf(connection)];
+    if (!entry.authLayer) {
+        entry.authLayer = new AuthRpcLayer(connection);
+        entry.authLayer->setRpcProcessingMethod([connection](PendingRpcOperation *operation) {
+            connection->rpcLayer()->scheduler()->schedule(operation);
+        });
+    }
+    AuthRpcLayer::PendingAuthAuthorization *importOperation = entry.authLayer->importAuthorization(userId, bytes);
+    QPointer<Connection> connectionPointer = connection;
+    connect(importOperation, &PendingOperation::finished, this, [this, connectionPointer, importOperation]() {
+        importOperation->deleteLater();
+        if (!connectionPointer || (indexOf(connectionPointer) < 0)) {
+            return;
+        }
+        if (!importOperation->isSucceeded()) {
+            qCWarning(c_clientConnectionPoolCategory) << this << "Unable to import the authorization to DC"
+                                                      << m_spec.dcId << importOperation->errorDetails();
+            onConnectionFailed(connectionPointer);
+            return;
+        }
+        connectionPointer->setStatus(Connection::Status::Signed, Connection::StatusReason::Remote);
+    });
+}
+
+void ConnectionPool::schedulePendingOperations(Connection *connection)
+{
+    const QVector<QPointer<PendingRpcOperation>> pendingOperations = m_pendingOperations;
+    m_pendingOperations.clear();
+    for (PendingRpcOperation *operation : pendingOperations) {
+        if (operation && !operation->isFinished()) {
+            connection->rpcLayer()->scheduler()->schedule(operation);
+        }
+    }
+    if (!pendingOperations.isEmpty()) {
+        m_entries[indexOf(connection)].lastUse.start();
+    }
+}
+
+int ConnectionPool::indexOf(const Connection *connection) const
+{
+    for (int i = 0; i < m_entries.count(); ++i) {
+        if (m_entries.at(i).connection == connection) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int ConnectionPool::getLoad(Connection *connection)
+{
+    static const RpcScheduler::Priority priorities[] = {
+        RpcScheduler::Priority::Interactive,
+        RpcScheduler::Priority::Normal,
+        RpcScheduler::Priority::Bulk,
+    };
+    const RpcScheduler *scheduler = connection->rpcLayer()->scheduler();
+    int result = 0;
+    for (const RpcScheduler::Priority priority : priorities) {
+        result += scheduler->queuedCount(priority) + scheduler->inFlightCount(priority);
+    }
+    return result;
+}
+
+} // Client namespace
+
+} // Telegram namespace
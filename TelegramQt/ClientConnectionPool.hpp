@@ -0,0 +1,117 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAM_CLIENT_CONNECTION_POOL_HPP
+#define TELEGRAM_CLIENT_CONNECTION_POOL_HPP
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QVector>
+
+#include "Connection.hpp"
+#include "DcConfiguration.hpp"
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+namespace Telegram {
+
+namespace Client {
+
+class AuthRpcLayer;
+class Connection;
+class ConnectionApiPrivate;
+class PendingRpcOperation;
+class PingOperation;
+
+// Keeps the connections to a DC other than the main one for the requests of one kind (generic or media).
+// The standby connections are connected and authorized via auth.exportAuthorization/importAuthorization
+// ahead of time; the connections over the standby count are closed once idle.
+class ConnectionPool : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ConnectionPool(ConnectionApiPrivate *api, const ConnectionSpec &spec);
+
+    static constexpr int c_minRefillDelay = 1000; // ms
+    static constexpr int c_maxRefillDelay = 60000; // ms
+
+    ConnectionSpec spec() const { return m_spec; }
+
+    int standbyCount() const { return m_standbyCount; }
+    void setStandbyCount(int count);
+
+    int idleTimeout() const { return m_idleTimeout; }
+    void setIdleTimeout(int msecs);
+
+    int count() const { return m_entries.count(); }
+    int signedCount() const;
+
+    // Returns the signed connection with the least operations or nullptr if there is no signed connection.
+    // A new connection is started if the pool is empty.
+    Connection *connection();
+
+    // Sends the operation via the least loaded signed connection or queues it until a connection is signed
+    void schedule(PendingRpcOperation *operation);
+    int pendingCount() const { return m_pendingOperations.count(); }
+
+    // Starts the connections up to the standby count
+    void warmUp();
+    // Closes the connections and fails their operations, including the queued ones
+    void clear();
+
+Q_SIGNALS:
+    void connectionSigned(Connection *connection);
+
+protected slots:
+    void onMaintenanceTimeout();
+
+protected:
+    struct Entry
+    {
+        Connection *connection = nullptr;
+        PingOperation *keepAlive = nullptr;
+        AuthRpcLayer *authLayer = nullptr;
+        QElapsedTimer lastUse;
+    };
+
+    bool addConnection();
+    void removeConnection(Connection *connection);
+    void onConnectionFailed(Connection *connection);
+    void onConnectionStatusChanged(Connection *connection, BaseConnection::Status status);
+    void authorize(Connection *connection);
+    void importAuthorization(Connection *connection, quint32 userId, const QByteArray &bytes);
+    void schedulePendingOperations(Connection *connection);
+    int indexOf(const Connection *connection) const;
+    static int getLoad(Connection *connection);
+
+    ConnectionApiPrivate *m_api = nullptr;
+    ConnectionSpec m_spec;
+    QVector<Entry> m_entries;
+    QVector<QPointer<PendingRpcOperation>> m_pendingOperations;
+    QTimer *m_maintenanceTimer = nullptr;
+    QTimer *m_refillTimer = nullptr;
+    int m_standbyCount = 0;
+    int m_idleTimeout = 0;
+    int m_failedAttempts = 0;
+};
+
+} // Client namespace
+
+} // Telegram namespace
+
+#endif // TELEGRAM_CLIENT_CONNECTION_POOL_HPP
@@ -0,0 +1,60 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include "ClientLocalSocketTransport.hpp"
+
+#include <QLoggingCategory>
+
+namespace Telegram {
+
+namespace Client {
+
+Q_LOGGING_CATEGORY(c_loggingLocalTranport, "telegram.client.transport.localsocket", QtWarningMsg)
+
+static const quint8 c_abridgedVersionByte = 0xef;
+
+LocalSocketTransport::LocalSocketTransport(QObject *parent) :
+    BaseLocalSocketTransport(parent)
+{
+    setSocket(new QLocalSocket(this));
+}
+
+LocalSocketTransport::~LocalSocketTransport()
+{
+    qCDebug(c_loggingLocalTranport) << this << __func__;
+}
+
+void LocalSocketTransport::connectToHost(const QString &serverName, quint16 port)
+{
+    Q_UNUSED(port)
+    qCDebug(c_loggingLocalTranport) << this << __func__ << serverName;
+    m_socket->connectToServer(serverName);
+}
+
+void LocalSocketTransport::writeEvent()
+{
+    if (Q_LIKELY(m_sessionStarted)) {
+        return;
+    }
+    qCDebug(c_loggingLocalTranport) << "Start the session in Abridged format";
+    m_socket->putChar(c_abridgedVersionByte);
+    m_sessionStarted = true;
+}
+
+} // Client namespace
+
+} // Telegram namespace
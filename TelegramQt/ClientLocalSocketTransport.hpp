@@ -0,0 +1,45 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAM_CLIENT_LOCAL_SOCKET_TRANSPORT_HPP
+#define TELEGRAM_CLIENT_LOCAL_SOCKET_TRANSPORT_HPP
+
+#include "LocalSocketTransport.hpp"
+
+namespace Telegram {
+
+namespace Client {
+
+class LocalSocketTransport : public BaseLocalSocketTransport
+{
+    Q_OBJECT
+public:
+    explicit LocalSocketTransport(QObject *parent = nullptr);
+    ~LocalSocketTransport() override;
+
+    // The serverName is the local socket name (or path); the port is ignored
+    void connectToHost(const QString &serverName, quint16 port) override;
+
+protected:
+    void writeEvent() final;
+};
+
+} // Client namespace
+
+} // Telegram namespace
+
+#endif // TELEGRAM_CLIENT_LOCAL_SOCKET_TRANSPORT_HPP
@@ -16,20 +16,25 @@
  */
 
 #include "ClientRpcLayer.hpp"
+#include "ClientRpcScheduler.hpp"
 #include "ClientRpcUpdatesLayer.hpp"
 #include "IgnoredMessageNotification.hpp"
 #include "SendPackageHelper.hpp"
 #include "Debug_p.hpp"
 #include "CAppInformation.hpp"
 #include "PendingRpcOperation.hpp"
+#include "ApiUtils.hpp"
 #include "RandomGenerator.hpp"
 #include "UpdatesLayer.hpp"
 
 #include "MTProto/MessageHeader.hpp"
 #include "MTProto/Stream.hpp"
 
+#include <QDateTime>
 #include <QLoggingCategory>
 
+#include <algorithm>
+
 Q_LOGGING_CATEGORY(c_clientRpcLayerCategory, "telegram.client.rpclayer", QtWarningMsg)
 
 namespace Telegram {
@@ -39,6 +44,7 @@ namespace Client {
 RpcLayer::RpcLayer(QObject *parent) :
     BaseRpcLayer(parent)
 {
+    m_scheduler = new RpcScheduler(this);
 }
 
 void RpcLayer::setAppInformation(CAppInformation *appInfo)
@@ -105,6 +111,7 @@ bool RpcLayer::processMTProtoMessage(const MTProto::Message &message)
         TLPong pong;
         stream >> pong;
         PendingRpcOperation *op = m_operations.take(pong.msgId);
+        delete m_messages.take(pong.msgId);
         if (!op) {
             qCWarning(c_clientRpcLayerCategory) << "Unexpected pong?!" << pong.msgId << pong.pingId;
             return false;
@@ -126,6 +133,7 @@ bool RpcLayer::processRpcResult(const MTProto::Message &message)
     quint64 messageId = 0;
     stream >> messageId;
     PendingRpcOperation *op = m_operations.take(messageId);
+    delete m_messages.take(messageId);
     if (!op) {
         qCWarning(c_clientRpcLayerCategory) << "processRpcQuery():"
                                             << "Unhandled RPC result for messageId"
@@ -305,6 +313,93 @@ bool RpcLayer::resendIgnoredMessage(quint64 messageId)
     return message->messageId;
 }
 
+int RpcLayer::resendUnacknowledgedMessages()
+{
+    // https://core.telegram.org/mtproto/service_messages#simple-container
+    static constexpr quint32 c_maxContainerMessages = 1020;
+    static constexpr int c_maxContainerSize = 1024 * 1024;
+
+    QVector<quint64> messageIds;
+    messageIds.reserve(m_operations.count());
+    for (auto it = m_operations.cbegin(); it != m_operations.cend(); ++it) {
+        if (m_messages.contains(it.key())) {
+            messageIds.append(it.key());
+        }
+    }
+    if (messageIds.isEmpty()) {
+        return 0;
+    }
+    // Keep the original order of the requests
+    std::sort(messageIds.begin(), messageIds.end());
+
+    // The server may have executed a request and lost the reply along with the connection.
+    // Such a request is resent with the same message id to get the stored reply instead of
+    // the second execution, but the server accepts only the message ids of the last 300 seconds.
+    // The older messages get new ids and the next sequence numbers.
+    static constexpr quint64 c_messageIdMaxAge = 270; // seconds
+    const quint64 currentTime = Utils::formatTimeStamp(QDateTime::currentMSecsSinceEpoch() + m_sendHelper->deltaTime() * 1000) >> 32;
+    const auto keepsMessageId = [currentTime](quint64 messageId) {
+        return (messageId >> 32) + c_messageIdMaxAge > currentTime;
+    };
+
+    QVector<QPair<quint64, quint64>> resentIds; // old id, new id
+    resentIds.reserve(messageIds.count());
+    QByteArray items;
+    quint32 itemsCount = 0;
+    const auto sendContainer = [this, &items, &itemsCount]() {
+        CRawStream stream(CRawStream::WriteOnly);
+        stream << static_cast<quint32>(TLValue::MsgContainer);
+        stream << itemsCount;
+        stream.writeBytes(items);
+
+        // The container id must be greater than the ids of the inner messages
+        MTProto::Message container;
+        container.messageId = m_sendHelper->newMessageId(SendMode::Client);
+        container.sequenceNumber = m_contentRelatedMessages * 2;
+        container.setData(stream.getData());
+        sendPackage(container);
+
+        items.clear();
+        itemsCount = 0;
+    };
+
+    // The messages go in the container even if there is a single one because the container header
+    // carries the current sequence number and the inner messages keep the original ones
+    for (const quint64 messageId : messageIds) {
+        MTProto::Message *message = m_messages.value(messageId);
+        const int itemSize = MTProto::MessageHeader::headerLength + message->data.size();
+        if (itemsCount && ((itemsCount == c_maxContainerMessages) || (items.size() + itemSize > c_maxContainerSize))) {
+            sendContainer();
+        }
+        if (!keepsMessageId(messageId)) {
+            PendingRpcOperation *operation = m_operations.take(messageId);
+            m_messages.remove(messageId);
+            message->messageId = m_sendHelper->newMessageId(SendMode::Client);
+            if (message->sequenceNumber & 1) {
+                message->sequenceNumber = getNextMessageSequenceNumber(ContentRelatedMessage);
+            }
+            m_operations.insert(message->messageId, operation);
+            m_messages.insert(message->messageId, message);
+            resentIds.append({ messageId, message->messageId });
+        }
+
+        CRawStream stream(CRawStream::WriteOnly);
+        stream << static_cast<const MTProto::MessageHeader &>(*message);
+        stream.writeBytes(message->data);
+        items.append(stream.getData());
+        ++itemsCount;
+    }
+    sendContainer();
+
+    qCDebug(c_clientRpcLayerCategory) << "Resent" << messageIds.count() << "unanswered messages,"
+                                      << resentIds.count() << "of them with new ids";
+    for (const QPair<quint64, quint64> &ids : resentIds) {
+        PendingRpcOperation *operation = m_operations.value(ids.second);
+        emit operation->resent(ids.first, ids.second);
+    }
+    return messageIds.count();
+}
+
 void RpcLayer::acknowledgeMessages()
 {
     CTelegramStream outputStream(CTelegramStream::WriteOnly);
@@ -324,6 +419,8 @@ void RpcLayer::acknowledgeMessages()
 
 void RpcLayer::onConnectionFailed()
 {
+    // Fail the queued operations first to not send them on the in-flight operations failure
+    m_scheduler->failQueued({{ PendingOperation::c_text(), QStringLiteral("connection failed")}});
     for (PendingRpcOperation *op : m_operations) {
         if (!op->isFinished()) {
             op->setFinishedWithError({{ PendingOperation::c_text(), QStringLiteral("connection failed")}});
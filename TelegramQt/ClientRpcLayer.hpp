@@ -40,6 +40,7 @@ namespace Client {
 
 class AuthOperation;
 class PendingRpcOperation;
+class RpcScheduler;
 class UpdatesInternalApi;
 
 class RpcLayer : public Telegram::BaseRpcLayer
@@ -67,8 +68,13 @@ public:
     bool processRpcResult(const MTProto::Message &message);
     bool processUpdates(const MTProto::Message &message);
 
+    // Sends the operation right away; use scheduler() to respect the priorities
     quint64 sendRpc(PendingRpcOperation *operation);
+    RpcScheduler *scheduler() const { return m_scheduler; }
     bool resendIgnoredMessage(quint64 messageId);
+    // Resends the messages of the unfinished operations (e.g. on the connection resume);
+    // the recent messages keep their ids, so the server answers them without the second execution
+    int resendUnacknowledgedMessages();
 
     void onConnectionFailed() override;
 
@@ -88,6 +94,7 @@ protected:
     void addMessageToAck(quint64 messageId);
 
     CAppInformation *m_appInfo = nullptr;
+    RpcScheduler *m_scheduler = nullptr;
     UpdatesInternalApi *m_UpdatesInternalApi = nullptr;
     AuthOperation *m_pendingAuthOperation = nullptr;
     QHash<quint64, PendingRpcOperation*> m_operations; // request message id, operation
@@ -0,0 +1,214 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include "ClientRpcScheduler.hpp"
+
+#include "ApiUtils.hpp"
+#include "ClientRpcLayer.hpp"
+#include "CTelegramStream.hpp"
+
+#include <QLoggingCategory>
+
+Q_LOGGING_CATEGORY(c_clientRpcSchedulerCategory, "telegram.client.rpcscheduler", QtWarningMsg)
+
+namespace Telegram {
+
+namespace Client {
+
+/*!
+    \class Telegram::Client::RpcScheduler
+    \brief Sends the RPC operations of a connection by priority classes
+    \inmodule TelegramQt
+    \ingroup Client
+
+    Each priority class has its own window of operations in flight.
+    A small window for the bulk class keeps the socket buffer short,
+    so interactive requests do not wait behind megabytes of file parts.
+    The operations of a class are sent round-robin between the peers
+    they belong to.
+*/
+RpcScheduler::RpcScheduler(RpcLayer *rpcLayer) :
+    QObject(rpcLayer),
+    m_rpcLayer(rpcLayer)
+{
+    m_queues[queueIndex(Priority::Interactive)].window = 0;
+    m_queues[queueIndex(Priority::Normal)].window = 16;
+    m_queues[queueIndex(Priority::Bulk)].window = 2;
+}
+
+RpcScheduler::Priority RpcScheduler::priorityForRequest(TLValue function)
+{
+    switch (function) {
+    case TLValue::MessagesSendMessage:
+    case TLValue::MessagesSendMedia:
+    case TLValue::MessagesForwardMessages:
+    case TLValue::MessagesEditMessage:
+    case TLValue::MessagesDeleteMessages:
+    case TLValue::MessagesSetTyping:
+    case TLValue::MessagesReadHistory:
+    case TLValue::MessagesReadMessageContents:
+    case TLValue::ChannelsReadHistory:
+    case TLValue::AccountUpdateStatus:
+        return Priority::Interactive;
+    case TLValue::UploadGetFile:
+    case TLValue::UploadGetWebFile:
+    case TLValue::UploadGetCdnFile:
+    case TLValue::UploadSaveFilePart:
+    case TLValue::UploadSaveBigFilePart:
+        return Priority::Bulk;
+    default:
+        return Priority::Normal;
+    }
+}
+
+/*!
+  Returns the peer of the dialog the request belongs to or an invalid Peer
+  if the request is not bound to a dialog.
+*/
+Peer RpcScheduler::peerForRequest(const QByteArray &requestData)
+{
+    CTelegramStream stream(requestData);
+    TLValue function;
+    stream >> function;
+    switch (function) {
+    case TLValue::MessagesSendMessage:
+    case TLValue::MessagesSendMedia:
+    case TLValue::MessagesSearch:
+    {
+        quint32 flags = 0;
+        stream >> flags;
+    }
+        break;
+    case TLValue::MessagesGetHistory:
+    case TLValue::MessagesSetTyping:
+    case TLValue::MessagesReadHistory:
+        break;
+    default:
+        return Peer();
+    }
+    TLInputPeer inputPeer;
+    stream >> inputPeer;
+    if (stream.error()) {
+        return Peer();
+    }
+    return Utils::toPublicPeer(inputPeer, 0);
+}
+
+int RpcScheduler::window(Priority priority) const
+{
+    return m_queues[queueIndex(priority)].window;
+}
+
+void RpcScheduler::setWindow(Priority priority, int window)
+{
+    m_queues[queueIndex(priority)].window = window;
+    sendQueued();
+}
+
+int RpcScheduler::queuedCount(Priority priority) const
+{
+    return m_queues[queueIndex(priority)].count;
+}
+
+int RpcScheduler::inFlightCount(Priority priority) const
+{
+    return m_queues[queueIndex(priority)].inFlight;
+}
+
+void RpcScheduler::schedule(PendingRpcOperation *operation)
+{
+    if (operation->priority() == Priority::Default) {
+        operation->setPriority(priorityForRequest(TLValue::firstFromArray(operation->requestData())));
+    }
+    const Peer peer = peerForRequest(operation->requestData());
+    Queue &queue = m_queues[queueIndex(operation->priority())];
+    QQueue<PendingRpcOperation *> &peerOperations = queue.operations[peer];
+    if (peerOperations.isEmpty()) {
+        queue.peers.enqueue(peer);
+    }
+    peerOperations.enqueue(operation);
+    ++queue.count;
+    sendQueued();
+}
+
+/*!
+  Finishes all operations which are not sent yet with the error \a details.
+*/
+void RpcScheduler::failQueued(const QVariantHash &details)
+{
+    QVector<PendingRpcOperation *> operations;
+    for (Queue &queue : m_queues) {
+        for (const QQueue<PendingRpcOperation *> &peerOperations : queue.operations) {
+            for (PendingRpcOperation *operation : peerOperations) {
+                operations.append(operation);
+            }
+        }
+        queue.operations.clear();
+        queue.peers.clear();
+        queue.count = 0;
+    }
+    for (PendingRpcOperation *operation : operations) {
+        operation->setFinishedWithError(details);
+    }
+}
+
+int RpcScheduler::queueIndex(Priority priority)
+{
+    switch (priority) {
+    case Priority::Interactive:
+        return 0;
+    case Priority::Bulk:
+        return 2;
+    case Priority::Default:
+    case Priority::Normal:
+        break;
+    }
+    return 1;
+}
+
+void RpcScheduler::sendQueued()
+{
+    // The queues are ordered from the highest priority
+    for (Queue &queue : m_queues) {
+        while (!queue.peers.isEmpty() && (!queue.window || (queue.inFlight < queue.window))) {
+            const Peer peer = queue.peers.dequeue();
+            QQueue<PendingRpcOperation *> &peerOperations = queue.operations[peer];
+            PendingRpcOperation *operation = peerOperations.dequeue();
+            if (peerOperations.isEmpty()) {
+                queue.operations.remove(peer);
+            } else {
+                queue.peers.enqueue(peer);
+            }
+            --queue.count;
+            ++queue.inFlight;
+            operation->connectToFinished(this, &RpcScheduler::onOperationFinished, operation);
+            const quint64 messageId = m_rpcLayer->sendRpc(operation);
+            qCDebug(c_clientRpcSchedulerCategory) << __func__ << TLValue::firstFromArray(operation->requestData())
+                                                  << "sent with id" << messageId;
+        }
+    }
+}
+
+void RpcScheduler::onOperationFinished(PendingRpcOperation *operation)
+{
+    --m_queues[queueIndex(operation->priority())].inFlight;
+    sendQueued();
+}
+
+} // Client namespace
+
+} // Telegram namespace
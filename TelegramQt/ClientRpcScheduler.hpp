@@ -0,0 +1,76 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAM_CLIENT_RPC_SCHEDULER_HPP
+#define TELEGRAM_CLIENT_RPC_SCHEDULER_HPP
+
+#include <QObject>
+#include <QHash>
+#include <QQueue>
+
+#include "PendingRpcOperation.hpp"
+#include "TLValues.hpp"
+
+namespace Telegram {
+
+namespace Client {
+
+class RpcLayer;
+
+class RpcScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    using Priority = PendingRpcOperation::Priority;
+
+    explicit RpcScheduler(RpcLayer *rpcLayer);
+
+    static Priority priorityForRequest(TLValue function);
+    static Peer peerForRequest(const QByteArray &requestData);
+
+    // Zero window means no limit for the operations in flight
+    int window(Priority priority) const;
+    void setWindow(Priority priority, int window);
+
+    int queuedCount(Priority priority) const;
+    int inFlightCount(Priority priority) const;
+
+    void schedule(PendingRpcOperation *operation);
+    void failQueued(const QVariantHash &details);
+
+protected:
+    struct Queue {
+        int window = 0;
+        int inFlight = 0;
+        int count = 0;
+        QHash<Peer, QQueue<PendingRpcOperation *>> operations;
+        QQueue<Peer> peers; // Peers with queued operations in round-robin order
+    };
+
+    static int queueIndex(Priority priority);
+    void sendQueued();
+    void onOperationFinished(PendingRpcOperation *operation);
+
+    RpcLayer *m_rpcLayer = nullptr;
+    Queue m_queues[3]; // Interactive, Normal, Bulk
+};
+
+} // Client namespace
+
+} // Telegram namespace
+
+#endif // TELEGRAM_CLIENT_RPC_SCHEDULER_HPP
@@ -15,7 +15,9 @@ Settings::Settings(QObject *parent) :
     m_key = RsaKey::defaultKey();
     m_preferedSessionType = SessionType::Obfuscated;
 
-    setPingInterval(defaultPingInterval());
+    setPingInterval(defaultPingInterval(), defaultServerDisconnectionAdditionalTime());
+    setMaxPingInterval(defaultMaxPingInterval());
+    setIdleConnectionTimeout(defaultIdleConnectionTimeout());
 }
 
 void Settings::setProxy(const QNetworkProxy &proxy)
@@ -43,6 +45,41 @@ void Settings::setPingInterval(quint32 interval, quint32 serverDisconnectionAddi
     emit pingIntervalChanged(interval, serverDisconnectionAdditionalTime);
 }
 
+quint32 Settings::defaultServerDisconnectionAdditionalTime()
+{
+    return 15000u;
+}
+
+quint32 Settings::defaultMaxPingInterval()
+{
+    return 180000u;
+}
+
+void Settings::setMaxPingInterval(quint32 interval)
+{
+    m_maxPingInterval = interval;
+}
+
+void Settings::setStandbyConnectionCount(int count)
+{
+    m_standbyConnectionCount = qMax(0, count);
+}
+
+void Settings::setStandbyMediaConnectionCount(int count)
+{
+    m_standbyMediaConnectionCount = qMax(0, count);
+}
+
+int Settings::defaultIdleConnectionTimeout()
+{
+    return 60000;
+}
+
+void Settings::setIdleConnectionTimeout(int msecs)
+{
+    m_idleConnectionTimeout = qMax(0, msecs);
+}
+
 QVector<DcOption> Settings::defaultServerConfiguration()
 {
     static const QVector<DcOption> s_builtInDcs = {
@@ -21,6 +21,9 @@ public:
         None,
         Abridged,
         Obfuscated,
+        Intermediate,
+        PaddedIntermediate,
+        ObfuscatedPaddedIntermediate,
     };
     Q_ENUM(SessionType)
 
@@ -33,12 +36,32 @@ public:
     void setPreferedSessionType(const SessionType type);
 
     Q_INVOKABLE static quint32 defaultPingInterval();
-    // By default, the app will ping server every 45 seconds
+    Q_INVOKABLE static quint32 defaultServerDisconnectionAdditionalTime();
+    // By default, the app will ping server every 45 seconds unless there is other traffic
     // Pass interval = 0 to disable ping; the additionalTime argument can be used to enable server-side disconnection
+    // (ping_delay_disconnect), which is enabled by default with 15 seconds
     quint32 pingInterval() const { return m_pingInterval; }
     quint32 serverDisconnectionAdditionalTime() const { return m_serverDisconnectionAdditionalTime; }
     void setPingInterval(quint32 interval, quint32 serverDisconnectionAdditionalTime = 0);
 
+    Q_INVOKABLE static quint32 defaultMaxPingInterval();
+    // The ping interval is doubled on each ping of an idle connection up to the max interval
+    // Pass interval = 0 (or less than pingInterval) to always ping with pingInterval
+    quint32 maxPingInterval() const { return m_maxPingInterval; }
+    void setMaxPingInterval(quint32 interval);
+
+    // The number of connections to each of the other DCs which are authorized ahead of time
+    // and kept alive; separate connections are kept for the generic and the media requests
+    int standbyConnectionCount() const { return m_standbyConnectionCount; }
+    void setStandbyConnectionCount(int count);
+    int standbyMediaConnectionCount() const { return m_standbyMediaConnectionCount; }
+    void setStandbyMediaConnectionCount(int count);
+
+    Q_INVOKABLE static int defaultIdleConnectionTimeout();
+    // The connections to the other DCs over the standby count are closed once unused for the timeout
+    int idleConnectionTimeout() const { return m_idleConnectionTimeout; }
+    void setIdleConnectionTimeout(int msecs);
+
     // void setMediaDataBufferSize(quint32 size);
 
     Q_INVOKABLE static QVector<DcOption> defaultServerConfiguration();
@@ -63,7 +86,11 @@ protected:
     RsaKey m_key;
     quint32 m_pingInterval = 0;
     quint32 m_serverDisconnectionAdditionalTime = 0;
+    quint32 m_maxPingInterval = 0;
     SessionType m_preferedSessionType = SessionType::None;
+    int m_standbyConnectionCount = 0;
+    int m_standbyMediaConnectionCount = 0;
+    int m_idleConnectionTimeout = 0;
 };
 
 } // Client namespace
@@ -3,20 +3,31 @@
 #include "AccountStorage.hpp"
 #include "ClientBackend.hpp"
 #include "ClientConnection.hpp"
+#include "ClientConnectionPool.hpp"
 #include "ClientRpcLayer.hpp"
 #include "ClientSettings.hpp"
 #include "CTelegramTransport.hpp"
 #include "CClientTcpTransport.hpp"
+#include "ClientLocalSocketTransport.hpp"
+#include "LoopbackTransport.hpp"
 #include "ConnectionError.hpp"
+#include "CRawStream.hpp"
 #include "DataStorage.hpp"
+#include "PendingRpcOperation.hpp"
+#include "RandomGenerator.hpp"
 
 #include "Operations/ClientAuthOperation_p.hpp"
 #include "Operations/ClientPingOperation.hpp"
 #include "Operations/ConnectionOperation.hpp"
 
+#include <QElapsedTimer>
 #include <QLoggingCategory>
+#include <QSet>
 #include <QTimer>
 
+#include <algorithm>
+#include <limits>
+
 Q_LOGGING_CATEGORY(c_connectionApiLoggingCategory, "telegram.client.api.connection", QtWarningMsg)
 
 namespace Telegram {
@@ -48,6 +59,28 @@ static const QVector<uint> getIntervals()
     return intervals;
 }
 
+// The number of attempts to resume the lost main connection before it is replaced by a new one
+static const int c_maxResumeAttempts = 3;
+
+// The delay before a connection to the next endpoint joins the race
+static const int c_connectionRaceStagger = 250; // ms
+static const int c_maxRacingConnections = 3;
+
+static QString getEndpointKey(const DcOption &dcOption)
+{
+    return dcOption.address + QLatin1Char(':') + QString::number(dcOption.port);
+}
+
+static uint getJitteredInterval(uint interval)
+{
+    // Spread the reconnections of the clients which lost the connection at the same time
+    const uint halfInterval = interval / 2;
+    if (!halfInterval) {
+        return interval;
+    }
+    return halfInterval + RandomGenerator::instance()->generate<quint32>() % (interval - halfInterval + 1);
+}
+
 ConnectionApiPrivate::ConnectionApiPrivate(ConnectionApi *parent) :
     ClientApiPrivate(parent)
 {
@@ -122,9 +155,21 @@ void ConnectionApiPrivate::setInitialConnection(Connection *connection, SetConne
 
 void ConnectionApiPrivate::disconnectFromServer()
 {
+    m_resumingMainConnection = false;
+    if (m_resumeTimer) {
+        m_resumeTimer->stop();
+    }
+    finishConnectionRace(nullptr);
     setStatus(ConnectionApi::StatusDisconnected, ConnectionApi::StatusReasonLocal);
     setInitialConnection(nullptr);
     setMainConnection(nullptr);
+    // The failed pool operations can ask for a connection again; take the pools out first
+    const QHash<ConnectionSpec, ConnectionPool *> connectionPools = m_connectionPools;
+    m_connectionPools.clear();
+    for (ConnectionPool *pool : connectionPools) {
+        pool->clear();
+        delete pool;
+    }
     m_initialConnectOperation->deleteLater();
     m_initialConnectOperation = nullptr;
 }
@@ -136,7 +181,7 @@ PendingOperation *ConnectionApiPrivate::connectToDc(quint32 dcId)
         m_initialConnectOperation = nullptr;
     }
 
-    DcOption opt = m_backend->dataStorage()->serverConfiguration().getOption(ConnectionSpec(dcId, ConnectionSpec::RequestFlag::Ipv4Only));
+    DcOption opt = getDcOption(ConnectionSpec(dcId, ConnectionSpec::RequestFlag::Ipv4Only));
     if (!opt.isValid()) {
         return PendingOperation::failOperation(QStringLiteral("Unable to connect to server (the requested dc not found in configuration)"));
     }
@@ -161,7 +206,6 @@ PendingOperation *ConnectionApiPrivate::connectToServer(const QVector<DcOption>
     }
     m_initialConnectOperation = new PendingOperation("ConnectionApi::connectToServer(options)", this);
     m_serverConfiguration = dcOptions;
-    m_nextServerAddressIndex = 0;
     m_connectionAttemptNumber = 0;
     queueConnectToNextServer();
     return m_initialConnectOperation;
@@ -173,20 +217,29 @@ void ConnectionApiPrivate::connectToNextServer()
     if (!m_connectionQueued) {
         return;
     }
+    m_connectionQueued = false;
 
-    const DcOption dcOption = m_serverConfiguration.at(m_nextServerAddressIndex);
-    ++m_nextServerAddressIndex;
-    if (m_serverConfiguration.count() <= m_nextServerAddressIndex) {
-        m_nextServerAddressIndex = 0;
-    }
-    if (dcOption.flags & (DcOption::Ipv6|DcOption::MediaOnly)) {
-        qCDebug(c_connectionApiLoggingCategory) << this << __func__
-                                                << "dequeued unsupported dc option, go for the next one...";
-        return connectToNextServer();
+    setInitialConnection(nullptr, DestroyOldConnection);
+    finishConnectionRace(nullptr);
+    m_raceOptions = getRaceOptions();
+    if (m_raceOptions.isEmpty()) {
+        qCWarning(c_connectionApiLoggingCategory) << this << __func__ << "There is no supported server address";
+        queueConnectToNextServer();
+        return;
     }
+    startNextRacingConnection();
+}
 
+void ConnectionApiPrivate::startNextRacingConnection()
+{
+    if (m_raceOptions.isEmpty()) {
+        return;
+    }
+    const DcOption dcOption = m_raceOptions.takeFirst();
     Connection *newConnection = createConnection(dcOption);
-    setInitialConnection(newConnection, DestroyOldConnection);
+    qCDebug(c_connectionApiLoggingCategory) << this << __func__ << newConnection
+                                            << dcOption.address << dcOption.port
+                                            << "RTT:" << roundTripTime(dcOption);
 
     AccountStorage *accountStorage = backend()->accountStorage();
     if (accountStorage && accountStorage->hasMinimalDataSet()) {
@@ -194,14 +247,31 @@ void ConnectionApiPrivate::connectToNextServer()
                                                 << "Use session from account storage for the new initial connection"
                                                 << newConnection;
 
-        m_initialConnection->setAuthKey(accountStorage->authKey());
-        m_initialConnection->rpcLayer()->setSessionData(
+        newConnection->setAuthKey(accountStorage->authKey());
+        newConnection->rpcLayer()->setSessionData(
                     accountStorage->sessionId(),
                     accountStorage->contentRelatedMessagesNumber());
     }
 
-    m_initialConnection->connectToDc();
-    m_connectionQueued = false;
+    m_racingConnections.append(newConnection);
+    if (!m_raceOptions.isEmpty()) {
+        if (!m_raceStaggerTimer) {
+            m_raceStaggerTimer = new QTimer(this);
+            m_raceStaggerTimer->setSingleShot(true);
+            connect(m_raceStaggerTimer, &QTimer::timeout, this, &ConnectionApiPrivate::onRaceStaggerTimeout);
+        }
+        m_raceStaggerTimer->start(c_connectionRaceStagger);
+    }
+    newConnection->connectToDc();
+}
+
+void ConnectionApiPrivate::onRaceStaggerTimeout()
+{
+    if (m_racingConnections.count() >= c_maxRacingConnections) {
+        // Wait for a connection to fail
+        return;
+    }
+    startNextRacingConnection();
 }
 
 void ConnectionApiPrivate::queueConnectToNextServer()
@@ -295,7 +365,11 @@ AuthOperation *ConnectionApiPrivate::checkIn()
     if (m_mainConnection) {
         m_authOperation->startLater();
     } else {
-        PendingOperation *connOp = connectToServer({accountStorage->dcInfo()});
+        // The stored endpoint has no flags, so look for the configured local endpoint of the DC
+        const DcOption storedOption = accountStorage->dcInfo();
+        const DcOption localOption = getDcOption(ConnectionSpec(storedOption.id));
+        const bool isLocal = localOption.flags & DcOption::LocalEndpointFlags;
+        PendingOperation *connOp = connectToServer({ isLocal ? localOption : storedOption });
         m_authOperation->runAfter(connOp);
     }
     return m_authOperation;
@@ -337,6 +411,25 @@ Connection *ConnectionApiPrivate::createConnection(const DcOption &dcOption)
 
     Settings *settings = backend()->m_settings;
     connection->setServerRsaKey(settings->serverRsaKey());
+    if (dcOption.flags & DcOption::LocalSocket) {
+        connection->setTransport(new LocalSocketTransport(connection));
+    } else if (dcOption.flags & DcOption::Loopback) {
+        connection->setTransport(new LoopbackTransport(connection));
+    } else {
+        connection->setTransport(createTcpTransport(connection));
+    }
+
+    connect(connection, &BaseConnection::statusChanged,
+            this, &ConnectionApiPrivate::onConnectionStatusChanged);
+    connect(connection, &BaseConnection::errorOccured,
+            this, &ConnectionApiPrivate::onConnectionError);
+
+    return connection;
+}
+
+TcpTransport *ConnectionApiPrivate::createTcpTransport(Connection *connection)
+{
+    const Settings *settings = backend()->m_settings;
     TcpTransport *transport = new TcpTransport(connection);
     transport->setProxy(settings->proxy());
 
@@ -351,38 +444,112 @@ Connection *ConnectionApiPrivate::createConnection(const DcOption &dcOption)
     case Settings::SessionType::Obfuscated:
         transport->setPreferedSessionType(TcpTransport::Obfuscated);
         break;
+    case Settings::SessionType::Intermediate:
+        transport->setPreferedSessionType(TcpTransport::Intermediate);
+        break;
+    case Settings::SessionType::PaddedIntermediate:
+        transport->setPreferedSessionType(TcpTransport::PaddedIntermediate);
+        break;
+    case Settings::SessionType::ObfuscatedPaddedIntermediate:
+        transport->setPreferedSessionType(TcpTransport::ObfuscatedPaddedIntermediate);
+        break;
     }
-    connection->setTransport(transport);
+    return transport;
+}
 
-    connect(connection, &BaseConnection::statusChanged,
-            this, &ConnectionApiPrivate::onConnectionStatusChanged);
-    connect(connection, &BaseConnection::errorOccured,
-            this, &ConnectionApiPrivate::onConnectionError);
+/*!
+  \fn DcOption ConnectionApiPrivate::getDcOption(const ConnectionSpec &connectionSpec)
 
-    return connection;
+  The method returns the endpoint of the DC from \a connectionSpec. A local socket or loopback
+  endpoint from the Settings server configuration is preferred; the local endpoints are not
+  advertised by the server, so the DataStorage configuration is used for the rest.
+*/
+DcOption ConnectionApiPrivate::getDcOption(const ConnectionSpec &connectionSpec) const
+{
+    ConnectionSpec localSpec = connectionSpec;
+    localSpec.flags |= ConnectionSpec::RequestFlag::LocalSocket;
+    localSpec.flags |= ConnectionSpec::RequestFlag::Loopback;
+    DcConfiguration settingsConfiguration;
+    settingsConfiguration.dcOptions = backend()->settings()->serverConfiguration();
+    const DcOption localOption = settingsConfiguration.getOption(localSpec);
+    if (localOption.flags & DcOption::LocalEndpointFlags) {
+        return localOption;
+    }
+    return backend()->dataStorage()->serverConfiguration().getOption(connectionSpec);
 }
 
 /*!
-  \fn Connection *ConnectionApiPrivate::ensureConnection(const DcOption &dcOption)
+  \fn Connection *ConnectionApiPrivate::ensureConnection(const ConnectionSpec &connectionSpec)
 
-  The method returns new or existing Connection to the passed server address.
+  The method returns a signed Connection to the DC from \a connectionSpec or nullptr.
 
-  The returned Connection is prepaired to work with \a connectionSpec and can have any status.
+  The connections to the DCs other than the main one are kept in the per-spec pools and
+  authorized via the main connection; nullptr is returned while the pool connection is
+  not ready yet and for the main DC, so the requests go to the default connection.
 */
 Connection *ConnectionApiPrivate::ensureConnection(const ConnectionSpec &connectionSpec)
 {
     qCDebug(c_connectionApiLoggingCategory) << __func__ << connectionSpec.dcId << connectionSpec.flags;
-    ConnectionSpec spec = connectionSpec;
-    spec.flags |= ConnectionSpec::RequestFlag::Ipv4Only; // Enable only ipv4 for now
-    if (!m_connections.contains(connectionSpec)) {
-        const DcOption opt = backend()->dataStorage()->serverConfiguration().getOption(spec);
-        if (!opt.isValid()) {
-            qCWarning(c_connectionApiLoggingCategory) << __func__ << "Unable to find suitable DC";
-            return nullptr;
+    ConnectionPool *pool = getConnectionPool(connectionSpec);
+    return pool ? pool->connection() : nullptr;
+}
+
+/*!
+  Returns the pool of connections to the DC from \a connectionSpec or nullptr if the
+  requests to the DC go to the default connection (the DC is the main one or the main
+  connection is not signed yet).
+*/
+ConnectionPool *ConnectionApiPrivate::getConnectionPool(const ConnectionSpec &connectionSpec)
+{
+    if (!m_mainConnection || (m_mainConnection->status() != Connection::Status::Signed)) {
+        return nullptr;
+    }
+    if (connectionSpec.dcId == m_mainConnection->dcOption().id) {
+        return nullptr;
+    }
+    return ensureConnectionPool(connectionSpec);
+}
+
+ConnectionPool *ConnectionApiPrivate::ensureConnectionPool(const ConnectionSpec &connectionSpec)
+{
+    ConnectionPool *pool = m_connectionPools.value(connectionSpec);
+    if (!pool) {
+        const Settings *settings = backend()->m_settings;
+        pool = new ConnectionPool(this, connectionSpec);
+        if (connectionSpec.flags & ConnectionSpec::RequestFlag::MediaOnly) {
+            pool->setStandbyCount(settings->standbyMediaConnectionCount());
+        } else {
+            pool->setStandbyCount(settings->standbyConnectionCount());
+        }
+        pool->setIdleTimeout(settings->idleConnectionTimeout());
+        m_connectionPools.insert(connectionSpec, pool);
+    }
+    return pool;
+}
+
+/*!
+  Starts the standby connections to all DCs other than the main one, so the first
+  media or cross-DC request does not wait for the connection and authorization.
+*/
+void ConnectionApiPrivate::warmUpConnectionPools()
+{
+    const Settings *settings = backend()->m_settings;
+    if (!settings->standbyConnectionCount() && !settings->standbyMediaConnectionCount()) {
+        return;
+    }
+    QSet<quint32> dcIds;
+    for (const DcOption &dcOption : backend()->dataStorage()->serverConfiguration().dcOptions) {
+        dcIds.insert(dcOption.id);
+    }
+    dcIds.remove(m_mainConnection->dcOption().id);
+    for (const quint32 dcId : dcIds) {
+        if (settings->standbyConnectionCount()) {
+            ensureConnectionPool(ConnectionSpec(dcId))->warmUp();
+        }
+        if (settings->standbyMediaConnectionCount()) {
+            ensureConnectionPool(ConnectionSpec(dcId, ConnectionSpec::RequestFlag::MediaOnly))->warmUp();
         }
-        m_connections.insert(connectionSpec, createConnection(opt));
     }
-    return m_connections.value(connectionSpec);
 }
 
 void ConnectionApiPrivate::onReconnectOperationFinished(PendingOperation *operation)
@@ -413,6 +580,7 @@ void ConnectionApiPrivate::onInitialConnectionStatusChanged(BaseConnection::Stat
     case BaseConnection::Status::HasDhKey:
         m_connectionAttemptNumber = 0;
     {
+        measureRoundTripTime(m_initialConnection);
         PendingOperation *op = backend()->getDcConfig();
         op->invokeOnFinished(this, &ConnectionApiPrivate::onGotDcConfig, op);
     }
@@ -425,6 +593,115 @@ void ConnectionApiPrivate::onInitialConnectionStatusChanged(BaseConnection::Stat
     }
 }
 
+void ConnectionApiPrivate::onRacingConnectionStatusChanged(Connection *connection, BaseConnection::Status status,
+                                                            BaseConnection::StatusReason reason)
+{
+    qCDebug(c_connectionApiLoggingCategory) << __func__ << connection << status << reason;
+    switch (status) {
+    case BaseConnection::Status::Connecting:
+        setStatus(ConnectionApi::StatusConnecting, ConnectionApi::StatusReasonNone);
+        break;
+    case BaseConnection::Status::Connected:
+        // The first completed transport handshake wins the race
+        finishConnectionRace(connection);
+        setInitialConnection(connection, DestroyOldConnection);
+        onInitialConnectionStatusChanged(status, reason);
+        break;
+    case BaseConnection::Status::Disconnected:
+        m_racingConnections.removeOne(connection);
+        disconnect(connection, nullptr, this, nullptr);
+        connection->deleteLater();
+        if (!m_raceOptions.isEmpty()) {
+            // Do not wait for the stagger on a failed attempt
+            startNextRacingConnection();
+        } else if (m_racingConnections.isEmpty()) {
+            queueConnectToNextServer();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+QVector<DcOption> ConnectionApiPrivate::getRaceOptions() const
+{
+    QVector<DcOption> options;
+    options.reserve(m_serverConfiguration.count());
+    for (const DcOption &dcOption : m_serverConfiguration) {
+        if (dcOption.flags & (DcOption::Ipv6|DcOption::MediaOnly)) {
+            continue;
+        }
+        options.append(dcOption);
+    }
+
+    // Prefer the endpoints with the lower measured RTT and keep the configured order for the others
+    const auto sortKey = [this](const DcOption &dcOption) {
+        if (dcOption.flags & DcOption::LocalEndpointFlags) {
+            // The local endpoint is on the same host and always preferred
+            return -1;
+        }
+        const int rtt = roundTripTime(dcOption);
+        return rtt < 0 ? std::numeric_limits<int>::max() : rtt;
+    };
+    std::stable_sort(options.begin(), options.end(), [&sortKey](const DcOption &left, const DcOption &right) {
+        return sortKey(left) < sortKey(right);
+    });
+    return options;
+}
+
+void ConnectionApiPrivate::finishConnectionRace(Connection *winner)
+{
+    if (m_raceStaggerTimer) {
+        m_raceStaggerTimer->stop();
+    }
+    m_raceOptions.clear();
+    for (Connection *connection : m_racingConnections) {
+        if (connection == winner) {
+            continue;
+        }
+        disconnect(connection, nullptr, this, nullptr);
+        connection->deleteLater();
+    }
+    m_racingConnections.clear();
+}
+
+void ConnectionApiPrivate::measureRoundTripTime(Connection *connection)
+{
+    // The server answers a ping right away, so its round trip is a fair latency sample
+    RawStream outputStream(RawStream::WriteOnly);
+    outputStream << TLValue::Ping;
+    outputStream << RandomGenerator::instance()->generate<quint64>();
+    PendingRpcOperation *operation = new PendingRpcOperation(outputStream.getData(), connection);
+    operation->setContentRelated(false);
+    operation->deleteOnFinished();
+
+    QElapsedTimer timer;
+    timer.start();
+    const DcOption dcOption = connection->dcOption();
+    connect(operation, &PendingOperation::finished, this, [this, operation, timer, dcOption]() {
+        if (operation->isSucceeded()) {
+            addRoundTripTimeSample(dcOption, timer.elapsed());
+        }
+    });
+    connection->rpcLayer()->sendRpc(operation);
+}
+
+int ConnectionApiPrivate::roundTripTime(const DcOption &dcOption) const
+{
+    return m_roundTripTimes.value(getEndpointKey(dcOption), -1);
+}
+
+void ConnectionApiPrivate::addRoundTripTimeSample(const DcOption &dcOption, qint64 msecs)
+{
+    const QString key = getEndpointKey(dcOption);
+    const int sample = static_cast<int>(qBound<qint64>(0, msecs, std::numeric_limits<int>::max()));
+    const int previous = m_roundTripTimes.value(key, -1);
+    // Smooth the value the same way as TCP does (RFC 6298)
+    const int rtt = previous < 0 ? sample : (previous * 7 + sample) / 8;
+    qCDebug(c_connectionApiLoggingCategory) << __func__ << key << "sample:" << sample << "RTT:" << rtt;
+    m_roundTripTimes.insert(key, rtt);
+}
+
 void ConnectionApiPrivate::onGotDcConfig(PendingOperation *operation)
 {
     if (!operation->isSucceeded()) {
@@ -491,7 +768,10 @@ void ConnectionApiPrivate::onAuthCodeRequired()
 
 void ConnectionApiPrivate::onConnectionStatusChanged(BaseConnection::Status status, BaseConnection::StatusReason reason)
 {
-    if (sender() == m_initialConnection) {
+    Connection *connection = qobject_cast<Connection *>(sender());
+    if (connection && m_racingConnections.contains(connection)) {
+        onRacingConnectionStatusChanged(connection, status, reason);
+    } else if (sender() == m_initialConnection) {
         onInitialConnectionStatusChanged(status, reason);
     } else if (sender() == m_mainConnection) {
         onMainConnectionStatusChanged(status, reason);
@@ -509,9 +789,13 @@ void ConnectionApiPrivate::onMainConnectionStatusChanged(BaseConnection::Status
         if (!m_pingOperation) {
             m_pingOperation = new PingOperation(this);
             m_pingOperation->setSettings(backend()->m_settings);
-            m_pingOperation->setRpcLayer(m_mainConnection->rpcLayer());
             connect(m_pingOperation, &PingOperation::pingFailed, this, &ConnectionApiPrivate::onPingFailed);
+            connect(m_pingOperation, &PingOperation::roundTripTimeMeasured,
+                    this, &ConnectionApiPrivate::onPingRoundTripTimeMeasured);
         }
+        // The main connection is replaced on resumption
+        m_pingOperation->setRpcLayer(m_mainConnection->rpcLayer());
+        m_pingOperation->setTransport(m_mainConnection->transport());
         m_pingOperation->ensureActive();
     } else {
         if (m_pingOperation) {
@@ -539,11 +823,31 @@ void ConnectionApiPrivate::onMainConnectionStatusChanged(BaseConnection::Status
         case ConnectionApi::StatusReady:
             onMainConnectionLost();
             break;
+        case ConnectionApi::StatusConnecting:
+            if (m_resumingMainConnection) {
+                onMainConnectionResumeFailed();
+            }
+            break;
         default:
             break;
         }
     }
         break;
+    case Connection::Status::HasDhKey:
+        if (m_resumingMainConnection) {
+            onMainConnectionResumed();
+        }
+        break;
+    case Connection::Status::Failed:
+        if (m_resumingMainConnection) {
+            qCWarning(c_connectionApiLoggingCategory) << __func__ << "Unable to resume the main connection";
+            resetMainConnection();
+        }
+        break;
+    case Connection::Status::Connecting:
+    case Connection::Status::Connected:
+        // Nothing to do; wait for HasDhKey
+        break;
     default:
         qCWarning(c_connectionApiLoggingCategory) << __func__ << status << reason << "not processed";
         break;
@@ -553,17 +857,88 @@ void ConnectionApiPrivate::onMainConnectionStatusChanged(BaseConnection::Status
 void ConnectionApiPrivate::onMainConnectionLost()
 {
     setStatus(ConnectionApi::StatusConnecting, ConnectionApi::StatusReasonRemote);
+    storeMainConnectionSession();
+
+    // Keep the connection with its auth key, session id and sequence numbers
+    // so the pending operations survive the reconnection
+    m_resumingMainConnection = true;
+    m_resumeAttemptNumber = 0;
+    queueResumeMainConnection();
+}
+
+void ConnectionApiPrivate::queueResumeMainConnection()
+{
+    const QVector<uint> intervals = getIntervals();
+    const uint interval = getJitteredInterval(intervals.value(m_resumeAttemptNumber, intervals.last()));
+    qCDebug(c_connectionApiLoggingCategory) << __func__ << "interval:" << interval;
+    ++m_resumeAttemptNumber;
+
+    if (!m_resumeTimer) {
+        m_resumeTimer = new QTimer(this);
+        m_resumeTimer->setSingleShot(true);
+        connect(m_resumeTimer, &QTimer::timeout, this, &ConnectionApiPrivate::resumeMainConnection);
+    }
+    m_resumeTimer->start(static_cast<int>(interval));
+}
+
+void ConnectionApiPrivate::resumeMainConnection()
+{
+    if (!m_resumingMainConnection || !m_mainConnection) {
+        return;
+    }
+    qCDebug(c_connectionApiLoggingCategory) << __func__ << m_mainConnection << "attempt" << m_resumeAttemptNumber;
+    setStatus(ConnectionApi::StatusConnecting, ConnectionApi::StatusReasonLocal);
+    m_mainConnection->connectToDc();
+}
+
+void ConnectionApiPrivate::onMainConnectionResumed()
+{
+    m_resumingMainConnection = false;
+    m_resumeAttemptNumber = 0;
+
+    // Replay the requests lost with the previous socket before anything else
+    const int resentCount = m_mainConnection->rpcLayer()->resendUnacknowledgedMessages();
+    qCDebug(c_connectionApiLoggingCategory) << __func__ << "resent" << resentCount << "messages";
+
+    // The session is already authorized; the sync on Signed re-syncs the updates state
+    m_mainConnection->setStatus(Connection::Status::Signed, Connection::StatusReason::Local);
+}
+
+void ConnectionApiPrivate::onMainConnectionResumeFailed()
+{
+    if (m_resumeAttemptNumber < c_maxResumeAttempts) {
+        setStatus(ConnectionApi::StatusWaitForConnection, ConnectionApi::StatusReasonRemote);
+        queueResumeMainConnection();
+        return;
+    }
+    qCDebug(c_connectionApiLoggingCategory) << __func__ << "Give up on the connection resume";
+    resetMainConnection();
+}
+
+void ConnectionApiPrivate::resetMainConnection()
+{
+    // Start over with a new connection which walks through all the known server addresses
+    m_resumingMainConnection = false;
+    if (m_resumeTimer) {
+        m_resumeTimer->stop();
+    }
+    storeMainConnectionSession();
+
+    Connection *previousMainConnection = m_mainConnection;
+    setMainConnection(nullptr);
+    previousMainConnection->rpcLayer()->onConnectionFailed();
+    previousMainConnection->deleteLater();
+    checkIn();
+}
+
+void ConnectionApiPrivate::storeMainConnectionSession()
+{
     AccountStorage *storage = backend()->accountStorage();
     storage->setAuthKey(m_mainConnection->authKey());
     storage->setAuthId(m_mainConnection->authId());
     storage->setDcInfo(m_mainConnection->dcOption());
     storage->setSessionData(m_mainConnection->rpcLayer()->sessionId(),
                             m_mainConnection->rpcLayer()->contentRelatedMessagesNumber());
-
-    Connection *previousMainConnection = m_mainConnection;
-    setMainConnection(nullptr);
-    previousMainConnection->deleteLater();
-    checkIn();
 }
 
 void ConnectionApiPrivate::onMainConnectionRestored()
@@ -590,6 +965,7 @@ void ConnectionApiPrivate::onSyncFinished(PendingOperation *operation)
 {
     if (operation->isSucceeded()) {
         setStatus(ConnectionApi::StatusReady, ConnectionApi::StatusReasonLocal);
+        warmUpConnectionPools();
     } else {
         qCCritical(c_connectionApiLoggingCategory) << Q_FUNC_INFO << "Unexpected sync operation status" << operation->errorDetails();
     }
@@ -600,6 +976,13 @@ void ConnectionApiPrivate::onPingFailed()
     qCWarning(c_connectionApiLoggingCategory) << Q_FUNC_INFO;
 }
 
+void ConnectionApiPrivate::onPingRoundTripTimeMeasured(qint64 msecs)
+{
+    if (m_mainConnection) {
+        addRoundTripTimeSample(m_mainConnection->dcOption(), msecs);
+    }
+}
+
 void ConnectionApiPrivate::onConnectionError(const QByteArray &errorBytes)
 {
     const ConnectionError error(errorBytes);
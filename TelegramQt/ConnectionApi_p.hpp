@@ -34,7 +34,9 @@ namespace Client {
 
 class Connection;
 class ConnectOperation;
+class ConnectionPool;
 class PingOperation;
+class TcpTransport;
 
 class ConnectionApiPrivate : public ClientApiPrivate
 {
@@ -66,19 +68,32 @@ public:
 public:
     // Internal TelegramQt API
     Connection *createConnection(const DcOption &dcOption);
+    DcOption getDcOption(const ConnectionSpec &connectionSpec) const;
     Connection *ensureConnection(const ConnectionSpec &connectionSpec);
+    ConnectionPool *getConnectionPool(const ConnectionSpec &connectionSpec);
+    ConnectionPool *ensureConnectionPool(const ConnectionSpec &connectionSpec);
+    void warmUpConnectionPools();
 
     Connection *getDefaultConnection();
     Connection *mainConnection();
     void setMainConnection(Connection *connection, SetConnectionOption option = KeepOldConnection);
     void setInitialConnection(Connection *connection, SetConnectionOption option = KeepOldConnection);
 
+    // Smoothed round trip time to the endpoint in msecs or -1 if there is no measurement yet
+    int roundTripTime(const DcOption &dcOption) const;
+    void addRoundTripTimeSample(const DcOption &dcOption, qint64 msecs);
+    void measureRoundTripTime(Connection *connection);
+
 protected slots:
     void connectToNextServer();
     void queueConnectToNextServer();
+    void startNextRacingConnection();
+    void onRaceStaggerTimeout();
 
     void onReconnectOperationFinished(PendingOperation *operation);
     void onInitialConnectionStatusChanged(BaseConnection::Status status, BaseConnection::StatusReason reason);
+    void onRacingConnectionStatusChanged(Connection *connection, BaseConnection::Status status,
+                                         BaseConnection::StatusReason reason);
     void onGotDcConfig(PendingOperation *operation);
     void onCheckInFinished(PendingOperation *operation);
     void onNewAuthenticationFinished(PendingOperation *operation);
@@ -87,14 +102,24 @@ protected slots:
     void onMainConnectionStatusChanged(BaseConnection::Status status, BaseConnection::StatusReason reason);
     void onMainConnectionLost();
     void onMainConnectionRestored();
+    void queueResumeMainConnection();
+    void resumeMainConnection();
+    void onMainConnectionResumed();
+    void onMainConnectionResumeFailed();
+    void resetMainConnection();
     void onSyncFinished(PendingOperation *operation);
     void onPingFailed();
+    void onPingRoundTripTimeMeasured(qint64 msecs);
     void onConnectionError(const QByteArray &errorBytes);
 
 protected:
+    TcpTransport *createTcpTransport(Connection *connection);
     void setStatus(ConnectionApi::Status status, ConnectionApi::StatusReason reason);
+    void storeMainConnectionSession();
+    QVector<DcOption> getRaceOptions() const;
+    void finishConnectionRace(Connection *winner);
 
-    QHash<ConnectionSpec, Connection *> m_connections;
+    QHash<ConnectionSpec, ConnectionPool *> m_connectionPools; // The pools of connections to the other DCs
     Connection *m_mainConnection = nullptr;
     Connection *m_initialConnection = nullptr;
     PendingOperation *m_initialConnectOperation = nullptr;
@@ -103,11 +128,21 @@ protected:
 
     ConnectionApi::Status m_status = ConnectionApi::StatusDisconnected;
     QVector<DcOption> m_serverConfiguration;
-    int m_nextServerAddressIndex = 0;
     int m_connectionAttemptNumber = 0;
     bool m_connectionQueued = false;
     QTimer *m_queuedConnectionTimer = nullptr;
 
+    // The connections to several endpoints are started with a stagger; the first connected one wins
+    QVector<Connection *> m_racingConnections;
+    QVector<DcOption> m_raceOptions; // The options to try next in the current race
+    QTimer *m_raceStaggerTimer = nullptr;
+    QHash<QString, int> m_roundTripTimes; // endpoint to smoothed RTT in msecs
+
+    // The lost main connection is resumed with the same auth key and session
+    bool m_resumingMainConnection = false;
+    int m_resumeAttemptNumber = 0;
+    QTimer *m_resumeTimer = nullptr;
+
 };
 
 } // Client namespace
@@ -24,6 +24,8 @@ PendingOperation *ContactList::becomeReady()
 {
     ContactsApiPrivate *api = ContactsApiPrivate::get(m_backend);
     if (!m_readyOperation) {
+        // Expose the cached contacts until the server confirms or replaces them
+        m_peers = api->dataStorage()->contactList();
         m_readyOperation = api->getContacts();
         connect(m_readyOperation, &PendingOperation::finished, this, &ContactList::onFinished);
         m_readyOperation->startLater();
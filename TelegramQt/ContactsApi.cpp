@@ -1,5 +1,6 @@
 #include "ContactsApi_p.hpp"
 
+#include "ApiUtils.hpp"
 #include "ClientBackend.hpp"
 #include "ContactList.hpp"
 #include "RandomGenerator.hpp"
@@ -69,7 +70,11 @@ PendingContactsOperation *ContactsApiPrivate::importContacts(const ContactsApi::
 PendingContactsOperation *ContactsApiPrivate::getContacts()
 {
     PendingContactsOperation *operation = new PendingContactsOperation(this);
-    ContactsRpcLayer::PendingContactsContacts *rpcOperation = contactsLayer()->getContacts(0);
+    quint32 hash = 0;
+    for (const TLContact &contact : dataInternalApi()->contactList()) {
+        hash = Utils::updateHash(hash, contact.userId);
+    }
+    ContactsRpcLayer::PendingContactsContacts *rpcOperation = contactsLayer()->getContacts(hash);
     rpcOperation->connectToFinished(this, &ContactsApiPrivate::onGetContactsResult, operation, rpcOperation);
     return operation;
 }
@@ -118,9 +123,22 @@ void ContactsApiPrivate::onContactsImported(PendingContactsOperation *operation,
 
 void ContactsApiPrivate::onGetContactsResult(PendingContactsOperation *operation, ContactsRpcLayer::PendingContactsContacts *rpcOperation)
 {
+    if (rpcOperation->isFailed()) {
+        operation->setFinishedWithError(rpcOperation->errorDetails());
+        return;
+    }
+
     TLContactsContacts result;
     rpcOperation->getResult(&result);
 
+    if (result.tlType == TLValue::ContactsContactsNotModified) {
+        // The cached contact list is up to date
+        result.contacts = dataInternalApi()->contactList();
+    } else {
+        dataInternalApi()->processData(result.users);
+        dataInternalApi()->setContactList(result.contacts);
+    }
+
     PendingContactsOperationPrivate *priv = PendingContactsOperationPrivate::get(operation);
 
     priv->m_userIds.reserve(result.contacts.count());
@@ -128,9 +146,6 @@ void ContactsApiPrivate::onGetContactsResult(PendingContactsOperation *operation
         priv->m_userIds.append(contact.userId);
     }
 
-    dataInternalApi()->processData(result.users);
-    dataInternalApi()->setContactList(result.contacts);
-
     operation->setFinished();
 }
 
@@ -176,6 +191,12 @@ PendingContactsOperation *ContactsApi::addContacts(const ContactsApi::ContactInf
     return d->importContacts(contacts);
 }
 
+PendingOperation *ContactsApi::getUserInfo(quint32 userId)
+{
+    Q_D(ContactsApi);
+    return d->backend()->getPeerInfo(Peer::fromUserId(userId));
+}
+
 Telegram::PendingOperation *ContactsApi::deleteContacts(const QVector<quint32> &ids)
 {
     return nullptr;
@@ -53,6 +53,9 @@ public:
 
     PendingContactsOperation *addContacts(const ContactInfoList &contacts);
 
+    // Fetches the user info if it is missing in the DataStorage; concurrent requests are batched
+    PendingOperation *getUserInfo(quint32 userId);
+
     PendingOperation *deleteContacts(const QVector<quint32> &ids);
     PendingOperation *blockContact(quint32 contactId);
     PendingOperation *unblockContact(quint32 contactId);
@@ -18,18 +18,34 @@
 #include "DataStorage_p.hpp"
 
 #include "ApiUtils.hpp"
+#include "CTelegramStream.hpp"
+#include "CTelegramStreamExtraOperators.hpp"
 #include "RandomGenerator.hpp"
 #include "TLTypesDebug.hpp"
 #include "Debug.hpp"
 
 #include "TelegramNamespace_p.hpp"
 
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QLoggingCategory>
+#include <QSaveFile>
+#include <QTimer>
+#include <QUrl>
+
+#include <algorithm>
+#include <functional>
+
+Q_LOGGING_CATEGORY(c_clientDataStorage, "telegram.client.data", QtWarningMsg)
 
 namespace Telegram {
 
 namespace Client {
 
+// The number of evicted messages remembered to be refetched from the server on demand
+static const int c_evictedMessagesLimit = 10000;
+
 /*!
     \class Telegram::Client::DataStorage
     \brief Provides public API to get data
@@ -159,6 +175,40 @@ bool DataStorage::getMessage(Message *message, const Peer &peer, quint32 message
     return true;
 }
 
+/*!
+    Returns the memory budget of the message cache in bytes.
+
+    Zero means that the cache is not limited.
+*/
+quint64 DataStorage::messageCacheLimit() const
+{
+    Q_D(const DataStorage);
+    return d->m_api->messageCacheLimit();
+}
+
+/*!
+    Sets the memory budget of the message cache to \a bytes.
+
+    Least recently used messages are evicted once the budget is exceeded.
+    The budget is shared by all dialogs: the messages are ordered by the last
+    use across the dialogs rather than per dialog, so a dialog that is not
+    read for a while can lose all its cached messages except of the top one.
+    Dialog top messages are never evicted. An evicted message is reloaded
+    from the persistent cache (if any) or refetched from the server
+    on the next getMessage() call.
+*/
+void DataStorage::setMessageCacheLimit(quint64 bytes)
+{
+    Q_D(DataStorage);
+    d->m_api->setMessageCacheLimit(bytes);
+}
+
+DataStorage::MessageCacheStats DataStorage::messageCacheStats() const
+{
+    Q_D(const DataStorage);
+    return d->m_api->messageCacheStats();
+}
+
 bool DataStorage::getMessageMediaInfo(MessageMediaInfo *info, const Peer &peer, quint32 messageId)
 {
     Q_D(const DataStorage);
@@ -178,7 +228,7 @@ DataStorage::DataStorage(DataStoragePrivate *priv, QObject *parent)
     : QObject(parent),
       d(priv)
 {
-    d->m_api = new DataInternalApi(this);
+    d->m_api = new DataInternalApi(d, this);
 }
 
 InMemoryDataStorage::InMemoryDataStorage(QObject *parent) :
@@ -186,8 +236,285 @@ InMemoryDataStorage::InMemoryDataStorage(QObject *parent) :
 {
 }
 
-DataInternalApi::DataInternalApi(QObject *parent) :
-    QObject(parent)
+const QByteArray FileDataStoragePrivate::c_signature = QByteArrayLiteral("TelegramQt_data");
+
+/*!
+    \class Telegram::Client::FileDataStorage
+    \brief The FileDataStorage class keeps the data cache in a local file
+    \inmodule TelegramQt
+    \ingroup Client
+
+    The storage saves users, chats, contacts, dialogs and the last
+    messagesPerDialog messages of each dialog. Changes are written behind:
+    the file is rewritten at most once per flushInterval milliseconds
+    and on sync() or destruction of the storage.
+
+    Call loadData() before the client connects to make the cached data
+    available without a network round-trip. The updates state is kept
+    by the AccountStorage.
+
+    \sa FileAccountStorage
+*/
+
+FileDataStorage::FileDataStorage(QObject *parent) :
+    DataStorage(new FileDataStoragePrivate(), parent)
+{
+    Q_D(FileDataStorage);
+    d->m_flushTimer = new QTimer(this);
+    d->m_flushTimer->setSingleShot(true);
+    d->m_flushTimer->setInterval(1000);
+    connect(d->m_flushTimer, &QTimer::timeout, this, &FileDataStorage::sync);
+    connect(d->internalApi(), &DataInternalApi::changed, d->m_flushTimer, [d]() {
+        if (!d->m_flushTimer->isActive()) {
+            d->m_flushTimer->start();
+        }
+    });
+}
+
+FileDataStorage::~FileDataStorage()
+{
+    if (hasPendingChanges()) {
+        saveData();
+    }
+}
+
+QString FileDataStorage::fileName() const
+{
+    Q_D(const FileDataStorage);
+    return d->m_fileName;
+}
+
+QString FileDataStorage::getLocalFileName() const
+{
+    Q_D(const FileDataStorage);
+    if (d->m_fileName.isEmpty()) {
+        return QString();
+    }
+    const QUrl fileUrl = QUrl::fromUserInput(d->m_fileName);
+    if (!fileUrl.isLocalFile()) {
+        qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "The file is not a local file" << d->m_fileName;
+        return QString();
+    }
+    return fileUrl.toLocalFile();
+}
+
+bool FileDataStorage::fileExists() const
+{
+    QFileInfo file(getLocalFileName());
+    return file.isReadable();
+}
+
+int FileDataStorage::messagesPerDialog() const
+{
+    Q_D(const FileDataStorage);
+    return d->m_messagesPerDialog;
+}
+
+void FileDataStorage::setMessagesPerDialog(int count)
+{
+    Q_D(FileDataStorage);
+    d->m_messagesPerDialog = qMax(count, 0);
+}
+
+int FileDataStorage::flushInterval() const
+{
+    Q_D(const FileDataStorage);
+    return d->m_flushTimer->interval();
+}
+
+void FileDataStorage::setFlushInterval(int interval)
+{
+    Q_D(FileDataStorage);
+    d->m_flushTimer->setInterval(interval);
+}
+
+bool FileDataStorage::hasPendingChanges() const
+{
+    Q_D(const FileDataStorage);
+    return d->m_flushTimer->isActive();
+}
+
+bool FileDataStorage::saveData()
+{
+    Q_D(FileDataStorage);
+    const QString localFileName = getLocalFileName();
+    if (localFileName.isEmpty()) {
+        qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "Invalid fileName" << d->m_fileName;
+        return false;
+    }
+    const QFileInfo fileInfo(localFileName);
+    if (!QDir().mkpath(fileInfo.absolutePath())) {
+        qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "Unable to create output directory" << fileInfo.absolutePath();
+        return false;
+    }
+
+    // Write to a temporary file and replace the cache at once to never leave a truncated file
+    QSaveFile file(localFileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "Unable to open file" << localFileName;
+        return false;
+    }
+    {
+        // The evicted messages are copied from the previous file to not lose them on the rewrite
+        QSet<quint64> evictedKeys;
+        for (auto it = d->m_messageOffsets.cbegin(); it != d->m_messageOffsets.cend(); ++it) {
+            if (!d->m_api->isMessageCached(it.key())) {
+                evictedKeys.insert(it.key());
+            }
+        }
+        const TLVector<TLMessage> evictedMessages = d->loadMessages(evictedKeys);
+        CTelegramStream stream(&file);
+        stream.writeBytes(FileDataStoragePrivate::c_signature);
+        stream << FileDataStoragePrivate::c_formatVersion;
+        d->m_api->writeCache(&stream, d->m_messagesPerDialog, evictedMessages, &d->m_messageOffsets);
+        if (stream.error()) {
+            qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "Unable to write the data";
+            file.cancelWriting();
+        }
+    }
+    if (!file.commit()) {
+        d->m_messageOffsets.clear();
+        return false;
+    }
+    return true;
+}
+
+bool FileDataStorage::loadData()
+{
+    Q_D(FileDataStorage);
+    const QString localFileName = getLocalFileName();
+    if (localFileName.isEmpty()) {
+        qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "Invalid fileName" << d->m_fileName;
+        return false;
+    }
+    QFile file(localFileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "Unable to open file" << d->m_fileName;
+        return false;
+    }
+
+    // Parse the mapped file in place to avoid copying the whole cache to the heap
+    QByteArray data;
+    uchar *mappedData = file.map(0, file.size());
+    if (mappedData) {
+        data = QByteArray::fromRawData(reinterpret_cast<const char *>(mappedData), static_cast<int>(file.size()));
+    } else {
+        data = file.readAll();
+    }
+
+    bool result = false;
+    {
+        CTelegramStream stream(data);
+        const QByteArray signature = stream.readBytes(FileDataStoragePrivate::c_signature.size());
+        quint32 format = 0;
+        stream >> format;
+        if (signature != FileDataStoragePrivate::c_signature) {
+            qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "The file is not a TelegramQt data file (unknown signature)";
+        } else if (format > FileDataStoragePrivate::c_formatVersion) {
+            qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "The file format version is unknown" << format;
+        } else {
+            result = d->m_api->readCache(&stream, &d->m_messageOffsets);
+        }
+    }
+    data.clear();
+    if (mappedData) {
+        file.unmap(mappedData);
+    }
+
+    qCDebug(c_clientDataStorage) << Q_FUNC_INFO << "Loaded dialogs:" << d->m_api->dialogs().count();
+    return result;
+}
+
+bool FileDataStorage::clearData()
+{
+    Q_D(FileDataStorage);
+    d->m_flushTimer->stop();
+    d->m_messageOffsets.clear();
+    const QString localFileName = getLocalFileName();
+    if (localFileName.isEmpty()) {
+        qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "Invalid fileName" << d->m_fileName;
+        return false;
+    }
+    const QFileInfo fileInfo(localFileName);
+    if (!fileInfo.exists()) {
+        // Not an error
+        return true;
+    }
+    if (!QFile::remove(fileInfo.absoluteFilePath())) {
+        qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "Unable to delete file" << fileInfo.absoluteFilePath();
+        return false;
+    }
+    return true;
+}
+
+bool FileDataStorage::sync()
+{
+    Q_D(FileDataStorage);
+    d->m_flushTimer->stop();
+    const bool result = saveData();
+    emit synced();
+    return result;
+}
+
+void FileDataStorage::setFileName(const QString &fileName)
+{
+    Q_D(FileDataStorage);
+    if (d->m_fileName == fileName) {
+        return;
+    }
+    d->m_fileName = fileName;
+    emit fileNameChanged(fileName);
+}
+
+bool FileDataStoragePrivate::loadMessage(quint64 messageKey, TLMessage *message)
+{
+    const qint64 offset = m_messageOffsets.value(messageKey, -1);
+    if (offset < 0) {
+        return false;
+    }
+    FileDataStorage *storage = static_cast<FileDataStorage *>(m_api->parent());
+    QFile file(storage->getLocalFileName());
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(offset)) {
+        return false;
+    }
+    CTelegramStream stream(&file);
+    stream >> *message;
+    return !stream.error() && (messageKey == DataInternalApi::messageKey(*message));
+}
+
+TLVector<TLMessage> FileDataStoragePrivate::loadMessages(const QSet<quint64> &messageKeys) const
+{
+    TLVector<TLMessage> messages;
+    if (messageKeys.isEmpty() || m_messageOffsets.isEmpty()) {
+        return messages;
+    }
+    FileDataStorage *storage = static_cast<FileDataStorage *>(m_api->parent());
+    QFile file(storage->getLocalFileName());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return messages;
+    }
+    CTelegramStream stream(&file);
+    for (const quint64 key : messageKeys) {
+        const qint64 offset = m_messageOffsets.value(key, -1);
+        if ((offset < 0) || !file.seek(offset)) {
+            continue;
+        }
+        TLMessage message;
+        stream >> message;
+        if (stream.error()) {
+            qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "Unable to read the message at" << offset;
+            break;
+        }
+        if (DataInternalApi::messageKey(message) == key) {
+            messages.append(message);
+        }
+    }
+    return messages;
+}
+
+DataInternalApi::DataInternalApi(DataStoragePrivate *storage, QObject *parent) :
+    QObject(parent),
+    m_storage(storage)
 {
 }
 
@@ -195,6 +522,31 @@ DataInternalApi::~DataInternalApi()
 {
 }
 
+void DataInternalApi::beginChanges()
+{
+    ++m_changesDepth;
+}
+
+void DataInternalApi::endChanges()
+{
+    if (--m_changesDepth > 0) {
+        return;
+    }
+    if (m_hasPendingChanges) {
+        m_hasPendingChanges = false;
+        emit changed();
+    }
+}
+
+void DataInternalApi::notifyChanged()
+{
+    if (m_changesDepth) {
+        m_hasPendingChanges = true;
+        return;
+    }
+    emit changed();
+}
+
 const TLUser *DataInternalApi::getSelfUser() const
 {
     if (!m_selfUserId) {
@@ -203,13 +555,100 @@ const TLUser *DataInternalApi::getSelfUser() const
     return m_users.value(m_selfUserId);
 }
 
-const TLMessage *DataInternalApi::getMessage(const Peer &peer, quint32 messageId) const
+const TLMessage *DataInternalApi::getMessage(const Peer &peer, quint32 messageId)
 {
+    const quint64 key = messageKey(peer, messageId);
+    const TLMessage *message = nullptr;
     if (peer.type == Peer::Channel) {
-        quint64 key = DataInternalApi::channelMessageToKey(peer.id, messageId);
-        return m_channelMessages.value(key);
+        message = m_channelMessages.value(key);
+    } else {
+        message = m_clientMessages.value(messageId);
+    }
+    if (message) {
+        ++m_messageCacheStats.hits;
+        touchMessage(key);
+        return message;
+    }
+    ++m_messageCacheStats.misses;
+    TLMessage storedMessage;
+    if (m_storage->loadMessage(key, &storedMessage)) {
+        ++m_messageCacheStats.reloads;
+        return insertMessage(storedMessage);
+    }
+    if (!forgetEvictedMessage(key)) {
+        return nullptr;
+    }
+    ++m_messageCacheStats.refetches;
+    emit messageRequired(peer, messageId);
+    return nullptr;
+}
+
+/*!
+  Returns \a limit ids of the cached \a peer messages older than \a offsetId
+  (or the latest messages if \a offsetId is zero) ordered from new to old
+  and puts the hash of the messages to \a hash.
+
+  The slice is returned only if the cache holds all of it without gaps; otherwise the result is empty.
+*/
+QVector<quint32> DataInternalApi::getCachedHistory(const Peer &peer, quint32 offsetId, quint32 limit, quint32 *hash) const
+{
+    QVector<quint32> result;
+    *hash = 0;
+    const auto indexIt = m_dialogMessages.constFind(peer);
+    if (!limit || (indexIt == m_dialogMessages.cend())) {
+        return result;
+    }
+    const QMap<quint32, quint32> &index = indexIt.value();
+
+    quint32 messageId = 0;
+    if (offsetId) {
+        // The first message of the slice is the one linked to the oldest cached message not older than offsetId
+        const auto it = index.lowerBound(offsetId);
+        if (it != index.cend()) {
+            messageId = it.value();
+        }
+    } else {
+        const int dialogIndex = getDialogIndex(peer);
+        if (dialogIndex >= 0) {
+            messageId = m_dialogs.at(dialogIndex).topMessage;
+        }
+    }
+
+    result.reserve(static_cast<int>(limit));
+    while (messageId && (result.count() < static_cast<int>(limit))) {
+        const auto it = index.constFind(messageId);
+        if (it == index.cend()) {
+            break;
+        }
+        const TLMessage *message = peer.type == Peer::Channel ? m_channelMessages.value(messageKey(peer, messageId))
+                                                              : m_clientMessages.value(messageId);
+        result.append(messageId);
+        *hash = Utils::updateMessagesHash(*hash, *message);
+        messageId = it.value();
+    }
+    if (result.count() < static_cast<int>(limit)) {
+        result.clear();
+        *hash = 0;
+    }
+    return result;
+}
+
+/*!
+  Records that the \a messageIds (ordered from new to old) follow each other in the \a peer dialog
+  without other messages in between.
+*/
+void DataInternalApi::linkDialogMessages(const Peer &peer, const QVector<quint32> &messageIds)
+{
+    const auto indexIt = m_dialogMessages.find(peer);
+    if (indexIt == m_dialogMessages.end()) {
+        return;
+    }
+    for (int i = 0; i + 1 < messageIds.count(); ++i) {
+        const auto it = indexIt.value().find(messageIds.at(i));
+        if (it != indexIt.value().end()) {
+            it.value() = messageIds.at(i + 1);
+        }
     }
-    return m_clientMessages.value(messageId);
 }
 
 /*!
@@ -229,33 +668,86 @@ bool DataInternalApi::processNewMessage(const TLMessage &message, quint32 pts)
     }
     TLDialog *dialog = &m_dialogs[dialogIndex];
     if (dialog->topMessage < message.id) {
-        dialog->topMessage = message.id;
+        if (dialog->topMessage) {
+            linkDialogMessages(dialogPeer, { message.id, dialog->topMessage });
+        }
+        setDialogTopMessage(dialog, message.id);
     }
     if (dialog->pts < pts) {
         dialog->pts = pts;
     }
     ++dialog->unreadCount;
+    notifyChanged();
 
     return true;
 }
 
-void DataInternalApi::processData(const TLMessage &message)
+/*!
+  Processes the \a messages as a single change of the storage.
+  Each dialog is looked up and updated once per call.
+
+  Returns the ids of the processed messages grouped by the dialog peer in order of arrival.
+*/
+QVector<DataInternalApi::DialogMessages> DataInternalApi::processNewMessages(const QVector<ReceivedMessage> &messages)
 {
-    TLMessage *m = nullptr;
-    if (message.toId.tlType == TLValue::PeerChannel) {
-        const quint64 key = channelMessageToKey(message.toId.channelId, message.id);
-        if (!m_channelMessages.contains(key)) {
-            m_channelMessages.insert(key, new TLMessage());
+    QVector<DialogMessages> result;
+    QHash<Peer, int> resultIndices;
+    QVector<quint32> dialogPts;
+
+    beginChanges();
+    for (const ReceivedMessage &received : messages) {
+        processData(received.message);
+
+        const Peer dialogPeer = Utils::getMessageDialogPeer(received.message, selfUserId());
+        int resultIndex = resultIndices.value(dialogPeer, -1);
+        if (resultIndex < 0) {
+            resultIndex = result.count();
+            resultIndices.insert(dialogPeer, resultIndex);
+            result.append({ dialogPeer, { } });
+            dialogPts.append(0);
         }
-        m = m_channelMessages.value(key);
-    } else {
-        const quint32 key = message.id;
-        if (!m_clientMessages.contains(key)) {
-            m_clientMessages.insert(key, new TLMessage());
+        result[resultIndex].messageIds.append(received.message.id);
+        dialogPts[resultIndex] = qMax(dialogPts.at(resultIndex), received.pts);
+    }
+
+    for (int i = 0; i < result.count(); ++i) {
+        const DialogMessages &dialogMessages = result.at(i);
+        int dialogIndex = getDialogIndex(dialogMessages.peer);
+        if (dialogIndex < 0) {
+            dialogIndex = m_dialogs.count();
+            m_dialogs.append(TLDialog());
+            m_dialogs.last().peer = Utils::toTLPeer(dialogMessages.peer);
+        }
+        TLDialog *dialog = &m_dialogs[dialogIndex];
+        QVector<quint32> newMessageIds;
+        newMessageIds.reserve(dialogMessages.messageIds.count() + 1);
+        for (const quint32 messageId : dialogMessages.messageIds) {
+            if (dialog->topMessage < messageId) {
+                newMessageIds.append(messageId);
+            }
+        }
+        if (!newMessageIds.isEmpty()) {
+            std::sort(newMessageIds.begin(), newMessageIds.end(), std::greater<quint32>());
+            if (dialog->topMessage) {
+                newMessageIds.append(dialog->topMessage);
+            }
+            linkDialogMessages(dialogMessages.peer, newMessageIds);
+            setDialogTopMessage(dialog, newMessageIds.first());
         }
-        m = m_clientMessages.value(key);
+        if (dialog->pts < dialogPts.at(i)) {
+            dialog->pts = dialogPts.at(i);
+        }
+        dialog->unreadCount += static_cast<quint32>(dialogMessages.messageIds.count());
     }
-    *m = message;
+    endChanges();
+
+    return result;
+}
+
+void DataInternalApi::processData(const TLMessage &message)
+{
+    insertMessage(message);
+    notifyChanged();
 }
 
 void DataInternalApi::processData(const TLVector<TLChat> &chats)
@@ -273,6 +765,7 @@ void DataInternalApi::processData(const TLChat &chat)
     } else {
         *m_chats[chat.id] = chat;
     }
+    notifyChanged();
 }
 
 void DataInternalApi::processData(const TLVector<TLUser> &users)
@@ -296,6 +789,7 @@ void DataInternalApi::processData(const TLUser &user)
         }
         m_selfUserId = user.id;
     }
+    notifyChanged();
 }
 
 void DataInternalApi::processData(const TLAuthAuthorization &authorization)
@@ -305,7 +799,8 @@ void DataInternalApi::processData(const TLAuthAuthorization &authorization)
 
 void DataInternalApi::processData(const TLMessagesDialogs &dialogs)
 {
-    m_dialogs = dialogs.dialogs;
+    setDialogs(dialogs.dialogs);
+    notifyChanged();
     processData(dialogs.users);
     processData(dialogs.chats);
     for (const TLMessage &message : dialogs.messages) {
@@ -325,6 +820,7 @@ void DataInternalApi::processData(const TLMessagesMessages &messages)
 void DataInternalApi::setContactList(const TLVector<TLContact> &contacts)
 {
     m_contactList = contacts;
+    notifyChanged();
 }
 
 quint64 DataInternalApi::enqueueMessage(const Telegram::Peer peer, const QString &message, quint32 replyToMsgId)
@@ -387,6 +883,19 @@ void DataInternalApi::dequeueMessageRead(const Peer peer, quint32 messageId)
 */
 bool DataInternalApi::updateInboxRead(const Telegram::Peer peer, quint32 messageId)
 {
+    const int dialogIndex = getDialogIndex(peer);
+    if (dialogIndex < 0) {
+        return true;
+    }
+    TLDialog *dialog = &m_dialogs[dialogIndex];
+    if (dialog->readInboxMaxId >= messageId) {
+        return false;
+    }
+    dialog->readInboxMaxId = messageId;
+    if (messageId >= dialog->topMessage) {
+        dialog->unreadCount = 0;
+    }
+    notifyChanged();
     return true;
 }
 
@@ -396,6 +905,16 @@ bool DataInternalApi::updateInboxRead(const Telegram::Peer peer, quint32 message
 */
 bool DataInternalApi::updateOutboxRead(const Telegram::Peer peer, quint32 messageId)
 {
+    const int dialogIndex = getDialogIndex(peer);
+    if (dialogIndex < 0) {
+        return true;
+    }
+    TLDialog *dialog = &m_dialogs[dialogIndex];
+    if (dialog->readOutboxMaxId >= messageId) {
+        return false;
+    }
+    dialog->readOutboxMaxId = messageId;
+    notifyChanged();
     return true;
 }
 
@@ -476,6 +995,370 @@ quint64 DataInternalApi::channelMessageToKey(quint32 channelId, quint32 messageI
     return (key << 32) + messageId;
 }
 
+/*!
+  Writes the data to the \a stream and fills \a messageOffsets with the positions of the messages
+  in the stream. The \a evictedMessages are not cached in memory, but they are written along with the
+  cached messages, so the last \a messagesPerDialog messages of each dialog are kept regardless of the eviction.
+*/
+void DataInternalApi::writeCache(CTelegramStream *stream, int messagesPerDialog, const TLVector<TLMessage> &evictedMessages,
+                                 QHash<quint64, qint64> *messageOffsets) const
+{
+    *stream << m_selfUserId;
+    *stream << static_cast<quint32>(m_users.count());
+    for (const TLUser *user : m_users) {
+        *stream << *user;
+    }
+    *stream << static_cast<quint32>(m_chats.count());
+    for (const TLChat *chat : m_chats) {
+        *stream << *chat;
+    }
+    *stream << static_cast<quint32>(m_contactList.count());
+    for (const TLContact &contact : m_contactList) {
+        *stream << contact;
+    }
+    *stream << static_cast<quint32>(m_dialogs.count());
+    for (const TLDialog &dialog : m_dialogs) {
+        *stream << dialog;
+    }
+
+    QHash<Peer, QVector<const TLMessage *>> dialogMessages;
+    for (const TLMessage *message : m_clientMessages) {
+        dialogMessages[Utils::getMessageDialogPeer(*message, m_selfUserId)].append(message);
+    }
+    for (const TLMessage *message : m_channelMessages) {
+        dialogMessages[Utils::toPublicPeer(message->toId)].append(message);
+    }
+    for (const TLMessage &message : evictedMessages) {
+        const Peer peer = message.toId.tlType == TLValue::PeerChannel ? Utils::toPublicPeer(message.toId)
+                                                                      : Utils::getMessageDialogPeer(message, m_selfUserId);
+        dialogMessages[peer].append(&message);
+    }
+    QVector<const TLMessage *> messages;
+    for (QVector<const TLMessage *> &list : dialogMessages) {
+        if (list.count() > messagesPerDialog) {
+            std::nth_element(list.begin(), list.begin() + messagesPerDialog, list.end(),
+                             [](const TLMessage *left, const TLMessage *right) {
+                return left->id > right->id;
+            });
+            list.resize(messagesPerDialog);
+        }
+        messages += list;
+    }
+    *stream << static_cast<quint32>(messages.count());
+    messageOffsets->clear();
+    for (const TLMessage *message : messages) {
+        messageOffsets->insert(messageKey(*message), stream->device()->pos());
+        *stream << *message;
+    }
+}
+
+/*!
+  Replaces the data with the cache from the \a stream and fills \a messageOffsets
+  with the positions of the messages in the stream.
+
+  Returns \c false and keeps the data intact if the stream is not valid.
+*/
+bool DataInternalApi::readCache(CTelegramStream *stream, QHash<quint64, qint64> *messageOffsets)
+{
+    quint32 selfUserId = 0;
+    quint32 count = 0;
+    *stream >> selfUserId;
+
+    *stream >> count;
+    TLVector<TLUser> users;
+    for (quint32 i = 0; (i < count) && !stream->error(); ++i) {
+        TLUser user;
+        *stream >> user;
+        users.append(user);
+    }
+    *stream >> count;
+    TLVector<TLChat> chats;
+    for (quint32 i = 0; (i < count) && !stream->error(); ++i) {
+        TLChat chat;
+        *stream >> chat;
+        chats.append(chat);
+    }
+    *stream >> count;
+    TLVector<TLContact> contacts;
+    for (quint32 i = 0; (i < count) && !stream->error(); ++i) {
+        TLContact contact;
+        *stream >> contact;
+        contacts.append(contact);
+    }
+    *stream >> count;
+    TLVector<TLDialog> dialogs;
+    for (quint32 i = 0; (i < count) && !stream->error(); ++i) {
+        TLDialog dialog;
+        *stream >> dialog;
+        dialogs.append(dialog);
+    }
+    *stream >> count;
+    TLVector<TLMessage> messages;
+    QHash<quint64, qint64> offsets;
+    for (quint32 i = 0; (i < count) && !stream->error(); ++i) {
+        const qint64 offset = stream->device()->pos();
+        TLMessage message;
+        *stream >> message;
+        messages.append(message);
+        offsets.insert(messageKey(message), offset);
+    }
+    if (stream->error()) {
+        qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "Unable to read the cache";
+        return false;
+    }
+
+    qDeleteAll(m_users);
+    m_users.clear();
+    for (const TLUser &user : users) {
+        m_users.insert(user.id, new TLUser(user));
+    }
+    qDeleteAll(m_chats);
+    m_chats.clear();
+    for (const TLChat &chat : chats) {
+        m_chats.insert(chat.id, new TLChat(chat));
+    }
+    m_contactList = contacts;
+    setDialogs(dialogs);
+    m_selfUserId = selfUserId;
+    clearMessages();
+    for (const TLMessage &message : messages) {
+        insertMessage(message);
+    }
+    *messageOffsets = offsets;
+    return true;
+}
+
+quint64 DataInternalApi::messageKey(const Peer &peer, quint32 messageId)
+{
+    if (peer.type == Peer::Channel) {
+        return channelMessageToKey(peer.id, messageId);
+    }
+    return messageId;
+}
+
+quint64 DataInternalApi::messageKey(const TLMessage &message)
+{
+    if (message.toId.tlType == TLValue::PeerChannel) {
+        return channelMessageToKey(message.toId.channelId, message.id);
+    }
+    return message.id;
+}
+
+/*!
+  Returns the approximate heap footprint of the \a message.
+*/
+quint32 DataInternalApi::estimateMessageSize(const TLMessage &message)
+{
+    quint32 size = sizeof(TLMessage);
+    size += static_cast<quint32>(message.message.size()) * sizeof(QChar);
+    size += static_cast<quint32>(message.entities.count()) * sizeof(TLMessageEntity);
+    size += static_cast<quint32>(message.postAuthor.size()) * sizeof(QChar);
+    size += static_cast<quint32>(message.media.caption.size()) * sizeof(QChar);
+    return size;
+}
+
+void DataInternalApi::setMessageCacheLimit(quint64 bytes)
+{
+    m_messageCacheLimit = bytes;
+    evictMessages();
+}
+
+DataStorage::MessageCacheStats DataInternalApi::messageCacheStats() const
+{
+    DataStorage::MessageCacheStats stats = m_messageCacheStats;
+    stats.size = m_messageCacheSize;
+    stats.count = m_messageCacheEntries.count();
+    return stats;
+}
+
+/*!
+  Stores the \a message as the most recently used one and evicts
+  the least recently used messages if the cache is over the budget.
+*/
+TLMessage *DataInternalApi::insertMessage(const TLMessage &message)
+{
+    if (!message.id) {
+        qCWarning(c_clientDataStorage) << Q_FUNC_INFO << "Invalid message id";
+        return nullptr;
+    }
+    const quint64 key = messageKey(message);
+    TLMessage *m = nullptr;
+    if (message.toId.tlType == TLValue::PeerChannel) {
+        m = m_channelMessages.value(key);
+        if (!m) {
+            m = new TLMessage();
+            m_channelMessages.insert(key, m);
+        }
+    } else {
+        m = m_clientMessages.value(message.id);
+        if (!m) {
+            m = new TLMessage();
+            m_clientMessages.insert(message.id, m);
+        }
+    }
+    *m = message;
+    if (message.tlType != TLValue::MessageEmpty) {
+        QMap<quint32, quint32> &index = m_dialogMessages[Utils::getMessageDialogPeer(message, m_selfUserId)];
+        if (!index.contains(message.id)) {
+            index.insert(message.id, 0);
+        }
+    }
+
+    const quint32 size = estimateMessageSize(message);
+    if (m_messageCacheEntries.contains(key)) {
+        MessageCacheEntry &entry = m_messageCacheEntries[key];
+        m_messageCacheSize = m_messageCacheSize - entry.size + size;
+        entry.size = size;
+        touchMessage(key);
+    } else {
+        m_messageCacheEntries.insert(key, { 0, m_messageCacheHead, size });
+        if (m_messageCacheHead) {
+            m_messageCacheEntries[m_messageCacheHead].previous = key;
+        } else {
+            m_messageCacheTail = key;
+        }
+        m_messageCacheHead = key;
+        m_messageCacheSize += size;
+    }
+    forgetEvictedMessage(key);
+    evictMessages();
+    return m;
+}
+
+void DataInternalApi::removeMessage(quint64 key)
+{
+    const MessageCacheEntry entry = m_messageCacheEntries.take(key);
+    if (entry.previous) {
+        m_messageCacheEntries[entry.previous].next = entry.next;
+    } else {
+        m_messageCacheHead = entry.next;
+    }
+    if (entry.next) {
+        m_messageCacheEntries[entry.next].previous = entry.previous;
+    } else {
+        m_messageCacheTail = entry.previous;
+    }
+    m_messageCacheSize -= entry.size;
+
+    TLMessage *message = (key >> 32) ? m_channelMessages.take(key) : m_clientMessages.take(static_cast<quint32>(key));
+    if (message && (message->tlType != TLValue::MessageEmpty)) {
+        const Peer peer = Utils::getMessageDialogPeer(*message, m_selfUserId);
+        const auto indexIt = m_dialogMessages.find(peer);
+        if (indexIt != m_dialogMessages.end()) {
+            indexIt.value().remove(message->id);
+            if (indexIt.value().isEmpty()) {
+                m_dialogMessages.erase(indexIt);
+            }
+        }
+    }
+    delete message;
+}
+
+void DataInternalApi::clearMessages()
+{
+    qDeleteAll(m_clientMessages);
+    m_clientMessages.clear();
+    qDeleteAll(m_channelMessages);
+    m_channelMessages.clear();
+    m_messageCacheEntries.clear();
+    m_dialogMessages.clear();
+    m_messageCacheHead = 0;
+    m_messageCacheTail = 0;
+    m_messageCacheSize = 0;
+    m_evictedMessages.clear();
+    m_evictionOrder.clear();
+}
+
+void DataInternalApi::touchMessage(quint64 key)
+{
+    if (key == m_messageCacheHead) {
+        return;
+    }
+    MessageCacheEntry &entry = m_messageCacheEntries[key];
+    // Unlink (the entry is not the head, so it always has a previous one)
+    m_messageCacheEntries[entry.previous].next = entry.next;
+    if (entry.next) {
+        m_messageCacheEntries[entry.next].previous = entry.previous;
+    } else {
+        m_messageCacheTail = entry.previous;
+    }
+    // Link as the head
+    entry.previous = 0;
+    entry.next = m_messageCacheHead;
+    m_messageCacheEntries[m_messageCacheHead].previous = key;
+    m_messageCacheHead = key;
+}
+
+void DataInternalApi::evictMessages()
+{
+    if (!m_messageCacheLimit || (m_messageCacheSize <= m_messageCacheLimit)) {
+        return;
+    }
+    // Evict a bit more than needed to not run the eviction on each new message
+    const quint64 targetSize = m_messageCacheLimit - m_messageCacheLimit / 8;
+
+    // The most recently used message is always kept
+    quint64 key = m_messageCacheTail;
+    while (key && (key != m_messageCacheHead) && (m_messageCacheSize > targetSize)) {
+        const quint64 previousKey = m_messageCacheEntries.value(key).previous;
+        if (!m_dialogTopMessages.contains(key)) {
+            removeMessage(key);
+            rememberEvictedMessage(key);
+            ++m_messageCacheStats.evictions;
+        }
+        key = previousKey;
+    }
+}
+
+/*!
+  Remembers the evicted message \a key to refetch the message on the next request.
+  Only the last c_evictedMessagesLimit keys are kept; the older messages are dropped for good.
+*/
+void DataInternalApi::rememberEvictedMessage(quint64 key)
+{
+    forgetEvictedMessage(key);
+    const quint64 number = ++m_evictionCounter;
+    m_evictedMessages.insert(key, number);
+    m_evictionOrder.insert(number, key);
+    if (m_evictedMessages.count() > c_evictedMessagesLimit) {
+        const auto oldest = m_evictionOrder.begin();
+        m_evictedMessages.remove(oldest.value());
+        m_evictionOrder.erase(oldest);
+    }
+}
+
+/*!
+  Returns \c true if the message \a key was evicted and removes it from the evicted messages.
+*/
+bool DataInternalApi::forgetEvictedMessage(quint64 key)
+{
+    const auto it = m_evictedMessages.find(key);
+    if (it == m_evictedMessages.end()) {
+        return false;
+    }
+    m_evictionOrder.remove(it.value());
+    m_evictedMessages.erase(it);
+    return true;
+}
+
+void DataInternalApi::setDialogs(const TLVector<TLDialog> &dialogs)
+{
+    m_dialogs = dialogs;
+    m_dialogTopMessages.clear();
+    m_dialogTopMessages.reserve(m_dialogs.count());
+    for (const TLDialog &dialog : m_dialogs) {
+        m_dialogTopMessages.insert(messageKey(Utils::toPublicPeer(dialog.peer), dialog.topMessage));
+    }
+}
+
+void DataInternalApi::setDialogTopMessage(TLDialog *dialog, quint32 messageId)
+{
+    const Peer peer = Utils::toPublicPeer(dialog->peer);
+    m_dialogTopMessages.remove(messageKey(peer, dialog->topMessage));
+    dialog->topMessage = messageId;
+    m_dialogTopMessages.insert(messageKey(peer, messageId));
+}
+
 int Telegram::Client::DataInternalApi::getDialogIndex(const Telegram::Peer &peer) const
 {
     for (int i = 0; i < m_dialogs.count(); ++i) {
@@ -491,6 +1374,16 @@ DataStoragePrivate *DataStoragePrivate::get(DataStorage *parent)
     return parent->d;
 }
 
+/*!
+  Restores the evicted message with \a messageKey from the persistent storage (if any).
+*/
+bool DataStoragePrivate::loadMessage(quint64 messageKey, TLMessage *message)
+{
+    Q_UNUSED(messageKey)
+    Q_UNUSED(message)
+    return false;
+}
+
 } // Client namespace
 
 } // Telegram namespace
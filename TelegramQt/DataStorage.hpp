@@ -49,6 +49,20 @@ public:
     bool getMessage(Message *message, const Telegram::Peer &peer, quint32 messageId);
     bool getMessageMediaInfo(MessageMediaInfo *info, const Telegram::Peer &peer, quint32 messageId);
 
+    struct MessageCacheStats {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 evictions = 0;
+        quint64 reloads = 0; // Evicted messages restored from the persistent cache
+        quint64 refetches = 0; // Evicted messages requested from the server
+        quint64 size = 0; // Estimated memory footprint of the cached messages (in bytes)
+        int count = 0;
+    };
+
+    quint64 messageCacheLimit() const;
+    void setMessageCacheLimit(quint64 bytes);
+    MessageCacheStats messageCacheStats() const;
+
 protected:
     DataStorage(DataStoragePrivate *priv, QObject *parent);
     DataStoragePrivate *d = nullptr;
@@ -63,6 +77,44 @@ public:
     explicit InMemoryDataStorage(QObject *parent = nullptr);
 };
 
+class FileDataStoragePrivate;
+class TELEGRAMQT_EXPORT FileDataStorage : public DataStorage
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE_D(d, FileDataStorage)
+    Q_PROPERTY(QString fileName READ fileName WRITE setFileName NOTIFY fileNameChanged)
+    Q_PROPERTY(int messagesPerDialog READ messagesPerDialog WRITE setMessagesPerDialog)
+    Q_PROPERTY(int flushInterval READ flushInterval WRITE setFlushInterval)
+public:
+    explicit FileDataStorage(QObject *parent = nullptr);
+    ~FileDataStorage() override;
+
+    QString fileName() const;
+    QString getLocalFileName() const;
+    Q_INVOKABLE bool fileExists() const;
+
+    int messagesPerDialog() const;
+    void setMessagesPerDialog(int count);
+
+    int flushInterval() const;
+    void setFlushInterval(int interval);
+
+    bool hasPendingChanges() const;
+
+public slots:
+    bool saveData();
+    bool loadData();
+    bool clearData();
+
+    bool sync();
+
+    void setFileName(const QString &fileName);
+
+Q_SIGNALS:
+    void synced();
+    void fileNameChanged(const QString &fileName);
+};
+
 } // Client namespace
 
 } // Telegram namespace
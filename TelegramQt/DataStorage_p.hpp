@@ -23,7 +23,13 @@
 #include "TLTypes.hpp"
 
 #include <QHash>
+#include <QMap>
 #include <QQueue>
+#include <QSet>
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+class CTelegramStream;
 
 namespace Telegram {
 
@@ -34,19 +40,37 @@ class DataInternalApi;
 class DataStoragePrivate
 {
 public:
+    virtual ~DataStoragePrivate() = default;
     static DataStoragePrivate *get(DataStorage *parent);
 
+    virtual bool loadMessage(quint64 messageKey, TLMessage *message);
+
     DataInternalApi *internalApi() { return m_api; }
 
     DcConfiguration m_serverConfig;
     DataInternalApi *m_api = nullptr;
 };
 
+class FileDataStoragePrivate : public DataStoragePrivate
+{
+public:
+    bool loadMessage(quint64 messageKey, TLMessage *message) override;
+    TLVector<TLMessage> loadMessages(const QSet<quint64> &messageKeys) const;
+
+    QString m_fileName;
+    QTimer *m_flushTimer = nullptr;
+    int m_messagesPerDialog = 50;
+    QHash<quint64, qint64> m_messageOffsets; // Message key to offset in the file
+
+    static constexpr quint32 c_formatVersion = 1;
+    static const QByteArray c_signature;
+};
+
 class DataInternalApi : public QObject
 {
     Q_OBJECT
 public:
-    explicit DataInternalApi(QObject *parent = nullptr);
+    explicit DataInternalApi(DataStoragePrivate *storage, QObject *parent = nullptr);
     ~DataInternalApi() override;
 
     struct SentMessage {
@@ -56,12 +80,25 @@ public:
         quint32 replyToMsgId;
     };
 
+    struct ReceivedMessage {
+        TLMessage message;
+        quint32 pts;
+    };
+
+    struct DialogMessages {
+        Peer peer;
+        QVector<quint32> messageIds;
+    };
+
     static DataInternalApi *get(DataStorage *parent) { return DataStoragePrivate::get(parent)->internalApi(); }
 
     const TLUser *getSelfUser() const;
-    const TLMessage *getMessage(const Telegram::Peer &peer, quint32 messageId) const;
+    const TLMessage *getMessage(const Telegram::Peer &peer, quint32 messageId);
+    QVector<quint32> getCachedHistory(const Telegram::Peer &peer, quint32 offsetId, quint32 limit, quint32 *hash) const;
+    void linkDialogMessages(const Telegram::Peer &peer, const QVector<quint32> &messageIds);
 
     bool processNewMessage(const TLMessage &message, quint32 pts);
+    QVector<DialogMessages> processNewMessages(const QVector<ReceivedMessage> &messages);
     void processData(const TLMessage &message);
     void processData(const TLVector<TLChat> &chats);
     void processData(const TLChat &chat);
@@ -89,6 +126,14 @@ public:
     TLInputChannel toInputChannel(quint32 channelId) const;
 
     static quint64 channelMessageToKey(quint32 channelId, quint32 messageId);
+    static quint64 messageKey(const Telegram::Peer &peer, quint32 messageId);
+    static quint64 messageKey(const TLMessage &message);
+    static quint32 estimateMessageSize(const TLMessage &message);
+
+    quint64 messageCacheLimit() const { return m_messageCacheLimit; }
+    bool isMessageCached(quint64 key) const { return m_messageCacheEntries.contains(key); }
+    void setMessageCacheLimit(quint64 bytes);
+    DataStorage::MessageCacheStats messageCacheStats() const;
 
     TLVector<TLContact> contactList() const { return m_contactList; }
     const QHash<quint32, TLUser *> &users() const { return m_users; }
@@ -96,7 +141,37 @@ public:
     const TLVector<TLDialog> &dialogs() const { return m_dialogs; }
     int getDialogIndex(const Peer &peer) const;
 
+    // The changed() signal is emitted once for all the changes made within the outermost pair of calls
+    void beginChanges();
+    void endChanges();
+
+    void writeCache(CTelegramStream *stream, int messagesPerDialog, const TLVector<TLMessage> &evictedMessages,
+                    QHash<quint64, qint64> *messageOffsets) const;
+    bool readCache(CTelegramStream *stream, QHash<quint64, qint64> *messageOffsets);
+
+Q_SIGNALS:
+    void changed();
+    // An evicted message is requested and it is not available in the persistent cache
+    void messageRequired(const Telegram::Peer peer, quint32 messageId);
+
 protected:
+    struct MessageCacheEntry {
+        quint64 previous; // The key of a more recently used message
+        quint64 next; // The key of a less recently used message
+        quint32 size;
+    };
+
+    TLMessage *insertMessage(const TLMessage &message);
+    void removeMessage(quint64 key);
+    void clearMessages();
+    void touchMessage(quint64 key);
+    void evictMessages();
+    void rememberEvictedMessage(quint64 key);
+    bool forgetEvictedMessage(quint64 key);
+    void setDialogs(const TLVector<TLDialog> &dialogs);
+    void setDialogTopMessage(TLDialog *dialog, quint32 messageId);
+    void notifyChanged();
+
     QHash<quint32, TLUser *> m_users;
     QHash<quint32, TLChat *> m_chats;
     QHash<quint32, TLMessage *> m_clientMessages;
@@ -105,6 +180,24 @@ protected:
     TLVector<TLContact> m_contactList;
     QQueue<SentMessage> m_queuedMessages;
     quint32 m_selfUserId = 0;
+    int m_changesDepth = 0;
+    bool m_hasPendingChanges = false;
+
+    DataStoragePrivate *m_storage = nullptr;
+    // Doubly linked list of the cached messages in order of use; zero key stands for no message
+    QHash<quint64, MessageCacheEntry> m_messageCacheEntries;
+    quint64 m_messageCacheHead = 0;
+    quint64 m_messageCacheTail = 0;
+    quint64 m_messageCacheSize = 0;
+    quint64 m_messageCacheLimit = 0;
+    // The evicted messages to refetch on demand: key to the eviction number and vice versa
+    QHash<quint64, quint64> m_evictedMessages;
+    QMap<quint64, quint64> m_evictionOrder;
+    quint64 m_evictionCounter = 0;
+    QSet<quint64> m_dialogTopMessages;
+    // Dialog peer to the cached message ids with the id of the previous message in the dialog (zero if unknown)
+    QHash<Peer, QMap<quint32, quint32>> m_dialogMessages;
+    DataStorage::MessageCacheStats m_messageCacheStats;
 };
 
 } // Client namespace
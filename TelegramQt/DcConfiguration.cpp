@@ -10,6 +10,20 @@ DcOption DcConfiguration::getOption(const ConnectionSpec spec) const
         if (opt.id != spec.dcId) {
             continue;
         }
+        if (opt.flags & DcOption::LocalSocket) {
+            if (spec.flags & ConnectionSpec::RequestFlag::LocalSocket) {
+                // Best match
+                return opt;
+            }
+            continue;
+        }
+        if (opt.flags & DcOption::Loopback) {
+            if (spec.flags & ConnectionSpec::RequestFlag::Loopback) {
+                // Best match
+                return opt;
+            }
+            continue;
+        }
         if (spec.flags & ConnectionSpec::RequestFlag::Ipv4Only) {
             if (opt.flags & DcOption::Ipv6) {
                 continue;
@@ -18,6 +18,8 @@ struct ConnectionSpec
         Ipv4Only = 1 << 1,
         Ipv6Only = 1 << 2,
         MediaOnly = 1 << 3,
+        LocalSocket = 1 << 4,
+        Loopback = 1 << 5,
     };
     Q_DECLARE_FLAGS(RequestFlags, RequestFlag)
 
@@ -24,6 +24,10 @@ PendingOperation *DialogList::becomeReady()
 {
     MessagingApiPrivate *api = MessagingApiPrivate::get(m_backend);
     if (!m_readyOperation) {
+        // Expose the cached dialogs while the actual list is requested
+        if (m_peers.isEmpty()) {
+            m_peers = api->dataStorage()->dialogs();
+        }
         m_readyOperation = api->getDialogs();
         connect(m_readyOperation, &PendingOperation::finished, this, &DialogList::onFinished);
         m_readyOperation->startLater();
@@ -0,0 +1,600 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include "FilesApi_p.hpp"
+
+#include "AccountStorage.hpp"
+#include "ClientBackend.hpp"
+#include "ClientConnection.hpp"
+#include "ClientConnectionPool.hpp"
+#include "ClientRpcLayer.hpp"
+#include "ClientRpcScheduler.hpp"
+#include "DcConfiguration.hpp"
+#include "RandomGenerator.hpp"
+#include "TelegramNamespace_p.hpp"
+
+#include "Operations/ClientFileOperation.hpp"
+#include "Operations/ClientFileOperation_p.hpp"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QPointer>
+
+#include <limits>
+
+Q_LOGGING_CATEGORY(c_filesApiLoggingCategory, "telegram.client.api.files", QtWarningMsg)
+
+namespace Telegram {
+
+namespace Client {
+
+constexpr quint32 FileDownload::c_partSize;
+constexpr int FileDownload::c_maxPartRetries;
+
+FileDownload::FileDownload(FilesApiPrivate *api, const RemoteFile &file) :
+    QObject(api),
+    m_api(api),
+    m_file(file)
+{
+    const RemoteFile::Private *filePrivate = RemoteFile::Private::get(&file);
+    m_location = filePrivate->getInputFileLocation();
+    m_dcId = filePrivate->m_dcId;
+    m_size = file.size();
+    if (m_size) {
+        m_sizeKnown = true;
+        m_partsCount = (m_size + c_partSize - 1) / c_partSize;
+    }
+}
+
+void FileDownload::addOperation(FileOperation *operation)
+{
+    m_operations.append(operation);
+    process();
+}
+
+/*
+    Requests the parts ahead of the write position of each operation.
+    The operations at the same position share the requests, so concurrent
+    downloads of the same file do not fetch the same parts twice.
+*/
+void FileDownload::requestParts()
+{
+    // Grow the window with each full part while the file size is unknown
+    const int window = m_sizeKnown ? m_api->m_downloadWindow : qMin(m_api->m_downloadWindow, m_fullParts + 1);
+    UploadRpcLayer *layer = nullptr;
+    for (FileOperation *operation : m_operations) {
+        const quint32 firstPart = FileOperationPrivate::get(operation)->m_nextPart;
+        const quint32 lastPart = firstPart + static_cast<quint32>(window);
+        for (quint32 part = firstPart; part < lastPart; ++part) {
+            if (m_partsInFlight.count() >= window) {
+                return;
+            }
+            if (m_sizeKnown && (part >= m_partsCount)) {
+                break;
+            }
+            if (m_partsInFlight.contains(part) || m_parts.contains(part)) {
+                continue;
+            }
+            if (!layer) {
+                layer = m_api->mediaLayer(m_dcId);
+            }
+            m_partsInFlight.insert(part);
+            UploadRpcLayer::PendingUploadFile *rpcOperation = layer->getFile(m_location, part * c_partSize, c_partSize);
+            rpcOperation->connectToFinished(this, &FileDownload::onPartReceived, part, rpcOperation);
+        }
+    }
+}
+
+void FileDownload::onPartReceived(quint32 part, UploadRpcLayer::PendingUploadFile *rpcOperation)
+{
+    // The operation holds the received part; the part is copied to m_parts if needed
+    rpcOperation->deleteLater();
+    m_partsInFlight.remove(part);
+    if (m_operations.isEmpty()) {
+        // The download is finished already
+        return;
+    }
+    if (rpcOperation->isFailed()) {
+        const int failures = ++m_partFailures[part];
+        qCWarning(c_filesApiLoggingCategory) << __func__ << "part" << part << "failed, attempt" << failures
+                                             << rpcOperation->errorDetails();
+        if (failures > c_maxPartRetries) {
+            failOperations(rpcOperation->errorDetails());
+            return;
+        }
+        // The part is requested again along with the rest of the window
+        requestParts();
+        return;
+    }
+    m_partFailures.remove(part);
+
+    TLUploadFile result;
+    rpcOperation->getResult(&result);
+    if (result.tlType != TLValue::UploadFile) {
+        failOperations({{ PendingOperation::c_text(), QStringLiteral("CDN files are not supported") }});
+        return;
+    }
+
+    const quint32 bytesCount = static_cast<quint32>(result.bytes.size());
+    if (bytesCount == c_partSize) {
+        ++m_fullParts;
+    } else if (bytesCount) {
+        // A short part is the last one
+        m_sizeKnown = true;
+        m_partsCount = part + 1;
+        m_size = part * c_partSize + bytesCount;
+    } else if (!m_sizeKnown || (part < m_partsCount)) {
+        // An empty part is past the end of the file
+        m_sizeKnown = true;
+        m_partsCount = part;
+        m_size = part * c_partSize;
+    }
+
+    if (bytesCount && (part < m_partsCount || !m_sizeKnown)) {
+        m_parts.insert(part, result.bytes);
+    }
+    process();
+}
+
+void FileDownload::process()
+{
+    for (int i = 0; i < m_operations.count(); ) {
+        FileOperation *operation = m_operations.at(i);
+        FileOperationPrivate *priv = FileOperationPrivate::get(operation);
+        if (!writeParts(operation)) {
+            qCWarning(c_filesApiLoggingCategory) << __func__ << "unable to write" << priv->m_device->errorString();
+            finishOperation(operation, {{ PendingOperation::c_text(), priv->m_device->errorString() }});
+            m_operations.removeAt(i);
+            continue;
+        }
+        if (m_sizeKnown && (priv->m_nextPart >= m_partsCount)) {
+            finishOperation(operation, QVariantHash());
+            m_operations.removeAt(i);
+            continue;
+        }
+        ++i;
+    }
+
+    if (m_operations.isEmpty()) {
+        m_api->onDownloadFinished(this);
+        return;
+    }
+
+    // Release the parts written by all operations
+    quint32 lowestPart = FileOperationPrivate::get(m_operations.first())->m_nextPart;
+    for (FileOperation *operation : m_operations) {
+        lowestPart = qMin(lowestPart, FileOperationPrivate::get(operation)->m_nextPart);
+    }
+    for (auto it = m_parts.begin(); it != m_parts.end(); ) {
+        if ((it.key() < lowestPart) || (m_sizeKnown && (it.key() >= m_partsCount))) {
+            it = m_parts.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    requestParts();
+}
+
+/*
+    Writes the received parts in order, so a file on disk always holds
+    a complete prefix and the download can be resumed from its size.
+*/
+bool FileDownload::writeParts(FileOperation *operation)
+{
+    FileOperationPrivate *priv = FileOperationPrivate::get(operation);
+    QIODevice *device = priv->m_device;
+    const quint32 firstPart = priv->m_nextPart;
+    while (m_parts.contains(priv->m_nextPart)) {
+        const QByteArray bytes = m_parts.value(priv->m_nextPart);
+        const qint64 offset = static_cast<qint64>(priv->m_nextPart) * c_partSize;
+        if (!device->isSequential() && (device->pos() != offset) && !device->seek(offset)) {
+            return false;
+        }
+        if (device->write(bytes) != bytes.size()) {
+            return false;
+        }
+        ++priv->m_nextPart;
+        priv->m_bytesTransferred += static_cast<quint32>(bytes.size());
+    }
+    if (priv->m_nextPart != firstPart) {
+        priv->m_totalBytes = m_size;
+        emit operation->progressChanged(priv->m_bytesTransferred, priv->m_totalBytes);
+    }
+    return true;
+}
+
+void FileDownload::finishOperation(FileOperation *operation, const QVariantHash &errorDetails)
+{
+    FileOperationPrivate *priv = FileOperationPrivate::get(operation);
+    priv->m_totalBytes = m_size;
+    if (priv->m_device->parent() == operation) {
+        // The device is opened by the API
+        priv->m_device->close();
+    }
+    if (errorDetails.isEmpty()) {
+        operation->setDelayedFinished();
+    } else {
+        operation->setDelayedFinishedWithError(errorDetails);
+    }
+}
+
+void FileDownload::failOperations(const QVariantHash &details)
+{
+    for (FileOperation *operation : m_operations) {
+        finishOperation(operation, details);
+    }
+    m_operations.clear();
+    m_api->onDownloadFinished(this);
+}
+
+constexpr quint32 FileUpload::c_bigFileSize;
+constexpr quint32 FileUpload::c_partSize;
+constexpr quint32 FileUpload::c_bigFilePartSize;
+constexpr int FileUpload::c_maxPartAttempts;
+
+FileUpload::FileUpload(FilesApiPrivate *api, FileOperation *operation, const QString &fileName) :
+    QObject(api),
+    m_api(api),
+    m_operation(operation),
+    m_input(FileOperationPrivate::get(operation)->m_device),
+    m_fileName(fileName),
+    m_hash(QCryptographicHash::Md5)
+{
+}
+
+void FileUpload::start()
+{
+    const qint64 size = m_input->size();
+    if (size <= 0 || size > static_cast<qint64>(std::numeric_limits<quint32>::max())) {
+        finish({{ PendingOperation::c_text(), QStringLiteral("Invalid input size") }});
+        return;
+    }
+    m_size = static_cast<quint32>(size);
+    m_partSize = isBigFile() ? c_bigFilePartSize : c_partSize;
+    m_partsCount = (m_size + m_partSize - 1) / m_partSize;
+    m_fileId = RandomGenerator::instance()->generate<quint64>();
+    m_dcId = m_api->backend()->accountStorage()->dcInfo().id;
+
+    FileOperationPrivate *priv = FileOperationPrivate::get(m_operation);
+    priv->m_totalBytes = m_size;
+
+    sendParts();
+}
+
+/*
+    Reads the next parts while the window has a room for them.
+    Only the parts in flight are kept in memory, so the memory use
+    does not depend on the file size.
+*/
+void FileUpload::sendParts()
+{
+    while ((m_partsInFlight.count() < m_api->m_uploadWindow) && (m_nextPart < m_partsCount)) {
+        const quint32 expectedSize = qMin(m_partSize, m_size - m_nextPart * m_partSize);
+        const QByteArray bytes = m_input->read(expectedSize);
+        if (static_cast<quint32>(bytes.size()) != expectedSize) {
+            finish({{ PendingOperation::c_text(), QStringLiteral("Unable to read the input: %1").arg(m_input->errorString()) }});
+            return;
+        }
+        if (!isBigFile()) {
+            // The parts are read in order, so the checksum is computed on the fly
+            m_hash.addData(bytes);
+        }
+        m_partsInFlight.insert(m_nextPart, bytes);
+        sendPart(m_nextPart);
+        ++m_nextPart;
+    }
+}
+
+void FileUpload::sendPart(quint32 part)
+{
+    UploadRpcLayer *layer = m_api->mediaLayer(m_dcId);
+    const QByteArray bytes = m_partsInFlight.value(part);
+    UploadRpcLayer::PendingBool *rpcOperation = nullptr;
+    if (isBigFile()) {
+        rpcOperation = layer->saveBigFilePart(m_fileId, part, m_partsCount, bytes);
+    } else {
+        rpcOperation = layer->saveFilePart(m_fileId, part, bytes);
+    }
+    rpcOperation->connectToFinished(this, &FileUpload::onPartSent, part, rpcOperation);
+}
+
+void FileUpload::onPartSent(quint32 part, UploadRpcLayer::PendingBool *rpcOperation)
+{
+    // The operation holds the part data
+    rpcOperation->deleteLater();
+    if (m_finished) {
+        return;
+    }
+
+    TLBool saved = false;
+    if (rpcOperation->isSucceeded()) {
+        rpcOperation->getResult(&saved);
+    }
+    if (!saved) {
+        const int attempts = ++m_partAttempts[part];
+        qCWarning(c_filesApiLoggingCategory) << __func__ << "part" << part << "is not saved, attempt" << attempts
+                                             << rpcOperation->errorDetails();
+        if (attempts >= c_maxPartAttempts) {
+            if (rpcOperation->isFailed()) {
+                finish(rpcOperation->errorDetails());
+            } else {
+                finish({{ PendingOperation::c_text(), QStringLiteral("The server has not saved the file part") }});
+            }
+            return;
+        }
+        sendPart(part);
+        return;
+    }
+
+    m_partAttempts.remove(part);
+    FileOperationPrivate *priv = FileOperationPrivate::get(m_operation);
+    priv->m_bytesTransferred += static_cast<quint32>(m_partsInFlight.take(part).size());
+    emit m_operation->progressChanged(priv->m_bytesTransferred, priv->m_totalBytes);
+
+    ++m_savedParts;
+    if (m_savedParts < m_partsCount) {
+        sendParts();
+        return;
+    }
+
+    TLInputFile inputFile;
+    inputFile.tlType = isBigFile() ? TLValue::InputFileBig : TLValue::InputFile;
+    inputFile.id = m_fileId;
+    inputFile.parts = m_partsCount;
+    inputFile.name = m_fileName;
+    if (!isBigFile()) {
+        inputFile.md5Checksum = QString::fromLatin1(m_hash.result().toHex());
+    }
+    RemoteFile::Private *filePrivate = RemoteFile::Private::get(&priv->m_file);
+    filePrivate->setInputFile(&inputFile);
+    filePrivate->m_size = m_size;
+    finish(QVariantHash());
+}
+
+void FileUpload::finish(const QVariantHash &errorDetails)
+{
+    m_finished = true;
+    m_partsInFlight.clear();
+    if (m_input->parent() == m_operation) {
+        // The device is opened by the API
+        m_input->close();
+    }
+    if (errorDetails.isEmpty()) {
+        m_operation->setDelayedFinished();
+    } else {
+        m_operation->setDelayedFinishedWithError(errorDetails);
+    }
+    deleteLater();
+}
+
+FilesApiPrivate::FilesApiPrivate(FilesApi *parent) :
+    ClientApiPrivate(parent)
+{
+}
+
+FilesApiPrivate *FilesApiPrivate::get(FilesApi *parent)
+{
+    return static_cast<FilesApiPrivate*>(parent->d);
+}
+
+FileOperation *FilesApiPrivate::downloadFile(const RemoteFile &file, QIODevice *output, quint32 firstPart, bool ownsOutput)
+{
+    FileOperation *operation = new FileOperation(this);
+    if (ownsOutput) {
+        output->setParent(operation);
+    }
+    if (!file.isValid() || (file.type() != RemoteFile::Download)) {
+        operation->setDelayedFinishedWithError({{ PendingOperation::c_text(), QStringLiteral("Invalid file location") }});
+        return operation;
+    }
+    if (!output || !output->isWritable()) {
+        operation->setDelayedFinishedWithError({{ PendingOperation::c_text(), QStringLiteral("Output device is not writable") }});
+        return operation;
+    }
+
+    FileOperationPrivate *priv = FileOperationPrivate::get(operation);
+    priv->m_file = file;
+    priv->m_device = output;
+    priv->m_nextPart = firstPart;
+    priv->m_bytesTransferred = firstPart * FileDownload::c_partSize;
+
+    const QString uniqueId = file.getUniqueId();
+    FileDownload *download = m_downloads.value(uniqueId);
+    if (!download) {
+        download = new FileDownload(this, file);
+        m_downloads.insert(uniqueId, download);
+    }
+    download->addOperation(operation);
+    return operation;
+}
+
+void FilesApiPrivate::onDownloadFinished(FileDownload *download)
+{
+    const QString uniqueId = download->file().getUniqueId();
+    if (m_downloads.value(uniqueId) == download) {
+        m_downloads.remove(uniqueId);
+    }
+    download->deleteLater();
+}
+
+FileOperation *FilesApiPrivate::uploadFile(QIODevice *input, const QString &fileName, bool ownsInput)
+{
+    FileOperation *operation = new FileOperation(this);
+    if (ownsInput) {
+        input->setParent(operation);
+    }
+    if (!input || !input->isReadable()) {
+        operation->setDelayedFinishedWithError({{ PendingOperation::c_text(), QStringLiteral("Input device is not readable") }});
+        return operation;
+    }
+    if (input->isSequential()) {
+        // The size is needed to choose the upload method and the part size
+        operation->setDelayedFinishedWithError({{ PendingOperation::c_text(), QStringLiteral("Sequential devices are not supported") }});
+        return operation;
+    }
+
+    FileOperationPrivate *priv = FileOperationPrivate::get(operation);
+    priv->m_device = input;
+
+    FileUpload *upload = new FileUpload(this, operation, fileName);
+    upload->start();
+    return operation;
+}
+
+/*
+    Returns the layer to send the file requests via the media connections to the DC.
+    The requests wait for a media connection to be signed if the pool is cold.
+    The requests go to the default routing of bulk operations if the DC is the
+    main one or the client is not connected yet.
+*/
+UploadRpcLayer *FilesApiPrivate::mediaLayer(quint32 dcId)
+{
+    ConnectionPool *pool = nullptr;
+    if (dcId) {
+        pool = m_backend->getConnectionPool(ConnectionSpec(dcId, ConnectionSpec::RequestFlag::MediaOnly));
+    }
+    if (!pool) {
+        return m_backend->uploadLayer();
+    }
+
+    UploadRpcLayer *layer = m_mediaLayers.value(pool);
+    if (!layer) {
+        layer = new UploadRpcLayer(this);
+        QPointer<ConnectionPool> poolPointer = pool;
+        layer->setRpcProcessingMethod([poolPointer](PendingRpcOperation *operation) {
+            if (!poolPointer) {
+                operation->setDelayedFinishedWithError({{ PendingOperation::c_text(), QStringLiteral("connection lost") }});
+                return;
+            }
+            if (operation->priority() == PendingRpcOperation::Priority::Default) {
+                operation->setPriority(PendingRpcOperation::Priority::Bulk);
+            }
+            poolPointer->schedule(operation);
+        });
+        m_mediaLayers.insert(pool, layer);
+        connect(pool, &QObject::destroyed, this, [this, pool]() {
+            UploadRpcLayer *poolLayer = m_mediaLayers.take(pool);
+            if (poolLayer) {
+                poolLayer->deleteLater();
+            }
+        });
+    }
+    return layer;
+}
+
+/*!
+    \class Telegram::Client::FilesApi
+    \brief Provides an API to download and upload files
+    \inmodule TelegramQt
+    \ingroup Client
+
+    The parts of a file are transferred concurrently within the download
+    and upload windows.
+*/
+FilesApi::FilesApi(QObject *parent) :
+    ClientApi(parent)
+{
+    d = new FilesApiPrivate(this);
+}
+
+int FilesApi::downloadWindow() const
+{
+    Q_D(const FilesApi);
+    return d->m_downloadWindow;
+}
+
+void FilesApi::setDownloadWindow(int window)
+{
+    Q_D(FilesApi);
+    d->m_downloadWindow = qMax(1, window);
+}
+
+int FilesApi::uploadWindow() const
+{
+    Q_D(const FilesApi);
+    return d->m_uploadWindow;
+}
+
+void FilesApi::setUploadWindow(int window)
+{
+    Q_D(FilesApi);
+    d->m_uploadWindow = qMax(1, window);
+}
+
+/*!
+    Uploads the content of the \a input device as a file named \a fileName.
+
+    The device is read in parts as the window of parts in flight advances.
+    The file() of the succeeded operation is the uploaded file.
+*/
+FileOperation *FilesApi::uploadFile(QIODevice *input, const QString &fileName)
+{
+    Q_D(FilesApi);
+    return d->uploadFile(input, fileName);
+}
+
+/*!
+    Uploads the file \a filePath.
+*/
+FileOperation *FilesApi::uploadFile(const QString &filePath)
+{
+    Q_D(FilesApi);
+    QFile *input = new QFile(filePath);
+    if (!input->open(QIODevice::ReadOnly)) {
+        const QString errorString = input->errorString();
+        delete input;
+        return PendingOperation::failOperation<FileOperation>(errorString, d);
+    }
+    return d->uploadFile(input, QFileInfo(filePath).fileName(), true);
+}
+
+/*!
+    Downloads the \a file to the \a output device.
+
+    If the file is already being downloaded, the received parts are shared
+    between the operations.
+*/
+FileOperation *FilesApi::downloadFile(const RemoteFile &file, QIODevice *output)
+{
+    Q_D(FilesApi);
+    return d->downloadFile(file, output, 0);
+}
+
+/*!
+    Downloads the \a file to the file \a fileName.
+
+    If the file already exists, the download continues from its size.
+*/
+FileOperation *FilesApi::downloadFile(const RemoteFile &file, const QString &fileName)
+{
+    Q_D(FilesApi);
+    QFile *output = new QFile(fileName);
+    if (!output->open(QIODevice::ReadWrite)) {
+        const QString errorString = output->errorString();
+        delete output;
+        return PendingOperation::failOperation<FileOperation>(errorString, d);
+    }
+    const quint32 firstPart = static_cast<quint32>(output->size() / FileDownload::c_partSize);
+    output->resize(static_cast<qint64>(firstPart) * FileDownload::c_partSize);
+    return d->downloadFile(file, output, firstPart, true);
+}
+
+} // Client namespace
+
+} // Telegram namespace
@@ -0,0 +1,138 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAMQT_CLIENT_FILES_API_PRIVATE_HPP
+#define TELEGRAMQT_CLIENT_FILES_API_PRIVATE_HPP
+
+#include "ClientApi_p.hpp"
+#include "FilesApi.hpp"
+
+#include "RpcLayers/ClientRpcUploadLayer.hpp"
+
+#include <QCryptographicHash>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+
+namespace Telegram {
+
+namespace Client {
+
+class ConnectionPool;
+class FileOperation;
+class FilesApiPrivate;
+
+// Fetches the parts of one file location for all operations requesting it
+class FileDownload : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FileDownload(FilesApiPrivate *api, const RemoteFile &file);
+
+    RemoteFile file() const { return m_file; }
+    void addOperation(FileOperation *operation);
+
+    static constexpr quint32 c_partSize = 128 * 1024;
+    static constexpr int c_maxPartRetries = 3;
+
+protected:
+    void requestParts();
+    void onPartReceived(quint32 part, UploadRpcLayer::PendingUploadFile *rpcOperation);
+    void process();
+    bool writeParts(FileOperation *operation);
+    void finishOperation(FileOperation *operation, const QVariantHash &errorDetails);
+    void failOperations(const QVariantHash &details);
+
+    FilesApiPrivate *m_api = nullptr;
+    RemoteFile m_file;
+    TLInputFileLocation m_location;
+    quint32 m_dcId = 0;
+    quint32 m_size = 0;
+    quint32 m_partsCount = 0;
+    bool m_sizeKnown = false;
+    int m_fullParts = 0;
+    QVector<FileOperation *> m_operations;
+    QHash<quint32, QByteArray> m_parts; // Received parts, which are not written by all operations yet
+    QSet<quint32> m_partsInFlight;
+    QHash<quint32, int> m_partFailures;
+};
+
+// Reads a file in parts and keeps a window of the parts in flight
+class FileUpload : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FileUpload(FilesApiPrivate *api, FileOperation *operation, const QString &fileName);
+
+    void start();
+
+    static constexpr quint32 c_bigFileSize = 10 * 1024 * 1024;
+    static constexpr quint32 c_partSize = 128 * 1024;
+    static constexpr quint32 c_bigFilePartSize = 512 * 1024;
+    static constexpr int c_maxPartAttempts = 3;
+
+protected:
+    bool isBigFile() const { return m_size > c_bigFileSize; }
+    void sendParts();
+    void sendPart(quint32 part);
+    void onPartSent(quint32 part, UploadRpcLayer::PendingBool *rpcOperation);
+    void finish(const QVariantHash &errorDetails);
+
+    FilesApiPrivate *m_api = nullptr;
+    FileOperation *m_operation = nullptr;
+    QIODevice *m_input = nullptr;
+    QString m_fileName;
+    QCryptographicHash m_hash;
+    quint64 m_fileId = 0;
+    quint32 m_dcId = 0;
+    quint32 m_size = 0;
+    quint32 m_partSize = 0;
+    quint32 m_partsCount = 0;
+    quint32 m_nextPart = 0;
+    quint32 m_savedParts = 0;
+    bool m_finished = false;
+    QHash<quint32, QByteArray> m_partsInFlight; // Kept until the server saves the part
+    QHash<quint32, int> m_partAttempts;
+};
+
+class FilesApiPrivate : public ClientApiPrivate
+{
+    Q_OBJECT
+    Q_DECLARE_PUBLIC(FilesApi)
+public:
+    explicit FilesApiPrivate(FilesApi *parent = nullptr);
+    static FilesApiPrivate *get(FilesApi *parent);
+
+    // The owned device is opened by the API; it is closed on finish and deleted along with the operation
+    FileOperation *downloadFile(const RemoteFile &file, QIODevice *output, quint32 firstPart, bool ownsOutput = false);
+    void onDownloadFinished(FileDownload *download);
+
+    FileOperation *uploadFile(QIODevice *input, const QString &fileName, bool ownsInput = false);
+
+    UploadRpcLayer *mediaLayer(quint32 dcId);
+
+    int m_downloadWindow = 8;
+    int m_uploadWindow = 8;
+    QHash<QString, FileDownload *> m_downloads; // File unique id to the download
+    QHash<ConnectionPool *, UploadRpcLayer *> m_mediaLayers;
+};
+
+} // Client namespace
+
+} // Telegram namespace
+
+#endif // TELEGRAMQT_CLIENT_FILES_API_PRIVATE_HPP
@@ -0,0 +1,129 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include "LocalSocketTransport.hpp"
+
+#include <QLoggingCategory>
+
+Q_LOGGING_CATEGORY(c_loggingLocalSocketTransport, "telegram.transport.localsocket", QtWarningMsg)
+
+namespace Telegram {
+
+BaseLocalSocketTransport::BaseLocalSocketTransport(QObject *parent) :
+    BaseTransport(parent)
+{
+}
+
+BaseLocalSocketTransport::~BaseLocalSocketTransport()
+{
+    if (m_socket && m_socket->isOpen() && (m_socket->state() != QLocalSocket::UnconnectedState)) {
+        m_socket->waitForBytesWritten(100);
+        qCDebug(c_loggingLocalSocketTransport) << this << __func__ << "close socket" << m_socket;
+        m_socket->disconnectFromServer();
+    }
+}
+
+QString BaseLocalSocketTransport::remoteAddress() const
+{
+    return m_socket ? m_socket->fullServerName() : QString();
+}
+
+void BaseLocalSocketTransport::disconnectFromHost()
+{
+    qCDebug(c_loggingLocalSocketTransport) << this << __func__;
+    if (m_socket) {
+        m_socket->disconnectFromServer();
+    }
+    m_readBuffer.clear();
+    m_framing.reset();
+    m_sessionStarted = false;
+}
+
+void BaseLocalSocketTransport::setState(QAbstractSocket::SocketState newState)
+{
+    qCDebug(c_loggingLocalSocketTransport) << this << __func__ << newState;
+    if (newState == QAbstractSocket::ConnectedState) {
+        m_framing.reset();
+        m_sessionStarted = false;
+    }
+    BaseTransport::setState(newState);
+}
+
+void BaseLocalSocketTransport::onReadyRead()
+{
+    readEvent();
+    if (!m_sessionStarted) {
+        qCCritical(c_loggingLocalSocketTransport) << this << "The session is not started!";
+        return;
+    }
+    m_readBuffer.append(m_socket->readAll());
+
+    QByteArray payload;
+    while (true) {
+        switch (m_framing.takePacket(&m_readBuffer, &payload)) {
+        case PacketFraming::ReadStatus::Packet:
+            emit packetReceived(payload);
+            break;
+        case PacketFraming::ReadStatus::Incomplete:
+            return;
+        case PacketFraming::ReadStatus::Invalid:
+            qCWarning(c_loggingLocalSocketTransport) << this << __func__ << "Invalid packet size byte"
+                                                     << hex << showbase << quint8(m_readBuffer.at(0));
+            setError(QAbstractSocket::UnknownSocketError, QStringLiteral("Invalid read operation"));
+            disconnectFromHost();
+            return;
+        }
+    }
+}
+
+void BaseLocalSocketTransport::onSocketStateChanged(QLocalSocket::LocalSocketState state)
+{
+    // The local socket states have the same values as the corresponding QAbstractSocket states
+    setState(static_cast<QAbstractSocket::SocketState>(state));
+}
+
+void BaseLocalSocketTransport::onSocketErrorOccurred(QLocalSocket::LocalSocketError error)
+{
+    // The local socket errors have the same values as the corresponding QAbstractSocket errors
+    setError(static_cast<QAbstractSocket::SocketError>(error), m_socket->errorString());
+}
+
+void BaseLocalSocketTransport::setSocket(QLocalSocket *socket)
+{
+    if (m_socket) {
+        qCCritical(c_loggingLocalSocketTransport) << this << __func__ << "An attempt to set a socket twice";
+    }
+    m_socket = socket;
+    connect(m_socket, &QLocalSocket::stateChanged, this, &BaseLocalSocketTransport::onSocketStateChanged);
+    connect(m_socket, SIGNAL(error(QLocalSocket::LocalSocketError)),
+            SLOT(onSocketErrorOccurred(QLocalSocket::LocalSocketError)));
+    connect(m_socket, &QIODevice::readyRead, this, &BaseLocalSocketTransport::onReadyRead);
+}
+
+void BaseLocalSocketTransport::sendPacketImplementation(const QByteArray &payload)
+{
+    if (payload.length() % 4) {
+        qCCritical(c_loggingLocalSocketTransport) << this << __func__
+                                                  << "Invalid outgoing packet! "
+                                                     "The payload size is not divisible by four!";
+    }
+    QByteArray packet;
+    m_framing.appendPacket(&packet, payload);
+    m_socket->write(packet);
+}
+
+} // Telegram namespace
@@ -0,0 +1,59 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAM_LOCAL_SOCKET_TRANSPORT_HPP
+#define TELEGRAM_LOCAL_SOCKET_TRANSPORT_HPP
+
+#include "CTelegramTransport.hpp"
+#include "PacketFraming.hpp"
+
+#include <QLocalSocket>
+
+namespace Telegram {
+
+// The transport over a local socket (a Unix domain socket or a Windows named pipe) for the clients
+// running on the same host as the server. The packets are framed as in the Abridged TCP session.
+class TELEGRAMQT_INTERNAL_EXPORT BaseLocalSocketTransport : public BaseTransport
+{
+    Q_OBJECT
+public:
+    explicit BaseLocalSocketTransport(QObject *parent = nullptr);
+    ~BaseLocalSocketTransport() override;
+
+    QString remoteAddress() const override;
+
+    void disconnectFromHost() override;
+
+protected slots:
+    void setState(QAbstractSocket::SocketState newState) override;
+    void onReadyRead();
+    void onSocketStateChanged(QLocalSocket::LocalSocketState state);
+    void onSocketErrorOccurred(QLocalSocket::LocalSocketError error);
+
+protected:
+    void setSocket(QLocalSocket *socket);
+    void sendPacketImplementation(const QByteArray &payload) override;
+
+    QLocalSocket *m_socket = nullptr;
+    QByteArray m_readBuffer;
+    PacketFraming m_framing;
+    bool m_sessionStarted = false; // The abridged session marker is sent (client) or received (server)
+};
+
+} // Telegram namespace
+
+#endif // TELEGRAM_LOCAL_SOCKET_TRANSPORT_HPP
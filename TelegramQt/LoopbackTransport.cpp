@@ -0,0 +1,370 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include "LoopbackTransport.hpp"
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QMutexLocker>
+#include <QThread>
+#include <QTimer>
+
+Q_LOGGING_CATEGORY(c_loggingLoopbackTransport, "telegram.transport.loopback", QtWarningMsg)
+
+namespace Telegram {
+
+// The unbounded lock-free queue for a single producer thread and a single consumer thread.
+// The consumer keeps the last taken node as a stub, so the threads never touch the same node.
+template <typename T>
+class SpscQueue
+{
+public:
+    SpscQueue() :
+        m_head(new Node()),
+        m_tail(m_head)
+    {
+    }
+
+    ~SpscQueue()
+    {
+        while (m_head) {
+            Node *next = m_head->next.loadAcquire();
+            delete m_head;
+            m_head = next;
+        }
+    }
+
+    // Called only from the producer thread
+    void enqueue(const T &value)
+    {
+        Node *node = new Node();
+        node->value = value;
+        m_tail->next.storeRelease(node);
+        m_tail = node;
+    }
+
+    // Called only from the consumer thread
+    bool dequeue(T *output)
+    {
+        Node *next = m_head->next.loadAcquire();
+        if (!next) {
+            return false;
+        }
+        *output = std::move(next->value);
+        next->value = T();
+        delete m_head;
+        m_head = next;
+        return true;
+    }
+
+private:
+    Q_DISABLE_COPY(SpscQueue)
+
+    struct Node
+    {
+        QAtomicPointer<Node> next;
+        T value;
+    };
+
+    Node *m_head; // Consumer side
+    Node *m_tail; // Producer side
+};
+
+class LoopbackChannel
+{
+public:
+    SpscQueue<QByteArray> inbox[2]; // The packets to be received by the side
+    QAtomicInt wakeupPending[2]; // The receive call is posted to the side
+    QMutex mutex; // Guards the endpoints
+    LoopbackTransport *endpoints[2] = { nullptr, nullptr };
+};
+
+struct LoopbackRegistry
+{
+    QMutex mutex;
+    QHash<QString, LoopbackServer *> servers;
+};
+
+static LoopbackRegistry *loopbackRegistry()
+{
+    static LoopbackRegistry registry;
+    return &registry;
+}
+
+LoopbackTransport::LoopbackTransport(QObject *parent) :
+    BaseTransport(parent),
+    m_delayTimer(new QTimer(this))
+{
+    m_delayTimer->setSingleShot(true);
+    m_delayTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_delayTimer, &QTimer::timeout, this, &LoopbackTransport::sendDelayedPackets);
+    m_clock.start();
+}
+
+LoopbackTransport::~LoopbackTransport()
+{
+    if (m_channel) {
+        closeChannel();
+    }
+}
+
+void LoopbackTransport::connectToHost(const QString &serverName, quint16 port)
+{
+    Q_UNUSED(port)
+    if (m_channel) {
+        qCWarning(c_loggingLoopbackTransport) << this << __func__ << "The transport is already connected";
+        return;
+    }
+    m_serverName = serverName;
+    setState(QAbstractSocket::ConnectingState);
+
+    const QSharedPointer<LoopbackChannel> channel(new LoopbackChannel());
+    LoopbackTransport *serverTransport = new LoopbackTransport();
+    serverTransport->m_serverName = serverName;
+    serverTransport->setChannel(channel, ServerSide);
+    serverTransport->setState(QAbstractSocket::ConnectedState);
+    setChannel(channel, ClientSide);
+
+    bool accepted = false;
+    {
+        LoopbackRegistry *registry = loopbackRegistry();
+        QMutexLocker locker(&registry->mutex);
+        LoopbackServer *server = registry->servers.value(serverName);
+        if (server) {
+            serverTransport->moveToThread(server->thread());
+            server->addPendingConnection(serverTransport);
+            accepted = true;
+        }
+    }
+    if (!accepted) {
+        qCDebug(c_loggingLoopbackTransport) << this << __func__ << "There is no server" << serverName;
+        delete serverTransport;
+        m_channel.reset();
+        setError(QAbstractSocket::HostNotFoundError, QStringLiteral("Loopback server not found"));
+        setState(QAbstractSocket::UnconnectedState);
+        return;
+    }
+    // Finish the connection asynchronously as a socket does
+    QMetaObject::invokeMethod(this, "onPeerConnected", Qt::QueuedConnection);
+}
+
+void LoopbackTransport::disconnectFromHost()
+{
+    qCDebug(c_loggingLoopbackTransport) << this << __func__;
+    if (!m_channel) {
+        return;
+    }
+    closeChannel();
+    setState(QAbstractSocket::UnconnectedState);
+}
+
+QString LoopbackTransport::remoteAddress() const
+{
+    return m_serverName;
+}
+
+void LoopbackTransport::setImpairments(const LoopbackImpairments &impairments)
+{
+    m_impairments = impairments;
+    m_lossGenerator.seed(impairments.seed);
+}
+
+void LoopbackTransport::receivePackets()
+{
+    if (!m_channel) {
+        return;
+    }
+    // Reset the flag before the dequeue, so a packet enqueued after this point posts a new call
+    m_channel->wakeupPending[m_side].storeRelease(0);
+    QByteArray payload;
+    // A packet handler may close the transport
+    while (m_channel && m_channel->inbox[m_side].dequeue(&payload)) {
+        emit packetReceived(payload);
+    }
+}
+
+void LoopbackTransport::sendDelayedPackets()
+{
+    const qint64 now = m_clock.nsecsElapsed() / 1000;
+    while (!m_delayedPackets.isEmpty() && (m_delayedPackets.head().dueTime <= now)) {
+        deliver(m_delayedPackets.dequeue().payload);
+    }
+    if (!m_delayedPackets.isEmpty()) {
+        const qint64 delay = (m_delayedPackets.head().dueTime - now + 999) / 1000;
+        m_delayTimer->start(static_cast<int>(delay));
+    }
+}
+
+void LoopbackTransport::onPeerConnected()
+{
+    if (m_channel && (state() == QAbstractSocket::ConnectingState)) {
+        setState(QAbstractSocket::ConnectedState);
+    }
+}
+
+void LoopbackTransport::onPeerDisconnected()
+{
+    if (!m_channel) {
+        return;
+    }
+    // Receive the packets sent before the disconnection
+    receivePackets();
+    if (!m_channel) {
+        return;
+    }
+    closeChannel();
+    setError(QAbstractSocket::RemoteHostClosedError, QStringLiteral("The remote host closed the connection"));
+    setState(QAbstractSocket::UnconnectedState);
+}
+
+void LoopbackTransport::sendPacketImplementation(const QByteArray &payload)
+{
+    if (!m_channel) {
+        qCWarning(c_loggingLoopbackTransport) << this << __func__ << "The transport is not connected";
+        return;
+    }
+    if (m_impairments.isEmpty()) {
+        deliver(payload);
+        return;
+    }
+    if (m_impairments.lossRate > 0) {
+        std::uniform_real_distribution<qreal> distribution(0, 1);
+        if (distribution(m_lossGenerator) < m_impairments.lossRate) {
+            ++m_droppedPackets;
+            return;
+        }
+    }
+    // The packets leave one by one at the bandwidth rate and arrive after the latency
+    const qint64 now = m_clock.nsecsElapsed() / 1000;
+    qint64 departureTime = qMax(now, m_linkBusyUntil);
+    if (m_impairments.bandwidth) {
+        departureTime += qint64(payload.size()) * 1000000 / m_impairments.bandwidth;
+    }
+    m_linkBusyUntil = departureTime;
+    m_delayedPackets.enqueue({ departureTime + m_impairments.latency * 1000, payload });
+    if (!m_delayTimer->isActive()) {
+        sendDelayedPackets();
+    }
+}
+
+void LoopbackTransport::setChannel(const QSharedPointer<LoopbackChannel> &channel, Side side)
+{
+    m_channel = channel;
+    m_side = side;
+    QMutexLocker locker(&m_channel->mutex);
+    m_channel->endpoints[m_side] = this;
+}
+
+void LoopbackTransport::deliver(const QByteArray &payload)
+{
+    if (!m_channel) {
+        return;
+    }
+    const int peerSide = m_side == ClientSide ? ServerSide : ClientSide;
+    m_channel->inbox[peerSide].enqueue(payload);
+    if (m_channel->wakeupPending[peerSide].fetchAndStoreOrdered(1)) {
+        // The peer is going to receive the packets anyway
+        return;
+    }
+    // The packets are received from the event loop of the peer even in the same thread,
+    // because the RPC layers do not expect a reply within the send call.
+    QMutexLocker locker(&m_channel->mutex);
+    if (LoopbackTransport *peer = m_channel->endpoints[peerSide]) {
+        QMetaObject::invokeMethod(peer, "receivePackets", Qt::QueuedConnection);
+    }
+}
+
+void LoopbackTransport::closeChannel()
+{
+    m_delayTimer->stop();
+    m_delayedPackets.clear();
+    m_linkBusyUntil = 0;
+    {
+        const int peerSide = m_side == ClientSide ? ServerSide : ClientSide;
+        QMutexLocker locker(&m_channel->mutex);
+        m_channel->endpoints[m_side] = nullptr;
+        if (LoopbackTransport *peer = m_channel->endpoints[peerSide]) {
+            QMetaObject::invokeMethod(peer, "onPeerDisconnected", Qt::QueuedConnection);
+        }
+    }
+    m_channel.reset();
+}
+
+LoopbackServer::LoopbackServer(QObject *parent) :
+    QObject(parent)
+{
+}
+
+LoopbackServer::~LoopbackServer()
+{
+    close();
+}
+
+bool LoopbackServer::listen(const QString &name)
+{
+    if (isListening()) {
+        qCWarning(c_loggingLoopbackTransport) << this << __func__ << "The server is already listening" << m_serverName;
+        return false;
+    }
+    if (name.isEmpty()) {
+        return false;
+    }
+    LoopbackRegistry *registry = loopbackRegistry();
+    QMutexLocker locker(&registry->mutex);
+    if (registry->servers.contains(name)) {
+        qCWarning(c_loggingLoopbackTransport) << this << __func__ << "The name is already in use" << name;
+        return false;
+    }
+    registry->servers.insert(name, this);
+    m_serverName = name;
+    return true;
+}
+
+void LoopbackServer::close()
+{
+    if (isListening()) {
+        LoopbackRegistry *registry = loopbackRegistry();
+        QMutexLocker locker(&registry->mutex);
+        registry->servers.remove(m_serverName);
+        m_serverName.clear();
+    }
+    QMutexLocker locker(&m_pendingMutex);
+    qDeleteAll(m_pendingConnections);
+    m_pendingConnections.clear();
+}
+
+LoopbackTransport *LoopbackServer::nextPendingConnection()
+{
+    QMutexLocker locker(&m_pendingMutex);
+    if (m_pendingConnections.isEmpty()) {
+        return nullptr;
+    }
+    return m_pendingConnections.dequeue();
+}
+
+void LoopbackServer::addPendingConnection(LoopbackTransport *transport)
+{
+    {
+        QMutexLocker locker(&m_pendingMutex);
+        m_pendingConnections.enqueue(transport);
+    }
+    QMetaObject::invokeMethod(this, "newConnection", Qt::QueuedConnection);
+}
+
+} // Telegram namespace
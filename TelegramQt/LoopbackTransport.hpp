@@ -0,0 +1,137 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAM_LOOPBACK_TRANSPORT_HPP
+#define TELEGRAM_LOOPBACK_TRANSPORT_HPP
+
+#include "CTelegramTransport.hpp"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QQueue>
+#include <QSharedPointer>
+
+#include <random>
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+namespace Telegram {
+
+class LoopbackChannel;
+class LoopbackServer;
+
+// The network conditions simulated on the sending side of a LoopbackTransport
+struct LoopbackImpairments
+{
+    bool isEmpty() const { return !latency && !bandwidth && !(lossRate > 0); }
+
+    int latency = 0; // One-way delay in msecs
+    qint64 bandwidth = 0; // Bytes per second; zero means unlimited
+    qreal lossRate = 0; // The probability to drop an outgoing packet
+    quint32 seed = 1; // The seed of the loss generator, so the drops are reproducible
+};
+
+// Passes the packets to the peer transport in the same process without sockets and framing.
+// The payloads are shared, not copied. The transports of a pair may live in different threads.
+class TELEGRAMQT_INTERNAL_EXPORT LoopbackTransport : public BaseTransport
+{
+    Q_OBJECT
+public:
+    explicit LoopbackTransport(QObject *parent = nullptr);
+    ~LoopbackTransport() override;
+
+    // Connects to the LoopbackServer listening on the serverName; the port is ignored
+    void connectToHost(const QString &serverName, quint16 port) override;
+    void disconnectFromHost() override;
+
+    QString remoteAddress() const override;
+
+    LoopbackImpairments impairments() const { return m_impairments; }
+    void setImpairments(const LoopbackImpairments &impairments);
+
+    quint64 droppedPackets() const { return m_droppedPackets; }
+
+protected slots:
+    void receivePackets();
+    void sendDelayedPackets();
+    void onPeerConnected();
+    void onPeerDisconnected();
+
+protected:
+    friend class LoopbackServer;
+
+    enum Side {
+        ClientSide,
+        ServerSide,
+    };
+
+    struct DelayedPacket
+    {
+        qint64 dueTime; // usecs of m_clock
+        QByteArray payload;
+    };
+
+    void sendPacketImplementation(const QByteArray &payload) override;
+    void setChannel(const QSharedPointer<LoopbackChannel> &channel, Side side);
+    void deliver(const QByteArray &payload);
+    void closeChannel();
+
+    QSharedPointer<LoopbackChannel> m_channel;
+    Side m_side = ClientSide;
+    QString m_serverName;
+    LoopbackImpairments m_impairments;
+    std::minstd_rand m_lossGenerator;
+    QElapsedTimer m_clock;
+    QQueue<DelayedPacket> m_delayedPackets;
+    QTimer *m_delayTimer = nullptr;
+    qint64 m_linkBusyUntil = 0; // usecs of m_clock
+    quint64 m_droppedPackets = 0;
+};
+
+// Accepts the LoopbackTransport connections to the name unique within the process
+class TELEGRAMQT_INTERNAL_EXPORT LoopbackServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LoopbackServer(QObject *parent = nullptr);
+    ~LoopbackServer() override;
+
+    bool listen(const QString &name);
+    void close();
+    bool isListening() const { return !m_serverName.isEmpty(); }
+    QString serverName() const { return m_serverName; }
+
+    // Returns the next accepted transport (living in the server thread) or nullptr
+    LoopbackTransport *nextPendingConnection();
+
+signals:
+    void newConnection();
+
+protected:
+    friend class LoopbackTransport;
+
+    // Called from the thread of the connecting transport
+    void addPendingConnection(LoopbackTransport *transport);
+
+    QString m_serverName;
+    QMutex m_pendingMutex;
+    QQueue<LoopbackTransport *> m_pendingConnections;
+};
+
+} // Telegram namespace
+
+#endif // TELEGRAM_LOOPBACK_TRANSPORT_HPP
@@ -14,6 +14,9 @@
 #include "Operations/ClientMessagesOperation_p.hpp"
 
 #include <QLoggingCategory>
+#include <QTimer>
+
+Q_LOGGING_CATEGORY(c_messagingApiLoggingCategory, "telegram.client.api.messaging", QtWarningMsg)
 
 namespace Telegram {
 
@@ -107,12 +110,20 @@ void MessagingApiPrivate::onSentMessageIdResolved(quint64 randomMessageId, quint
 
 void MessagingApiPrivate::onMessageReceived(const TLMessage &message)
 {
-    Q_Q(MessagingApi);
     const Telegram::Peer peer = Telegram::Utils::getMessageDialogPeer(message, m_backend->dataStorage()->selfUserId());
+    onMessagesReceived(peer, { message.id });
+}
+
+void MessagingApiPrivate::onMessagesReceived(const Peer peer, const QVector<quint32> &messageIds)
+{
+    Q_Q(MessagingApi);
     if (m_dialogList) {
         m_dialogList->ensurePeer(peer);
     }
-    emit q->messageReceived(peer, message.id);
+    for (const quint32 messageId : messageIds) {
+        emit q->messageReceived(peer, messageId);
+    }
+    emit q->messagesReceived(peer, messageIds);
 }
 
 void MessagingApiPrivate::onMessageInboxRead(const Telegram::Peer peer, quint32 messageId)
@@ -121,12 +132,39 @@ void MessagingApiPrivate::onMessageInboxRead(const Telegram::Peer peer, quint32
     emit q->messageReadInbox(peer, messageId);
 }
 
+void MessagingApiPrivate::onMessageRequired(const Peer peer, quint32 messageId)
+{
+    if (m_requiredMessages.isEmpty()) {
+        // Collect the messages requested within this event loop iteration into a single request
+        QTimer::singleShot(0, this, &MessagingApiPrivate::fetchRequiredMessages);
+    }
+    const Peer boxPeer = peer.type == Peer::Channel ? peer : Peer();
+    m_requiredMessages[boxPeer].append(messageId);
+}
+
 void MessagingApiPrivate::onMessageOutboxRead(const Telegram::Peer peer, quint32 messageId)
 {
     Q_Q(MessagingApi);
     emit q->messageReadOutbox(peer, messageId);
 }
 
+void MessagingApiPrivate::onHistoryOutdated()
+{
+    Q_Q(MessagingApi);
+    // Refetch the dialogs to get the actual top messages and unread counters
+    PendingOperation *operation = getDialogs();
+    operation->deleteOnFinished();
+    connect(operation, &PendingOperation::succeeded, this, [this]() {
+        if (!m_dialogList) {
+            return;
+        }
+        for (const Peer &peer : dataStorage()->dialogs()) {
+            m_dialogList->ensurePeer(peer);
+        }
+    });
+    emit q->historyOutdated();
+}
+
 PendingOperation *MessagingApiPrivate::getDialogs()
 {
     PendingOperation *operation = new PendingOperation("MessagingApi::getDialogs", this);
@@ -145,6 +183,22 @@ MessagesOperation *MessagingApiPrivate::getHistory(const Peer peer, const Telegr
     MessagesOperationPrivate *priv = MessagesOperationPrivate::get(apiOp);
     priv->m_peer = peer;
     priv->m_fetchOptions = options;
+
+    quint32 hash = options.hash;
+    const bool cacheable = options.limit && !options.offsetDate && !options.addOffset
+            && !options.maxId && !options.minId && !options.hash;
+    if (cacheable) {
+        // Answer from the cache and let the server confirm the slice by the hash
+        quint32 cachedHash = 0;
+        const QVector<quint32> cachedMessages = dataInternalApi()->getCachedHistory(peer, options.offsetId,
+                                                                                    options.limit, &cachedHash);
+        if (cachedMessages.count() == static_cast<int>(options.limit)) {
+            priv->m_messages = cachedMessages;
+            hash = cachedHash;
+            apiOp->setDelayedFinished();
+        }
+    }
+
     MessagesRpcLayer::PendingMessagesMessages *rpcOp = messagesLayer()->getHistory(inputPeer,
                                                                                    options.offsetId,
                                                                                    options.offsetDate,
@@ -152,7 +206,7 @@ MessagesOperation *MessagingApiPrivate::getHistory(const Peer peer, const Telegr
                                                                                    options.limit,
                                                                                    options.maxId,
                                                                                    options.minId,
-                                                                                   options.hash);
+                                                                                   hash);
     rpcOp->connectToFinished(this, &MessagingApiPrivate::onGetHistoryFinished, apiOp, rpcOp);
     return apiOp;
 }
@@ -206,6 +260,15 @@ MessagesOperation *MessagingApi::getHistory(const Telegram::Peer peer, const Tel
     return d->getHistory(peer, options);
 }
 
+PendingOperation *MessagingApi::getChatInfo(const Peer peer)
+{
+    Q_D(MessagingApi);
+    if (peer.type == Peer::User) {
+        return PendingOperation::failOperation(QStringLiteral("Invalid peer for getChatInfo()"), this);
+    }
+    return d->backend()->getPeerInfo(peer);
+}
+
 void MessagingApi::setDraftMessage(const Peer peer, const QString &text)
 {
 
@@ -263,18 +326,44 @@ void MessagingApiPrivate::onGetDialogsFinished(PendingOperation *operation, Mess
 
 void MessagingApiPrivate::onGetHistoryFinished(MessagesOperation *operation, MessagesRpcLayer::PendingMessagesMessages *rpcOperation)
 {
+    // The operation is already finished if it is answered from the cache
+    const bool finished = operation->isFinished();
+    if (rpcOperation->isFailed()) {
+        if (!finished) {
+            operation->setFinishedWithError(rpcOperation->errorDetails());
+        }
+        return;
+    }
+
     TLMessagesMessages messages;
     rpcOperation->getResult(&messages);
 
+    if (messages.tlType == TLValue::MessagesMessagesNotModified) {
+        if (!finished) {
+            operation->setFinished();
+        }
+        return;
+    }
+
     MessagesOperationPrivate *priv = MessagesOperationPrivate::get(operation);
 
     dataInternalApi()->processData(messages);
 
-    priv->m_messages.reserve(messages.messages.count());
+    QVector<quint32> messageIds;
+    messageIds.reserve(messages.messages.count());
     for (const TLMessage &m : messages.messages) {
-        priv->m_messages.append(m.id);
+        messageIds.append(m.id);
+    }
+    // The server returns a contiguous slice of the history
+    dataInternalApi()->linkDialogMessages(priv->m_peer, messageIds);
+
+    priv->m_messages = messageIds;
+    if (finished) {
+        // The cached slice is outdated (missing, extra or edited messages)
+        emit operation->messagesRefreshed(operation);
+    } else {
+        operation->setFinished();
     }
-    operation->setFinished();
 }
 
 void MessagingApiPrivate::onReadHistoryFinished(const Peer peer, quint32 messageId, MessagesRpcLayer::PendingMessagesAffectedMessages *rpcOperation)
@@ -286,6 +375,7 @@ void MessagingApiPrivate::onReadHistoryFinished(const Peer peer, quint32 message
 
     TLMessagesAffectedMessages result;
     rpcOperation->getResult(&result);
+    backend()->updatesApi()->processAffectedPts(result.pts, result.ptsCount);
     onHistoryReadSucceeded(peer, messageId);
 }
 
@@ -309,6 +399,62 @@ void MessagingApiPrivate::onHistoryReadSucceeded(const Peer peer, quint32 messag
     emit q->messageReadInbox(peer, messageId);
 }
 
+void MessagingApiPrivate::fetchRequiredMessages()
+{
+    const QHash<Peer, QVector<quint32>> requiredMessages = m_requiredMessages;
+    m_requiredMessages.clear();
+
+    for (auto it = requiredMessages.cbegin(); it != requiredMessages.cend(); ++it) {
+        const Peer boxPeer = it.key();
+        MessagesRpcLayer::PendingMessagesMessages *rpcOperation = nullptr;
+        if (boxPeer.isValid()) {
+            const TLInputChannel inputChannel = dataInternalApi()->toInputChannel(boxPeer.id);
+            rpcOperation = channelsLayer()->getMessages(inputChannel, it.value());
+        } else {
+            rpcOperation = messagesLayer()->getMessages(it.value());
+        }
+        rpcOperation->connectToFinished(this, &MessagingApiPrivate::onFetchMessagesFinished, rpcOperation);
+    }
+}
+
+void MessagingApiPrivate::onFetchMessagesFinished(MessagesRpcLayer::PendingMessagesMessages *rpcOperation)
+{
+    Q_Q(MessagingApi);
+    rpcOperation->deleteLater();
+    if (!rpcOperation->isSucceeded()) {
+        qCWarning(c_messagingApiLoggingCategory) << Q_FUNC_INFO << "Unable to fetch messages"
+                                                 << rpcOperation->errorDetails();
+        return;
+    }
+
+    TLMessagesMessages messages;
+    rpcOperation->getResult(&messages);
+
+    DataInternalApi *dataApi = dataInternalApi();
+    dataApi->processData(messages.users);
+    dataApi->processData(messages.chats);
+
+    QVector<DataInternalApi::DialogMessages> fetchedMessages;
+    QHash<Peer, int> dialogIndices;
+    for (const TLMessage &message : messages.messages) {
+        if (message.tlType == TLValue::MessageEmpty) {
+            continue;
+        }
+        dataApi->processData(message);
+        const Peer dialogPeer = Utils::getMessageDialogPeer(message, dataApi->selfUserId());
+        int index = dialogIndices.value(dialogPeer, -1);
+        if (index < 0) {
+            index = fetchedMessages.count();
+            dialogIndices.insert(dialogPeer, index);
+            fetchedMessages.append({ dialogPeer, { } });
+        }
+        fetchedMessages[index].messageIds.append(message.id);
+    }
+    for (const DataInternalApi::DialogMessages &dialogMessages : fetchedMessages) {
+        emit q->messagesFetched(dialogMessages.peer, dialogMessages.messageIds);
+    }
+}
+
 MessagingApi::SendOptions::SendOptions() :
     m_replyMessageId(0),
     m_clearDraft(true)
@@ -85,6 +85,9 @@ public:
     DialogList *getDialogList();
     MessagesOperation *getHistory(const Telegram::Peer peer, const MessageFetchOptions &options);
 
+    // Fetches the chat or channel info if it is missing in the DataStorage; concurrent requests are batched
+    PendingOperation *getChatInfo(const Telegram::Peer peer);
+
 public slots:
     void setDraftMessage(const Telegram::Peer peer, const QString &text);
 
@@ -96,11 +99,18 @@ public slots:
 
 Q_SIGNALS:
     void messageReceived(const Telegram::Peer peer, quint32 messageId);
+    // Emitted once per dialog for all messages received with a single updates package
+    void messagesReceived(const Telegram::Peer peer, const QVector<quint32> &messageIds);
+    // Emitted when messages evicted from the data storage cache are fetched again
+    void messagesFetched(const Telegram::Peer peer, const QVector<quint32> &messageIds);
     void messageSent(const Telegram::Peer peer, quint64 messageRandomId, quint32 messageId);
     // We read an incoming message(s)
     void messageReadInbox(const Telegram::Peer peer, quint32 messageId);
     // Our outgoing message(s) was read
     void messageReadOutbox(const Telegram::Peer peer, quint32 messageId);
+    // The updates are missed for too long to be received; the cached history may lack messages
+    // and should be requested again. The dialogs are refetched automatically.
+    void historyOutdated();
 
     void messageActionChanged(const Telegram::Peer &peer, quint32 contactId, TelegramNamespace::MessageAction action);
 
@@ -51,8 +51,11 @@ public:
     void onSentMessageIdResolved(quint64 randomMessageId, quint32 messageId);
 
     void onMessageReceived(const TLMessage &message);
+    void onMessagesReceived(const Telegram::Peer peer, const QVector<quint32> &messageIds);
     void onMessageInboxRead(const Telegram::Peer peer, quint32 messageId);
     void onMessageOutboxRead(const Telegram::Peer peer, quint32 messageId);
+    void onMessageRequired(const Telegram::Peer peer, quint32 messageId);
+    void onHistoryOutdated();
 
     PendingOperation *getDialogs();
     MessagesOperation *getHistory(const Telegram::Peer peer, const MessageFetchOptions &options);
@@ -65,6 +68,8 @@ public:
     DialogList *m_dialogList = nullptr;
     MessagesRpcLayer *m_messagesLayer = nullptr;
     quint64 m_expectedRandomMessageId = 0;
+    // Channel peer or an invalid peer for the common message box to the message ids
+    QHash<Telegram::Peer, QVector<quint32>> m_requiredMessages;
 
 protected slots:
     void onGetDialogsFinished(PendingOperation *operation, MessagesRpcLayer::PendingMessagesDialogs *rpcOperation);
@@ -72,6 +77,8 @@ protected slots:
     void onReadHistoryFinished(const Peer peer, quint32 messageId, MessagesRpcLayer::PendingMessagesAffectedMessages *rpcOperation);
     void onReadChannelHistoryFinished(const Peer peer, quint32 messageId, ChannelsRpcLayer::PendingBool *rpcOperation);
     void onHistoryReadSucceeded(const Peer peer, quint32 messageId);
+    void fetchRequiredMessages();
+    void onFetchMessagesFinished(MessagesRpcLayer::PendingMessagesMessages *rpcOperation);
 };
 
 } // Client namespace
@@ -0,0 +1,45 @@
+#include "ClientFileOperation.hpp"
+#include "ClientFileOperation_p.hpp"
+
+namespace Telegram {
+
+namespace Client {
+
+FileOperationPrivate *FileOperationPrivate::get(FileOperation *parent)
+{
+    return static_cast<FileOperationPrivate*>(parent->d);
+}
+
+FileOperation::FileOperation(QObject *parent) :
+    PendingOperation(parent)
+{
+    d = new FileOperationPrivate;
+}
+
+RemoteFile FileOperation::file() const
+{
+    Q_D(const FileOperation);
+    return d->m_file;
+}
+
+QIODevice *FileOperation::device() const
+{
+    Q_D(const FileOperation);
+    return d->m_device;
+}
+
+quint32 FileOperation::bytesTransferred() const
+{
+    Q_D(const FileOperation);
+    return d->m_bytesTransferred;
+}
+
+quint32 FileOperation::totalBytes() const
+{
+    Q_D(const FileOperation);
+    return d->m_totalBytes;
+}
+
+} // Client
+
+} // Telegram namespace
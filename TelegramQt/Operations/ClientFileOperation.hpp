@@ -0,0 +1,38 @@
+#ifndef TELEGRAMQT_CLIENT_FILE_OPERATION
+#define TELEGRAMQT_CLIENT_FILE_OPERATION
+
+#include "../PendingOperation.hpp"
+#include "../TelegramNamespace.hpp"
+
+QT_FORWARD_DECLARE_CLASS(QIODevice)
+
+namespace Telegram {
+
+namespace Client {
+
+class FileOperationPrivate;
+class TELEGRAMQT_EXPORT FileOperation : public PendingOperation
+{
+    Q_OBJECT
+public:
+    explicit FileOperation(QObject *parent = nullptr);
+
+    RemoteFile file() const;
+    QIODevice *device() const;
+
+    quint32 bytesTransferred() const;
+    quint32 totalBytes() const; // Zero if the file size is not known yet
+
+Q_SIGNALS:
+    void progressChanged(quint32 bytesTransferred, quint32 totalBytes);
+
+protected:
+    Q_DECLARE_PRIVATE_D(d, FileOperation)
+
+};
+
+} // Client
+
+} // Telegram
+
+#endif // TELEGRAMQT_CLIENT_FILE_OPERATION
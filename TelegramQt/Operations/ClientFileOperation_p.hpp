@@ -0,0 +1,48 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAMQT_CLIENT_FILE_OPERATION_PRIVATE_HPP
+#define TELEGRAMQT_CLIENT_FILE_OPERATION_PRIVATE_HPP
+
+#include "PendingOperation_p.hpp"
+#include "TelegramNamespace.hpp"
+
+QT_FORWARD_DECLARE_CLASS(QIODevice)
+
+namespace Telegram {
+
+namespace Client {
+
+class FileOperation;
+
+class FileOperationPrivate : public PendingOperationPrivate
+{
+public:
+    static FileOperationPrivate *get(FileOperation *parent);
+
+    RemoteFile m_file;
+    QIODevice *m_device = nullptr;
+    quint32 m_nextPart = 0; // The next part to write to the device
+    quint32 m_bytesTransferred = 0;
+    quint32 m_totalBytes = 0;
+};
+
+} // Client namespace
+
+} // Telegram namespace
+
+#endif // TELEGRAMQT_CLIENT_FILE_OPERATION_PRIVATE_HPP
@@ -18,6 +18,10 @@ public:
     Peer peer() const;
     QVector<quint32> messages() const;
 
+Q_SIGNALS:
+    // Emitted if the operation finished with the cached messages and the server reported a different slice
+    void messagesRefreshed(MessagesOperation *operation);
+
 protected:
     Q_DECLARE_PRIVATE_D(d, MessagesOperation)
 
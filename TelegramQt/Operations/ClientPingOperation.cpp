@@ -3,6 +3,7 @@
 #include "ClientRpcLayer.hpp"
 #include "ClientSettings.hpp"
 #include "ClientConnection.hpp"
+#include "CTelegramTransport.hpp"
 #include "MTProto/Stream.hpp"
 #include "TLTypes.hpp"
 
@@ -23,17 +24,51 @@ PingOperation::PingOperation(QObject *parent) :
 
 void PingOperation::ensureActive()
 {
+    m_interval = m_settings->pingInterval();
     if (!m_pingTimer) {
         qCDebug(c_clientPingCategory) << "startKeepAlive(): construct the timer";
         m_pingTimer = new QTimer(this);
         m_pingTimer->setSingleShot(true);
         connect(m_pingTimer, &QTimer::timeout, this, &PingOperation::onTimeToKeepAlive);
-        m_pingTimer->start(m_settings->pingInterval());
+        m_pingTimer->start(m_interval);
         // The start is called right on connection, but we want to send our first ping after the pingInterval
         return;
     }
 
-    m_pingTimer->start(m_settings->pingInterval());
+    m_pingTimer->start(m_interval);
+}
+
+void PingOperation::setRpcLayer(RpcLayer *layer)
+{
+    if (m_rpcLayer == layer) {
+        return;
+    }
+    m_rpcLayer = layer;
+    if (m_pingRpcOperation) {
+        // The ping sent via the previous layer is not going to be answered on the new one
+        disconnect(m_pingRpcOperation, nullptr, this, nullptr);
+        connect(m_pingRpcOperation, &PendingOperation::finished, m_pingRpcOperation, &QObject::deleteLater);
+        m_pingRpcOperation = nullptr;
+    }
+    m_pingMessageId = 0;
+}
+
+void PingOperation::setTransport(BaseTransport *transport)
+{
+    if (m_transport == transport) {
+        return;
+    }
+    if (m_transport) {
+        disconnect(m_transport, nullptr, this, nullptr);
+    }
+    m_transport = transport;
+    m_checkedReceivedPackets = m_receivedPackets;
+    m_checkedSentPackets = m_sentPackets;
+    m_pingSent = false;
+    if (m_transport) {
+        connect(m_transport, &BaseTransport::packetReceived, this, [this]() { ++m_receivedPackets; });
+        connect(m_transport, &BaseTransport::packetSent, this, [this]() { ++m_sentPackets; });
+    }
 }
 
 void PingOperation::ensureInactive()
@@ -59,6 +94,17 @@ void PingOperation::onPingResent(quint64 oldMessageId, quint64 newMessageId)
     }
 }
 
+bool PingOperation::hasTraffic()
+{
+    const quint64 received = m_receivedPackets - m_checkedReceivedPackets;
+    const quint64 sent = m_sentPackets - m_checkedSentPackets;
+    m_checkedReceivedPackets = m_receivedPackets;
+    m_checkedSentPackets = m_sentPackets;
+    // The previous ping and pong are the only packets of an idle connection
+    const quint64 idlePackets = m_pingSent ? 1 : 0;
+    return (received > idlePackets) && (sent > idlePackets);
+}
+
 void PingOperation::onTimeToKeepAlive()
 {
     if (m_pingMessageId) {
@@ -67,6 +113,18 @@ void PingOperation::onTimeToKeepAlive()
          return;
     }
 
+    if (hasTraffic()) {
+        // The connection is alive and the server sees our packets, so there is nothing to check
+        qCDebug(c_clientPingCategory) << "onTimeToKeepAlive(): skip the ping of a connection with traffic";
+        m_pingSent = false;
+        m_interval = m_settings->pingInterval();
+        m_pingTimer->start(m_interval);
+        return;
+    }
+
+    // Back off on an idle connection to save the battery and the mobile traffic
+    const quint32 nextInterval = qMax(m_interval, qMin(m_interval * 2, m_settings->maxPingInterval()));
+
     ++m_pingId;
 
     if (!m_pingRpcOperation) {
@@ -77,11 +135,15 @@ void PingOperation::onTimeToKeepAlive()
     {
         Telegram::RawStream outputStream(Telegram::RawStream::WriteOnly);
         if (m_settings->serverDisconnectionAdditionalTime()) {
-            // Server should close the connection after m_pingServerDisconnectionExtraTime ms more than our ping interval.
-            const quint32 serverDisconnectTimeout = m_settings->pingInterval() + m_settings->serverDisconnectionAdditionalTime();
+            // Server should close the connection after serverDisconnectionAdditionalTime ms more than our next ping.
+            // A skipped check postpones the ping for up to pingInterval after the last traffic.
+            const quint32 serverDisconnectTimeout = nextInterval + m_settings->pingInterval()
+                    + m_settings->serverDisconnectionAdditionalTime();
+            // The delay is in seconds
+            const quint32 disconnectDelay = (serverDisconnectTimeout + 999) / 1000;
             outputStream << TLValue::PingDelayDisconnect;
             outputStream << m_pingId;
-            outputStream << serverDisconnectTimeout;
+            outputStream << disconnectDelay;
         } else {
             outputStream << TLValue::Ping;
             outputStream << m_pingId;
@@ -89,9 +151,12 @@ void PingOperation::onTimeToKeepAlive()
         m_pingRpcOperation->reuse(outputStream.getData());
         m_pingRpcOperation->setContentRelated(false);
     }
+    m_roundTripTimer.start();
     m_pingMessageId = m_rpcLayer->sendRpc(m_pingRpcOperation);
     qCDebug(c_clientPingCategory) << "onTimeToKeepAlive(): send ping with id" << hex << m_pingId << ", messageId: " << m_pingMessageId;
-    m_pingTimer->start(m_settings->pingInterval());
+    m_pingSent = true;
+    m_interval = nextInterval;
+    m_pingTimer->start(m_interval);
 }
 
 void PingOperation::onPingRpcFinished()
@@ -121,6 +186,7 @@ void PingOperation::onPingRpcFinished()
         return;
     }
     m_pingMessageId = 0;
+    emit roundTripTimeMeasured(m_roundTripTimer.elapsed());
 }
 
 } // Client
@@ -3,10 +3,15 @@
 
 #include "../PendingRpcOperation.hpp"
 
+#include <QElapsedTimer>
+#include <QPointer>
+
 QT_FORWARD_DECLARE_CLASS(QTimer)
 
 namespace Telegram {
 
+class BaseTransport;
+
 namespace Client {
 
 class RpcLayer;
@@ -19,7 +24,12 @@ public:
     explicit PingOperation(QObject *parent = nullptr);
 
     void setSettings(Settings *settings) { m_settings = settings; }
-    void setRpcLayer(RpcLayer *layer) { m_rpcLayer = layer; }
+    void setRpcLayer(RpcLayer *layer);
+    // The ping is skipped if the transport has other traffic in both directions
+    void setTransport(BaseTransport *transport);
+
+    // The interval grows on each ping of an idle connection and resets on traffic
+    quint32 currentInterval() const { return m_interval; }
 
     void ensureActive();
     void ensureInactive();
@@ -27,6 +37,7 @@ public:
 
 Q_SIGNALS:
     void pingFailed(const QVariantHash &details);
+    void roundTripTimeMeasured(qint64 msecs);
 
 protected slots:
     void onTimeToKeepAlive();
@@ -34,15 +45,25 @@ protected slots:
 
 protected:
     void onPingResent(quint64 oldMessageId, quint64 newMessageId);
+    bool hasTraffic();
 
     PendingRpcOperation *m_pingRpcOperation = nullptr;
 
     quint64 m_pingId = 0;
     quint64 m_pingMessageId = 0;
+    QElapsedTimer m_roundTripTimer;
+
+    quint32 m_interval = 0;
+    quint64 m_receivedPackets = 0;
+    quint64 m_sentPackets = 0;
+    quint64 m_checkedReceivedPackets = 0;
+    quint64 m_checkedSentPackets = 0;
+    bool m_pingSent = false; // The ping is sent at the last check
 
     QTimer *m_pingTimer = nullptr;
     Settings *m_settings = nullptr;
     RpcLayer *m_rpcLayer = nullptr;
+    QPointer<BaseTransport> m_transport;
 };
 
 } // Client
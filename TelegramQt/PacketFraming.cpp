@@ -0,0 +1,198 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include "PacketFraming.hpp"
+
+#include "RandomGenerator.hpp"
+
+#include <QtEndian>
+
+namespace Telegram {
+
+constexpr quint32 PacketFraming::c_maxPacketSize;
+
+static const quint32 c_abridgedIdentifier = 0xefefefefu;
+static const quint32 c_intermediateIdentifier = 0xeeeeeeeeu;
+static const quint32 c_paddedIntermediateIdentifier = 0xddddddddu;
+
+quint32 PacketFraming::protocolIdentifier(PacketFraming::Mode mode)
+{
+    switch (mode) {
+    case Mode::Abridged:
+        return c_abridgedIdentifier;
+    case Mode::Intermediate:
+        return c_intermediateIdentifier;
+    case Mode::PaddedIntermediate:
+        return c_paddedIntermediateIdentifier;
+    }
+    return 0;
+}
+
+bool PacketFraming::getModeForProtocolIdentifier(quint32 identifier, PacketFraming::Mode *mode)
+{
+    switch (identifier) {
+    case c_abridgedIdentifier:
+        *mode = Mode::Abridged;
+        return true;
+    case c_intermediateIdentifier:
+        *mode = Mode::Intermediate;
+        return true;
+    case c_paddedIntermediateIdentifier:
+        *mode = Mode::PaddedIntermediate;
+        return true;
+    default:
+        return false;
+    }
+}
+
+void PacketFraming::setMode(PacketFraming::Mode mode)
+{
+    m_mode = mode;
+    reset();
+}
+
+void PacketFraming::appendPacket(QByteArray *output, const QByteArray &payload) const
+{
+    if (m_mode == Mode::Abridged) {
+        const quint32 length = static_cast<quint32>(payload.length() / 4);
+        output->reserve(output->size() + payload.size() + 4);
+        if (length < 0x7f) {
+            output->append(char(length));
+        } else {
+            output->append(char(0x7f));
+            output->append(char(length & 0xff));
+            output->append(char((length >> 8) & 0xff));
+            output->append(char((length >> 16) & 0xff));
+        }
+        output->append(payload);
+        return;
+    }
+
+    const int paddingSize = m_mode == Mode::PaddedIntermediate ? RandomGenerator::instance()->generate<quint8>() % 16 : 0;
+    const int offset = output->size();
+    output->resize(offset + 4 + payload.size() + paddingSize);
+    char *data = output->data() + offset;
+    qToLittleEndian<quint32>(static_cast<quint32>(payload.size() + paddingSize), data);
+    memcpy(data + 4, payload.constData(), static_cast<size_t>(payload.size()));
+    if (paddingSize) {
+        RandomGenerator::instance()->generate(data + 4 + payload.size(), paddingSize);
+    }
+}
+
+PacketFraming::ReadStatus PacketFraming::takePacket(QByteArray *buffer, QByteArray *payload)
+{
+    if (m_readOffset > buffer->size()) {
+        // The buffer is cleared by the owner
+        m_readOffset = 0;
+        m_expectedLength = 0;
+    }
+    if (m_expectedLength == 0) {
+        const ReadStatus status = readLength(buffer);
+        if (status != ReadStatus::Packet) {
+            if (m_readOffset) {
+                buffer->remove(0, m_readOffset);
+                m_readOffset = 0;
+            }
+            return status;
+        }
+    }
+    if (buffer->size() - m_readOffset < static_cast<int>(m_expectedLength)) {
+        buffer->remove(0, m_readOffset);
+        m_readOffset = 0;
+        return ReadStatus::Incomplete;
+    }
+    const char *data = buffer->constData() + m_readOffset;
+    const int packetSize = static_cast<int>(m_expectedLength);
+    const int payloadSize = m_mode == Mode::PaddedIntermediate ? getPaddedPayloadSize(data, packetSize) : packetSize;
+    if ((m_readOffset == 0) && (packetSize == buffer->size()) && (payloadSize == packetSize)) {
+        // The only packet in the buffer; take the data without a copy
+        *payload = *buffer;
+        buffer->clear();
+    } else {
+        *payload = QByteArray(data, payloadSize);
+        m_readOffset += packetSize;
+        if (m_readOffset == buffer->size()) {
+            buffer->clear();
+            m_readOffset = 0;
+        }
+    }
+    m_expectedLength = 0;
+    return ReadStatus::Packet;
+}
+
+void PacketFraming::reset()
+{
+    m_expectedLength = 0;
+    m_readOffset = 0;
+}
+
+// Reads the packet length at the read offset; returns Packet if the length is known
+PacketFraming::ReadStatus PacketFraming::readLength(const QByteArray *buffer)
+{
+    const int available = buffer->size() - m_readOffset;
+    if (available <= 0) {
+        return ReadStatus::Incomplete;
+    }
+    const quint8 *data = reinterpret_cast<const quint8*>(buffer->constData()) + m_readOffset;
+    if (m_mode == Mode::Abridged) {
+        const quint8 length_t1 = data[0];
+        if (length_t1 < 0x7fu) {
+            m_expectedLength = length_t1 * 4u;
+            m_readOffset += 1;
+        } else if (length_t1 == 0x7fu) {
+            if (available < 4) {
+                return ReadStatus::Incomplete;
+            }
+            m_expectedLength = data[1] + data[2] * 256u + data[3] * 256u * 256u;
+            m_expectedLength *= 4;
+            m_readOffset += 4;
+        } else {
+            return ReadStatus::Invalid;
+        }
+        return ReadStatus::Packet;
+    }
+
+    if (available < 4) {
+        return ReadStatus::Incomplete;
+    }
+    const quint32 length = qFromLittleEndian<quint32>(data);
+    if ((length > c_maxPacketSize) || ((m_mode == Mode::Intermediate) && (length % 4))) {
+        return ReadStatus::Invalid;
+    }
+    m_expectedLength = length;
+    m_readOffset += 4;
+    return ReadStatus::Packet;
+}
+
+// The padding size is not transferred, so the payload size is restored from the MTProto packet:
+// a plain message has its length in the header and an encrypted one consists of 16-byte blocks.
+int PacketFraming::getPaddedPayloadSize(const char *data, int size)
+{
+    static constexpr int c_plainHeaderSize = 20; // auth_key_id, message_id, message_data_length
+    static constexpr int c_encryptedHeaderSize = 24; // auth_key_id, msg_key
+    if (size < c_plainHeaderSize + 4) {
+        // A transport error code
+        return qMin(size, 4);
+    }
+    if (qFromLittleEndian<quint64>(data) == 0) {
+        const quint32 messageLength = qFromLittleEndian<quint32>(data + 16);
+        return static_cast<int>(qMin<quint32>(c_plainHeaderSize + messageLength, static_cast<quint32>(size)));
+    }
+    return c_encryptedHeaderSize + ((size - c_encryptedHeaderSize) & ~15);
+}
+
+} // Telegram namespace
@@ -0,0 +1,75 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAM_PACKET_FRAMING_HPP
+#define TELEGRAM_PACKET_FRAMING_HPP
+
+#include "telegramqt_global.h"
+
+#include <QByteArray>
+
+namespace Telegram {
+
+// The packet framing of the stream transports:
+// Abridged: quint8 Packet length / 4 if it is less than 0x7f, otherwise quint8 0x7f and quint24 Packet length / 4; Payload
+// Intermediate: quint32 Packet length; Payload
+// Padded intermediate: quint32 Packet length; Payload; 0-15 random padding bytes
+class TELEGRAMQT_INTERNAL_EXPORT PacketFraming
+{
+public:
+    enum class Mode {
+        Abridged,
+        Intermediate,
+        PaddedIntermediate,
+    };
+
+    enum class ReadStatus {
+        Packet,
+        Incomplete,
+        Invalid,
+    };
+
+    static constexpr quint32 c_maxPacketSize = 0x1000000;
+
+    // The identifiers of the modes in the session header
+    static quint32 protocolIdentifier(Mode mode);
+    static bool getModeForProtocolIdentifier(quint32 identifier, Mode *mode);
+
+    Mode mode() const { return m_mode; }
+    void setMode(Mode mode);
+
+    void appendPacket(QByteArray *output, const QByteArray &payload) const;
+
+    // Takes the next packet from the buffer. The taken bytes are removed from the buffer
+    // once there is no complete packet left, so a batch of packets is not moved per packet.
+    // The length of an incomplete packet is kept for the next call.
+    ReadStatus takePacket(QByteArray *buffer, QByteArray *payload);
+    quint32 expectedLength() const { return m_expectedLength; }
+    void reset();
+
+protected:
+    ReadStatus readLength(const QByteArray *buffer);
+    static int getPaddedPayloadSize(const char *data, int size);
+
+    Mode m_mode = Mode::Abridged;
+    quint32 m_expectedLength = 0;
+    int m_readOffset = 0;
+};
+
+} // Telegram namespace
+
+#endif // TELEGRAM_PACKET_FRAMING_HPP
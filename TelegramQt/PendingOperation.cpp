@@ -104,6 +104,11 @@ void PendingOperation::setFinishedWithError(const QVariantHash &details)
     setFinished();
 }
 
+void PendingOperation::setDelayedFinished()
+{
+    QMetaObject::invokeMethod(this, "setFinished", Qt::QueuedConnection); // Invoke after return
+}
+
 void PendingOperation::setDelayedFinishedWithError(const QVariantHash &details)
 {
     QMetaObject::invokeMethod(this, "setFinishedWithError", Qt::QueuedConnection, Q_ARG(QVariantHash, details)); // Invoke after return
@@ -133,6 +133,7 @@ public Q_SLOTS:
 
     void setFinished();
     void setFinishedWithError(const QVariantHash &details);
+    void setDelayedFinished();
     void setDelayedFinishedWithError(const QVariantHash &details);
     virtual void clearResult();
 
@@ -14,12 +14,21 @@ class PendingRpcOperation : public PendingOperation
 {
     Q_OBJECT
 public:
+    enum class Priority {
+        Default, // Derived from the request function on scheduling
+        Interactive,
+        Normal,
+        Bulk,
+    };
+
     explicit PendingRpcOperation(QObject *parent = nullptr);
     explicit PendingRpcOperation(const QByteArray &requestData, QObject *parent = nullptr);
     ~PendingRpcOperation() override;
 
     bool isContentRelated() const { return m_contentRelated; }
     void setContentRelated(bool related) { m_contentRelated = related; }
+    Priority priority() const { return m_priority; }
+    void setPriority(Priority priority) { m_priority = priority; }
     QByteArray requestData() const { return m_requestData; }
     QByteArray replyData() const { return m_replyData; }
     void setFinishedWithReplyData(const QByteArray &data);
@@ -43,6 +52,7 @@ protected:
     RpcError *m_error = nullptr;
     BaseConnection *m_connection = nullptr;
     bool m_contentRelated = true;
+    Priority m_priority = Priority::Default;
 };
 
 } // Client namespace
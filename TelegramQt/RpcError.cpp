@@ -145,6 +145,15 @@ RpcError::RpcError(RpcError::Reason r, quint32 arg) :
     case PhoneNumberUnoccupied:
     case PeerIdInvalid:
     case UserIdInvalid:
+    case FilePartXMissing:
+    case FilePartInvalid:
+    case FilePartsInvalid:
+    case FilePartSizeInvalid:
+    case LocationInvalid:
+    case LimitInvalid:
+    case OffsetInvalid:
+    case DcIdInvalid:
+    case AuthBytesInvalid:
         type = BadRequest;
         break;
 //    case FileMigrateX:
@@ -162,7 +171,6 @@ RpcError::RpcError(RpcError::Reason r, quint32 arg) :
 //    case ApiIdInvalid:
 //    case PasswordHashInvalid:
 //    case PhoneNumberOccupied:
-//    case FilePartXMissing:
 //    case AuthKeyUnregistered:
 //    case AuthKeyInvalid:
 //    case UserDeactivated:
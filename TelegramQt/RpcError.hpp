@@ -73,6 +73,14 @@ public:
         FloodWaitX,
         PeerIdInvalid,
         UserIdInvalid,
+        FilePartInvalid,
+        FilePartsInvalid,
+        FilePartSizeInvalid,
+        LocationInvalid,
+        LimitInvalid,
+        OffsetInvalid,
+        DcIdInvalid,
+        AuthBytesInvalid,
     };
     Q_ENUM(Reason)
 
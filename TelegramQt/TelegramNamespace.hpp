@@ -221,12 +221,17 @@ struct TELEGRAMQT_EXPORT DcOption
         TcpOnly = 1 << 2,
         Cdn = 1 << 3,
         IsStatic = 1 << 4,
+        // Not a part of the MTProto: the address is a local socket name and the port is unused
+        LocalSocket = 1 << 8,
+        // Not a part of the MTProto: the address is an in-process loopback server name and the port is unused
+        Loopback = 1 << 9,
+        LocalEndpointFlags = LocalSocket|Loopback,
     };
 
     DcOption() = default;
     DcOption(const QString &a, quint16 p, quint32 dcId = 0) : address(a), id(dcId), port(p) { }
     bool operator==(const DcOption &option) const;
-    bool isValid() const { return id && port && !address.isEmpty(); }
+    bool isValid() const { return id && (port || (flags & LocalEndpointFlags)) && !address.isEmpty(); }
 
     QString address;
     quint32 id = 0;
@@ -239,6 +244,16 @@ inline bool DcOption::operator==(const DcOption &option) const
     return (option.id == id) && (option.port == port) && (option.address == address) && (option.flags == flags);
 }
 
+struct TELEGRAMQT_EXPORT UpdatesState
+{
+    bool isValid() const { return pts; }
+
+    quint32 pts = 0;
+    quint32 qts = 0;
+    quint32 seq = 0;
+    quint32 date = 0;
+};
+
 struct TELEGRAMQT_EXPORT Message
 {
     Message() = default;
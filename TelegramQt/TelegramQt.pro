@@ -51,13 +51,16 @@ SOURCES += \
     ClientApi.cpp \
     ClientBackend.cpp \
     ClientConnection.cpp \
+    ClientConnectionPool.cpp \
     ClientDhLayer.cpp \
     ClientSettings.cpp \
     ClientRpcLayer.cpp \
     ClientRpcLayerExtension.cpp \
+    ClientRpcScheduler.cpp \
     ConnectionApi.cpp \
     ContactList.cpp \
     ContactsApi.cpp \
+    FilesApi.cpp \
     DataStorage.cpp \
     IgnoredMessageNotification.cpp \
     RpcError.cpp \
@@ -74,9 +77,13 @@ SOURCES += \
     CTelegramTransport.cpp \
     CTcpTransport.cpp \
     CClientTcpTransport.cpp \
+    LocalSocketTransport.cpp \
+    LoopbackTransport.cpp \
+    ClientLocalSocketTransport.cpp \
     TelegramNamespace.cpp \
     LegacySecretReader.cpp \
     MessagingApi.cpp \
+    PacketFraming.cpp \
     PendingOperation.cpp \
     PendingRpcOperation.cpp \
     PendingRpcResult.cpp \
@@ -95,6 +102,7 @@ PUBLIC_HEADERS += \
     ContactsApi.hpp \
     Debug.hpp \
     DialogList.hpp \
+    FilesApi.hpp \
     MessagingApi.hpp \
     ReadyObject.hpp \
     RsaKey.hpp \
@@ -121,16 +129,20 @@ HEADERS += \
     ClientApi_p.hpp \
     ClientBackend.hpp \
     ClientConnection.hpp \
+    ClientConnectionPool.hpp \
     ClientDhLayer.hpp \
     ClientSettings.hpp \
     ClientRpcLayer.hpp \
     ClientRpcLayerExtension.hpp \
     ClientRpcLayerExtension_p.hpp \
+    ClientRpcScheduler.hpp \
     ConnectionApi.hpp \
     ConnectionApi_p.hpp \
     ContactList.hpp \
     ContactsApi.hpp \
     ContactsApi_p.hpp \
+    FilesApi.hpp \
+    FilesApi_p.hpp \
     DataStorage.hpp \
     DataStorage_p.hpp \
     IgnoredMessageNotification.hpp \
@@ -151,12 +163,16 @@ HEADERS += \
     CTelegramTransport.hpp \
     CTcpTransport.hpp \
     CClientTcpTransport.hpp \
+    LocalSocketTransport.hpp \
+    LoopbackTransport.hpp \
+    ClientLocalSocketTransport.hpp \
     TLFunctions.hpp \
     TLTypes.hpp \
     TLNumbers.hpp \
     crypto-aes.hpp \
     crypto-rsa.hpp \
     LegacySecretReader.hpp \
+    PacketFraming.hpp \
     PendingOperation.hpp \
     PendingOperation_p.hpp \
     PendingRpcOperation.hpp \
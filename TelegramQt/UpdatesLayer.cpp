@@ -1,17 +1,22 @@
 #include "UpdatesLayer.hpp"
 
+#include "AccountStorage.hpp"
 #include "ApiUtils.hpp"
 #include "ClientBackend.hpp"
 #include "DataStorage.hpp"
 #include "DataStorage_p.hpp"
 #include "MessagingApi.hpp"
 #include "MessagingApi_p.hpp"
+#include "PendingOperation.hpp"
 
 #ifdef DEVELOPER_BUILD
 #include "TLTypesDebug.hpp"
 #endif
 
 #include <QLoggingCategory>
+#include <QTimer>
+
+#include <algorithm>
 
 Q_LOGGING_CATEGORY(c_updatesLoggingCategory, "telegram.client.updates", QtWarningMsg)
 
@@ -19,9 +24,22 @@ namespace Telegram {
 
 namespace Client {
 
+// The pts_total_limit field of updates.getDifference is set
+static constexpr quint32 c_differencePtsTotalLimitFlag = 1 << 0;
+
+constexpr int UpdatesInternalApi::c_minDifferenceRetryDelay;
+constexpr int UpdatesInternalApi::c_maxDifferenceRetryDelay;
+
 UpdatesInternalApi::UpdatesInternalApi(QObject *parent) :
     QObject(parent)
 {
+    m_gapTimer = new QTimer(this);
+    m_gapTimer->setSingleShot(true);
+    m_gapTimer->setInterval(500);
+    connect(m_gapTimer, &QTimer::timeout, this, &UpdatesInternalApi::onGapTimeout);
+    m_differenceRetryTimer = new QTimer(this);
+    m_differenceRetryTimer->setSingleShot(true);
+    connect(m_differenceRetryTimer, &QTimer::timeout, this, &UpdatesInternalApi::getDifference);
 }
 
 void UpdatesInternalApi::setBackend(Backend *backend)
@@ -29,6 +47,36 @@ void UpdatesInternalApi::setBackend(Backend *backend)
     m_backend = backend;
 }
 
+PendingOperation *UpdatesInternalApi::sync()
+{
+    if (m_syncOperation) {
+        return m_syncOperation;
+    }
+    m_syncOperation = new PendingOperation("UpdatesInternalApi::sync", this);
+    PendingOperation *operation = m_syncOperation;
+
+    if (!m_state.isValid()) {
+        m_state = m_backend->accountStorage()->updatesState();
+    }
+    if (m_state.isValid()) {
+        getDifference();
+    } else {
+        UpdatesRpcLayer::PendingUpdatesState *rpcOperation = m_backend->updatesLayer()->getState();
+        rpcOperation->connectToFinished(this, &UpdatesInternalApi::onGetStateFinished, rpcOperation);
+    }
+    return operation;
+}
+
+int UpdatesInternalApi::gapTimeout() const
+{
+    return m_gapTimer->interval();
+}
+
+void UpdatesInternalApi::setGapTimeout(int timeout)
+{
+    m_gapTimer->setInterval(timeout);
+}
+
 bool UpdatesInternalApi::processUpdates(const TLUpdates &updates)
 {
 #ifdef DEVELOPER_BUILD
@@ -42,6 +90,7 @@ bool UpdatesInternalApi::processUpdates(const TLUpdates &updates)
     switch (updates.tlType) {
     case TLValue::UpdatesTooLong:
         qCDebug(c_updatesLoggingCategory) << "Updates too long!";
+        getDifference();
         break;
     case TLValue::UpdateShortMessage:
     case TLValue::UpdateShortChatMessage:
@@ -83,53 +132,48 @@ bool UpdatesInternalApi::processUpdates(const TLUpdates &updates)
             shortMessage.fromId = updates.fromId;
         }
 
-        processUpdate(update);
+        processPtsUpdate(update);
     }
         break;
     case TLValue::UpdateShort:
-        processUpdate(updates.update);
+        processPtsUpdate(updates.update);
         break;
     case TLValue::UpdatesCombined:
-        internal->processData(updates.users);
-        internal->processData(updates.chats);
-        qCDebug(c_updatesLoggingCategory) << Q_FUNC_INFO << "UpdatesCombined processing is not implemented yet.";
-        for (int i = 0; i < updates.updates.count(); ++i) {
-            processUpdate(updates.updates.at(i));
-        }
-        break;
     case TLValue::Updates:
+    {
+        // The whole package is applied as a single change of the data
+        beginBatch();
         internal->processData(updates.users);
         internal->processData(updates.chats);
 
-        if (!updates.updates.isEmpty()) {
-            // Official client sorts updates by pts/qts. Wat?!
-            // Ok, let's see if there would be unordered updates.
-            quint32 pts = updates.updates.first().pts;
-            for (int i = 0; i < updates.updates.count(); ++i) {
-                const quint32 updatePts = updates.updates.at(i).pts;
-                if (updatePts == 0) {
-                    continue;
-                }
-                if (updatePts < pts) {
-                    qCDebug(c_updatesLoggingCategory) << "Unordered update!";
-                    //Q_ASSERT(0);
-                }
-                pts = updates.updates.at(i).pts;
+        const quint32 seqStart = updates.tlType == TLValue::UpdatesCombined ? updates.seqStart : updates.seq;
+        if (seqStart && m_state.seq && (seqStart > m_state.seq + 1)) {
+            // Some Updates are missing; let them come or get the difference
+            qCDebug(c_updatesLoggingCategory) << "Seq gap:" << m_state.seq << "->" << seqStart;
+            if (!m_gapTimer->isActive()) {
+                m_gapTimer->start();
             }
+        }
 
-            // Initial implementation
-            for (int i = 0; i < updates.updates.count(); ++i) {
-                processUpdate(updates.updates.at(i));
-            }
+        // Unordered updates are kept pending until the preceding ones are applied
+        for (const TLUpdate &update : updates.updates) {
+            processPtsUpdate(update);
+        }
+        commitBatch();
+
+        if (updates.seq && (updates.seq > m_state.seq) && !m_differenceInProgress) {
+            m_state.seq = updates.seq;
         }
+        if (updates.date > m_state.date) {
+            m_state.date = updates.date;
+        }
+    }
         break;
     case TLValue::UpdateShortSentMessage:
     {
         MessagingApiPrivate *messaging = MessagingApiPrivate::get(messagingApi());
         messaging->onSentMessageIdResolved(0, updates.id);
-        // TODO: Check that the follow state update is the right thing to do.
-        // This fixes scenario: "send sendMessage" -> "receive UpdateShortSentMessage" -> "receive UpdateReadHistoryOutbox with update.pts == m_updatesState.pts + 2"
-        // setUpdateState(m_updatesState.pts + 1, 0, 0);
+        processAffectedPts(updates.pts, updates.ptsCount);
         return true;
     }
         break;
@@ -139,6 +183,311 @@ bool UpdatesInternalApi::processUpdates(const TLUpdates &updates)
     return false;
 }
 
+void UpdatesInternalApi::processAffectedPts(quint32 pts, quint32 ptsCount)
+{
+    // The result carries no data except of pts, so apply it as an empty contents update
+    // to keep the order of the pending updates
+    TLUpdate update;
+    update.tlType = TLValue::UpdateReadMessagesContents;
+    update.pts = pts;
+    update.ptsCount = ptsCount;
+    processPtsUpdate(update);
+}
+
+bool UpdatesInternalApi::hasCommonPts(const TLUpdate &update)
+{
+    switch (update.tlType) {
+    case TLValue::UpdateNewMessage:
+    case TLValue::UpdateDeleteMessages:
+    case TLValue::UpdateEditMessage:
+    case TLValue::UpdateReadHistoryInbox:
+    case TLValue::UpdateReadHistoryOutbox:
+    case TLValue::UpdateReadMessagesContents:
+    case TLValue::UpdateWebPage:
+        return update.pts != 0;
+    default:
+        // Channel updates have own per-channel pts
+        return false;
+    }
+}
+
+UpdatesInternalApi::PtsCheckResult UpdatesInternalApi::checkPts(quint32 pts, quint32 ptsCount) const
+{
+    if (!m_state.pts) {
+        // The state is unknown yet
+        return PtsCheckResult::Apply;
+    }
+    const quint32 expectedPts = m_state.pts + ptsCount;
+    if (pts == expectedPts) {
+        return PtsCheckResult::Apply;
+    }
+    if (pts < expectedPts) {
+        // Already applied
+        return PtsCheckResult::Skip;
+    }
+    return PtsCheckResult::Gap;
+}
+
+void UpdatesInternalApi::processPtsUpdate(const TLUpdate &update)
+{
+    if (!hasCommonPts(update)) {
+        processUpdate(update);
+        return;
+    }
+
+    if (!m_differenceInProgress) {
+        switch (checkPts(update.pts, update.ptsCount)) {
+        case PtsCheckResult::Apply:
+            processUpdate(update);
+            setPts(update.pts);
+            applyPendingUpdates();
+            return;
+        case PtsCheckResult::Skip:
+            qCDebug(c_updatesLoggingCategory) << "Skip already applied update" << update.tlType << update.pts;
+            return;
+        case PtsCheckResult::Gap:
+            qCDebug(c_updatesLoggingCategory) << "Pts gap:" << m_state.pts << "->" << update.pts - update.ptsCount;
+            break;
+        }
+    }
+
+    // Keep the update until the gap is filled or the difference is received
+    const auto it = std::upper_bound(m_pendingUpdates.begin(), m_pendingUpdates.end(), update.pts,
+                                     [](quint32 pts, const TLUpdate &pendingUpdate) {
+        return pts < pendingUpdate.pts;
+    });
+    m_pendingUpdates.insert(it, update);
+    if (!m_differenceInProgress && !m_gapTimer->isActive()) {
+        m_gapTimer->start();
+    }
+}
+
+void UpdatesInternalApi::applyPendingUpdates()
+{
+    while (!m_pendingUpdates.isEmpty()) {
+        const TLUpdate update = m_pendingUpdates.first();
+        const PtsCheckResult result = checkPts(update.pts, update.ptsCount);
+        if (result == PtsCheckResult::Gap) {
+            break;
+        }
+        m_pendingUpdates.removeFirst();
+        if (result == PtsCheckResult::Apply) {
+            processUpdate(update);
+            setPts(update.pts);
+        }
+    }
+    if (m_pendingUpdates.isEmpty()) {
+        m_gapTimer->stop();
+    }
+}
+
+void UpdatesInternalApi::setPts(quint32 pts)
+{
+    if (pts > m_state.pts) {
+        m_state.pts = pts;
+        saveState();
+    }
+}
+
+void UpdatesInternalApi::setState(const TLUpdatesState &state)
+{
+    m_state.pts = state.pts;
+    m_state.qts = state.qts;
+    m_state.seq = state.seq;
+    m_state.date = state.date;
+    saveState();
+}
+
+void UpdatesInternalApi::saveState()
+{
+    m_backend->accountStorage()->setUpdatesState(m_state);
+}
+
+void UpdatesInternalApi::beginBatch()
+{
+    ++m_batchDepth;
+    dataInternalApi()->beginChanges();
+}
+
+/*
+    Applies the collected messages and read states at once. The storage
+    reports a single change and the messages are announced once per dialog.
+*/
+void UpdatesInternalApi::commitBatch()
+{
+    if (--m_batchDepth > 0) {
+        dataInternalApi()->endChanges();
+        return;
+    }
+    // Take the collected data first, as the signal handlers are free to trigger new updates
+    const QVector<DataInternalApi::ReceivedMessage> messages = m_batchMessages;
+    const QHash<Peer, quint32> inboxRead = m_batchInboxRead;
+    const QHash<Peer, quint32> outboxRead = m_batchOutboxRead;
+    m_batchMessages.clear();
+    m_batchInboxRead.clear();
+    m_batchOutboxRead.clear();
+
+    DataInternalApi *internal = dataInternalApi();
+    QVector<DataInternalApi::DialogMessages> receivedMessages;
+    if (!messages.isEmpty()) {
+        receivedMessages = internal->processNewMessages(messages);
+    }
+    QHash<Peer, quint32> changedInboxRead;
+    for (auto it = inboxRead.cbegin(); it != inboxRead.cend(); ++it) {
+        if (internal->updateInboxRead(it.key(), it.value())) {
+            changedInboxRead.insert(it.key(), it.value());
+        }
+    }
+    QHash<Peer, quint32> changedOutboxRead;
+    for (auto it = outboxRead.cbegin(); it != outboxRead.cend(); ++it) {
+        if (internal->updateOutboxRead(it.key(), it.value())) {
+            changedOutboxRead.insert(it.key(), it.value());
+        }
+    }
+    internal->endChanges();
+
+    MessagingApiPrivate *messaging = MessagingApiPrivate::get(messagingApi());
+    for (const DataInternalApi::DialogMessages &dialogMessages : receivedMessages) {
+        messaging->onMessagesReceived(dialogMessages.peer, dialogMessages.messageIds);
+    }
+    for (auto it = changedInboxRead.cbegin(); it != changedInboxRead.cend(); ++it) {
+        messaging->onMessageInboxRead(it.key(), it.value());
+    }
+    for (auto it = changedOutboxRead.cbegin(); it != changedOutboxRead.cend(); ++it) {
+        messaging->onMessageOutboxRead(it.key(), it.value());
+    }
+}
+
+void UpdatesInternalApi::onGapTimeout()
+{
+    qCDebug(c_updatesLoggingCategory) << Q_FUNC_INFO << "The gap is not filled in time";
+    getDifference();
+}
+
+void UpdatesInternalApi::getDifference()
+{
+    if (m_differenceInProgress) {
+        return;
+    }
+    if (!m_state.isValid()) {
+        qCWarning(c_updatesLoggingCategory) << Q_FUNC_INFO << "Unable to get difference for unknown state";
+        return;
+    }
+    m_gapTimer->stop();
+    m_differenceRetryTimer->stop();
+    m_differenceInProgress = true;
+
+    // Limit the difference size to let the server answer with a slice instead of a huge reply
+    constexpr quint32 c_ptsTotalLimit = 1000;
+    UpdatesRpcLayer::PendingUpdatesDifference *rpcOperation
+            = m_backend->updatesLayer()->getDifference(c_differencePtsTotalLimitFlag, m_state.pts, c_ptsTotalLimit,
+                                                       m_state.date, m_state.qts);
+    rpcOperation->connectToFinished(this, &UpdatesInternalApi::onGetDifferenceFinished, rpcOperation);
+}
+
+void UpdatesInternalApi::onGetDifferenceFinished(UpdatesRpcLayer::PendingUpdatesDifference *rpcOperation)
+{
+    m_differenceInProgress = false;
+    if (!rpcOperation->isSucceeded()) {
+        qCWarning(c_updatesLoggingCategory) << Q_FUNC_INFO << "Unable to get difference" << rpcOperation->errorDetails();
+        // The pts is not moved, so the pending updates are received again with the next difference
+        m_pendingUpdates.clear();
+        m_gapTimer->stop();
+        ++m_failedDifferenceAttempts;
+        int delay = c_minDifferenceRetryDelay;
+        for (int i = 1; (i < m_failedDifferenceAttempts) && (delay < c_maxDifferenceRetryDelay); ++i) {
+            delay *= 2;
+        }
+        m_differenceRetryTimer->start(qMin(delay, c_maxDifferenceRetryDelay));
+        finishSync(false, rpcOperation->errorDetails());
+        return;
+    }
+    m_failedDifferenceAttempts = 0;
+
+    TLUpdatesDifference difference;
+    rpcOperation->getResult(&difference);
+    qCDebug(c_updatesLoggingCategory) << Q_FUNC_INFO << difference.tlType
+                                      << difference.newMessages.count() << difference.otherUpdates.count();
+
+    DataInternalApi *internal = dataInternalApi();
+    beginBatch();
+    switch (difference.tlType) {
+    case TLValue::UpdatesDifferenceEmpty:
+        m_state.date = difference.date;
+        m_state.seq = difference.seq;
+        saveState();
+        break;
+    case TLValue::UpdatesDifference:
+    case TLValue::UpdatesDifferenceSlice:
+    {
+        internal->processData(difference.users);
+        internal->processData(difference.chats);
+        m_batchMessages.reserve(m_batchMessages.count() + difference.newMessages.count());
+        for (const TLMessage &message : difference.newMessages) {
+            m_batchMessages.append({ message, 0 });
+        }
+        for (const TLUpdate &update : difference.otherUpdates) {
+            processUpdate(update);
+        }
+        if (difference.tlType == TLValue::UpdatesDifferenceSlice) {
+            setState(difference.intermediateState);
+            commitBatch();
+            getDifference();
+            return;
+        }
+        setState(difference.state);
+    }
+        break;
+    case TLValue::UpdatesDifferenceTooLong:
+        // The local data is too old to be updated incrementally
+        qCWarning(c_updatesLoggingCategory) << Q_FUNC_INFO << "The difference is too long, the cache is outdated";
+        MessagingApiPrivate::get(messagingApi())->onHistoryOutdated();
+        m_pendingUpdates.clear();
+        setPts(difference.pts);
+        break;
+    default:
+        break;
+    }
+
+    applyPendingUpdates();
+    commitBatch();
+    if (!m_pendingUpdates.isEmpty()) {
+        // Some updates are still missing
+        m_gapTimer->start();
+    }
+    m_backend->accountStorage()->sync();
+    finishSync(true);
+}
+
+void UpdatesInternalApi::onGetStateFinished(UpdatesRpcLayer::PendingUpdatesState *rpcOperation)
+{
+    if (!rpcOperation->isSucceeded()) {
+        qCWarning(c_updatesLoggingCategory) << Q_FUNC_INFO << "Unable to get state" << rpcOperation->errorDetails();
+        finishSync(false, rpcOperation->errorDetails());
+        return;
+    }
+    TLUpdatesState state;
+    rpcOperation->getResult(&state);
+    setState(state);
+    applyPendingUpdates();
+    m_backend->accountStorage()->sync();
+    finishSync(true);
+}
+
+void UpdatesInternalApi::finishSync(bool succeeded, const QVariantHash &errorDetails)
+{
+    if (!m_syncOperation) {
+        return;
+    }
+    PendingOperation *operation = m_syncOperation;
+    m_syncOperation = nullptr;
+    if (succeeded) {
+        operation->setFinished();
+    } else {
+        operation->setFinishedWithError(errorDetails);
+    }
+}
+
 bool UpdatesInternalApi::processUpdate(const TLUpdate &update)
 {
 #ifdef DEVELOPER_BUILD
@@ -152,6 +501,10 @@ bool UpdatesInternalApi::processUpdate(const TLUpdate &update)
         return true;
     case TLValue::UpdateNewMessage:
     case TLValue::UpdateNewChannelMessage:
+        if (m_batchDepth) {
+            m_batchMessages.append({ update.message, update.pts });
+            return true;
+        }
         if (dataInternalApi()->processNewMessage(update.message, update.pts)) {
             messaging->onMessageReceived(update.message);
         }
@@ -159,6 +512,10 @@ bool UpdatesInternalApi::processUpdate(const TLUpdate &update)
     case TLValue::UpdateReadHistoryInbox:
     {
         const Peer peer = Utils::toPublicPeer(update.peer);
+        if (m_batchDepth) {
+            m_batchInboxRead.insert(peer, qMax(m_batchInboxRead.value(peer), update.maxId));
+            return true;
+        }
         if (dataInternalApi()->updateInboxRead(peer, update.maxId)) {
             messaging->onMessageInboxRead(peer, update.maxId);
         }
@@ -167,6 +524,10 @@ bool UpdatesInternalApi::processUpdate(const TLUpdate &update)
     case TLValue::UpdateReadHistoryOutbox:
     {
         const Peer peer = Utils::toPublicPeer(update.peer);
+        if (m_batchDepth) {
+            m_batchOutboxRead.insert(peer, qMax(m_batchOutboxRead.value(peer), update.maxId));
+            return true;
+        }
         if (dataInternalApi()->updateOutboxRead(peer, update.maxId)) {
             messaging->onMessageOutboxRead(peer, update.maxId);
         }
@@ -20,15 +20,22 @@
 
 #include <QObject>
 
+#include "DataStorage_p.hpp"
+#include "TelegramNamespace.hpp"
 #include "TLTypes.hpp"
 
+#include "RpcLayers/ClientRpcUpdatesLayer.hpp"
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
 namespace Telegram {
 
+class PendingOperation;
+
 namespace Client {
 
 class Backend;
 class DataStorage;
-class DataInternalApi;
 class MessagingApi;
 
 class UpdatesInternalApi : public QObject
@@ -39,16 +46,68 @@ public:
 
     void setBackend(Backend *backend);
 
+    // Restores the updates state after (re)connection: gets the difference for the known state
+    // or requests the actual state on the first sign in.
+    PendingOperation *sync();
+
+    UpdatesState state() const { return m_state; }
+
+    // Time to wait for the missing updates before the difference request (in milliseconds)
+    int gapTimeout() const;
+    void setGapTimeout(int timeout);
+
     bool processUpdates(const TLUpdates &updates);
     bool processUpdate(const TLUpdate &update);
 
+    // Accounts pts of messages.affectedMessages and similar results
+    void processAffectedPts(quint32 pts, quint32 ptsCount);
+
 protected:
+    enum class PtsCheckResult {
+        Apply,
+        Skip,
+        Gap,
+    };
+
     MessagingApi *messagingApi();
     DataStorage *dataStorage();
     DataInternalApi *dataInternalApi();
 
-    Backend *m_backend = nullptr;
+    static bool hasCommonPts(const TLUpdate &update);
+    PtsCheckResult checkPts(quint32 pts, quint32 ptsCount) const;
+    void processPtsUpdate(const TLUpdate &update);
+    void applyPendingUpdates();
+    void setPts(quint32 pts);
+    void setState(const TLUpdatesState &state);
+    void saveState();
+
+    // Updates processed between begin and commit are applied to the data storage at once
+    // and announced by the aggregated signals
+    void beginBatch();
+    void commitBatch();
 
+    void onGapTimeout();
+    void getDifference();
+    void onGetDifferenceFinished(UpdatesRpcLayer::PendingUpdatesDifference *rpcOperation);
+    void onGetStateFinished(UpdatesRpcLayer::PendingUpdatesState *rpcOperation);
+    void finishSync(bool succeeded, const QVariantHash &errorDetails = QVariantHash());
+
+    static constexpr int c_minDifferenceRetryDelay = 1000; // ms
+    static constexpr int c_maxDifferenceRetryDelay = 60000; // ms
+
+    Backend *m_backend = nullptr;
+    QTimer *m_gapTimer = nullptr;
+    QTimer *m_differenceRetryTimer = nullptr;
+    int m_failedDifferenceAttempts = 0;
+    PendingOperation *m_syncOperation = nullptr;
+    UpdatesState m_state;
+    QVector<TLUpdate> m_pendingUpdates; // Updates received after a gap, ordered by pts
+    bool m_differenceInProgress = false;
+
+    int m_batchDepth = 0;
+    QVector<DataInternalApi::ReceivedMessage> m_batchMessages;
+    QHash<Peer, quint32> m_batchInboxRead;
+    QHash<Peer, quint32> m_batchOutboxRead;
 };
 
 } // Client namespace
@@ -139,50 +139,82 @@ quint64 Utils::greatestCommonOddDivisor(quint64 a, quint64 b)
     return b == 0 ? a : b;
 }
 
-// Yet another copy of some unknown pq-solver algorithm.
+static quint64 addMod(quint64 a, quint64 b, quint64 modulus)
+{
+    return (a >= modulus - b) ? a - (modulus - b) : a + b;
+}
+
+static quint64 mulMod(quint64 a, quint64 b, quint64 modulus)
+{
+#ifdef __SIZEOF_INT128__
+    return static_cast<quint64>(static_cast<unsigned __int128>(a) * b % modulus);
+#else
+    // Double-and-add keeps the intermediate values below the modulus
+    quint64 result = 0;
+    a %= modulus;
+    while (b) {
+        if (b & 1) {
+            result = addMod(result, a, modulus);
+        }
+        a = addMod(a, a, modulus);
+        b >>= 1;
+    }
+    return result;
+#endif
+}
+
+// Brent's variant of Pollard's rho algorithm with the GCD computed once per batch of steps.
+// The seeds are taken from the RandomGenerator, so the result is reproducible with
+// a deterministic generator. The amount of work is limited by c_maxFactorizationSteps.
 // Links:
-// https://github.com/DrKLO/Telegram/blob/433f59c5b9ed17543d8e206c83f0bc7c7edb43a6/TMessagesProj/jni/jni.c#L86
-// https://github.com/ex3ndr/telegram-mt/blob/91b1186e567b0484d6f371b8e5c61c425daf867e/src/main/java/org/telegram/mtproto/secure/pq/PQLopatin.java#L35
-// https://github.com/vysheng/tg/blob/1dad2e89933085ea1e3d9fb1becb1907ce5de55f/mtproto-client.c#L296
+// https://maths-people.anu.edu.au/~brent/pd/rpb051i.pdf
 quint64 Utils::findDivider(quint64 number)
 {
-    int it = 0;
-    quint64 g = 0;
-    for (int i = 0; i < 3 || it < 10000; i++) {
-        const quint64 q = ((rand() & 15) + 17) % number;
-        quint64 x = (quint64) rand() % (number - 1) + 1;
-        quint64 y = x;
-        const quint32 lim = 1 << (i + 18);
-        for (quint32 j = 1; j < lim; j++) {
-            ++it;
-            quint64 a = x;
-            quint64 b = x;
-            quint64 c = q;
-            while (b) {
-                if (b & 1) {
-                    c += a;
-                    if (c >= number) {
-                        c -= number;
-                    }
-                }
-                a += a;
-                if (a >= number) {
-                    a -= number;
-                }
-                b >>= 1;
-            }
-            x = c;
-            const quint64 z = x < y ? number + x - y : x - y;
-            g = greatestCommonOddDivisor(z, number);
-            if (g != 1) {
-                return g;
+    if (number < 4) {
+        return 1;
+    }
+    if (!(number & 1)) {
+        return 2;
+    }
+    constexpr quint64 c_gcdBatchSize = 128;
+
+    quint64 steps = 0;
+    while (steps < c_maxFactorizationSteps) {
+        const quint64 c = RandomGenerator::instance()->generate<quint64>() % (number - 1) + 1;
+        const auto f = [c, number](quint64 value) {
+            return addMod(mulMod(value, value, number), c, number);
+        };
+
+        quint64 y = RandomGenerator::instance()->generate<quint64>() % number;
+        quint64 x = y;
+        quint64 ys = y;
+        quint64 product = 1;
+        quint64 g = 1;
+        for (quint64 r = 1; (g == 1) && (steps < c_maxFactorizationSteps); r *= 2) {
+            x = y;
+            for (quint64 i = 0; i < r; ++i) {
+                y = f(y);
             }
-            if (!(j & (j - 1))) {
-                y = x;
+            steps += r;
+            for (quint64 k = 0; (k < r) && (g == 1); k += c_gcdBatchSize) {
+                ys = y;
+                const quint64 batch = qMin(c_gcdBatchSize, r - k);
+                for (quint64 i = 0; i < batch; ++i) {
+                    y = f(y);
+                    product = mulMod(product, x > y ? x - y : y - x, number);
+                }
+                steps += batch;
+                g = greatestCommonOddDivisor(product, number);
             }
         }
-
-        if (g > 1 && g < number) {
+        if (g == number) {
+            // The batch has collected all the factors; repeat it step by step
+            do {
+                ys = f(ys);
+                g = greatestCommonOddDivisor(x > ys ? x - ys : ys - x, number);
+            } while (g == 1);
+        }
+        if ((g != 1) && (g != number)) {
             return g;
         }
     }
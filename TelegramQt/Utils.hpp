@@ -45,6 +45,8 @@ QByteArray packGZip(const QByteArray &data);
 QByteArray unpackGZip(const QByteArray &data);
 
 constexpr quint32 c_gzipBufferSize = 1024;
+// The upper bound of the findDivider() work; a pq value needs about 2^17 steps
+constexpr quint64 c_maxFactorizationSteps = 1 << 24;
 
 }
 
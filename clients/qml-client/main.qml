@@ -35,8 +35,9 @@ ApplicationWindow {
         onSynced: console.log("Account synced")
     }
 
-    Telegram.InMemoryDataStorage {
+    Telegram.FileDataStorage {
         id: dataStorage
+        fileName: StandardPaths.writableLocation(StandardPaths.HomeLocation) + "/.cache/telegram-qt/data/" + accountStorage.accountIdentifier
     }
 
     Telegram.AppInformation {
@@ -99,6 +100,9 @@ ApplicationWindow {
         running: true
         onTriggered: {
             if (accountStorage.fileExists() && accountStorage.loadData()) {
+                if (dataStorage.fileExists()) {
+                    dataStorage.loadData()
+                }
                 signInOperation.checkIn()
             } else {
                 signInOperation.signIn()
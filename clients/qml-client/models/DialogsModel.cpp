@@ -1,6 +1,7 @@
 #include "DialogsModel.hpp"
 
 #include "Client.hpp"
+#include "ContactsApi.hpp"
 #include "DataStorage.hpp"
 #include "Debug.hpp"
 #include "MessagingApi.hpp"
@@ -143,7 +144,7 @@ void DialogsModel::populate()
 {
     m_list = client()->messagingApi()->getDialogList();
     connect(m_list->becomeReady(), &Telegram::PendingOperation::finished, this, &DialogsModel::onListReady);
-    if (m_list->isReady()) {
+    if (m_list->isReady() || !m_list->peers().isEmpty()) {
         onListReady();
     }
 }
@@ -185,7 +186,7 @@ QString getPeerAlias(const Telegram::Peer &peer, const Telegram::Client::Client
 void DialogsModel::onListReady()
 {
     qWarning() << Q_FUNC_INFO;
-    connect(m_list, &DialogList::listChanged, this, &DialogsModel::onListChanged);
+    connect(m_list, &DialogList::listChanged, this, &DialogsModel::onListChanged, Qt::UniqueConnection);
     beginResetModel();
     m_dialogs.clear();
     const QVector<Telegram::Peer> peers = m_list->peers();
@@ -216,6 +217,19 @@ void DialogsModel::addPeer(const Peer &peer)
     d.name = getPeerAlias(peer, c);
     d.peer = peer;
 
+    UserInfo userInfo;
+    ChatInfo chatInfo;
+    const bool hasPeerInfo = peer.type == Peer::User ? c->dataStorage()->getUserInfo(&userInfo, peer.id)
+                                                     : c->dataStorage()->getChatInfo(&chatInfo, peer);
+    if (!hasPeerInfo) {
+        // The lookups of all unknown peers of the list are sent as a single request
+        PendingOperation *operation = peer.type == Peer::User ? c->contactsApi()->getUserInfo(peer.id)
+                                                              : c->messagingApi()->getChatInfo(peer);
+        connect(operation, &PendingOperation::succeeded, this, [this, peer]() {
+            onPeerInfoReceived(peer);
+        });
+    }
+
     Telegram::DialogInfo apiInfo;
     if (c->dataStorage()->getDialogInfo(&apiInfo, peer)) {
         d.unreadCount = apiInfo.unreadCount();
@@ -231,6 +245,18 @@ void DialogsModel::addPeer(const Peer &peer)
     m_dialogs << d;
 }
 
+void DialogsModel::onPeerInfoReceived(const Peer &peer)
+{
+    for (int i = 0; i < m_dialogs.count(); ++i) {
+        if (m_dialogs.at(i).peer != peer) {
+            continue;
+        }
+        m_dialogs[i].name = getPeerAlias(peer, client());
+        emit dataChanged(index(i, 0), index(i, columnCount() - 1));
+        return;
+    }
+}
+
 DialogsModel::Role DialogsModel::intToRole(int value)
 {
     if (value < 0 || value > static_cast<int>(Role::Count)) {
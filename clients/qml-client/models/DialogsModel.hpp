@@ -88,6 +88,7 @@ private slots:
     void onListReady();
     void onListChanged(const Telegram::PeerList &added, const Telegram::PeerList &removed);
     void addPeer(const Telegram::Peer &peer);
+    void onPeerInfoReceived(const Telegram::Peer &peer);
 
 private:
     QVariantMap getDialogLastMessageData(const DialogEntry &dialog) const;
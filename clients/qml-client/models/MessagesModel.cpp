@@ -303,8 +303,8 @@ void MessagesModel::setQmlClient(DeclarativeClient *qmlClient)
     m_qmlClient = qmlClient;
     emit clientChanged();
 
-    connect(client()->messagingApi(), &MessagingApi::messageReceived,
-            this, &MessagesModel::onMessageReceived);
+    connect(client()->messagingApi(), &MessagingApi::messagesReceived,
+            this, &MessagesModel::onMessagesReceived);
 }
 
 //const MessagesModel::SMessage *MessagesModel::messageAt(quint32 messageIndex) const
@@ -517,6 +517,9 @@ void MessagesModel::fetchPrevious()
     connect(op, &MessagesOperation::finished, this, [this, op] () {
         processMessages(op->messages());
     });
+    connect(op, &MessagesOperation::messagesRefreshed, this, [this, op] () {
+        processMessages(op->messages());
+    });
 }
 
 void MessagesModel::fetchNext()
@@ -556,13 +559,13 @@ void MessagesModel::processMessages(const QVector<quint32> &messageIds)
     endResetModel();
 }
 
-void MessagesModel::onMessageReceived(const Peer peer, quint32 messageId)
+void MessagesModel::onMessagesReceived(const Peer peer, const QVector<quint32> &messageIds)
 {
-    qDebug() << Q_FUNC_INFO << "peer:" << peer << "messageId:" << messageId;
+    qDebug() << Q_FUNC_INFO << "peer:" << peer << "messageIds:" << messageIds;
     if (peer != m_peer) {
         return;
     }
-    insertMessages({messageId});
+    insertMessages(messageIds);
 }
 
 MessagesModel::Role MessagesModel::intToRole(int value)
@@ -265,7 +265,7 @@ protected:
     void insertMessages(const QVector<quint32> &messageIds);
 
     void processMessages(const QVector<quint32> &messageIds);
-    void onMessageReceived(const Telegram::Peer peer, quint32 messageId);
+    void onMessagesReceived(const Telegram::Peer peer, const QVector<quint32> &messageIds);
 
     static Role intToRole(int value);
     static Column intToColumn(int value);
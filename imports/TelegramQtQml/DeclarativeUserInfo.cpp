@@ -1,7 +1,9 @@
 #include "DeclarativeUserInfo.hpp"
 
 #include "Client.hpp"
+#include "ContactsApi.hpp"
 #include "DataStorage.hpp"
+#include "PendingOperation.hpp"
 
 namespace Telegram {
 
@@ -35,7 +37,15 @@ void DeclarativeUserInfo::setDisplayName(const QString &displayName)
 void DeclarativeUserInfo::updateDisplayName()
 {
     UserInfo info;
-    client()->dataStorage()->getUserInfo(&info, m_contactId);
+    if (!client()->dataStorage()->getUserInfo(&info, m_contactId) && m_contactId) {
+        const quint32 contactId = m_contactId;
+        PendingOperation *operation = client()->contactsApi()->getUserInfo(contactId);
+        connect(operation, &PendingOperation::succeeded, this, [this, contactId]() {
+            if (m_contactId == contactId) {
+                updateDisplayName();
+            }
+        });
+    }
     setDisplayName(info.firstName());
 }
 
@@ -3,6 +3,7 @@
 #include <QHostAddress>
 #include <QMetaMethod>
 #include <QTcpSocket>
+#include <QtEndian>
 
 #include "AesCtr.hpp"
 #include "CRawStream.hpp"
@@ -37,10 +38,6 @@ void TcpTransport::connectToHost(const QString &, quint16)
 bool TcpTransport::startObfuscatedSession()
 {
     qCDebug(c_loggingServerTcpTransport()) << Q_FUNC_INFO;
-    if (m_socket->bytesAvailable() < 64) {
-        qCWarning(c_loggingServerTcpTransport()) << Q_FUNC_INFO << "Invalid package size";
-        return false;
-    }
     QByteArray plainData = m_socket->read(56);
     CRawStream raw(plainData);
 
@@ -59,7 +56,15 @@ bool TcpTransport::startObfuscatedSession()
     // The client sends its encryption key in plain text
     setCryptoKeysSourceData(encryptionSourceData, DirectIsReadReversedIsWrite);
     QByteArray content1 = plainData + m_socket->read(8);
-    m_readAesContext->crypt(content1);
+    const QByteArray decryptedHeader = m_readAesContext->crypt(content1);
+    const quint32 protocolIdentifier = qFromLittleEndian<quint32>(decryptedHeader.constData() + 56);
+    PacketFraming::Mode framingMode;
+    if (!PacketFraming::getModeForProtocolIdentifier(protocolIdentifier, &framingMode)) {
+        qCWarning(c_loggingServerTcpTransport()) << Q_FUNC_INFO << "Unknown protocol identifier"
+                                                 << hex << showbase << protocolIdentifier;
+        return false;
+    }
+    m_framing.setMode(framingMode);
     return true;
 }
 
@@ -68,17 +73,31 @@ void TcpTransport::readEvent()
     if (Q_LIKELY(m_sessionType != Unknown)) {
         return;
     }
-    char sessionSign;
-    m_socket->getChar(&sessionSign);
-    if (sessionSign == char(0xef)) {
+    if (m_socket->bytesAvailable() < 4) {
+        // Wait for the complete session header
+        return;
+    }
+    const QByteArray sessionSign = m_socket->peek(4);
+    const quint32 sessionWord = qFromLittleEndian<quint32>(sessionSign.constData());
+    PacketFraming::Mode framingMode;
+    if (sessionSign.at(0) == char(0xef)) {
+        m_socket->read(1);
+        m_framing.setMode(PacketFraming::Mode::Abridged);
         setSessionType(Abridged);
+    } else if (PacketFraming::getModeForProtocolIdentifier(sessionWord, &framingMode)) {
+        m_socket->read(4);
+        m_framing.setMode(framingMode);
+        setSessionType(framingMode == PacketFraming::Mode::PaddedIntermediate ? PaddedIntermediate : Intermediate);
+    } else if (m_socket->bytesAvailable() < 64) {
+        // Wait for the complete obfuscation header
+        return;
+    } else if (startObfuscatedSession()) {
+        setSessionType(Obfuscated);
     } else {
-        m_socket->ungetChar(sessionSign);
-        if (startObfuscatedSession()) {
-            setSessionType(Obfuscated);
-        } else {
-            qCCritical(c_loggingServerTcpTransport()) << Q_FUNC_INFO << "Invalid data";
-        }
+        qCCritical(c_loggingServerTcpTransport()) << Q_FUNC_INFO << remoteAddress() << "Unknown session type";
+        setError(QAbstractSocket::UnknownSocketError, QStringLiteral("Unsupported session type"));
+        disconnectFromHost();
+        return;
     }
     qCDebug(c_loggingServerTcpTransport()) << Q_FUNC_INFO << remoteAddress() << "Session type:" << m_sessionType;
 }
@@ -68,6 +68,9 @@ bool LocalCluster::start()
     }
 
     for (const DcOption &dc : m_serverConfiguration.dcOptions) {
+        if (dc.flags & DcOption::LocalEndpointFlags) {
+            continue;
+        }
         Server *server = m_constructor(this);
         server->setServerConfiguration(m_serverConfiguration);
         server->setDcOption(dc);
@@ -76,6 +79,23 @@ bool LocalCluster::start()
         server->setAuthorizationProvider(m_authProvider);
         m_serverInstances.append(server);
     }
+    // The local socket and loopback endpoints are served by the server of the same DC
+    for (const DcOption &dc : m_serverConfiguration.dcOptions) {
+        if (!(dc.flags & DcOption::LocalEndpointFlags)) {
+            continue;
+        }
+        Server *server = getServerInstance(dc.id);
+        if (!server) {
+            qCCritical(c_loggingClusterCategory) << Q_FUNC_INFO << "Unable to find a server for the local endpoint"
+                                                 << dc.address << "of DC" << dc.id;
+            return false;
+        }
+        if (dc.flags & DcOption::LocalSocket) {
+            server->setLocalSocketName(dc.address);
+        } else {
+            server->setLoopbackName(dc.address);
+        }
+    }
 
     bool hasFails = false;
     for (Server *server : m_serverInstances) {
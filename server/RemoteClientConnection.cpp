@@ -69,6 +69,11 @@ void RemoteClientConnection::setRpcFactories(const QVector<RpcOperationFactory *
     rpcLayer()->setRpcFactories(rpcFactories);
 }
 
+void RemoteClientConnection::setDhWorkerPool(DhWorkerPool *pool)
+{
+    static_cast<DhLayer*>(m_dhLayer)->setWorkerPool(pool);
+}
+
 ServerApi *RemoteClientConnection::api() const
 {
     return rpcLayer()->api();
@@ -93,9 +98,14 @@ void RemoteClientConnection::setSession(Session *session)
 void RemoteClientConnection::onClientDhStateChanged()
 {
     if (m_dhLayer->state() == BaseDhLayer::State::HasKey) {
-        Session *session = api()->createSession(m_sendHelper->authId(), m_sendHelper->authKey(), m_transport->remoteAddress());
-        session->setInitialServerSalt(m_dhLayer->serverSalt());
+        Session *session = api()->createSession(m_sendHelper->authId(), m_sendHelper->authKey(),
+                                                m_transport->remoteAddress(), m_dhLayer->serverSalt());
         setSession(session);
+    } else if (m_dhLayer->state() == BaseDhLayer::State::Failed) {
+        // Free the handshake slot and the socket for the clients which are able to complete the handshake
+        qCInfo(loggingCategoryRemoteClientConnection) << this << transport()->remoteAddress()
+                                                      << "DH handshake failed";
+        transport()->disconnectFromHost();
     }
 }
 
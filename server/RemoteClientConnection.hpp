@@ -10,6 +10,7 @@ namespace Telegram {
 
 namespace Server {
 
+class DhWorkerPool;
 class ServerApi;
 class RpcLayer;
 class RpcOperationFactory;
@@ -24,6 +25,7 @@ public:
     RpcLayer *rpcLayer() const;
 
     void setRpcFactories(const QVector<RpcOperationFactory*> &rpcFactories);
+    void setDhWorkerPool(DhWorkerPool *pool);
 
     ServerApi *api() const;
     void setServerApi(ServerApi *api);
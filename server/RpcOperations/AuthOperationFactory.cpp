@@ -220,21 +220,39 @@ void AuthRpcOperation::runDropTempAuthKeys()
 
 void AuthRpcOperation::runExportAuthorization()
 {
-    // TLFunctions::TLAuthExportAuthorization &arguments = m_exportAuthorization;
-    if (processNotImplementedMethod(TLValue::AuthExportAuthorization)) {
+    const TLFunctions::TLAuthExportAuthorization &arguments = m_exportAuthorization;
+    qCDebug(c_serverAuthRpcCategory) << Q_FUNC_INFO << arguments.dcId;
+    LocalUser *self = layer()->getUser();
+    if (!self) {
+        sendRpcError(RpcError::AuthKeyUnregistered);
+        return;
+    }
+    if ((arguments.dcId == api()->dcId()) || !api()->serverConfiguration().getOption(ConnectionSpec(arguments.dcId)).isValid()) {
+        sendRpcError(RpcError::DcIdInvalid);
         return;
     }
+
     TLAuthExportedAuthorization result;
+    result.id = self->id();
+    result.bytes = api()->exportAuthorization(self, arguments.dcId);
     sendRpcReply(result);
 }
 
 void AuthRpcOperation::runImportAuthorization()
 {
-    // TLFunctions::TLAuthImportAuthorization &arguments = m_importAuthorization;
-    if (processNotImplementedMethod(TLValue::AuthImportAuthorization)) {
+    const TLFunctions::TLAuthImportAuthorization &arguments = m_importAuthorization;
+    qCDebug(c_serverAuthRpcCategory) << Q_FUNC_INFO << arguments.id;
+    LocalUser *user = api()->importAuthorization(arguments.id, arguments.bytes);
+    if (!user) {
+        sendRpcError(RpcError::AuthBytesInvalid);
         return;
     }
+    // The session is authorized for the requests to this DC, but the updates
+    // are delivered only to the sessions of the user home DC
+    layer()->session()->setUser(user);
+
     TLAuthAuthorization result;
+    Utils::setupTLUser(&result.user, user, user);
     sendRpcReply(result);
 }
 
@@ -17,12 +17,17 @@
 
 #include "ChannelsOperationFactory.hpp"
 
+#include "ApiUtils.hpp"
 #include "RpcOperationFactory_p.hpp"
 // TODO: Instead of this include, add a generated cpp with all needed template instances
 #include "ServerRpcOperation_p.hpp"
 
 #include "ServerApi.hpp"
+#include "ServerMessageData.hpp"
 #include "ServerRpcLayer.hpp"
+#include "ServerUtils.hpp"
+#include "Storage.hpp"
+#include "TelegramServerChannel.hpp"
 #include "TelegramServerUser.hpp"
 
 #include "Debug_p.hpp"
@@ -417,11 +422,21 @@ void ChannelsRpcOperation::runGetAdminedPublicChannels()
 
 void ChannelsRpcOperation::runGetChannels()
 {
-    // TLFunctions::TLChannelsGetChannels &arguments = m_getChannels;
-    if (processNotImplementedMethod(TLValue::ChannelsGetChannels)) {
-        return;
-    }
+    TLFunctions::TLChannelsGetChannels &arguments = m_getChannels;
+
+    const LocalUser *self = layer()->getUser();
     TLMessagesChats result;
+    result.chats.reserve(arguments.id.count());
+    TLChat chat;
+    for (const TLInputChannel &input : arguments.id) {
+        const LocalChannel *channel = api()->getChannel(input.channelId);
+        if (!channel) {
+            continue;
+        }
+        if (Utils::setupTLChat(&chat, channel, self)) {
+            result.chats.append(chat);
+        }
+    }
     sendRpcReply(result);
 }
 
@@ -437,11 +452,34 @@ void ChannelsRpcOperation::runGetFullChannel()
 
 void ChannelsRpcOperation::runGetMessages()
 {
-    // TLFunctions::TLChannelsGetMessages &arguments = m_getMessages;
-    if (processNotImplementedMethod(TLValue::ChannelsGetMessages)) {
+    TLFunctions::TLChannelsGetMessages &arguments = m_getMessages;
+
+    const LocalUser *self = layer()->getUser();
+    const LocalChannel *channel = api()->getChannel(arguments.channel.channelId);
+    if (!channel || !channel->hasMember(self->id())) {
+        sendRpcError(RpcError(RpcError::PeerIdInvalid));
         return;
     }
+    const PostBox *box = channel->getPostBox();
+
     TLMessagesMessages result;
+    result.messages.reserve(arguments.id.count());
+    for (const quint32 messageId : arguments.id) {
+        const MessageData *messageData = api()->storage()->getMessage(box->getMessageGlobalId(messageId));
+        TLMessage message;
+        if (messageData) {
+            Utils::setupTLMessage(&message, messageData, messageId, self);
+        } else {
+            message.tlType = TLValue::MessageEmpty;
+            message.id = messageId;
+        }
+        result.messages.append(message);
+    }
+
+    QSet<Peer> interestingPeers;
+    interestingPeers.insert(Peer::fromChannelId(channel->id()));
+    Utils::getInterestingPeers(&interestingPeers, result.messages);
+    Utils::setupTLPeers(&result, interestingPeers, api(), self);
     sendRpcReply(result);
 }
 
@@ -497,12 +535,34 @@ void ChannelsRpcOperation::runLeaveChannel()
 
 void ChannelsRpcOperation::runReadHistory()
 {
-    // TLFunctions::TLChannelsReadHistory &arguments = m_readHistory;
-    if (processNotImplementedMethod(TLValue::ChannelsReadHistory)) {
+    TLFunctions::TLChannelsReadHistory &arguments = m_readHistory;
+
+    LocalUser *self = layer()->getUser();
+    LocalChannel *channel = api()->getChannel(arguments.channel.channelId);
+    if (!channel || !channel->hasMember(self->id())) {
+        sendRpcError(RpcError(RpcError::PeerIdInvalid));
         return;
     }
-    bool result;
+
+    ChannelPostBox *box = channel->getPostBox();
+    const quint32 requestDate = Telegram::Utils::getCurrentTime();
+    const quint32 maxId = arguments.maxId ? arguments.maxId : box->lastMessageId();
+    const bool hasNewRead = box->setReadInboxMaxId(self->id(), maxId);
+
+    bool result = true;
     sendRpcReply(result);
+
+    if (hasNewRead && (self->activeSessions().count() > 1)) {
+        UpdateNotification readNotification;
+        readNotification.userId = self->userId();
+        readNotification.type = UpdateNotification::Type::ReadInbox;
+        readNotification.date = requestDate;
+        readNotification.pts = box->pts();
+        readNotification.messageId = box->readInboxMaxId(self->id());
+        readNotification.dialogPeer = channel->toPeer();
+        readNotification.excludeSession = layer()->session();
+        api()->queueUpdates({readNotification});
+    }
 }
 
 void ChannelsRpcOperation::runReadMessageContents()
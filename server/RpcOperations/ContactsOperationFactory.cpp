@@ -17,6 +17,7 @@
 
 #include "ContactsOperationFactory.hpp"
 
+#include "ApiUtils.hpp"
 #include "RpcOperationFactory_p.hpp"
 // TODO: Instead of this include, add a generated cpp with all needed template instances
 #include "ServerRpcOperation_p.hpp"
@@ -196,11 +197,19 @@ void ContactsRpcOperation::runGetBlocked()
 
 void ContactsRpcOperation::runGetContacts()
 {
+    TLFunctions::TLContactsGetContacts &arguments = m_getContacts;
+    LocalUser *self = layer()->getUser();
+
+    if (arguments.hash && (arguments.hash == self->contactListHash())) {
+        TLContactsContacts notModified;
+        notModified.tlType = TLValue::ContactsContactsNotModified;
+        sendRpcReply(notModified);
+        return;
+    }
+
     TLContactsContacts result;
     result.tlType = TLValue::ContactsContacts;
 
-    LocalUser *self = layer()->getUser();
-
     const QVector<UserContact> importedContacts = self->importedContacts();
     result.contacts.reserve(importedContacts.size());
     result.users.reserve(importedContacts.size());
@@ -318,11 +327,20 @@ void ContactsRpcOperation::runResolveUsername()
 
 void ContactsRpcOperation::runSearch()
 {
-    // TLFunctions::TLContactsSearch &arguments = m_search;
-    if (processNotImplementedMethod(TLValue::ContactsSearch)) {
-        return;
-    }
+    TLFunctions::TLContactsSearch &arguments = m_search;
+    LocalUser *self = layer()->getUser();
+
+    constexpr quint32 c_serverSearchLimit = 100;
+    const int limit = static_cast<int>(qMin(arguments.limit, c_serverSearchLimit));
+
     TLContactsFound result;
+    QSet<Peer> interestingPeers;
+    for (const quint32 userId : api()->searchUsers(arguments.q, limit)) {
+        const Peer userPeer = Peer::fromUserId(userId);
+        result.results.append(Telegram::Utils::toTLPeer(userPeer));
+        interestingPeers.insert(userPeer);
+    }
+    Utils::setupTLPeers(&result, interestingPeers, api(), self);
     sendRpcReply(result);
 }
 
@@ -157,6 +157,10 @@ void HelpRpcOperation::runGetConfig()
     // TODO: fill other fields of result
     // manually copy fields from all DcOption's to TLDcOption's
     for (const DcOption &dcOption : dcConfig.dcOptions) {
+        if (dcOption.flags & DcOption::LocalEndpointFlags) {
+            // The local endpoints are not a part of the protocol and configured on the client side
+            continue;
+        }
         TLDcOption tlDcOption;
         tlDcOption.id = dcOption.id;
         tlDcOption.ipAddress = dcOption.address;
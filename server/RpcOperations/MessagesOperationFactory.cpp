@@ -27,6 +27,7 @@
 #include "ServerRpcLayer.hpp"
 #include "ServerUtils.hpp"
 #include "Storage.hpp"
+#include "TelegramServerChannel.hpp"
 #include "TelegramServerUser.hpp"
 
 #include "Debug_p.hpp"
@@ -39,6 +40,8 @@
 
 #include <QLoggingCategory>
 
+#include <algorithm>
+
 namespace Telegram {
 
 namespace Server {
@@ -931,10 +934,7 @@ void MessagesRpcOperation::runGetBotCallbackAnswer()
 
 void MessagesRpcOperation::runGetChats()
 {
-    // TLFunctions::TLMessagesGetChats &arguments = m_getChats;
-    if (processNotImplementedMethod(TLValue::MessagesGetChats)) {
-        return;
-    }
+    // The server has no basic groups, so none of the requested chats is found
     TLMessagesChats result;
     sendRpcReply(result);
 }
@@ -976,6 +976,20 @@ void MessagesRpcOperation::runGetDialogs()
         dialog.readOutboxMaxId = d->readOutboxMaxId;
         dialog.unreadCount = d->unreadCount;
         dialog.unreadMentionsCount = d->unreadMentionsCount;
+
+        if (d->peer.type == Peer::Channel) {
+            const LocalChannel *channel = api()->getChannel(d->peer.id);
+            if (!channel) {
+                continue;
+            }
+            const ChannelPostBox *channelBox = channel->getPostBox();
+            box = channelBox;
+            dialog.topMessage = channelBox->lastMessageId();
+            dialog.readInboxMaxId = channelBox->readInboxMaxId(self->id());
+            dialog.unreadCount = channelBox->unreadCount(self->id());
+            dialog.pts = channelBox->pts();
+            dialog.flags |= TLDialog::Pts;
+        }
         result.dialogs.append(dialog);
 
         quint64 topMessageGlobalId = box->getMessageGlobalId(dialog.topMessage);
@@ -1053,9 +1067,9 @@ void MessagesRpcOperation::runGetHistory()
     case TLValue::InputPeerEmpty:
     case TLValue::InputPeerSelf:
     case TLValue::InputPeerUser:
+    case TLValue::InputPeerChannel:
         break;
     case TLValue::InputPeerChat:
-    case TLValue::InputPeerChannel:
     default:
         qCritical() << Q_FUNC_INFO << "Not implemented for requested peer" << arguments.peer.tlType;
         processNotImplementedMethod(TLValue::MessagesGetHistory);
@@ -1065,24 +1079,33 @@ void MessagesRpcOperation::runGetHistory()
 
     const LocalUser *self = layer()->getUser();
     const Peer peer = api()->getPeer(arguments.peer, self);
-    const QHash<quint32,quint64> messageKeys = self->getPostBox()->getAllMessageKeys();
-
-    if (arguments.offsetId || arguments.offsetDate || arguments.addOffset || arguments.minId || arguments.maxId || arguments.hash) {
-        qCritical() << Q_FUNC_INFO << "Not implemented for requested arguments" << arguments.peer.tlType;
-        processNotImplementedMethod(TLValue::MessagesGetHistory);
-        sendRpcError(RpcError());
-        return;
+    const PostBox *box = self->getPostBox();
+    if (peer.type == Peer::Channel) {
+        const LocalChannel *channel = api()->getChannel(peer.id);
+        if (!channel || !channel->hasMember(self->id())) {
+            sendRpcError(RpcError(RpcError::PeerIdInvalid));
+            return;
+        }
+        box = channel->getPostBox();
     }
-
     constexpr int c_serverHistorySliceLimit = 30;
-    const int serverLimit = qMin<int>(c_serverHistorySliceLimit, messageKeys.count());
-    const int actualLimit = qMin<int>(static_cast<int>(arguments.limit), serverLimit);
+    const int actualLimit = qMin<int>(static_cast<int>(arguments.limit), c_serverHistorySliceLimit);
 
     TLMessagesMessages result;
     result.messages.reserve(actualLimit);
 
-    for (quint32 messageId = self->getPostBox()->lastMessageId(); messageId != 0; --messageId) {
-        const quint64 globalMessageId = messageKeys.value(messageId);
+    quint32 messageId = box->lastMessageId();
+    if (arguments.offsetId && (arguments.offsetId <= messageId)) {
+        messageId = arguments.offsetId - 1;
+    }
+    if (arguments.maxId && (arguments.maxId <= messageId)) {
+        messageId = arguments.maxId - 1;
+    }
+
+    quint32 skipCount = arguments.addOffset;
+    quint32 hash = 0;
+    for ( ; (messageId > arguments.minId) && (result.messages.count() < actualLimit); --messageId) {
+        const quint64 globalMessageId = box->getMessageGlobalId(messageId);
         if (!globalMessageId) {
             // It's OK to have no message e.g. for deleted entires
             continue;
@@ -1105,11 +1128,24 @@ void MessagesRpcOperation::runGetHistory()
                 continue;
             }
         }
+        if (arguments.offsetDate && (message.date >= arguments.offsetDate)) {
+            continue;
+        }
+        if (skipCount) {
+            --skipCount;
+            continue;
+        }
 
+        hash = Telegram::Utils::updateMessagesHash(hash, message);
         result.messages.append(message);
-        if (result.messages.count() >= actualLimit) {
-            break;
-        }
+    }
+
+    if (arguments.hash && (arguments.hash == hash)) {
+        TLMessagesMessages notModified;
+        notModified.tlType = TLValue::MessagesMessagesNotModified;
+        notModified.count = static_cast<quint32>(result.messages.count());
+        sendRpcReply(notModified);
+        return;
     }
 
     QSet<Peer> interestingPeers;
@@ -1163,11 +1199,28 @@ void MessagesRpcOperation::runGetMessageEditData()
 
 void MessagesRpcOperation::runGetMessages()
 {
-    // TLFunctions::TLMessagesGetMessages &arguments = m_getMessages;
-    if (processNotImplementedMethod(TLValue::MessagesGetMessages)) {
-        return;
-    }
+    TLFunctions::TLMessagesGetMessages &arguments = m_getMessages;
+
+    const LocalUser *self = layer()->getUser();
+    const PostBox *box = self->getPostBox();
+
     TLMessagesMessages result;
+    result.messages.reserve(arguments.id.count());
+    for (const quint32 messageId : arguments.id) {
+        const MessageData *messageData = api()->storage()->getMessage(box->getMessageGlobalId(messageId));
+        TLMessage message;
+        if (messageData) {
+            Utils::setupTLMessage(&message, messageData, messageId, self);
+        } else {
+            message.tlType = TLValue::MessageEmpty;
+            message.id = messageId;
+        }
+        result.messages.append(message);
+    }
+
+    QSet<Peer> interestingPeers;
+    Utils::getInterestingPeers(&interestingPeers, result.messages);
+    Utils::setupTLPeers(&result, interestingPeers, api(), self);
     sendRpcReply(result);
 }
 
@@ -1368,32 +1421,25 @@ void MessagesRpcOperation::runReadHistory()
     }
 
     const quint32 requestDate = Telegram::Utils::getCurrentTime();
-    QVector<quint32> affectedMessages;
-    quint32 maxId = qMax(dialog->topMessage, arguments.maxId);
-    for (quint32 messageId = maxId; messageId > dialog->readInboxMaxId; --messageId) {
-        affectedMessages.append(messageId);
-    }
-
-    dialog->readInboxMaxId = maxId;
+    const quint32 maxId = arguments.maxId ? qMin(arguments.maxId, dialog->topMessage) : dialog->topMessage;
 
-    const quint64 globalMessageId = self->getPostBox()->getMessageGlobalId(maxId);
-    const MessageData *messageData = api()->storage()->getMessage(globalMessageId);
-
-    LocalUser *messageSender = api()->getUser(messageData->fromId());
-    UserDialog *senderDialog = messageSender->getDialog(messageData->toPeer());
-    quint32 senderMessageId = messageData->getReference(messageSender->toPeer());
-
-    if (senderDialog->readOutboxMaxId < senderMessageId) {
-        // Message sender update needed
-        senderDialog->readOutboxMaxId = senderMessageId;
-        messageSender->getPostBox()->bumpPts();
-    }
+    QVector<UnreadMessage> lastReadMessages;
+    const bool hasNewRead = self->readInbox(dialog, maxId, &lastReadMessages);
 
     TLMessagesAffectedMessages result;
-    result.pts = self->getPostBox()->bumpPts();
-    result.ptsCount = 1;
+    if (hasNewRead) {
+        result.pts = self->getPostBox()->addUpdate(PostBoxUpdate::Type::ReadInbox, targetPeer, maxId);
+        result.ptsCount = 1;
+    } else {
+        result.pts = self->getPostBox()->pts();
+        result.ptsCount = 0;
+    }
     sendRpcReply(result);
 
+    if (!hasNewRead) {
+        return;
+    }
+
     if (self->activeSessions().count() > 1) {
         UpdateNotification readNotification;
         readNotification.userId = self->userId();
@@ -1406,15 +1452,36 @@ void MessagesRpcOperation::runReadHistory()
         api()->queueUpdates({readNotification});
     }
 
-    if (messageSender->hasActiveSession()) {
-        UpdateNotification readNotification;
-        readNotification.userId = messageSender->userId();
-        readNotification.type = UpdateNotification::Type::ReadOutbox;
-        readNotification.date = requestDate;
-        readNotification.pts = messageSender->getPostBox()->pts();
-        readNotification.messageId = senderMessageId;
-        readNotification.dialogPeer = messageData->toPeer();
-        api()->queueUpdates({readNotification});
+    // Each sender of the read messages sees the outbox read up to the last read message.
+    // Unread entries keep the sender message ids, so there is no need to lookup the message data.
+    const Peer senderDialogPeer = targetPeer.type == Peer::User ? self->toPeer() : targetPeer;
+    QVector<UpdateNotification> readNotifications;
+    for (const UnreadMessage &lastReadMessage : lastReadMessages) {
+        LocalUser *messageSender = api()->getUser(lastReadMessage.senderId);
+        if (!messageSender || (messageSender == self)) {
+            continue;
+        }
+        UserDialog *senderDialog = messageSender->getDialog(senderDialogPeer);
+        if (!senderDialog || (senderDialog->readOutboxMaxId >= lastReadMessage.senderMessageId)) {
+            continue;
+        }
+        senderDialog->readOutboxMaxId = lastReadMessage.senderMessageId;
+        const quint32 senderPts = messageSender->getPostBox()->addUpdate(PostBoxUpdate::Type::ReadOutbox,
+                                                                         senderDialogPeer,
+                                                                         lastReadMessage.senderMessageId);
+        if (messageSender->hasActiveSession()) {
+            UpdateNotification readNotification;
+            readNotification.userId = messageSender->userId();
+            readNotification.type = UpdateNotification::Type::ReadOutbox;
+            readNotification.date = requestDate;
+            readNotification.pts = senderPts;
+            readNotification.messageId = lastReadMessage.senderMessageId;
+            readNotification.dialogPeer = senderDialogPeer;
+            readNotifications.append(readNotification);
+        }
+    }
+    if (!readNotifications.isEmpty()) {
+        api()->queueUpdates(readNotifications);
     }
 }
 
@@ -1540,11 +1607,86 @@ void MessagesRpcOperation::runSaveRecentSticker()
 
 void MessagesRpcOperation::runSearch()
 {
-    // TLFunctions::TLMessagesSearch &arguments = m_search;
-    if (processNotImplementedMethod(TLValue::MessagesSearch)) {
-        return;
+    TLFunctions::TLMessagesSearch &arguments = m_search;
+    LocalUser *self = layer()->getUser();
+    const Peer peer = api()->getPeer(arguments.peer, self);
+    const PostBox *box = self->getPostBox();
+    if (peer.type == Peer::Channel) {
+        const LocalChannel *channel = api()->getChannel(peer.id);
+        if (!channel || !channel->hasMember(self->id())) {
+            sendRpcError(RpcError(RpcError::PeerIdInvalid));
+            return;
+        }
+        box = channel->getPostBox();
+    }
+
+    quint32 fromUserId = 0;
+    if (arguments.fromId.tlType != TLValue::InputUserEmpty) {
+        const AbstractUser *fromUser = api()->getUser(arguments.fromId, self);
+        if (!fromUser) {
+            sendRpcError(RpcError(RpcError::UserIdInvalid));
+            return;
+        }
+        fromUserId = fromUser->id();
     }
+
     TLMessagesMessages result;
+    // There are only text messages on the server, so nothing matches a media filter
+    if (arguments.filter.tlType != TLValue::InputMessagesFilterEmpty) {
+        sendRpcReply(result);
+        return;
+    }
+
+    constexpr quint32 c_serverSearchLimit = 100;
+    const int limit = static_cast<int>(qMin(arguments.limit, c_serverSearchLimit));
+    Storage *storage = api()->storage();
+    quint32 skip = arguments.addOffset;
+
+    // The box index has only the messages visible for the user; the sender and the dialog are indexed as tags
+    QStringList tags;
+    if (fromUserId) {
+        tags.append(PostBox::senderTag(fromUserId));
+    }
+    if (peer.isValid() && (peer.type != Peer::Channel)) {
+        tags.append(PostBox::dialogTag(peer));
+    }
+    quint32 maxId = arguments.offsetId;
+    if (arguments.maxId && (!maxId || (arguments.maxId < maxId))) {
+        maxId = arguments.maxId;
+    }
+    if (limit > 0) {
+        box->searchIndex()->search(arguments.q, tags, maxId, [&](quint64 id) {
+            const quint32 messageId = static_cast<quint32>(id);
+            if (arguments.minId && (messageId <= arguments.minId)) {
+                return false;
+            }
+            const MessageData *messageData = storage->getMessage(box->getMessageGlobalId(messageId));
+            if (!messageData) {
+                return true;
+            }
+            if (arguments.minDate && (messageData->date() < arguments.minDate)) {
+                return false;
+            }
+            if (arguments.maxDate && (messageData->date() > arguments.maxDate)) {
+                return true;
+            }
+            if (skip) {
+                --skip;
+                return true;
+            }
+            TLMessage message;
+            Utils::setupTLMessage(&message, messageData, messageId, self);
+            result.messages.append(message);
+            return result.messages.count() < limit;
+        });
+    }
+
+    QSet<Peer> interestingPeers;
+    if (peer.isValid()) {
+        interestingPeers.insert(peer);
+    }
+    Utils::getInterestingPeers(&interestingPeers, result.messages);
+    Utils::setupTLPeers(&result, interestingPeers, api(), self);
     sendRpcReply(result);
 }
 
@@ -1560,11 +1702,78 @@ void MessagesRpcOperation::runSearchGifs()
 
 void MessagesRpcOperation::runSearchGlobal()
 {
-    // TLFunctions::TLMessagesSearchGlobal &arguments = m_searchGlobal;
-    if (processNotImplementedMethod(TLValue::MessagesSearchGlobal)) {
-        return;
+    TLFunctions::TLMessagesSearchGlobal &arguments = m_searchGlobal;
+    const LocalUser *self = layer()->getUser();
+
+    // The user sees the messages of the own box and of the boxes of the joined channels
+    QVector<const PostBox *> boxes = { self->getPostBox() };
+    for (const UserDialog *dialog : self->dialogs()) {
+        if (dialog->peer.type != Peer::Channel) {
+            continue;
+        }
+        const LocalChannel *channel = api()->getChannel(dialog->peer.id);
+        if (channel && channel->hasMember(self->id())) {
+            boxes.append(channel->getPostBox());
+        }
+    }
+
+    quint64 maxGlobalId = 0;
+    if (arguments.offsetId) {
+        const Peer offsetPeer = api()->getPeer(arguments.offsetPeer, self);
+        for (const PostBox *box : boxes) {
+            if (box->peer() == (offsetPeer.type == Peer::Channel ? offsetPeer : self->toPeer())) {
+                maxGlobalId = box->getMessageGlobalId(arguments.offsetId);
+                break;
+            }
+        }
+    }
+
+    constexpr quint32 c_serverSearchLimit = 100;
+    const int limit = static_cast<int>(qMin(arguments.limit, c_serverSearchLimit));
+    Storage *storage = api()->storage();
+
+    // Take the latest matches of each box and merge them by the global id, which grows along with the date
+    struct Match {
+        const MessageData *messageData;
+        quint32 messageId;
+    };
+    QVector<Match> matches;
+    for (const PostBox *box : boxes) {
+        const quint32 maxId = maxGlobalId ? box->getLastMessageIdBefore(maxGlobalId) + 1 : 0;
+        if ((limit <= 0) || (maxId == 1)) {
+            continue;
+        }
+        int boxMatches = 0;
+        box->searchIndex()->search(arguments.q, maxId, [&](quint64 id) {
+            const quint32 messageId = static_cast<quint32>(id);
+            const MessageData *messageData = storage->getMessage(box->getMessageGlobalId(messageId));
+            if (!messageData) {
+                return true;
+            }
+            if (arguments.offsetDate && (messageData->date() > arguments.offsetDate)) {
+                return true;
+            }
+            matches.append({ messageData, messageId });
+            return ++boxMatches < limit;
+        });
+    }
+    std::sort(matches.begin(), matches.end(), [](const Match &left, const Match &right) {
+        return left.messageData->globalId() > right.messageData->globalId();
+    });
+    if (matches.count() > limit) {
+        matches.resize(limit);
     }
+
     TLMessagesMessages result;
+    for (const Match &match : matches) {
+        TLMessage message;
+        Utils::setupTLMessage(&message, match.messageData, match.messageId, self);
+        result.messages.append(message);
+    }
+
+    QSet<Peer> interestingPeers;
+    Utils::getInterestingPeers(&interestingPeers, result.messages);
+    Utils::setupTLPeers(&result, interestingPeers, api(), self);
     sendRpcReply(result);
 }
 
@@ -1662,6 +1871,15 @@ void MessagesRpcOperation::runSendMessage()
         notification.date = requestDate;
         notification.messageId = newMessageId;
         notification.pts = box->pts();
+        if (box->peer().type == Peer::Channel) {
+            // The members share the channel box, so there is neither per-member message copies
+            // nor per-member dialog updates. Server delivers the message to the members on its own.
+            notification.userId = self->id();
+            notification.dialogPeer = targetPeer;
+            notifications.append(notification);
+            selfNotification = &notifications.last();
+            continue;
+        }
         for (const quint32 userId : box->users()) {
             notification.userId = userId;
             if (targetPeer.type == Peer::User) {
@@ -1685,13 +1903,27 @@ void MessagesRpcOperation::runSendMessage()
     selfNotification->excludeSession = layer()->session();
     selfNotification->dialogPeer = targetPeer;
 
+    for (const UpdateNotification &notification : notifications) {
+        if (notification.userId == self->id()) {
+            continue;
+        }
+        LocalUser *user = api()->getUser(notification.userId);
+        UnreadMessage unreadMessage;
+        unreadMessage.messageId = notification.messageId;
+        unreadMessage.senderId = self->id();
+        unreadMessage.senderMessageId = selfNotification->messageId;
+        unreadMessage.mention = Utils::hasMention(arguments.message, user->userName());
+        user->addUnreadMessage(notification.dialogPeer, unreadMessage);
+    }
+
     TLUpdate updateMessageId;
     updateMessageId.tlType = TLValue::UpdateMessageID;
     updateMessageId.quint32Id = selfNotification->messageId;
     updateMessageId.randomId = arguments.randomId;
 
     TLUpdate newMessageUpdate;
-    newMessageUpdate.tlType = TLValue::UpdateNewMessage;
+    newMessageUpdate.tlType = targetPeer.type == Peer::Channel ? TLValue::UpdateNewChannelMessage
+                                                               : TLValue::UpdateNewMessage;
     newMessageUpdate.pts = selfNotification->pts;
     newMessageUpdate.ptsCount = 1;
 
@@ -22,7 +22,10 @@
 #include "ServerRpcOperation_p.hpp"
 
 #include "ServerApi.hpp"
+#include "ServerFileStore.hpp"
 #include "ServerRpcLayer.hpp"
+#include "ServerUtils.hpp"
+#include "Storage.hpp"
 #include "TelegramServerUser.hpp"
 
 #include "Debug_p.hpp"
@@ -102,11 +105,39 @@ void PhotosRpcOperation::runUpdateProfilePhoto()
 
 void PhotosRpcOperation::runUploadProfilePhoto()
 {
-    // TLFunctions::TLPhotosUploadProfilePhoto &arguments = m_uploadProfilePhoto;
-    if (processNotImplementedMethod(TLValue::PhotosUploadProfilePhoto)) {
+    const TLFunctions::TLPhotosUploadProfilePhoto &arguments = m_uploadProfilePhoto;
+    LocalUser *self = layer()->getUser();
+    quint32 missingPart = 0;
+    const FileDescriptor descriptor = api()->storage()->fileStore()->commitUpload(self->userId(),
+                                                                                  arguments.file.id,
+                                                                                  arguments.file.parts,
+                                                                                  arguments.file.name,
+                                                                                  api()->dcId(),
+                                                                                  &missingPart);
+    if (!descriptor.isValid()) {
+        sendRpcError(RpcError(RpcError::FilePartXMissing, missingPart));
         return;
     }
+
+    // The image is not processed, so the only size refers to the uploaded file as is
+    TLPhotoSize size;
+    size.tlType = TLValue::PhotoSize;
+    size.type = QStringLiteral("x");
+    size.location.tlType = TLValue::FileLocation;
+    size.location.volumeId = descriptor.volumeId;
+    size.location.localId = descriptor.localId;
+    size.location.secret = descriptor.secret;
+    size.location.dcId = descriptor.dcId;
+    size.size = descriptor.size;
+
     TLPhotosPhoto result;
+    result.photo.tlType = TLValue::Photo;
+    result.photo.id = descriptor.localId;
+    result.photo.accessHash = descriptor.secret;
+    result.photo.date = descriptor.date;
+    result.photo.sizes.append(size);
+    result.users.resize(1);
+    Utils::setupTLUser(&result.users[0], self, self);
     sendRpcReply(result);
 }
 // End of generated run methods
@@ -21,9 +21,12 @@
 // TODO: Instead of this include, add a generated cpp with all needed template instances
 #include "ServerRpcOperation_p.hpp"
 
+#include "ApiUtils.hpp"
 #include "ServerApi.hpp"
+#include "ServerMessageData.hpp"
 #include "ServerRpcLayer.hpp"
 #include "ServerUtils.hpp"
+#include "Storage.hpp"
 #include "TelegramServerUser.hpp"
 
 #include "Debug_p.hpp"
@@ -76,11 +79,95 @@ void UpdatesRpcOperation::runGetChannelDifference()
 
 void UpdatesRpcOperation::runGetDifference()
 {
-    // TLFunctions::TLUpdatesGetDifference &arguments = m_getDifference;
-    if (processNotImplementedMethod(TLValue::UpdatesGetDifference)) {
+    TLFunctions::TLUpdatesGetDifference &arguments = m_getDifference;
+
+    LocalUser *self = layer()->getUser();
+    const PostBox *box = self->getPostBox();
+
+    TLUpdatesDifference result;
+    if (arguments.pts >= box->pts()) {
+        result.tlType = TLValue::UpdatesDifferenceEmpty;
+        result.date = Telegram::Utils::getCurrentTime();
+        result.seq = 0;
+        sendRpcReply(result);
         return;
     }
-    TLUpdatesDifference result;
+
+    QVector<PostBoxUpdate> updates;
+    if (!box->getUpdates(arguments.pts, &updates)) {
+        // The requested state is older than the log, the client have to refetch the dialogs
+        result.tlType = TLValue::UpdatesDifferenceTooLong;
+        result.pts = box->pts();
+        sendRpcReply(result);
+        return;
+    }
+
+    constexpr int c_serverDifferenceLimit = 1000;
+    int limit = c_serverDifferenceLimit;
+    if (arguments.ptsTotalLimit) {
+        limit = qMin<int>(limit, static_cast<int>(arguments.ptsTotalLimit));
+    }
+    const bool isSlice = updates.count() > limit;
+    if (isSlice) {
+        updates.resize(limit);
+    }
+
+    QSet<Peer> interestingPeers;
+    for (const PostBoxUpdate &update : updates) {
+        switch (update.type) {
+        case PostBoxUpdate::Type::NewMessage:
+        case PostBoxUpdate::Type::EditMessage:
+        {
+            const quint64 globalMessageId = box->getMessageGlobalId(update.messageId);
+            const MessageData *messageData = api()->storage()->getMessage(globalMessageId);
+            if (!messageData) {
+                // It's OK to have no message e.g. for deleted entires
+                continue;
+            }
+            if (update.type == PostBoxUpdate::Type::NewMessage) {
+                result.newMessages.resize(result.newMessages.size() + 1);
+                Utils::setupTLMessage(&result.newMessages.last(), messageData, update.messageId, self);
+            } else {
+                TLUpdate editUpdate;
+                editUpdate.tlType = TLValue::UpdateEditMessage;
+                editUpdate.pts = update.pts;
+                editUpdate.ptsCount = 1;
+                Utils::setupTLMessage(&editUpdate.message, messageData, update.messageId, self);
+                result.otherUpdates.append(editUpdate);
+            }
+            interestingPeers.insert(messageData->toPeer());
+            interestingPeers.insert(Peer::fromUserId(messageData->fromId()));
+        }
+            break;
+        case PostBoxUpdate::Type::ReadInbox:
+        case PostBoxUpdate::Type::ReadOutbox:
+        {
+            TLUpdate readUpdate;
+            readUpdate.tlType = update.type == PostBoxUpdate::Type::ReadInbox
+                    ? TLValue::UpdateReadHistoryInbox
+                    : TLValue::UpdateReadHistoryOutbox;
+            readUpdate.pts = update.pts;
+            readUpdate.ptsCount = 1;
+            readUpdate.peer = Telegram::Utils::toTLPeer(update.dialogPeer);
+            readUpdate.maxId = update.messageId;
+            result.otherUpdates.append(readUpdate);
+            interestingPeers.insert(update.dialogPeer);
+        }
+            break;
+        case PostBoxUpdate::Type::Invalid:
+            break;
+        }
+    }
+    Utils::setupTLPeers(&result, interestingPeers, api(), self);
+
+    if (isSlice) {
+        result.tlType = TLValue::UpdatesDifferenceSlice;
+        Utils::setupTLUpdatesState(&result.intermediateState, self);
+        result.intermediateState.pts = updates.last().pts;
+    } else {
+        result.tlType = TLValue::UpdatesDifference;
+        Utils::setupTLUpdatesState(&result.state, self);
+    }
     sendRpcReply(result);
 }
 
@@ -22,7 +22,9 @@
 #include "ServerRpcOperation_p.hpp"
 
 #include "ServerApi.hpp"
+#include "ServerFileStore.hpp"
 #include "ServerRpcLayer.hpp"
+#include "Storage.hpp"
 #include "TelegramServerUser.hpp"
 
 #include "Debug_p.hpp"
@@ -39,6 +41,8 @@ namespace Telegram {
 
 namespace Server {
 
+static const quint32 c_maxGetFileLimit = 1024 * 1024;
+
 // Generated process methods
 bool UploadRpcOperation::processGetCdnFile(RpcProcessingContext &context)
 {
@@ -113,11 +117,33 @@ void UploadRpcOperation::runGetCdnFileHashes()
 
 void UploadRpcOperation::runGetFile()
 {
-    // TLFunctions::TLUploadGetFile &arguments = m_getFile;
-    if (processNotImplementedMethod(TLValue::UploadGetFile)) {
+    const TLFunctions::TLUploadGetFile &arguments = m_getFile;
+    if (arguments.location.tlType != TLValue::InputFileLocation) {
+        sendRpcError(RpcError(RpcError::LocationInvalid));
+        return;
+    }
+    if (!arguments.limit || (arguments.limit > c_maxGetFileLimit) || (arguments.limit % 1024)) {
+        sendRpcError(RpcError(RpcError::LimitInvalid));
+        return;
+    }
+    if (arguments.offset % 1024) {
+        sendRpcError(RpcError(RpcError::OffsetInvalid));
+        return;
+    }
+    FileStore *fileStore = api()->storage()->fileStore();
+    const FileDescriptor *descriptor = fileStore->getFileDescriptor(arguments.location.volumeId,
+                                                                    arguments.location.localId,
+                                                                    arguments.location.secret);
+    if (!descriptor) {
+        sendRpcError(RpcError(RpcError::LocationInvalid));
         return;
     }
+
     TLUploadFile result;
+    result.tlType = TLValue::UploadFile;
+    result.type.tlType = TLValue::StorageFilePartial;
+    result.mtime = descriptor->date;
+    result.bytes = fileStore->readFile(*descriptor, arguments.offset, arguments.limit);
     sendRpcReply(result);
 }
 
@@ -143,24 +169,36 @@ void UploadRpcOperation::runReuploadCdnFile()
 
 void UploadRpcOperation::runSaveBigFilePart()
 {
-    // TLFunctions::TLUploadSaveBigFilePart &arguments = m_saveBigFilePart;
-    if (processNotImplementedMethod(TLValue::UploadSaveBigFilePart)) {
+    const TLFunctions::TLUploadSaveBigFilePart &arguments = m_saveBigFilePart;
+    if (!arguments.fileTotalParts || (arguments.fileTotalParts > FileStore::c_maxPartsCount)) {
+        sendRpcError(RpcError(RpcError::FilePartsInvalid));
         return;
     }
-    bool result;
-    sendRpcReply(result);
+    savePart(arguments.fileId, arguments.filePart, arguments.bytes, arguments.fileTotalParts);
 }
 
 void UploadRpcOperation::runSaveFilePart()
 {
-    // TLFunctions::TLUploadSaveFilePart &arguments = m_saveFilePart;
-    if (processNotImplementedMethod(TLValue::UploadSaveFilePart)) {
+    const TLFunctions::TLUploadSaveFilePart &arguments = m_saveFilePart;
+    savePart(arguments.fileId, arguments.filePart, arguments.bytes, 0);
+}
+// End of generated run methods
+
+void UploadRpcOperation::savePart(quint64 fileId, quint32 part, const QByteArray &bytes, quint32 totalParts)
+{
+    if (bytes.isEmpty() || (static_cast<quint32>(bytes.size()) > FileStore::c_maxPartSize)) {
+        sendRpcError(RpcError(RpcError::FilePartSizeInvalid));
+        return;
+    }
+    const LocalUser *self = layer()->getUser();
+    FileStore *fileStore = api()->storage()->fileStore();
+    if (!fileStore->saveFilePart(self->userId(), fileId, part, bytes, totalParts)) {
+        sendRpcError(RpcError(RpcError::FilePartInvalid));
         return;
     }
-    bool result;
+    bool result = true;
     sendRpcReply(result);
 }
-// End of generated run methods
 
 void UploadRpcOperation::setRunMethod(UploadRpcOperation::RunMethod method)
 {
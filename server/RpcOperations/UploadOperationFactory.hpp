@@ -62,6 +62,7 @@ protected:
     void startImplementation() override { callMember<>(this, m_runMethod); }
 
     void setRunMethod(RunMethod method);
+    void savePart(quint64 fileId, quint32 part, const QByteArray &bytes, quint32 totalParts);
 
     RunMethod m_runMethod = nullptr;
 
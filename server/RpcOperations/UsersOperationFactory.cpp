@@ -80,8 +80,12 @@ void UsersRpcOperation::runGetUsers()
     for (const TLInputUser &input : m_getUsers.id) {
         AbstractUser *remoteUser = api()->getUser(input, self);
         if (!remoteUser) {
-            sendRpcError(RpcError::UserIdInvalid);
-            return;
+            if (m_getUsers.id.count() == 1) {
+                sendRpcError(RpcError::UserIdInvalid);
+                return;
+            }
+            // Skip the unknown users to serve the rest of a batched request
+            continue;
         }
         if (Utils::setupTLUser(&user, remoteUser, self)) {
             result.append(user);
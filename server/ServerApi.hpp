@@ -26,6 +26,7 @@ class Provider;
 } // Authorization namespace
 
 class Session;
+class LocalChannel;
 class LocalUser;
 class RemoteClientConnection;
 class AbstractUser;
@@ -92,10 +93,24 @@ public:
     virtual LocalUser *getUser(quint32 userId) const = 0;
     virtual AbstractUser *getUser(const TLInputUser &inputUser, LocalUser *self) const = 0;
     virtual AbstractUser *tryAccessUser(quint32 userId, quint64 accessHash, LocalUser *applicant) const = 0;
-    virtual Session *createSession(quint64 authId, const QByteArray &authKey, const QString &address) = 0;
-    virtual Session *getSessionByAuthId(quint64 authId) const = 0;
+    virtual Session *createSession(quint64 authId, const QByteArray &authKey, const QString &address,
+                                   quint64 serverSalt) = 0;
+    // Restores the session from the storage if the auth key is not loaded yet
+    virtual Session *getSessionByAuthId(quint64 authId) = 0;
     virtual void bindUserSession(LocalUser *user, Session *session) = 0;
+    // The connection of the session is closed if the client sends nothing within the delay (ping_delay_disconnect)
+    virtual void scheduleDisconnect(Session *session, quint32 delay) = 0;
+    // The authorization transfer between the DCs (auth.exportAuthorization and auth.importAuthorization)
+    virtual QByteArray exportAuthorization(LocalUser *user, quint32 dcId) = 0;
+    virtual LocalUser *importAuthorization(quint32 userId, const QByteArray &bytes) = 0;
+    // Returns the user if the authorization is exported to the DC; an exported authorization is taken once
+    virtual LocalUser *takeExportedAuthorization(quint32 userId, const QByteArray &bytes, quint32 dcId) = 0;
     virtual LocalUser *addUser(const QString &identifier) = 0;
+    virtual QVector<quint32> searchUsers(const QString &query, int limit) const = 0;
+
+    virtual LocalChannel *getChannel(quint32 channelId) const = 0;
+    virtual LocalChannel *createChannel(LocalUser *creator, const QString &title) = 0;
+    virtual bool addChannelMember(LocalChannel *channel, LocalUser *user) = 0;
 
     virtual void queueUpdates(const QVector<UpdateNotification> &updates) = 0;
 };
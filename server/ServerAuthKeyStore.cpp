@@ -0,0 +1,342 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include "ServerAuthKeyStore.hpp"
+
+#include <QDataStream>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QMutexLocker>
+#include <QPair>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QTimer>
+
+Q_LOGGING_CATEGORY(loggingCategoryAuthKeyStore, "telegram.server.authkeystore", QtInfoMsg)
+
+namespace Telegram {
+
+namespace Server {
+
+static const QByteArray c_fileMagic = QByteArrayLiteral("TQAK");
+static const quint32 c_fileVersion = 1;
+
+constexpr int AuthKeyStore::c_authKeySize;
+constexpr int AuthKeyStore::c_headerSize;
+constexpr int AuthKeyStore::c_recordSize;
+constexpr int AuthKeyStore::c_defaultCacheLimit;
+
+using SlotData = QPair<quint32, QByteArray>;
+
+class AuthKeyWriteJob : public QRunnable
+{
+public:
+    AuthKeyWriteJob(QFile *file, QMutex *mutex, QHash<quint32, QByteArray> *writingSlots,
+                    const QVector<SlotData> &slotsData) :
+        m_file(file),
+        m_mutex(mutex),
+        m_writingSlots(writingSlots),
+        m_slotsData(slotsData)
+    {
+    }
+
+    void run() override
+    {
+        QMutexLocker locker(m_mutex);
+        for (const SlotData &slotData : m_slotsData) {
+            const qint64 offset = AuthKeyStore::c_headerSize + qint64(slotData.first) * AuthKeyStore::c_recordSize;
+            if (!m_file->seek(offset) || (m_file->write(slotData.second) != slotData.second.size())) {
+                qCWarning(loggingCategoryAuthKeyStore) << "Unable to write an auth key record to"
+                                                       << m_file->fileName() << m_file->errorString();
+                break;
+            }
+        }
+        m_file->flush();
+        // The next batches can have a newer data for the same slots
+        for (const SlotData &slotData : m_slotsData) {
+            const auto it = m_writingSlots->find(slotData.first);
+            if ((it != m_writingSlots->end()) && (it.value() == slotData.second)) {
+                m_writingSlots->erase(it);
+            }
+        }
+    }
+
+protected:
+    QFile *m_file;
+    QMutex *m_mutex;
+    QHash<quint32, QByteArray> *m_writingSlots;
+    QVector<SlotData> m_slotsData;
+};
+
+AuthKeyStore::AuthKeyStore(QObject *parent) :
+    QObject(parent),
+    m_writer(new QThreadPool(this))
+{
+    // A single writer thread keeps the batches in order
+    m_writer->setMaxThreadCount(1);
+    m_records.setMaxCost(c_defaultCacheLimit);
+}
+
+AuthKeyStore::~AuthKeyStore()
+{
+    close();
+}
+
+QString AuthKeyStore::fileName() const
+{
+    return m_file ? m_file->fileName() : QString();
+}
+
+bool AuthKeyStore::isOpen() const
+{
+    return m_file;
+}
+
+int AuthKeyStore::cacheLimit() const
+{
+    return m_records.maxCost();
+}
+
+void AuthKeyStore::setCacheLimit(int records)
+{
+    m_records.setMaxCost(records);
+}
+
+bool AuthKeyStore::open(const QString &fileName)
+{
+    close();
+    m_file = new QFile(fileName);
+    if (!m_file->open(QIODevice::ReadWrite)) {
+        qCWarning(loggingCategoryAuthKeyStore) << "Unable to open" << fileName << m_file->errorString();
+        delete m_file;
+        m_file = nullptr;
+        return false;
+    }
+    bool result = false;
+    if (m_file->size()) {
+        result = readIndex();
+    } else {
+        // The file keeps the auth keys in plain; make it private before anything is written
+        result = m_file->setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner) && writeHeader();
+    }
+    if (!result) {
+        delete m_file;
+        m_file = nullptr;
+        m_index.clear();
+        m_freeSlots.clear();
+        m_slotsCount = 0;
+        return false;
+    }
+    qCInfo(loggingCategoryAuthKeyStore) << "Opened" << fileName << "with" << m_index.count() << "auth keys";
+    return true;
+}
+
+void AuthKeyStore::close()
+{
+    if (!m_file) {
+        return;
+    }
+    waitForWritten();
+    delete m_file;
+    m_file = nullptr;
+    m_writingSlots.clear();
+    m_index.clear();
+    m_records.clear();
+    m_freeSlots.clear();
+    m_slotsCount = 0;
+}
+
+AuthKeyRecord AuthKeyStore::load(quint64 authId)
+{
+    if (const AuthKeyRecord *cachedRecord = m_records.object(authId)) {
+        return *cachedRecord;
+    }
+    if (!m_index.contains(authId)) {
+        return AuthKeyRecord();
+    }
+    const quint32 slot = m_index.value(authId);
+    QByteArray data = m_dirtySlots.value(slot);
+    if (data.isEmpty()) {
+        QMutexLocker locker(&m_fileMutex);
+        // The record evicted from the cache can be still on its way to the file
+        data = m_writingSlots.value(slot);
+        if (data.isEmpty() && m_file->seek(c_headerSize + qint64(slot) * c_recordSize)) {
+            data = m_file->read(c_recordSize);
+        }
+    }
+    const AuthKeyRecord record = deserialize(data);
+    if (record.authId != authId) {
+        qCWarning(loggingCategoryAuthKeyStore) << "Unable to read the auth key" << hex << showbase << authId;
+        return AuthKeyRecord();
+    }
+    m_records.insert(authId, new AuthKeyRecord(record));
+    return record;
+}
+
+void AuthKeyStore::save(const AuthKeyRecord &record)
+{
+    if (!m_file || !record.isValid()) {
+        return;
+    }
+    if (record.authKey.size() != c_authKeySize) {
+        qCWarning(loggingCategoryAuthKeyStore) << Q_FUNC_INFO << "Unexpected auth key size" << record.authKey.size();
+        return;
+    }
+    quint32 slot = 0;
+    if (m_index.contains(record.authId)) {
+        slot = m_index.value(record.authId);
+    } else if (!m_freeSlots.isEmpty()) {
+        slot = m_freeSlots.takeLast();
+    } else {
+        slot = m_slotsCount++;
+    }
+    m_index.insert(record.authId, slot);
+    m_records.insert(record.authId, new AuthKeyRecord(record));
+    m_dirtySlots.insert(slot, serialize(record));
+
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QTimer::singleShot(0, this, &AuthKeyStore::flush);
+    }
+}
+
+void AuthKeyStore::remove(quint64 authId)
+{
+    if (!m_index.contains(authId)) {
+        return;
+    }
+    const quint32 slot = m_index.take(authId);
+    m_records.remove(authId);
+    m_freeSlots.append(slot);
+    m_dirtySlots.insert(slot, serialize(AuthKeyRecord()));
+
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QTimer::singleShot(0, this, &AuthKeyStore::flush);
+    }
+}
+
+void AuthKeyStore::waitForWritten()
+{
+    flush();
+    m_writer->waitForDone();
+}
+
+void AuthKeyStore::flush()
+{
+    m_flushScheduled = false;
+    if (m_dirtySlots.isEmpty() || !m_file) {
+        return;
+    }
+    QVector<SlotData> slotsData;
+    slotsData.reserve(m_dirtySlots.count());
+    {
+        QMutexLocker locker(&m_fileMutex);
+        for (auto it = m_dirtySlots.cbegin(); it != m_dirtySlots.cend(); ++it) {
+            slotsData.append({ it.key(), it.value() });
+            m_writingSlots.insert(it.key(), it.value());
+        }
+    }
+    m_dirtySlots.clear();
+    m_writer->start(new AuthKeyWriteJob(m_file, &m_fileMutex, &m_writingSlots, slotsData));
+}
+
+QByteArray AuthKeyStore::serialize(const AuthKeyRecord &record)
+{
+    QByteArray data;
+    data.reserve(c_recordSize);
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << record.authId;
+    stream << record.dcId;
+    stream << record.userId;
+    stream << record.layer;
+    stream << quint32(0); // Reserved
+    stream << record.serverSalt;
+    const QByteArray authKey = record.authKey.isEmpty() ? QByteArray(c_authKeySize, char(0)) : record.authKey;
+    stream.writeRawData(authKey.constData(), c_authKeySize);
+    return data;
+}
+
+AuthKeyRecord AuthKeyStore::deserialize(const QByteArray &data)
+{
+    AuthKeyRecord record;
+    if (data.size() != c_recordSize) {
+        return record;
+    }
+    QDataStream stream(data);
+    quint32 reserved;
+    stream >> record.authId;
+    stream >> record.dcId;
+    stream >> record.userId;
+    stream >> record.layer;
+    stream >> reserved;
+    stream >> record.serverSalt;
+    record.authKey = data.right(c_authKeySize);
+    return record;
+}
+
+bool AuthKeyStore::readIndex()
+{
+    const QByteArray header = m_file->read(c_headerSize);
+    if ((header.size() != c_headerSize) || !header.startsWith(c_fileMagic)) {
+        qCWarning(loggingCategoryAuthKeyStore) << "Invalid auth keys file" << m_file->fileName();
+        return false;
+    }
+    QDataStream headerStream(header.mid(c_fileMagic.size()));
+    quint32 version = 0;
+    quint32 recordSize = 0;
+    headerStream >> version;
+    headerStream >> recordSize;
+    if ((version != c_fileVersion) || (recordSize != c_recordSize)) {
+        qCWarning(loggingCategoryAuthKeyStore) << "Unsupported auth keys file version" << version
+                                               << "or record size" << recordSize;
+        return false;
+    }
+
+    // Only the ids are indexed; the records are read on demand
+    m_slotsCount = static_cast<quint32>((m_file->size() - c_headerSize) / c_recordSize);
+    for (quint32 slot = 0; slot < m_slotsCount; ++slot) {
+        if (!m_file->seek(c_headerSize + qint64(slot) * c_recordSize)) {
+            qCWarning(loggingCategoryAuthKeyStore) << "Unable to read the auth keys index" << m_file->errorString();
+            return false;
+        }
+        QDataStream stream(m_file->read(sizeof(quint64)));
+        quint64 authId = 0;
+        stream >> authId;
+        if (authId) {
+            m_index.insert(authId, slot);
+        } else {
+            m_freeSlots.append(slot);
+        }
+    }
+    return true;
+}
+
+bool AuthKeyStore::writeHeader()
+{
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream.writeRawData(c_fileMagic.constData(), c_fileMagic.size());
+    stream << c_fileVersion;
+    stream << quint32(c_recordSize);
+    stream << quint32(0); // Reserved
+    return m_file->write(header) == c_headerSize;
+}
+
+} // Server namespace
+
+} // Telegram namespace
@@ -0,0 +1,105 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAM_SERVER_AUTH_KEY_STORE_HPP
+#define TELEGRAM_SERVER_AUTH_KEY_STORE_HPP
+
+#include <QObject>
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+QT_FORWARD_DECLARE_CLASS(QThreadPool)
+
+namespace Telegram {
+
+namespace Server {
+
+struct AuthKeyRecord
+{
+    bool isValid() const { return authId; }
+
+    quint64 authId = 0;
+    quint32 dcId = 0;
+    quint32 userId = 0;
+    quint32 layer = 0;
+    quint64 serverSalt = 0;
+    QByteArray authKey;
+};
+
+// Keeps the auth keys in a file of fixed size records indexed by the auth key id.
+// Only the ids are kept in memory; the records are read on demand and a limited
+// number of them is cached. The writes are batched and performed in a background thread.
+class AuthKeyStore : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AuthKeyStore(QObject *parent = nullptr);
+    ~AuthKeyStore() override;
+
+    static constexpr int c_authKeySize = 256;
+    static constexpr int c_headerSize = 16;
+    static constexpr int c_recordSize = 32 + c_authKeySize;
+    static constexpr int c_defaultCacheLimit = 1024;
+
+    // The store is disabled until a file is opened
+    QString fileName() const;
+    bool isOpen() const;
+    bool open(const QString &fileName);
+    void close();
+
+    int cacheLimit() const;
+    void setCacheLimit(int records);
+
+    int count() const { return m_index.count(); }
+    bool contains(quint64 authId) const { return m_index.contains(authId); }
+
+    AuthKeyRecord load(quint64 authId);
+    void save(const AuthKeyRecord &record);
+    void remove(quint64 authId);
+
+    // Blocks until all the saved records are written to the file
+    void waitForWritten();
+
+protected slots:
+    void flush();
+
+protected:
+    static QByteArray serialize(const AuthKeyRecord &record);
+    static AuthKeyRecord deserialize(const QByteArray &data);
+    bool readIndex();
+    bool writeHeader();
+
+    QFile *m_file = nullptr;
+    QMutex m_fileMutex; // Guards the file I/O shared with the writer thread
+    QThreadPool *m_writer = nullptr;
+    QHash<quint64, quint32> m_index; // authId to slot
+    QCache<quint64, AuthKeyRecord> m_records; // Recently loaded and saved records
+    QHash<quint32, QByteArray> m_dirtySlots;
+    QHash<quint32, QByteArray> m_writingSlots; // The slots passed to the writer thread, guarded by m_fileMutex
+    QVector<quint32> m_freeSlots;
+    quint32 m_slotsCount = 0;
+    bool m_flushScheduled = false;
+};
+
+} // Server namespace
+
+} // Telegram namespace
+
+#endif // TELEGRAM_SERVER_AUTH_KEY_STORE_HPP
@@ -17,6 +17,7 @@
 
 #include "ServerDhLayer.hpp"
 
+#include "ServerDhWorkerPool.hpp"
 #include "CTelegramStream.hpp"
 #include "CTelegramTransport.hpp"
 #include "Utils.hpp"
@@ -26,21 +27,11 @@
 
 #include <QDateTime>
 #include <QLoggingCategory>
+#include <QTimer>
 #include <QtEndian>
 
 Q_LOGGING_CATEGORY(c_serverDhLayerCategory, "telegram.server.dhlayer", QtInfoMsg)
 
-static const QByteArray c_hardcodedDhPrime =
-        QByteArray::fromHex(QByteArrayLiteral(
-                                "c71caeb9c6b1c9048e6c522f70f13f73980d40238e3e21c14934d037563d930f"
-                                "48198a0aa7c14058229493d22530f4dbfa336f6e0ac925139543aed44cce7c37"
-                                "20fd51f69458705ac68cd4fe6b6b13abdc9746512969328454f18faf8c595f64"
-                                "2477fe96bb2a941d5bcd1d4ac8cc49880708fa9b378e3c4f3a9060bee67cf9a4"
-                                "a4a695811051907e162753b56b0f6b410dba74d8a84b2a14b3144e0ef1284754"
-                                "fd17ed950d5965b4b9dd46582db1178d169c6bc465b0d6ff9ca3928fef5b9ae4"
-                                "e418fc15e83ebea0f87fa9ff5eed70050ded2849f47bf959d956850ce929851f"
-                                "0d8115f635b105ee2e4e15d04b2454bf6f4fadf034b10403119cd8e3b92fcc5b"));
-
 namespace Telegram {
 
 namespace Server {
@@ -48,16 +39,29 @@ namespace Server {
 DhLayer::DhLayer(QObject *parent) :
     BaseDhLayer(parent)
 {
-    m_p = 1244159563ul;
-    m_q = 1558201013ul;
-    m_pq = static_cast<quint64>(m_p) * static_cast<quint64>(m_q);
+    m_pq = 0;
+    m_p = 0;
+    m_q = 0;
 }
 
 void DhLayer::init()
 {
+    if (!m_workerPool) {
+        qCWarning(c_serverDhLayerCategory) << Q_FUNC_INFO << "The worker pool is not set";
+    }
     setState(State::Idle);
 }
 
+DhWorkerPool *DhLayer::workerPool() const
+{
+    return m_workerPool;
+}
+
+void DhLayer::setWorkerPool(DhWorkerPool *pool)
+{
+    m_workerPool = pool;
+}
+
 bool DhLayer::processRequestPQ(const QByteArray &data)
 {
     CTelegramStream inputStream(data);
@@ -74,6 +78,10 @@ bool DhLayer::processRequestPQ(const QByteArray &data)
 bool DhLayer::sendResultPQ()
 {
     RandomGenerator::instance()->generate(m_serverNonce.data, m_serverNonce.size());
+    const DhPq pq = m_workerPool->takePq();
+    m_pq = pq.pq;
+    m_p = pq.p;
+    m_q = pq.q;
     const TLVector<quint64> fingerprints = { m_rsaKey.fingerprint };
     QByteArray output;
     CTelegramStream outputStream(&output, /* write */ true);
@@ -87,9 +95,8 @@ bool DhLayer::sendResultPQ()
     return sendReplyPackage(output);
 }
 
-bool DhLayer::processRequestDHParams(const QByteArray &data)
+bool DhLayer::processRequestDHParams(const QByteArray &data, QByteArray *encryptedPackage)
 {
-    QByteArray encryptedPackage;
     {
         CTelegramStream inputStream(data);
         TLValue value;
@@ -122,12 +129,16 @@ bool DhLayer::processRequestDHParams(const QByteArray &data)
             qCWarning(c_serverDhLayerCategory) << Q_FUNC_INFO << "Invalid server fingerprint" << fingerprint << "vs" << m_rsaKey.fingerprint;
             return false;
         }
-        inputStream >> encryptedPackage;
+        inputStream >> *encryptedPackage;
     }
 
-    qCDebug(c_serverDhLayerCategory) << Q_FUNC_INFO << "encrypted:" << encryptedPackage.toHex();
+    qCDebug(c_serverDhLayerCategory) << Q_FUNC_INFO << "encrypted:" << encryptedPackage->toHex();
+    return true;
+}
 
-    QByteArray decryptedPackage = Utils::binaryNumberModExp(encryptedPackage, m_rsaKey.modulus, m_rsaKey.secretExponent);
+bool DhLayer::processPQInnerData(const QByteArray &data)
+{
+    QByteArray decryptedPackage = data;
     constexpr int c_innerPackageSize = 255;
     if (decryptedPackage.size() < c_innerPackageSize) {
 #if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
@@ -192,13 +203,11 @@ bool DhLayer::processRequestDHParams(const QByteArray &data)
     return true;
 }
 
-bool DhLayer::acceptDhParams()
+bool DhLayer::acceptDhParams(const DhKeyPair &keyPair)
 {
     qCDebug(c_serverDhLayerCategory) << Q_FUNC_INFO;
-    m_g = 7;
-    m_dhPrime.resize(256);
-    RandomGenerator::instance()->generate(&m_dhPrime);
-    m_dhPrime = c_hardcodedDhPrime;
+    m_g = m_workerPool->g();
+    m_dhPrime = m_workerPool->dhPrime();
 
     //    if ((m_g < 2) || (m_g > 7)) {
     //        qCDebug(c_serverDhLayerCategory) << "Error: 'g' number is out of acceptable range [2-7].";
@@ -216,8 +225,8 @@ bool DhLayer::acceptDhParams()
     //    }
 
     // #5 Server computes random 2048-bit number a (using a sufficient amount of entropy)
-    m_a.resize(256);
-    RandomGenerator::instance()->generate(&m_a);
+    // The pool pregenerates the numbers and the corresponding g_a values
+    m_a = keyPair.a;
 
     // IMPORTANT: Apart from the conditions on the Diffie-Hellman prime dh_prime and generator g,
     // both sides are to check that g, g_a and g_b are greater than 1 and less than dh_prime - 1.
@@ -227,7 +236,7 @@ bool DhLayer::acceptDhParams()
     qCDebug(c_serverDhLayerCategory) << "m_b" << m_a;
 #endif
 
-    m_gA = Utils::binaryNumberModExp(intToBytes(m_g), m_dhPrime, m_a);
+    m_gA = keyPair.gA;
 
     const QByteArray innerData = [this](){
         QByteArray data;
@@ -269,7 +278,7 @@ bool DhLayer::declineDhParams()
     return false;
 }
 
-bool DhLayer::processSetClientDHParams(const QByteArray &data)
+bool DhLayer::processSetClientDHParams(const QByteArray &data, QByteArray *gB)
 {
     CTelegramStream stream(data);
 
@@ -310,10 +319,12 @@ bool DhLayer::processSetClientDHParams(const QByteArray &data)
     encryptedInputStream >> authRetryId;
     m_authRetryId = authRetryId;
 
-    QByteArray gB;
-    encryptedInputStream >> gB;
+    encryptedInputStream >> *gB;
+    return true;
+}
 
-    const QByteArray newAuthKey = Utils::binaryNumberModExp(gB, m_dhPrime, m_a);
+bool DhLayer::acceptClientDHParams(const QByteArray &newAuthKey)
+{
     const QByteArray newAuthKeySha = Utils::sha1(newAuthKey);
 
     // answerDcGenOk
@@ -352,35 +363,100 @@ void DhLayer::processReceivedPacket(const QByteArray &payload)
 {
     const TLValue v = TLValue::firstFromArray(payload);
     qCInfo(c_serverDhLayerCategory) << this << __func__ << v.toString();
+    if (!m_workerPool) {
+        finishHandshake(State::Failed);
+        return;
+    }
+    // The expensive steps are computed by the worker pool; the stale results are
+    // recognized by the state which is changed on a failure or a timeout.
     switch (v) {
     case TLValue::ReqPq:
-        if (!processRequestPQ(payload)) {
-            setState(State::Failed);
-            return;
-        }
-        sendResultPQ();
-        setState(State::PqReplied);
+        m_workerPool->acquireHandshake(this, [this, payload]() {
+            startTimeout();
+            if (!processRequestPQ(payload)) {
+                finishHandshake(State::Failed);
+                return;
+            }
+            sendResultPQ();
+            setState(State::PqReplied);
+        });
         break;
     case TLValue::ReqDHParams:
-        if (!processRequestDHParams(payload)) {
-            setState(State::Failed);
+    {
+        QByteArray encryptedPackage;
+        if ((m_state != State::PqReplied) || !processRequestDHParams(payload, &encryptedPackage)) {
+            finishHandshake(State::Failed);
             return;
         }
-        acceptDhParams();
-        setState(State::DhRepliedOK);
+        setState(State::DhRequested);
+        m_workerPool->modExp(encryptedPackage, m_rsaKey.modulus, m_rsaKey.secretExponent, this,
+                             [this](const QByteArray &decryptedPackage) {
+            if (m_state != State::DhRequested) {
+                return;
+            }
+            if (!processPQInnerData(decryptedPackage)) {
+                finishHandshake(State::Failed);
+                return;
+            }
+            m_workerPool->takeKeyPair(this, [this](const DhKeyPair &keyPair) {
+                if (m_state != State::DhRequested) {
+                    return;
+                }
+                acceptDhParams(keyPair);
+                setState(State::DhRepliedOK);
+            });
+        });
+    }
         break;
     case TLValue::SetClientDHParams:
-        if (!processSetClientDHParams(payload)) {
-            setState(State::Failed);
+    {
+        QByteArray gB;
+        if ((m_state != State::DhRepliedOK) || !processSetClientDHParams(payload, &gB)) {
+            finishHandshake(State::Failed);
             return;
         }
-        setState(State::HasKey);
+        setState(State::DhGenerationResultRequested);
+        m_workerPool->modExp(gB, m_dhPrime, m_a, this, [this](const QByteArray &newAuthKey) {
+            if (m_state != State::DhGenerationResultRequested) {
+                return;
+            }
+            acceptClientDHParams(newAuthKey);
+            finishHandshake(State::HasKey);
+        });
+    }
         break;
     default:
         break;
     }
 }
 
+void DhLayer::startTimeout()
+{
+    if (!m_timeoutTimer) {
+        m_timeoutTimer = new QTimer(this);
+        m_timeoutTimer->setSingleShot(true);
+        connect(m_timeoutTimer, &QTimer::timeout, this, &DhLayer::onHandshakeTimeout);
+    }
+    m_timeoutTimer->start(m_workerPool->handshakeTimeout());
+}
+
+void DhLayer::finishHandshake(State state)
+{
+    if (m_timeoutTimer) {
+        m_timeoutTimer->stop();
+    }
+    if (m_workerPool) {
+        m_workerPool->releaseHandshake(this);
+    }
+    setState(state);
+}
+
+void DhLayer::onHandshakeTimeout()
+{
+    qCInfo(c_serverDhLayerCategory) << this << __func__ << "state:" << m_state;
+    finishHandshake(State::Failed);
+}
+
 } // Server namespace
 
 } // Telegram namespace
@@ -20,10 +20,17 @@
 
 #include "DhLayer.hpp"
 
+#include <QPointer>
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
 namespace Telegram {
 
 namespace Server {
 
+class DhWorkerPool;
+struct DhKeyPair;
+
 class DhLayer : public Telegram::BaseDhLayer
 {
     Q_OBJECT
@@ -31,18 +38,28 @@ public:
     explicit DhLayer(QObject *parent = nullptr);
     void init() override;
 
+    DhWorkerPool *workerPool() const;
+    void setWorkerPool(DhWorkerPool *pool);
+
     bool processRequestPQ(const QByteArray &data);
     bool sendResultPQ();
-    bool processRequestDHParams(const QByteArray &data);
-    bool acceptDhParams();
+    bool processRequestDHParams(const QByteArray &data, QByteArray *encryptedPackage);
+    bool processPQInnerData(const QByteArray &data);
+    bool acceptDhParams(const DhKeyPair &keyPair);
     bool declineDhParams();
-    bool processSetClientDHParams(const QByteArray &data);
+    bool processSetClientDHParams(const QByteArray &data, QByteArray *gB);
+    bool acceptClientDHParams(const QByteArray &newAuthKey);
 
     quint64 sendReplyPackage(const QByteArray &payload);
 
 protected:
     void processReceivedPacket(const QByteArray &payload) override;
+    void startTimeout();
+    void finishHandshake(State state);
+    void onHandshakeTimeout();
 
+    QPointer<DhWorkerPool> m_workerPool;
+    QTimer *m_timeoutTimer = nullptr;
     QByteArray m_a;
 };
 
@@ -0,0 +1,335 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include "ServerDhWorkerPool.hpp"
+
+#include "DhLayer.hpp"
+#include "RandomGenerator.hpp"
+#include "Utils.hpp"
+
+#include <QLoggingCategory>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+Q_LOGGING_CATEGORY(c_serverDhWorkerPoolCategory, "telegram.server.dhworkerpool", QtInfoMsg)
+
+static const QByteArray c_hardcodedDhPrime =
+        QByteArray::fromHex(QByteArrayLiteral(
+                                "c71caeb9c6b1c9048e6c522f70f13f73980d40238e3e21c14934d037563d930f"
+                                "48198a0aa7c14058229493d22530f4dbfa336f6e0ac925139543aed44cce7c37"
+                                "20fd51f69458705ac68cd4fe6b6b13abdc9746512969328454f18faf8c595f64"
+                                "2477fe96bb2a941d5bcd1d4ac8cc49880708fa9b378e3c4f3a9060bee67cf9a4"
+                                "a4a695811051907e162753b56b0f6b410dba74d8a84b2a14b3144e0ef1284754"
+                                "fd17ed950d5965b4b9dd46582db1178d169c6bc465b0d6ff9ca3928fef5b9ae4"
+                                "e418fc15e83ebea0f87fa9ff5eed70050ded2849f47bf959d956850ce929851f"
+                                "0d8115f635b105ee2e4e15d04b2454bf6f4fadf034b10403119cd8e3b92fcc5b"));
+
+namespace Telegram {
+
+namespace Server {
+
+constexpr int DhWorkerPool::c_defaultPregeneratedCount;
+constexpr int DhWorkerPool::c_defaultHandshakeTimeout;
+
+class DhModExpJob : public QRunnable
+{
+public:
+    DhModExpJob(DhWorkerPool *pool, quint32 jobId,
+                const QByteArray &number, const QByteArray &modulus, const QByteArray &exponent) :
+        m_pool(pool),
+        m_jobId(jobId),
+        m_number(number),
+        m_modulus(modulus),
+        m_exponent(exponent)
+    {
+    }
+
+    void run() override
+    {
+        const QByteArray result = Utils::binaryNumberModExp(m_number, m_modulus, m_exponent);
+        // The pool waits for the jobs on destruction, so it is safe to post the result to it
+        QMetaObject::invokeMethod(m_pool, "onJobFinished", Qt::QueuedConnection,
+                                  Q_ARG(quint32, m_jobId), Q_ARG(QByteArray, result));
+    }
+
+protected:
+    DhWorkerPool *m_pool;
+    quint32 m_jobId;
+    QByteArray m_number;
+    QByteArray m_modulus;
+    QByteArray m_exponent;
+};
+
+DhWorkerPool::DhWorkerPool(QObject *parent) :
+    QObject(parent),
+    m_threadPool(new QThreadPool(this)),
+    m_g(7),
+    m_dhPrime(c_hardcodedDhPrime)
+{
+    m_threadPool->setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+}
+
+DhWorkerPool::~DhWorkerPool()
+{
+    m_threadPool->clear();
+    m_threadPool->waitForDone();
+}
+
+int DhWorkerPool::threadCount() const
+{
+    return m_threadPool->maxThreadCount();
+}
+
+void DhWorkerPool::setThreadCount(int count)
+{
+    m_threadPool->setMaxThreadCount(qMax(1, count));
+}
+
+void DhWorkerPool::setPregeneratedCount(int count)
+{
+    m_pregeneratedCount = qMax(0, count);
+    while (m_keyPairs.count() > m_pregeneratedCount) {
+        m_keyPairs.dequeue();
+    }
+    while (m_pqValues.count() > m_pregeneratedCount) {
+        m_pqValues.dequeue();
+    }
+}
+
+void DhWorkerPool::setMaxConcurrentHandshakes(int count)
+{
+    m_maxConcurrentHandshakes = qMax(0, count);
+    startPendingHandshakes();
+}
+
+void DhWorkerPool::setHandshakeTimeout(int msecs)
+{
+    m_handshakeTimeout = msecs;
+}
+
+void DhWorkerPool::pregenerate()
+{
+    refillPq();
+    refillKeyPairs();
+}
+
+void DhWorkerPool::acquireHandshake(QObject *handshake, const Callback &callback)
+{
+    if (m_activeHandshakes.contains(handshake)) {
+        callback();
+        return;
+    }
+    for (PendingHandshake &pending : m_pendingHandshakes) {
+        if (pending.handshake == handshake) {
+            pending.callback = callback;
+            return;
+        }
+    }
+    connect(handshake, &QObject::destroyed, this, &DhWorkerPool::onHandshakeDestroyed, Qt::UniqueConnection);
+
+    if (m_maxConcurrentHandshakes && (m_activeHandshakes.count() >= m_maxConcurrentHandshakes)) {
+        qCDebug(c_serverDhWorkerPoolCategory) << this << __func__ << "Postpone a handshake"
+                                              << "(" << m_activeHandshakes.count() << "are active)";
+        m_pendingHandshakes.enqueue({ handshake, callback });
+        return;
+    }
+    m_activeHandshakes.insert(handshake);
+    callback();
+}
+
+void DhWorkerPool::releaseHandshake(QObject *handshake)
+{
+    disconnect(handshake, &QObject::destroyed, this, &DhWorkerPool::onHandshakeDestroyed);
+    onHandshakeDestroyed(handshake);
+}
+
+void DhWorkerPool::modExp(const QByteArray &number, const QByteArray &modulus, const QByteArray &exponent,
+                          QObject *context, const ResultCallback &callback)
+{
+    ++m_lastJobId;
+    m_jobs.insert(m_lastJobId, { context, callback });
+    m_threadPool->start(new DhModExpJob(this, m_lastJobId, number, modulus, exponent));
+}
+
+void DhWorkerPool::takeKeyPair(QObject *context, const KeyPairCallback &callback)
+{
+    if (m_keyPairs.isEmpty()) {
+        addKeyPairJob(context, callback);
+    } else {
+        callback(m_keyPairs.dequeue());
+    }
+    refillKeyPairs();
+}
+
+DhPq DhWorkerPool::takePq()
+{
+    const DhPq result = m_pqValues.isEmpty() ? generatePq() : m_pqValues.dequeue();
+    refillPq();
+    return result;
+}
+
+void DhWorkerPool::onJobFinished(quint32 jobId, const QByteArray &result)
+{
+    const Job job = m_jobs.take(jobId);
+    if (!job.context) {
+        return;
+    }
+    job.callback(result);
+}
+
+void DhWorkerPool::addKeyPairJob(QObject *context, const KeyPairCallback &callback)
+{
+    // The random generator is not required to be thread-safe; generate the secret here
+    // and leave only the exponentiation to the worker
+    DhKeyPair keyPair;
+    keyPair.a.resize(256);
+    RandomGenerator::instance()->generate(&keyPair.a);
+    modExp(BaseDhLayer::intToBytes(m_g), m_dhPrime, keyPair.a, context,
+           [keyPair, callback](const QByteArray &gA) mutable {
+        keyPair.gA = gA;
+        callback(keyPair);
+    });
+}
+
+void DhWorkerPool::refillKeyPairs()
+{
+    while (m_keyPairs.count() + m_keyPairsInProgress < m_pregeneratedCount) {
+        ++m_keyPairsInProgress;
+        addKeyPairJob(this, [this](const DhKeyPair &keyPair) {
+            --m_keyPairsInProgress;
+            if (m_keyPairs.count() < m_pregeneratedCount) {
+                m_keyPairs.enqueue(keyPair);
+            }
+        });
+    }
+}
+
+void DhWorkerPool::refillPq()
+{
+    // A pq value takes microseconds to generate, so there is no need to involve the workers
+    while (m_pqValues.count() < m_pregeneratedCount) {
+        m_pqValues.enqueue(generatePq());
+    }
+}
+
+void DhWorkerPool::onHandshakeDestroyed(QObject *handshake)
+{
+    if (m_activeHandshakes.remove(handshake)) {
+        startPendingHandshakes();
+        return;
+    }
+    for (int i = 0; i < m_pendingHandshakes.count(); ++i) {
+        if (m_pendingHandshakes.at(i).handshake == handshake) {
+            m_pendingHandshakes.removeAt(i);
+            return;
+        }
+    }
+}
+
+void DhWorkerPool::startPendingHandshakes()
+{
+    while (!m_pendingHandshakes.isEmpty()) {
+        if (m_maxConcurrentHandshakes && (m_activeHandshakes.count() >= m_maxConcurrentHandshakes)) {
+            return;
+        }
+        const PendingHandshake pending = m_pendingHandshakes.dequeue();
+        m_activeHandshakes.insert(pending.handshake);
+        pending.callback();
+    }
+}
+
+DhPq DhWorkerPool::generatePq()
+{
+    DhPq result;
+    result.p = generatePrime();
+    do {
+        result.q = generatePrime();
+    } while (result.q == result.p);
+    if (result.p > result.q) {
+        qSwap(result.p, result.q);
+    }
+    result.pq = static_cast<quint64>(result.p) * result.q;
+    return result;
+}
+
+quint32 DhWorkerPool::generatePrime()
+{
+    // 31-bit primes keep pq below 2^62 as the client factorization expects
+    quint32 candidate = 0;
+    do {
+        RandomGenerator::instance()->generate(&candidate);
+        candidate = (candidate & 0x3fffffffu) | 0x40000001u;
+    } while (!isPrime(candidate));
+    return candidate;
+}
+
+bool DhWorkerPool::isPrime(quint32 number)
+{
+    if (number < 2) {
+        return false;
+    }
+    static const quint32 smallPrimes[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+    for (const quint32 prime : smallPrimes) {
+        if (number % prime == 0) {
+            return number == prime;
+        }
+    }
+
+    // Miller-Rabin; the bases 2, 7 and 61 are enough for any 32-bit number
+    quint32 d = number - 1;
+    int s = 0;
+    while (!(d & 1)) {
+        d >>= 1;
+        ++s;
+    }
+    const auto powMod = [number](quint64 base, quint32 exponent) {
+        quint64 result = 1;
+        base %= number;
+        while (exponent) {
+            if (exponent & 1) {
+                result = result * base % number;
+            }
+            base = base * base % number;
+            exponent >>= 1;
+        }
+        return result;
+    };
+    static const quint32 bases[] = { 2, 7, 61 };
+    for (const quint32 base : bases) {
+        quint64 x = powMod(base, d);
+        if ((x == 1) || (x == number - 1)) {
+            continue;
+        }
+        bool composite = true;
+        for (int i = 1; i < s; ++i) {
+            x = x * x % number;
+            if (x == number - 1) {
+                composite = false;
+                break;
+            }
+        }
+        if (composite) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // Server namespace
+
+} // Telegram namespace
@@ -0,0 +1,145 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAM_SERVER_DH_WORKER_POOL_HPP
+#define TELEGRAM_SERVER_DH_WORKER_POOL_HPP
+
+#include <QObject>
+#include <QHash>
+#include <QPointer>
+#include <QQueue>
+#include <QSet>
+
+#include <functional>
+
+QT_FORWARD_DECLARE_CLASS(QThreadPool)
+
+namespace Telegram {
+
+namespace Server {
+
+struct DhKeyPair
+{
+    QByteArray a;
+    QByteArray gA;
+};
+
+struct DhPq
+{
+    quint64 pq = 0;
+    quint32 p = 0;
+    quint32 q = 0;
+};
+
+// Runs the handshake big number arithmetic in worker threads, keeps pregenerated
+// handshake key material and limits the number of simultaneous handshakes
+class DhWorkerPool : public QObject
+{
+    Q_OBJECT
+public:
+    using ResultCallback = std::function<void(const QByteArray &result)>;
+    using KeyPairCallback = std::function<void(const DhKeyPair &keyPair)>;
+    using Callback = std::function<void()>;
+
+    explicit DhWorkerPool(QObject *parent = nullptr);
+    ~DhWorkerPool() override;
+
+    static constexpr int c_defaultPregeneratedCount = 16;
+    static constexpr int c_defaultHandshakeTimeout = 30000; // ms
+
+    quint32 g() const { return m_g; }
+    QByteArray dhPrime() const { return m_dhPrime; }
+
+    int threadCount() const;
+    void setThreadCount(int count);
+
+    // The number of (a, g_a) pairs and pq values kept ready for the next handshakes
+    int pregeneratedCount() const { return m_pregeneratedCount; }
+    void setPregeneratedCount(int count);
+    int availableKeyPairs() const { return m_keyPairs.count(); }
+
+    // Zero means no limit
+    int maxConcurrentHandshakes() const { return m_maxConcurrentHandshakes; }
+    void setMaxConcurrentHandshakes(int count);
+    int activeHandshakes() const { return m_activeHandshakes.count(); }
+    int pendingHandshakes() const { return m_pendingHandshakes.count(); }
+
+    int handshakeTimeout() const { return m_handshakeTimeout; }
+    void setHandshakeTimeout(int msecs);
+
+    void pregenerate();
+
+    // The callback is called once the handshake gets a slot; the slot is held until released.
+    // Calls for a handshake which already holds the slot or waits for it just replace the callback.
+    void acquireHandshake(QObject *handshake, const Callback &callback);
+    void releaseHandshake(QObject *handshake);
+
+    // The callbacks are queued to the thread of the caller (the pool object thread)
+    // and are not called if the context is destroyed before
+    void modExp(const QByteArray &number, const QByteArray &modulus, const QByteArray &exponent,
+                QObject *context, const ResultCallback &callback);
+    void takeKeyPair(QObject *context, const KeyPairCallback &callback);
+    DhPq takePq();
+
+private slots:
+    void onJobFinished(quint32 jobId, const QByteArray &result);
+
+private:
+    struct Job
+    {
+        QPointer<QObject> context;
+        ResultCallback callback;
+    };
+    struct PendingHandshake
+    {
+        QObject *handshake;
+        Callback callback;
+    };
+
+    void addKeyPairJob(QObject *context, const KeyPairCallback &callback);
+    void refillKeyPairs();
+    void refillPq();
+    void onHandshakeDestroyed(QObject *handshake);
+    void startPendingHandshakes();
+
+    static DhPq generatePq();
+    static quint32 generatePrime();
+    static bool isPrime(quint32 number);
+
+    QThreadPool *m_threadPool = nullptr;
+    quint32 m_g = 0;
+    QByteArray m_dhPrime;
+
+    QHash<quint32, Job> m_jobs;
+    quint32 m_lastJobId = 0;
+
+    QQueue<DhKeyPair> m_keyPairs;
+    QQueue<DhPq> m_pqValues;
+    int m_keyPairsInProgress = 0;
+    int m_pregeneratedCount = c_defaultPregeneratedCount;
+
+    QSet<QObject*> m_activeHandshakes;
+    QQueue<PendingHandshake> m_pendingHandshakes;
+    int m_maxConcurrentHandshakes = 0;
+    int m_handshakeTimeout = c_defaultHandshakeTimeout;
+};
+
+} // Server namespace
+
+} // Telegram namespace
+
+#endif // TELEGRAM_SERVER_DH_WORKER_POOL_HPP
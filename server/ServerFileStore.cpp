@@ -0,0 +1,326 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include "ServerFileStore.hpp"
+
+#include "ApiUtils.hpp"
+#include "RandomGenerator.hpp"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QTemporaryDir>
+#include <QTimer>
+
+Q_LOGGING_CATEGORY(c_serverFileStoreCategory, "telegram.server.filestore", QtWarningMsg)
+
+namespace Telegram {
+
+namespace Server {
+
+static const int c_defaultCacheLimit = 32 * 1024 * 1024;
+static const int c_maxMissedParts = 4096;
+static const int c_defaultUploadTimeout = 60 * 60 * 1000; // ms
+
+constexpr quint32 FileStore::c_maxPartSize;
+constexpr quint32 FileStore::c_maxPartsCount;
+
+FileStore::FileStore(QObject *parent) :
+    QObject(parent),
+    m_volumeId(RandomGenerator::instance()->generate<quint64>() | 1)
+{
+    m_partsCache.setMaxCost(c_defaultCacheLimit);
+    m_reaperTimer = new QTimer(this);
+    connect(m_reaperTimer, &QTimer::timeout, this, &FileStore::reapUploads);
+    setUploadTimeout(defaultUploadTimeout());
+    m_temporaryDir = new QTemporaryDir();
+    setDirectory(m_temporaryDir->path());
+}
+
+FileStore::~FileStore()
+{
+    for (const Upload &upload : m_uploads) {
+        upload.file->close();
+    }
+    for (const Content &content : m_contents) {
+        content.file->close();
+    }
+    delete m_temporaryDir;
+}
+
+QString FileStore::directory() const
+{
+    return m_directory;
+}
+
+bool FileStore::setDirectory(const QString &path)
+{
+    if (!m_uploads.isEmpty() || !m_contents.isEmpty()) {
+        qCWarning(c_serverFileStoreCategory) << __func__ << "The store is in use";
+        return false;
+    }
+    QDir dir(path);
+    if (!dir.mkpath(QStringLiteral("uploads")) || !dir.mkpath(QStringLiteral("files"))) {
+        qCWarning(c_serverFileStoreCategory) << __func__ << "Unable to prepare the directory" << path;
+        return false;
+    }
+    m_directory = dir.absolutePath();
+    if (m_temporaryDir && (m_temporaryDir->path() != m_directory)) {
+        delete m_temporaryDir;
+        m_temporaryDir = nullptr;
+    }
+    return true;
+}
+
+int FileStore::cacheLimit() const
+{
+    return m_partsCache.maxCost();
+}
+
+void FileStore::setCacheLimit(int bytes)
+{
+    m_partsCache.setMaxCost(bytes);
+}
+
+int FileStore::defaultUploadTimeout()
+{
+    return c_defaultUploadTimeout;
+}
+
+void FileStore::setUploadTimeout(int msecs)
+{
+    m_uploadTimeout = msecs;
+    // An upload is dropped within one and a half of the timeout
+    m_reaperTimer->setInterval(qMax(1, msecs / 2));
+}
+
+/*
+    Each part is written to its own slot of the maximum part size, so the parts
+    can come in any order. The slots of a big file are preallocated at once;
+    the file is sparse, so the unused tails of the slots take no disk space.
+*/
+bool FileStore::saveFilePart(quint32 ownerId, quint64 fileId, quint32 part, const QByteArray &bytes, quint32 totalParts)
+{
+    if (bytes.isEmpty() || (static_cast<quint32>(bytes.size()) > c_maxPartSize)) {
+        return false;
+    }
+    if ((part >= c_maxPartsCount) || (totalParts && (part >= totalParts))) {
+        return false;
+    }
+
+    const UploadKey key(ownerId, fileId);
+    Upload &upload = m_uploads[key];
+    if (!upload.file) {
+        const QString fileName = QStringLiteral("%1-%2").arg(ownerId).arg(fileId, 16, 16, QLatin1Char('0'));
+        upload.file = new QFile(uploadsPath() + QLatin1Char('/') + fileName, this);
+        if (!upload.file->open(QIODevice::ReadWrite|QIODevice::Truncate)) {
+            qCWarning(c_serverFileStoreCategory) << __func__ << "Unable to open" << upload.file->fileName();
+            closeUpload(key);
+            return false;
+        }
+        if (totalParts) {
+            upload.file->resize(static_cast<qint64>(totalParts) * c_maxPartSize);
+        }
+        if (!m_reaperTimer->isActive()) {
+            m_reaperTimer->start();
+        }
+    }
+    upload.lastActivityTime = QDateTime::currentMSecsSinceEpoch();
+
+    if (!upload.file->seek(static_cast<qint64>(part) * c_maxPartSize)) {
+        return false;
+    }
+    if (upload.file->write(bytes) != bytes.size()) {
+        qCWarning(c_serverFileStoreCategory) << __func__ << "Unable to write" << upload.file->errorString();
+        return false;
+    }
+    if (static_cast<quint32>(upload.partSizes.count()) <= part) {
+        upload.partSizes.resize(static_cast<int>(part) + 1);
+    }
+    upload.partSizes[static_cast<int>(part)] = static_cast<quint32>(bytes.size());
+    return true;
+}
+
+FileDescriptor FileStore::commitUpload(quint32 ownerId, quint64 fileId, quint32 partsCount, const QString &name,
+                                       quint32 dcId, quint32 *missingPart)
+{
+    const UploadKey key(ownerId, fileId);
+    const Upload upload = m_uploads.value(key);
+    if (!partsCount || (partsCount > c_maxPartsCount)) {
+        if (missingPart) {
+            *missingPart = 0;
+        }
+        return FileDescriptor();
+    }
+    for (quint32 part = 0; part < partsCount; ++part) {
+        if (!upload.file || (part >= static_cast<quint32>(upload.partSizes.count())) || !upload.partSizes.at(static_cast<int>(part))) {
+            if (missingPart) {
+                *missingPart = part;
+            }
+            return FileDescriptor();
+        }
+    }
+
+    QFile incoming(contentsPath() + QStringLiteral("/incoming"));
+    if (!incoming.open(QIODevice::WriteOnly|QIODevice::Truncate)) {
+        qCWarning(c_serverFileStoreCategory) << __func__ << "Unable to open" << incoming.fileName();
+        return FileDescriptor();
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    quint32 size = 0;
+    for (quint32 part = 0; part < partsCount; ++part) {
+        const quint32 partSize = upload.partSizes.at(static_cast<int>(part));
+        if (!upload.file->seek(static_cast<qint64>(part) * c_maxPartSize)) {
+            return FileDescriptor();
+        }
+        const QByteArray bytes = upload.file->read(partSize);
+        if (static_cast<quint32>(bytes.size()) != partSize) {
+            return FileDescriptor();
+        }
+        hash.addData(bytes);
+        incoming.write(bytes);
+        size += partSize;
+    }
+    incoming.close();
+    closeUpload(key);
+
+    const QByteArray sha256 = hash.result();
+    if (m_contents.contains(sha256)) {
+        incoming.remove();
+    } else {
+        const QString path = contentsPath() + QLatin1Char('/') + QString::fromLatin1(sha256.toHex());
+        QFile::remove(path);
+        if (!incoming.rename(path)) {
+            qCWarning(c_serverFileStoreCategory) << __func__ << "Unable to store" << path;
+            return FileDescriptor();
+        }
+        Content content;
+        content.id = ++m_lastContentId;
+        content.file = new QFile(path, this);
+        content.size = size;
+        if (!content.file->open(QIODevice::ReadOnly)) {
+            delete content.file;
+            return FileDescriptor();
+        }
+        m_contents.insert(sha256, content);
+    }
+
+    FileDescriptor descriptor;
+    descriptor.volumeId = m_volumeId;
+    descriptor.localId = ++m_lastLocalId;
+    descriptor.secret = RandomGenerator::instance()->generate<quint64>();
+    descriptor.dcId = dcId;
+    descriptor.size = size;
+    descriptor.date = Telegram::Utils::getCurrentTime();
+    descriptor.name = name;
+    descriptor.sha256 = sha256;
+    m_files.insert(descriptor.localId, descriptor);
+    return descriptor;
+}
+
+const FileDescriptor *FileStore::getFileDescriptor(quint64 volumeId, quint32 localId, quint64 secret) const
+{
+    if (volumeId != m_volumeId) {
+        return nullptr;
+    }
+    const auto it = m_files.constFind(localId);
+    if ((it == m_files.constEnd()) || (it->secret != secret)) {
+        return nullptr;
+    }
+    return &it.value();
+}
+
+/*
+    Parts are served directly from the mapped file. A part requested for
+    the second time is copied to the bounded cache, so a one time sequential
+    download does not push the hot parts (such as avatars) out of the cache.
+*/
+QByteArray FileStore::readFile(const FileDescriptor &descriptor, quint32 offset, quint32 limit)
+{
+    const auto it = m_contents.find(descriptor.sha256);
+    if ((it == m_contents.end()) || (offset >= it->size)) {
+        return QByteArray();
+    }
+    Content &content = it.value();
+    const quint32 length = qMin(limit, content.size - offset);
+    const PartKey key((static_cast<quint64>(content.id) << 32) | offset, length);
+    const QByteArray *cachedPart = m_partsCache.object(key);
+    if (cachedPart) {
+        return *cachedPart;
+    }
+
+    if (!content.data) {
+        content.data = content.file->map(0, content.size);
+    }
+    if (!content.data) {
+        // Fallback to the plain read
+        content.file->seek(offset);
+        return content.file->read(length);
+    }
+
+    const char *data = reinterpret_cast<const char *>(content.data) + offset;
+    if (m_missedParts.remove(key)) {
+        const QByteArray part(data, static_cast<int>(length));
+        m_partsCache.insert(key, new QByteArray(part), static_cast<int>(length));
+        return part;
+    }
+    if (m_missedParts.count() >= c_maxMissedParts) {
+        m_missedParts.clear();
+    }
+    m_missedParts.insert(key);
+    return QByteArray::fromRawData(data, static_cast<int>(length));
+}
+
+QString FileStore::uploadsPath() const
+{
+    return m_directory + QStringLiteral("/uploads");
+}
+
+QString FileStore::contentsPath() const
+{
+    return m_directory + QStringLiteral("/files");
+}
+
+void FileStore::closeUpload(const UploadKey &key)
+{
+    const Upload upload = m_uploads.take(key);
+    if (upload.file) {
+        upload.file->remove();
+        delete upload.file;
+    }
+    if (m_uploads.isEmpty()) {
+        m_reaperTimer->stop();
+    }
+}
+
+void FileStore::reapUploads()
+{
+    const qint64 deadline = QDateTime::currentMSecsSinceEpoch() - m_uploadTimeout;
+    const QList<UploadKey> keys = m_uploads.keys();
+    for (const UploadKey &key : keys) {
+        if (m_uploads.value(key).lastActivityTime <= deadline) {
+            qCDebug(c_serverFileStoreCategory) << __func__ << "Drop the expired upload" << key.first << key.second;
+            closeUpload(key);
+        }
+    }
+}
+
+} // Server namespace
+
+} // Telegram namespace
@@ -0,0 +1,133 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAM_SERVER_FILE_STORE_HPP
+#define TELEGRAM_SERVER_FILE_STORE_HPP
+
+#include <QObject>
+#include <QCache>
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QVector>
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+QT_FORWARD_DECLARE_CLASS(QTemporaryDir)
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+namespace Telegram {
+
+namespace Server {
+
+struct FileDescriptor
+{
+    bool isValid() const { return volumeId; }
+
+    quint64 volumeId = 0;
+    quint32 localId = 0;
+    quint64 secret = 0;
+    quint32 dcId = 0;
+    quint32 size = 0;
+    quint32 date = 0;
+    QString name;
+    QByteArray sha256;
+};
+
+// Keeps the parts of the files being uploaded and the complete files addressed by their content
+class FileStore : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FileStore(QObject *parent = nullptr);
+    ~FileStore() override;
+
+    static constexpr quint32 c_maxPartSize = 512 * 1024;
+    static constexpr quint32 c_maxPartsCount = 4000;
+
+    // A temporary directory is used by default
+    QString directory() const;
+    bool setDirectory(const QString &path);
+
+    // The limit of the memory used for the frequently requested parts
+    int cacheLimit() const;
+    void setCacheLimit(int bytes);
+
+    // An upload which gets no parts for the timeout is dropped with its parts
+    static int defaultUploadTimeout();
+    int uploadTimeout() const { return m_uploadTimeout; }
+    void setUploadTimeout(int msecs);
+
+    // Zero totalParts means that the number of parts is not known (the small file upload)
+    bool saveFilePart(quint32 ownerId, quint64 fileId, quint32 part, const QByteArray &bytes, quint32 totalParts = 0);
+
+    // Assembles the uploaded parts into a file. Files with the same content share the storage.
+    // Returns an invalid descriptor and the index of the first missing part on failure.
+    FileDescriptor commitUpload(quint32 ownerId, quint64 fileId, quint32 partsCount, const QString &name,
+                                quint32 dcId, quint32 *missingPart = nullptr);
+
+    const FileDescriptor *getFileDescriptor(quint64 volumeId, quint32 localId, quint64 secret) const;
+
+    // The returned data can refer to the mapped file; it is valid until the next call of the method
+    QByteArray readFile(const FileDescriptor &descriptor, quint32 offset, quint32 limit);
+
+    int uploadsCount() const { return m_uploads.count(); }
+    int filesCount() const { return m_files.count(); }
+    int contentsCount() const { return m_contents.count(); }
+
+protected:
+    struct Upload
+    {
+        QFile *file = nullptr;
+        QVector<quint32> partSizes; // Zero size for the missing parts
+        qint64 lastActivityTime = 0;
+    };
+
+    struct Content
+    {
+        quint32 id = 0;
+        QFile *file = nullptr;
+        uchar *data = nullptr; // Mapped on the first read
+        quint32 size = 0;
+    };
+
+    using UploadKey = QPair<quint32, quint64>; // Owner id and file id
+    using PartKey = QPair<quint64, quint32>; // Content id with offset and the part size
+
+    QString uploadsPath() const;
+    QString contentsPath() const;
+    void closeUpload(const UploadKey &key);
+    void reapUploads();
+
+    QTemporaryDir *m_temporaryDir = nullptr;
+    QTimer *m_reaperTimer = nullptr;
+    int m_uploadTimeout = 0;
+    QString m_directory;
+    quint64 m_volumeId = 0;
+    quint32 m_lastLocalId = 0;
+    quint32 m_lastContentId = 0;
+    QHash<UploadKey, Upload> m_uploads;
+    QHash<QByteArray, Content> m_contents; // SHA-256 of the content to the content
+    QHash<quint32, FileDescriptor> m_files; // Local id to the file
+    QCache<PartKey, QByteArray> m_partsCache;
+    QSet<PartKey> m_missedParts; // Parts requested once; the next request puts the part to the cache
+};
+
+} // Server namespace
+
+} // Telegram namespace
+
+#endif // TELEGRAM_SERVER_FILE_STORE_HPP
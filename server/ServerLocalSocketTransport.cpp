@@ -0,0 +1,50 @@
+#include "ServerLocalSocketTransport.hpp"
+
+#include <QLoggingCategory>
+
+Q_LOGGING_CATEGORY(c_loggingServerLocalSocketTransport, "telegram.server.transport.localsocket", QtWarningMsg)
+
+namespace Telegram {
+
+namespace Server {
+
+LocalSocketTransport::LocalSocketTransport(QLocalSocket *socket, QObject *parent) :
+    BaseLocalSocketTransport(parent)
+{
+    setSocket(socket);
+    setState(static_cast<QAbstractSocket::SocketState>(m_socket->state()));
+}
+
+LocalSocketTransport::~LocalSocketTransport()
+{
+    qCDebug(c_loggingServerLocalSocketTransport) << this << __func__;
+}
+
+void LocalSocketTransport::connectToHost(const QString &, quint16)
+{
+    qCritical() << Q_FUNC_INFO << "The function must not be called in a server application";
+}
+
+void LocalSocketTransport::readEvent()
+{
+    if (Q_LIKELY(m_sessionStarted)) {
+        return;
+    }
+    // Only the Abridged session is supported over the local socket
+    char sessionSign;
+    if (!m_socket->getChar(&sessionSign)) {
+        return;
+    }
+    if (sessionSign == char(0xef)) {
+        m_sessionStarted = true;
+    } else {
+        qCCritical(c_loggingServerLocalSocketTransport) << Q_FUNC_INFO << "Invalid session sign"
+                                                        << hex << showbase << quint8(sessionSign);
+        setError(QAbstractSocket::UnknownSocketError, QStringLiteral("Unsupported session type"));
+        disconnectFromHost();
+    }
+}
+
+} // Server namespace
+
+} // Telegram namespace
@@ -0,0 +1,27 @@
+#ifndef TELEGRAM_SERVER_LOCAL_SOCKET_TRANSPORT_HPP
+#define TELEGRAM_SERVER_LOCAL_SOCKET_TRANSPORT_HPP
+
+#include "LocalSocketTransport.hpp"
+
+namespace Telegram {
+
+namespace Server {
+
+class LocalSocketTransport : public BaseLocalSocketTransport
+{
+    Q_OBJECT
+public:
+    explicit LocalSocketTransport(QLocalSocket *socket, QObject *parent = nullptr);
+    ~LocalSocketTransport() override;
+
+    void connectToHost(const QString &serverName, quint16 port) override;
+
+protected:
+    void readEvent() final;
+};
+
+} // Server namespace
+
+} // Telegram namespace
+
+#endif // TELEGRAM_SERVER_LOCAL_SOCKET_TRANSPORT_HPP
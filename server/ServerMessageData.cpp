@@ -19,6 +19,14 @@ void MessageData::setGlobalId(quint64 id)
     m_globalId = id;
 }
 
+Peer MessageData::getDialogPeer(quint32 applicantUserId) const
+{
+    if ((m_to.type == Peer::User) && (m_to.id == applicantUserId)) {
+        return Peer::fromUserId(m_fromId);
+    }
+    return m_to;
+}
+
 void MessageData::addReference(const Peer &peer, quint32 messageId)
 {
     m_references.insert(peer, messageId);
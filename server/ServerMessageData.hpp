@@ -40,6 +40,9 @@ public:
     quint32 fromId() const { return m_fromId; }
     quint32 date() const { return m_date; }
 
+    // Returns the peer of the message dialog from the point of view of the given user
+    Peer getDialogPeer(quint32 applicantUserId) const;
+
     void addReference(const Peer &peer, quint32 messageId);
     quint32 getReference(const Peer &peer) const { return m_references.value(peer); }
 
@@ -5,6 +5,7 @@
 
 #include <QHash>
 #include <QString>
+#include <QVector>
 
 namespace Telegram {
 
@@ -25,6 +26,14 @@ struct ServerSalt
     quint32 validUntil = 0;
 };
 
+struct UnreadMessage
+{
+    quint32 messageId = 0; // Id in the reader postbox
+    quint32 senderId = 0;
+    quint32 senderMessageId = 0; // Id of the same message in the sender postbox
+    bool mention = false;
+};
+
 struct UserDialog
 {
     Telegram::Peer peer;
@@ -35,6 +44,9 @@ struct UserDialog
     quint32 unreadCount = 0;
     quint32 unreadMentionsCount = 0;
     quint32 pts = 0;
+
+    // Not read incoming messages sorted by messageId
+    QVector<UnreadMessage> unreadMessages;
 };
 
 struct UserContact
@@ -49,4 +61,6 @@ struct UserContact
 
 } // Telegram namespace
 
+Q_DECLARE_TYPEINFO(Telegram::Server::UnreadMessage, Q_MOVABLE_TYPE);
+
 #endif // TELEGRAM_SERVER_NAMESPACE_HPP
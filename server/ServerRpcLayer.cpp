@@ -18,6 +18,7 @@
 
 #include "CTelegramStream.hpp"
 #include "CTelegramStreamExtraOperators.hpp"
+#include <QDateTime>
 #include <QLoggingCategory>
 
 Q_LOGGING_CATEGORY(c_serverRpcLayerCategory, "telegram.server.rpclayer", QtWarningMsg)
@@ -122,6 +123,10 @@ bool RpcLayer::processMTProtoMessage(const MTProto::Message &message)
         output << message.messageId;
         output << ping.pingId;
         sendPackage(output.getData(), SendMode::ServerReply);
+        if ((ping.tlType == TLValue::PingDelayDisconnect) && m_session) {
+            // The delay is in seconds
+            api()->scheduleDisconnect(m_session, ping.disconnectDelay * 1000u);
+        }
     }
         return true;
     default:
@@ -138,6 +143,17 @@ bool RpcLayer::processMTProtoMessage(const MTProto::Message &message)
         return sendRpcError(error, context.requestId());
     }
 
+    if (m_session && m_session->hasRequest(message.messageId)) {
+        // The client resent the request (e.g. on reconnection) and it should not be executed twice
+        const QByteArray reply = m_session->getRequestReply(message.messageId);
+        qCDebug(c_serverRpcLayerCategory) << Q_FUNC_INFO << "Duplicate request" << requestValue.toString()
+                                          << "answered:" << !reply.isEmpty();
+        if (!reply.isEmpty()) {
+            return sendPackage(reply, SendMode::ServerReply);
+        }
+        return true;
+    }
+
     RpcOperation *op = nullptr;
     for (RpcOperationFactory *f : m_operationFactories) {
         op = f->processRpcCall(this, context);
@@ -149,6 +165,9 @@ bool RpcLayer::processMTProtoMessage(const MTProto::Message &message)
         qCWarning(c_serverRpcLayerCategory) << Q_FUNC_INFO << requestValue.toString() << "is not processed!";
         return false;
     }
+    if (m_session) {
+        m_session->addRequest(message.messageId);
+    }
     op->startLater();
     return true;
 }
@@ -264,6 +283,9 @@ bool RpcLayer::sendRpcReply(const QByteArray &reply, quint64 messageId)
         output.writeBytes(reply);
     }
     qDebug() << Q_FUNC_INFO << TLValue::firstFromArray(reply) << "for message id" << messageId;
+    if (m_session) {
+        m_session->setRequestReply(messageId, output.getData());
+    }
     return sendPackage(output.getData(), SendMode::ServerReply);
 }
 
@@ -329,6 +351,7 @@ bool RpcLayer::processDecryptedMessageHeader(const MTProto::FullMessageHeader &h
     }
     m_session->lastSequenceNumber = header.sequenceNumber;
     m_session->lastMessageNumber = header.messageId;
+    m_session->lastActivityTime = QDateTime::currentMSecsSinceEpoch();
     return true;
 }
 
@@ -0,0 +1,334 @@
+#include "ServerSearchIndex.hpp"
+
+#include <QSet>
+#include <QTextBoundaryFinder>
+
+#include <algorithm>
+#include <limits>
+
+namespace Telegram {
+
+namespace Server {
+
+constexpr int SearchIndex::c_blockSize;
+
+QStringList SearchIndex::tokenize(const QString &text)
+{
+    QStringList words;
+    QSet<QString> knownWords;
+    QTextBoundaryFinder finder(QTextBoundaryFinder::Word, text);
+    int wordStart = 0;
+    while (finder.toNextBoundary() >= 0) {
+        const int position = finder.position();
+        if (finder.boundaryReasons() & QTextBoundaryFinder::EndOfItem) {
+            const QString word = text.mid(wordStart, position - wordStart).toCaseFolded();
+            if (!knownWords.contains(word)) {
+                knownWords.insert(word);
+                words.append(word);
+            }
+        }
+        wordStart = position;
+    }
+    return words;
+}
+
+void SearchIndex::addEntry(quint64 id, const QString &text, const QStringList &tags)
+{
+    if (!id) {
+        return;
+    }
+    ++m_entriesCount;
+    for (const QString &word : tokenize(text)) {
+        m_postings[word].insert(id);
+    }
+    for (const QString &tag : tags) {
+        m_tags[tag].insert(id);
+    }
+}
+
+/*
+    Walks the ids of one posting list or the union of several lists (a prefix)
+    from the latest id to the oldest one. Only the visited blocks are decoded.
+*/
+class SearchIndex::Cursor
+{
+public:
+    void addList(const PostingList *list)
+    {
+        ListCursor listCursor;
+        listCursor.list = list;
+        listCursor.blockIndex = list->blocks.count();
+        m_lists.append(listCursor);
+        m_count += list->count;
+    }
+
+    bool isEmpty() const { return m_lists.isEmpty(); }
+    int count() const { return m_count; }
+
+    // Zero means the end of the lists
+    quint64 id() const { return m_id; }
+
+    // Moves to the greatest id which is less than or equal to maxId
+    void seekAtMost(quint64 maxId)
+    {
+        for (ListCursor &list : m_lists) {
+            list.seekAtMost(maxId);
+        }
+        updateId();
+    }
+
+    void next()
+    {
+        const quint64 currentId = m_id;
+        for (ListCursor &list : m_lists) {
+            if (list.id() == currentId) {
+                list.next();
+            }
+        }
+        updateId();
+    }
+
+protected:
+    struct ListCursor
+    {
+        quint64 id() const { return position >= 0 ? ids.at(position) : 0; }
+
+        void seekAtMost(quint64 maxId)
+        {
+            if (position >= 0) {
+                if (ids.at(position) <= maxId) {
+                    return;
+                }
+                if (ids.first() <= maxId) {
+                    position = static_cast<int>(std::upper_bound(ids.cbegin(), ids.cbegin() + position, maxId) - ids.cbegin()) - 1;
+                    return;
+                }
+            }
+            // Skip the blocks which start after maxId without decoding them
+            const int index = list->findBlock(maxId, blockIndex);
+            if (index < 0) {
+                setEnd();
+                return;
+            }
+            loadBlock(index);
+            position = static_cast<int>(std::upper_bound(ids.cbegin(), ids.cend(), maxId) - ids.cbegin()) - 1;
+            if (position < 0) {
+                setEnd();
+            }
+        }
+
+        void next()
+        {
+            if (position > 0) {
+                --position;
+            } else if (blockIndex > 0) {
+                loadBlock(blockIndex - 1);
+                position = ids.count() - 1;
+            } else {
+                setEnd();
+            }
+        }
+
+        void loadBlock(int index)
+        {
+            blockIndex = index;
+            list->blocks.at(index).decode(&ids);
+        }
+
+        void setEnd()
+        {
+            blockIndex = 0;
+            position = -1;
+            ids.clear();
+        }
+
+        const PostingList *list = nullptr;
+        QVector<quint64> ids; // The decoded block
+        int blockIndex = 0;
+        int position = -1;
+    };
+
+    void updateId()
+    {
+        m_id = 0;
+        for (const ListCursor &list : m_lists) {
+            m_id = qMax(m_id, list.id());
+        }
+    }
+
+    QVector<ListCursor> m_lists;
+    quint64 m_id = 0;
+    int m_count = 0;
+};
+
+void SearchIndex::search(const QString &query, quint64 maxId, const Visitor &visitor) const
+{
+    search(query, QStringList(), maxId, visitor);
+}
+
+void SearchIndex::search(const QString &query, const QStringList &tags, quint64 maxId, const Visitor &visitor) const
+{
+    const QStringList words = tokenize(query);
+    if (words.isEmpty()) {
+        return;
+    }
+
+    QVector<Cursor> cursors;
+    cursors.reserve(words.count() + tags.count());
+    for (const QString &tag : tags) {
+        const auto it = m_tags.constFind(tag);
+        if (it == m_tags.constEnd()) {
+            return;
+        }
+        Cursor cursor;
+        cursor.addList(&it.value());
+        cursors.append(cursor);
+    }
+    for (int i = 0; i < words.count(); ++i) {
+        const QString &word = words.at(i);
+        Cursor cursor;
+        if (i == words.count() - 1) {
+            for (auto it = m_postings.lowerBound(word); it != m_postings.constEnd(); ++it) {
+                if (!it.key().startsWith(word)) {
+                    break;
+                }
+                cursor.addList(&it.value());
+            }
+        } else {
+            const auto it = m_postings.constFind(word);
+            if (it != m_postings.constEnd()) {
+                cursor.addList(&it.value());
+            }
+        }
+        if (cursor.isEmpty()) {
+            return;
+        }
+        cursors.append(cursor);
+    }
+
+    // The shortest list leads and the rest of the lists skip to its ids
+    std::sort(cursors.begin(), cursors.end(), [](const Cursor &left, const Cursor &right) {
+        return left.count() < right.count();
+    });
+    const quint64 upperId = maxId ? maxId - 1 : std::numeric_limits<quint64>::max();
+    for (Cursor &cursor : cursors) {
+        cursor.seekAtMost(upperId);
+    }
+
+    Cursor &lead = cursors.first();
+    while (const quint64 candidate = lead.id()) {
+        bool matches = true;
+        for (int i = 1; i < cursors.count(); ++i) {
+            Cursor &cursor = cursors[i];
+            cursor.seekAtMost(candidate);
+            const quint64 id = cursor.id();
+            if (!id) {
+                return;
+            }
+            if (id < candidate) {
+                lead.seekAtMost(id);
+                matches = false;
+                break;
+            }
+        }
+        if (!matches) {
+            continue;
+        }
+        if (!visitor(candidate)) {
+            return;
+        }
+        lead.next();
+    }
+}
+
+void SearchIndex::Block::append(quint64 id)
+{
+    quint64 delta = id - lastId;
+    while (delta >= 0x80) {
+        data.append(static_cast<char>((delta & 0x7f) | 0x80));
+        delta >>= 7;
+    }
+    data.append(static_cast<char>(delta));
+    if (!count) {
+        firstId = id;
+    }
+    lastId = id;
+    ++count;
+}
+
+void SearchIndex::Block::encode(const QVector<quint64> &ids)
+{
+    data.clear();
+    firstId = 0;
+    lastId = 0;
+    count = 0;
+    for (const quint64 id : ids) {
+        append(id);
+    }
+}
+
+void SearchIndex::Block::decode(QVector<quint64> *ids) const
+{
+    ids->clear();
+    ids->reserve(count);
+    quint64 id = 0;
+    quint64 delta = 0;
+    int shift = 0;
+    for (const char c : data) {
+        const quint8 byte = static_cast<quint8>(c);
+        delta |= static_cast<quint64>(byte & 0x7f) << shift;
+        if (byte & 0x80) {
+            shift += 7;
+            continue;
+        }
+        id += delta;
+        ids->append(id);
+        delta = 0;
+        shift = 0;
+    }
+}
+
+void SearchIndex::PostingList::insert(quint64 id)
+{
+    if (blocks.isEmpty() || (id > blocks.last().lastId)) {
+        if (blocks.isEmpty() || (blocks.last().count >= c_blockSize)) {
+            blocks.append(Block());
+        }
+        blocks.last().append(id);
+        ++count;
+        return;
+    }
+
+    // An out of order id is inserted to its block, which is split once it gets twice as big
+    const int index = qMax(0, findBlock(id, blocks.count()));
+    QVector<quint64> ids;
+    blocks.at(index).decode(&ids);
+    const auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if ((it != ids.end()) && (*it == id)) {
+        return;
+    }
+    ids.insert(it, id);
+    ++count;
+    if (ids.count() <= 2 * c_blockSize) {
+        blocks[index].encode(ids);
+        return;
+    }
+    Block tail;
+    tail.encode(ids.mid(c_blockSize));
+    ids.resize(c_blockSize);
+    blocks[index].encode(ids);
+    blocks.insert(index + 1, tail);
+}
+
+int SearchIndex::PostingList::findBlock(quint64 maxId, int blocksCount) const
+{
+    const auto end = blocks.cbegin() + blocksCount;
+    const auto it = std::upper_bound(blocks.cbegin(), end, maxId, [](quint64 id, const Block &block) {
+        return id < block.firstId;
+    });
+    return static_cast<int>(it - blocks.cbegin()) - 1;
+}
+
+} // Server namespace
+
+} // Telegram namespace
@@ -0,0 +1,95 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAM_SERVER_SEARCH_INDEX_HPP
+#define TELEGRAM_SERVER_SEARCH_INDEX_HPP
+
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QStringList>
+#include <QVector>
+
+#include <functional>
+
+namespace Telegram {
+
+namespace Server {
+
+// Inverted index of words to the ids of entries (e.g. the message ids of a post box).
+// The posting lists are split to blocks of delta encoded ids, so a search decodes only the
+// blocks it visits, from the latest entries to the oldest ones, and stops as soon as the
+// visitor has enough results.
+class SearchIndex
+{
+public:
+    using Visitor = std::function<bool(quint64 id)>;
+
+    static constexpr int c_blockSize = 128;
+
+    // Splits the text to the case folded unique words (Unicode word boundaries)
+    static QStringList tokenize(const QString &text);
+
+    // The tags (e.g. the sender of a message) are matched exactly and never match the words.
+    // The ids are expected in the ascending order; an out of order id is inserted to its place.
+    void addEntry(quint64 id, const QString &text, const QStringList &tags = QStringList());
+
+    // Visits the ids of entries which contain all words of the query and all the tags, from the
+    // latest to the oldest one. The last word of the query is matched as a prefix. Only the ids
+    // less than maxId are visited (zero means no limit). The search stops as soon as the visitor
+    // returns false.
+    void search(const QString &query, quint64 maxId, const Visitor &visitor) const;
+    void search(const QString &query, const QStringList &tags, quint64 maxId, const Visitor &visitor) const;
+
+    int wordsCount() const { return m_postings.count(); }
+    quint64 entriesCount() const { return m_entriesCount; }
+
+protected:
+    struct Block
+    {
+        void append(quint64 id);
+        void encode(const QVector<quint64> &ids);
+        void decode(QVector<quint64> *ids) const;
+
+        QByteArray data; // Deltas of the ascending ids as base-128 varints, the first one is the id itself
+        quint64 firstId = 0;
+        quint64 lastId = 0;
+        int count = 0;
+    };
+
+    struct PostingList
+    {
+        void insert(quint64 id);
+        // Returns the index of the last block among the first blocksCount ones which may contain ids <= maxId or -1
+        int findBlock(quint64 maxId, int blocksCount) const;
+
+        QVector<Block> blocks;
+        int count = 0;
+    };
+
+    class Cursor;
+
+    QMap<QString, PostingList> m_postings;
+    QHash<QString, PostingList> m_tags;
+    quint64 m_entriesCount = 0;
+};
+
+} // Server namespace
+
+} // Telegram namespace
+
+#endif // TELEGRAM_SERVER_SEARCH_INDEX_HPP
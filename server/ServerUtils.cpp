@@ -3,6 +3,7 @@
 #include "ApiUtils.hpp"
 #include "ServerApi.hpp"
 #include "ServerMessageData.hpp"
+#include "TelegramServerChannel.hpp"
 #include "TelegramServerUser.hpp"
 
 #include <QLoggingCategory>
@@ -23,6 +24,30 @@ void getInterestingPeers(QSet<Peer> *peers, const TLVector<TLMessage> &messages)
     }
 }
 
+static bool isUserNameCharacter(const QChar c)
+{
+    return c.isLetterOrNumber() || (c == QLatin1Char('_'));
+}
+
+bool hasMention(const QString &text, const QString &userName)
+{
+    if (userName.isEmpty()) {
+        return false;
+    }
+    const QString mention = QLatin1Char('@') + userName;
+    int index = text.indexOf(mention, 0, Qt::CaseInsensitive);
+    while (index >= 0) {
+        const int end = index + mention.size();
+        const bool wordStart = (index == 0) || !isUserNameCharacter(text.at(index - 1));
+        const bool wordEnd = (end == text.size()) || !isUserNameCharacter(text.at(end));
+        if (wordStart && wordEnd) {
+            return true;
+        }
+        index = text.indexOf(mention, index + 1, Qt::CaseInsensitive);
+    }
+    return false;
+}
+
 bool setupTLUser(TLUser *output, const AbstractUser *input, const LocalUser *applicant)
 {
     output->id = input->id();
@@ -45,6 +70,12 @@ bool setupTLUser(TLUser *output, const AbstractUser *input, const LocalUser *app
     if (!output->phone.isEmpty()) {
         flags |= TLUser::Phone;
     }
+    if (!applicant) {
+        // A view shared between many users (e.g. channel members) can not have personal flags
+        flags |= TLUser::Min;
+        output->flags = flags;
+        return true;
+    }
     if (output->id == applicant->id()) {
         flags |= TLUser::Self;
     }
@@ -59,13 +90,35 @@ bool setupTLUser(TLUser *output, const AbstractUser *input, const LocalUser *app
     return true;
 }
 
+bool setupTLChat(TLChat *output, const LocalChannel *channel, const LocalUser *forUser)
+{
+    output->tlType = TLValue::Channel;
+    output->id = channel->id();
+    output->title = channel->title();
+    output->date = channel->date();
+    output->participantsCount = static_cast<quint32>(channel->members().count());
+
+    quint32 flags = 0;
+    if (channel->isBroadcast()) {
+        flags |= TLChat::Broadcast;
+    } else {
+        flags |= TLChat::Megagroup;
+    }
+    if (forUser && (channel->creatorId() == forUser->id())) {
+        flags |= TLChat::Creator;
+    }
+    output->flags = flags;
+
+    return true;
+}
+
 bool setupTLUpdatesState(TLUpdatesState *output, const LocalUser *forUser)
 {
     output->pts = forUser->getPostBox()->pts();
     output->date = Telegram::Utils::getCurrentTime();
     output->seq = 1; // FIXME
     output->qts = 0;
-    output->unreadCount = 0;
+    output->unreadCount = forUser->unreadCount();
     return true;
 }
 
@@ -86,6 +139,14 @@ bool setupTLPeers(TLVector<TLUser> *users, TLVector<TLChat> *chats,
                 continue;
             }
             setupTLUser(&users->last(), user, forUser);
+        } else if (peer.type == Peer::Channel) {
+            LocalChannel *channel = api->getChannel(peer.id);
+            if (!channel) {
+                qWarning() << Q_FUNC_INFO << "Channel not found:" << peer.id;
+                continue;
+            }
+            chats->append(TLChat());
+            setupTLChat(&chats->last(), channel, forUser);
         } else {
             // TODO
             return false;
@@ -109,6 +170,11 @@ bool setupTLMessage(TLMessage *output, const MessageData *messageData, quint32 m
     output->date = messageData->date();
     output->toId = Telegram::Utils::toTLPeer(messageData->toPeer());
 
+    if (!forUser) {
+        output->flags = flags;
+        return true;
+    }
+
     const bool messageToSelf = messageData->toPeer() == forUser->toPeer();
     if (messageData->fromId() == forUser->userId()) {
         if (!messageToSelf) {
@@ -11,6 +11,7 @@ namespace Telegram {
 namespace Server {
 
 class AbstractUser;
+class LocalChannel;
 class LocalUser;
 class MessageData;
 class ServerApi;
@@ -19,7 +20,11 @@ namespace Utils {
 
 void getInterestingPeers(QSet<Peer> *peers, const TLVector<TLMessage> &messages);
 
+// Returns true if the text mentions the user name as a whole word (e.g. @bob does not match @bobby)
+bool hasMention(const QString &text, const QString &userName);
+
 bool setupTLUser(TLUser *output, const AbstractUser *input, const LocalUser *forUser);
+bool setupTLChat(TLChat *output, const LocalChannel *channel, const LocalUser *forUser);
 bool setupTLUpdatesState(TLUpdatesState *output, const LocalUser *forUser);
 bool setupTLPeers(TLVector<TLUser> *users, TLVector<TLChat> *chats,
                   const QSet<Peer> &peers, const ServerApi *api, const LocalUser *forUser);
@@ -22,6 +22,9 @@ static quint32 getCurrentTime()
 constexpr quint32 c_sessionRotation = 1 * 60 * 60;
 constexpr quint32 c_sessionOverlapping = 300;
 constexpr quint32 c_maxServerSalts = 64;
+// The client keeps the message ids of the resent requests within the time window of the message ids
+constexpr quint64 c_requestRepliesWindow = 300; // seconds
+constexpr int c_maxRequestRepliesSize = 4 * 1024 * 1024;
 
 RpcLayer *Session::rpcLayer() const
 {
@@ -95,6 +98,60 @@ ServerSalt Session::generateSalt(quint32 validSince)
     return s;
 }
 
+void Session::addRequest(quint64 messageId)
+{
+    m_requestReplies.insert(messageId, QByteArray());
+    dropOldRequests();
+}
+
+void Session::setRequestReply(quint64 messageId, const QByteArray &reply)
+{
+    auto it = m_requestReplies.find(messageId);
+    if (it == m_requestReplies.end()) {
+        return;
+    }
+    m_requestRepliesSize += reply.size() - it.value().size();
+    it.value() = reply;
+    dropOldRequests();
+}
+
+void Session::dropOldRequests()
+{
+    // The upper 32 bits of a message id are the unix time
+    const quint64 minTime = (m_requestReplies.lastKey() >> 32) - qMin(m_requestReplies.lastKey() >> 32, c_requestRepliesWindow);
+    while ((m_requestReplies.firstKey() >> 32) < minTime) {
+        m_requestRepliesSize -= m_requestReplies.first().size();
+        m_requestReplies.erase(m_requestReplies.begin());
+    }
+    // Drop the oldest replies if they take too much memory; such a request would be executed again
+    auto it = m_requestReplies.begin();
+    while ((m_requestRepliesSize > c_maxRequestRepliesSize) && (it != m_requestReplies.end())) {
+        if (it.value().isEmpty()) {
+            // The request is not answered yet
+            ++it;
+            continue;
+        }
+        m_requestRepliesSize -= it.value().size();
+        it = m_requestReplies.erase(it);
+    }
+}
+
+quint64 Session::memoryUsage() const
+{
+    quint64 result = sizeof(Session);
+    result += static_cast<quint64>(authKey.capacity());
+    result += static_cast<quint64>(m_salts.capacity()) * sizeof(ServerSalt);
+    result += static_cast<quint64>(m_requestReplies.count()) * (sizeof(quint64) + sizeof(QByteArray));
+    result += static_cast<quint64>(m_requestRepliesSize);
+    const QString *strings[] = {
+        &deviceInfo, &osInfo, &appVersion, &systemLanguage, &languagePack, &languageCode, &ip,
+    };
+    for (const QString *string : strings) {
+        result += static_cast<quint64>(string->capacity()) * sizeof(QChar);
+    }
+    return result;
+}
+
 void Session::addSalt()
 {
     m_salts.append(generateSalt(m_salts.constLast().validUntil - c_sessionOverlapping));
@@ -1,6 +1,7 @@
 #ifndef TELEGRAM_QT_SERVER_USER_SESSION_HPP
 #define TELEGRAM_QT_SERVER_USER_SESSION_HPP
 
+#include <QMap>
 #include <QVector>
 
 #include "ServerNamespace.hpp"
@@ -42,6 +43,16 @@ public:
 
     static ServerSalt generateSalt(quint32 validSince);
 
+    // The requests of the recent message ids and their replies (empty until the request is answered).
+    // A request resent with the same message id is answered with the stored reply instead of a new execution.
+    bool hasRequest(quint64 messageId) const { return m_requestReplies.contains(messageId); }
+    QByteArray getRequestReply(quint64 messageId) const { return m_requestReplies.value(messageId); }
+    void addRequest(quint64 messageId);
+    void setRequestReply(quint64 messageId, const QByteArray &reply);
+
+    // Approximate heap and object size in bytes
+    quint64 memoryUsage() const;
+
     quint32 appId = 0;
     quint32 lastSequenceNumber = 0;
     quint64 lastMessageNumber = 0;
@@ -56,9 +67,13 @@ public:
     QString languageCode;
     QString ip;
     quint64 timestamp = 0;
+    qint64 lastActivityTime = 0; // msecs since epoch of the last packet from the client or of the disconnection
+    quint32 disconnectDelay = 0; // msecs; the connection is closed if there is no packet within the delay
+    qint64 reapDeadline = 0; // The scheduled check of the session by the server
 
 protected:
     void addSalt();
+    void dropOldRequests();
 
     RemoteClientConnection *m_connection = nullptr;
     LocalUser *m_wanterUser = nullptr;
@@ -66,6 +81,8 @@ protected:
     QVector<ServerSalt> m_salts;
     ServerSalt m_oldSalt;
     quint32 m_layer = 0;
+    QMap<quint64, QByteArray> m_requestReplies; // request message id to the rpc_result package
+    int m_requestRepliesSize = 0;
 };
 
 } // Server namespace
@@ -17,12 +17,17 @@
 
 #include "Storage.hpp"
 
+#include "ServerAuthKeyStore.hpp"
+#include "ServerFileStore.hpp"
+
 namespace Telegram {
 
 namespace Server {
 
 Storage::Storage(QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    m_fileStore(new FileStore(this)),
+    m_authKeyStore(new AuthKeyStore(this))
 {
 }
 
@@ -28,6 +28,9 @@ namespace Telegram {
 
 namespace Server {
 
+class AuthKeyStore;
+class FileStore;
+
 class Storage : public QObject
 {
     Q_OBJECT
@@ -36,8 +39,13 @@ public:
     MessageData *addMessage(quint32 fromId, Peer toPeer, const QString &text);
     const MessageData *getMessage(quint64 globalId);
 
+    FileStore *fileStore() const { return m_fileStore; }
+    AuthKeyStore *authKeyStore() const { return m_authKeyStore; }
+
 protected:
     QHash<quint64, MessageData> m_messages;
+    FileStore *m_fileStore = nullptr;
+    AuthKeyStore *m_authKeyStore = nullptr;
     quint64 m_lastGlobalId = 0;
 };
 
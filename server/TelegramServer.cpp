@@ -1,16 +1,28 @@
 #include "TelegramServer.hpp"
 
+#include <QDateTime>
+#include <QLocalServer>
+#include <QLocalSocket>
 #include <QLoggingCategory>
 #include <QTcpServer>
 #include <QTcpSocket>
+#include <QTimer>
+
+#include <algorithm>
 
 #include "ApiUtils.hpp"
+#include "RandomGenerator.hpp"
+#include "TelegramServerChannel.hpp"
 #include "TelegramServerUser.hpp"
 #include "RemoteClientConnection.hpp"
 #include "RemoteServerConnection.hpp"
+#include "ServerAuthKeyStore.hpp"
+#include "ServerDhWorkerPool.hpp"
 #include "Session.hpp"
 
 #include "CServerTcpTransport.hpp"
+#include "ServerLocalSocketTransport.hpp"
+#include "LoopbackTransport.hpp"
 
 // Generated RPC Operation Factory includes
 #include "AccountOperationFactory.hpp"
@@ -32,10 +44,14 @@
 
 #include "ServerMessageData.hpp"
 #include "ServerRpcLayer.hpp"
+#include "ServerSearchIndex.hpp"
 #include "ServerUtils.hpp"
 #include "Storage.hpp"
 #include "Debug.hpp"
 
+#include "CTelegramStream.hpp"
+#include "CTelegramStreamExtraOperators.hpp"
+
 Q_LOGGING_CATEGORY(loggingCategoryServer, "telegram.server.main", QtInfoMsg)
 Q_LOGGING_CATEGORY(loggingCategoryServerApi, "telegram.server.api", QtWarningMsg)
 
@@ -43,6 +59,12 @@ namespace Telegram {
 
 namespace Server {
 
+// The time for the client to import the exported authorization to the other DC
+static const qint64 c_exportedAuthorizationLifetime = 60 * 1000; // ms
+static const int c_exportedAuthorizationSize = 128;
+// The reaper timer interval is bounded to keep the interval in int
+static const qint64 c_maxReaperInterval = 60 * 60 * 1000; // ms
+
 Server::Server(QObject *parent) :
     QObject(parent)
 {
@@ -67,6 +89,16 @@ Server::Server(QObject *parent) :
     };
     m_serverSocket = new QTcpServer(this);
     connect(m_serverSocket, &QTcpServer::newConnection, this, &Server::onNewConnection);
+    m_localServer = new QLocalServer(this);
+    m_localServer->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_localServer, &QLocalServer::newConnection, this, &Server::onNewLocalConnection);
+    m_loopbackServer = new LoopbackServer(this);
+    connect(m_loopbackServer, &LoopbackServer::newConnection, this, &Server::onNewLoopbackConnection);
+    m_dhWorkerPool = new DhWorkerPool(this);
+    m_reaperTimer = new QTimer(this);
+    m_reaperTimer->setSingleShot(true);
+    connect(m_reaperTimer, &QTimer::timeout, this, &Server::reapSessions);
+    m_sessionIdleTimeout = defaultSessionIdleTimeout();
 }
 
 void Server::setDcOption(const DcOption &option)
@@ -74,6 +106,16 @@ void Server::setDcOption(const DcOption &option)
     m_dcOption = option;
 }
 
+void Server::setLocalSocketName(const QString &name)
+{
+    m_localSocketName = name;
+}
+
+void Server::setLoopbackName(const QString &name)
+{
+    m_loopbackName = name;
+}
+
 void Server::setServerPrivateRsaKey(const Telegram::RsaKey &key)
 {
     m_key = key;
@@ -89,6 +131,29 @@ bool Server::start()
     qCInfo(loggingCategoryServer).nospace().noquote() << this << " start server (DC " << m_dcOption.id << ") "
                                                       << "on " << m_dcOption.address << ":" << m_dcOption.port
                                                       << "; Key:" << hex << showbase << m_key.fingerprint;
+    if (!m_localSocketName.isEmpty()) {
+        // Remove the socket file left by a crashed server
+        QLocalServer::removeServer(m_localSocketName);
+        if (!m_localServer->listen(m_localSocketName)) {
+            qCCritical(loggingCategoryServer).noquote().nospace() << "Unable to listen local socket "
+                                                                  << m_localSocketName
+                                                                  << " (" << m_localServer->errorString() << ")";
+            m_serverSocket->close();
+            return false;
+        }
+        qCInfo(loggingCategoryServer).nospace().noquote() << this << " listen local socket "
+                                                          << m_localServer->fullServerName();
+    }
+    if (!m_loopbackName.isEmpty()) {
+        if (!m_loopbackServer->listen(m_loopbackName)) {
+            qCCritical(loggingCategoryServer).noquote().nospace() << "Unable to listen loopback " << m_loopbackName;
+            m_serverSocket->close();
+            m_localServer->close();
+            return false;
+        }
+        qCInfo(loggingCategoryServer).nospace().noquote() << this << " listen loopback " << m_loopbackName;
+    }
+    m_dhWorkerPool->pregenerate();
     return true;
 }
 
@@ -99,6 +164,12 @@ void Server::stop()
     if (m_serverSocket) {
         m_serverSocket->close();
     }
+    if (m_localServer) {
+        m_localServer->close();
+    }
+    if (m_loopbackServer) {
+        m_loopbackServer->close();
+    }
 
     // Connections removed from the set on disconnected.
     // Copy connections to a variable to iterate over a constant container instead of
@@ -147,6 +218,20 @@ void Server::setStorage(Storage *storage)
     m_storage = storage;
 }
 
+int Server::defaultSessionIdleTimeout()
+{
+    return 10 * 60 * 1000;
+}
+
+void Server::setSessionIdleTimeout(int msecs)
+{
+    m_sessionIdleTimeout = qMax(0, msecs);
+    // Bring forward the checks of the idle sessions
+    for (Session *session : m_authIdToSession) {
+        scheduleSessionCheck(session);
+    }
+}
+
 void Server::onNewConnection()
 {
     QTcpSocket *socket = m_serverSocket->nextPendingConnection();
@@ -157,9 +242,37 @@ void Server::onNewConnection()
     qCInfo(loggingCategoryServer) << this << "An incoming connection from" << socket->peerAddress().toString();
     TcpTransport *transport = new TcpTransport(socket, this);
     socket->setParent(transport);
+    addClientConnection(transport);
+}
+
+void Server::onNewLocalConnection()
+{
+    QLocalSocket *socket = m_localServer->nextPendingConnection();
+    if (!socket) {
+        qCDebug(loggingCategoryServer) << "expected pending local connection does not exist";
+        return;
+    }
+    qCInfo(loggingCategoryServer) << this << "An incoming local connection on" << m_localServer->fullServerName();
+    LocalSocketTransport *transport = new LocalSocketTransport(socket, this);
+    socket->setParent(transport);
+    addClientConnection(transport);
+}
+
+void Server::onNewLoopbackConnection()
+{
+    while (LoopbackTransport *transport = m_loopbackServer->nextPendingConnection()) {
+        qCInfo(loggingCategoryServer) << this << "An incoming loopback connection on" << m_loopbackName;
+        transport->setParent(this);
+        addClientConnection(transport);
+    }
+}
+
+void Server::addClientConnection(BaseTransport *transport)
+{
     RemoteClientConnection *client = new RemoteClientConnection(this);
     connect(client, &BaseConnection::statusChanged, this, &Server::onClientConnectionStatusChanged);
     client->setServerRsaKey(m_key);
+    client->setDhWorkerPool(m_dhWorkerPool);
     client->setTransport(transport);
     client->setServerApi(this);
     client->setRpcFactories(m_rpcOperationFactories);
@@ -180,12 +293,15 @@ void Server::onClientConnectionStatusChanged()
             qCInfo(loggingCategoryServer) << this << __func__ << "Disconnected a client with session id"
                                           << hex << showbase << client->session()->id()
                                           << "from" << client->transport()->remoteAddress();
-            client->session()->setConnection(nullptr);
+            Session *session = client->session();
+            session->setConnection(nullptr);
+            session->disconnectDelay = 0;
+            session->lastActivityTime = QDateTime::currentMSecsSinceEpoch();
+            scheduleSessionCheck(session);
         } else {
             qCInfo(loggingCategoryServer) << this << __func__ << "Disconnected a client without a session"
                                           << "from" << client->transport()->remoteAddress();
         }
-        // TODO: Initiate session cleanup after session expiration time out
         m_activeConnections.remove(client);
         client->deleteLater();
     }
@@ -220,8 +336,13 @@ MessageRecipient *Server::getRecipient(const Peer &peer, const LocalUser *applic
         // recipient = api()->getChannel(arguments.peer.groupId, arguments.peer.accessHash);
         break;
     case Telegram::Peer::Channel:
-        //recipient = api()->getChannel(arguments.peer.channelId, arguments.peer.accessHash);
-        break;
+    {
+        LocalChannel *channel = getChannel(peer.id);
+        if (channel && applicant && !channel->hasMember(applicant->id())) {
+            return nullptr;
+        }
+        return channel;
+    }
     }
     return nullptr;
 }
@@ -271,92 +392,521 @@ LocalUser *Server::addUser(const QString &identifier)
     return user;
 }
 
-Session *Server::createSession(quint64 authId, const QByteArray &authKey, const QString &address)
+QVector<quint32> Server::searchUsers(const QString &query, int limit) const
+{
+    // Every query word should be a prefix of some word of the user name or username
+    const QStringList queryWords = SearchIndex::tokenize(query);
+    QVector<quint32> result;
+    if (queryWords.isEmpty() || (limit <= 0)) {
+        return result;
+    }
+    QSet<quint32> matches;
+    for (int i = 0; i < queryWords.count(); ++i) {
+        const QString &queryWord = queryWords.at(i);
+        QSet<quint32> wordMatches;
+        for (auto it = m_userNameIndex.lowerBound(queryWord); it != m_userNameIndex.cend(); ++it) {
+            if (!it.key().startsWith(queryWord)) {
+                break;
+            }
+            wordMatches.unite(it.value());
+        }
+        if (i == 0) {
+            matches = wordMatches;
+        } else {
+            matches.intersect(wordMatches);
+        }
+        if (matches.isEmpty()) {
+            return result;
+        }
+    }
+    result.reserve(matches.count());
+    for (const quint32 userId : matches) {
+        result.append(userId);
+    }
+    std::sort(result.begin(), result.end());
+    if (result.count() > limit) {
+        result.resize(limit);
+    }
+    return result;
+}
+
+LocalChannel *Server::getChannel(quint32 channelId) const
+{
+    return m_channels.value(channelId);
+}
+
+LocalChannel *Server::createChannel(LocalUser *creator, const QString &title)
+{
+    LocalChannel *channel = new LocalChannel(++m_lastChannelId);
+    channel->setTitle(title);
+    channel->setCreatorId(creator->id());
+    m_channels.insert(channel->id(), channel);
+    addChannelMember(channel, creator);
+    return channel;
+}
+
+bool Server::addChannelMember(LocalChannel *channel, LocalUser *user)
+{
+    if (!channel->getPostBox()->addMember(user->id())) {
+        return false;
+    }
+    // The dialog is needed only to list the channel, the actual top message is kept by the channel box
+    user->syncDialogTopMessage(channel->toPeer(), channel->getPostBox()->lastMessageId());
+    return true;
+}
+
+Session *Server::createSession(quint64 authId, const QByteArray &authKey, const QString &address,
+                               quint64 serverSalt)
 {
     Session *session = new Session();
     session->authId = authId;
     session->authKey = authKey;
     session->ip = address;
+    session->setInitialServerSalt(serverSalt);
+    session->lastActivityTime = QDateTime::currentMSecsSinceEpoch();
     m_authIdToSession.insert(authId, session);
+    persistSession(session);
+    scheduleSessionCheck(session);
     return session;
 }
 
-Session *Server::getSessionByAuthId(quint64 authKeyId) const
+Session *Server::getSessionByAuthId(quint64 authKeyId)
 {
-    return m_authIdToSession.value(authKeyId);
+    Session *session = m_authIdToSession.value(authKeyId);
+    if (!session) {
+        session = restoreSession(authKeyId);
+    }
+    return session;
 }
 
 void Server::bindUserSession(LocalUser *user, Session *session)
 {
     user->addSession(session);
+    persistSession(session);
+}
+
+void Server::scheduleDisconnect(Session *session, quint32 delay)
+{
+    session->disconnectDelay = delay;
+    scheduleSessionCheck(session);
+}
+
+QByteArray Server::exportAuthorization(LocalUser *user, quint32 dcId)
+{
+    const qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+    // Drop the authorizations which are not imported in time
+    for (auto it = m_exportedAuthorizations.begin(); it != m_exportedAuthorizations.end(); ) {
+        if (it->expiresAt < currentTime) {
+            it = m_exportedAuthorizations.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    ExportedAuthorization authorization;
+    authorization.userId = user->id();
+    authorization.dcId = dcId;
+    authorization.expiresAt = currentTime + c_exportedAuthorizationLifetime;
+    const QByteArray bytes = RandomGenerator::instance()->generate(c_exportedAuthorizationSize);
+    m_exportedAuthorizations.insert(bytes, authorization);
+    return bytes;
+}
+
+LocalUser *Server::importAuthorization(quint32 userId, const QByteArray &bytes)
+{
+    for (RemoteServerConnection *remoteServer : m_remoteServers) {
+        LocalUser *user = remoteServer->api()->takeExportedAuthorization(userId, bytes, dcId());
+        if (user) {
+            return user;
+        }
+    }
+    qCDebug(loggingCategoryServerApi) << this << __func__ << "Invalid authorization of user" << userId;
+    return nullptr;
+}
+
+LocalUser *Server::takeExportedAuthorization(quint32 userId, const QByteArray &bytes, quint32 dcId)
+{
+    if (!m_exportedAuthorizations.contains(bytes)) {
+        return nullptr;
+    }
+    const ExportedAuthorization authorization = m_exportedAuthorizations.take(bytes);
+    if ((authorization.userId != userId) || (authorization.dcId != dcId)
+            || (authorization.expiresAt < QDateTime::currentMSecsSinceEpoch())) {
+        return nullptr;
+    }
+    return getUser(userId);
+}
+
+Session *Server::restoreSession(quint64 authId)
+{
+    if (!m_storage) {
+        return nullptr;
+    }
+    const AuthKeyRecord record = m_storage->authKeyStore()->load(authId);
+    if (!record.isValid() || (record.dcId != dcId())) {
+        return nullptr;
+    }
+    Session *session = new Session();
+    session->authId = record.authId;
+    session->authKey = record.authKey;
+    session->setLayer(record.layer);
+    session->setInitialServerSalt(record.serverSalt);
+    session->lastActivityTime = QDateTime::currentMSecsSinceEpoch();
+    m_authIdToSession.insert(authId, session);
+    scheduleSessionCheck(session);
+
+    LocalUser *user = record.userId ? getUser(record.userId) : nullptr;
+    if (user) {
+        user->addSession(session);
+    }
+    qCInfo(loggingCategoryServer) << this << __func__ << "Restored auth key" << hex << showbase << authId
+                                  << "of user" << dec << record.userId;
+    return session;
+}
+
+void Server::persistSession(Session *session)
+{
+    if (!m_storage) {
+        return;
+    }
+    AuthKeyRecord record;
+    record.authId = session->authId;
+    record.dcId = dcId();
+    record.userId = session->user() ? session->user()->id() : 0;
+    record.layer = session->layer();
+    record.serverSalt = session->getServerSalt();
+    record.authKey = session->authKey;
+    m_storage->authKeyStore()->save(record);
+}
+
+void Server::scheduleSessionCheck(Session *session)
+{
+    const qint64 deadline = getSessionDeadline(session);
+    if (!deadline) {
+        return;
+    }
+    if (session->reapDeadline && (session->reapDeadline <= deadline)) {
+        // The session will be checked earlier anyway
+        return;
+    }
+    // The previous entry (if any) becomes stale and it is skipped by the reaper
+    session->reapDeadline = deadline;
+    m_sessionDeadlines.insert(deadline, session->authId);
+    if (m_sessionDeadlines.firstKey() == deadline) {
+        updateReaperTimer();
+    }
+}
+
+qint64 Server::getSessionDeadline(const Session *session) const
+{
+    if (session->isActive()) {
+        if (!session->disconnectDelay) {
+            return 0;
+        }
+        return session->lastActivityTime + session->disconnectDelay;
+    }
+    if (!m_sessionIdleTimeout || !m_storage || !m_storage->authKeyStore()->isOpen()) {
+        return 0;
+    }
+    return session->lastActivityTime + m_sessionIdleTimeout;
+}
+
+void Server::reapSessions()
+{
+    const qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+    while (!m_sessionDeadlines.isEmpty() && (m_sessionDeadlines.firstKey() <= currentTime)) {
+        const auto it = m_sessionDeadlines.begin();
+        const qint64 entryDeadline = it.key();
+        const quint64 authId = it.value();
+        m_sessionDeadlines.erase(it);
+
+        Session *session = m_authIdToSession.value(authId);
+        if (!session || (session->reapDeadline != entryDeadline)) {
+            continue;
+        }
+        session->reapDeadline = 0;
+
+        // The deadline is moved by the traffic since the entry is scheduled
+        const qint64 deadline = getSessionDeadline(session);
+        if (!deadline) {
+            continue;
+        }
+        if (deadline > currentTime) {
+            scheduleSessionCheck(session);
+            continue;
+        }
+        if (session->isActive()) {
+            qCInfo(loggingCategoryServer) << this << __func__ << "Close the connection of session"
+                                          << hex << showbase << session->id() << "without ping in time";
+            ++m_sessionStats.droppedConnections;
+            session->disconnectDelay = 0;
+            // The session is scheduled for the eviction on disconnected
+            session->getConnection()->transport()->disconnectFromHost();
+        } else {
+            evictSession(session);
+        }
+    }
+    updateReaperTimer();
+}
+
+void Server::evictSession(Session *session)
+{
+    if (!m_storage->authKeyStore()->contains(session->authId)) {
+        // The session can not be restored
+        return;
+    }
+    qCDebug(loggingCategoryServer) << this << __func__ << "Evict idle session with auth key"
+                                   << hex << showbase << session->authId;
+    if (session->user()) {
+        session->user()->removeSession(session);
+    }
+    m_authIdToSession.remove(session->authId);
+    ++m_sessionStats.evictedSessions;
+    delete session;
+}
+
+void Server::updateReaperTimer()
+{
+    if (m_sessionDeadlines.isEmpty()) {
+        m_reaperTimer->stop();
+        return;
+    }
+    const qint64 interval = m_sessionDeadlines.firstKey() - QDateTime::currentMSecsSinceEpoch();
+    m_reaperTimer->start(static_cast<int>(qBound<qint64>(0, interval, c_maxReaperInterval)));
+}
+
+SessionStats Server::sessionStats() const
+{
+    SessionStats stats = m_sessionStats;
+    for (const Session *session : m_authIdToSession) {
+        if (session->isActive()) {
+            ++stats.activeSessions;
+        } else {
+            ++stats.idleSessions;
+        }
+        stats.memoryUsage += session->memoryUsage();
+    }
+    return stats;
 }
 
 void Server::queueUpdates(const QVector<UpdateNotification> &notifications)
 {
+    // Updates with the same recipient view (the user and the excluded session) are collected to
+    // a single Updates, which is built and serialized once for all active sessions of the user.
+    struct RecipientUpdates
+    {
+        LocalUser *recipient = nullptr;
+        Session *excludeSession = nullptr;
+        QSet<Peer> interestingPeers;
+        TLUpdates updates;
+    };
+    using RecipientViewKey = QPair<quint32, Session *>;
+
+    QVector<RecipientUpdates> recipientUpdates;
+    QHash<RecipientViewKey, int> recipientUpdatesIndex;
+
     for (const UpdateNotification &notification : notifications) {
+        if ((notification.type == UpdateNotification::Type::NewMessage)
+                && (notification.dialogPeer.type == Peer::Channel)) {
+            queueChannelUpdate(notification);
+            continue;
+        }
+
         LocalUser *recipient = getUser(notification.userId);
         if (!recipient) {
             qWarning() << Q_FUNC_INFO << "Invalid user!" << notification.userId;
+            continue;
+        }
+
+        const RecipientViewKey key(notification.userId, notification.excludeSession);
+        int index = recipientUpdatesIndex.value(key, -1);
+        if (index < 0) {
+            bool hasTargetSession = false;
+            for (const Session *session : recipient->activeSessions()) {
+                if (session != notification.excludeSession) {
+                    hasTargetSession = true;
+                    break;
+                }
+            }
+            if (!hasTargetSession) {
+                continue;
+            }
+            index = recipientUpdates.count();
+            recipientUpdatesIndex.insert(key, index);
+            recipientUpdates.append(RecipientUpdates());
+            RecipientUpdates &entry = recipientUpdates.last();
+            entry.recipient = recipient;
+            entry.excludeSession = notification.excludeSession;
+            entry.updates.tlType = TLValue::Updates;
+            entry.updates.seq = 0; // ??
         }
 
+        RecipientUpdates &entry = recipientUpdates[index];
+        TLUpdate update;
+        if (!setupTLUpdate(&update, &entry.interestingPeers, notification, recipient)) {
+            continue;
+        }
+        entry.updates.date = qMax(entry.updates.date, notification.date);
+        entry.updates.updates.append(update);
+    }
+
+    for (RecipientUpdates &entry : recipientUpdates) {
+        if (entry.updates.updates.isEmpty()) {
+            continue;
+        }
+        Utils::setupTLPeers(&entry.updates, entry.interestingPeers, this, entry.recipient);
+        deliverUpdates(entry.recipient, entry.updates, entry.excludeSession);
+    }
+}
+
+bool Server::setupTLUpdate(TLUpdate *output, QSet<Peer> *interestingPeers,
+                           const UpdateNotification &notification, const LocalUser *recipient) const
+{
+    switch (notification.type) {
+    case UpdateNotification::Type::NewMessage: {
+        output->tlType = TLValue::UpdateNewMessage;
+
+        const quint64 globalMessageId = recipient->getPostBox()->getMessageGlobalId(notification.messageId);
+        const MessageData *messageData = storage()->getMessage(globalMessageId);
+
+        if (!messageData) {
+            qWarning() << Q_FUNC_INFO << "no message";
+            return false;
+        }
+        Utils::setupTLMessage(&output->message, messageData, notification.messageId, recipient);
+        output->pts = notification.pts;
+        output->ptsCount = 1;
+
+        interestingPeers->insert(messageData->toPeer());
+        if (output->message.fromId) {
+            interestingPeers->insert(Peer::fromUserId(output->message.fromId));
+        }
+    }
+        return true;
+    case UpdateNotification::Type::ReadInbox:
+    case UpdateNotification::Type::ReadOutbox:
+        if (notification.dialogPeer.type == Peer::Channel) {
+            output->tlType = notification.type == UpdateNotification::Type::ReadInbox
+                    ? TLValue::UpdateReadChannelInbox
+                    : TLValue::UpdateReadChannelOutbox;
+            output->channelId = notification.dialogPeer.id;
+        } else {
+            output->tlType = notification.type == UpdateNotification::Type::ReadInbox
+                    ? TLValue::UpdateReadHistoryInbox
+                    : TLValue::UpdateReadHistoryOutbox;
+            output->pts = notification.pts;
+            output->ptsCount = 1;
+            output->peer = Telegram::Utils::toTLPeer(notification.dialogPeer);
+        }
+        output->maxId = notification.messageId;
+        return true;
+    case UpdateNotification::Type::Invalid:
+        break;
+    }
+    return false;
+}
+
+QByteArray Server::serializeUpdates(const TLUpdates &updates)
+{
+    ++m_updatesDeliveryStats.serializations;
+    CTelegramStream stream(CTelegramStream::WriteOnly);
+    stream << updates;
+    return stream.getData();
+}
+
+void Server::deliverUpdates(const LocalUser *recipient, const TLUpdates &updates, const Session *excludeSession)
+{
+    QByteArray updatesData;
+    for (Session *session : recipient->activeSessions()) {
+        if (session == excludeSession) {
+            continue;
+        }
+        if (updatesData.isEmpty()) {
+            updatesData = serializeUpdates(updates);
+        }
+        sendUpdatesData(session, updatesData, updates.updates.count());
+    }
+}
+
+void Server::sendUpdatesData(Session *session, const QByteArray &updatesData, int updatesCount)
+{
+    // Only the encryption is performed per session
+    session->rpcLayer()->sendRpcMessage(updatesData);
+    ++m_updatesDeliveryStats.sentPackages;
+    m_updatesDeliveryStats.deliveredUpdates += static_cast<quint64>(updatesCount);
+}
+
+void Server::queueChannelUpdate(const UpdateNotification &notification)
+{
+    if (m_channelUpdatesQueue.isEmpty()) {
+        QTimer::singleShot(0, this, &Server::deliverChannelUpdates);
+    }
+    m_channelUpdatesQueue.append(notification);
+}
+
+void Server::deliverChannelUpdates()
+{
+    const QVector<UpdateNotification> notifications = m_channelUpdatesQueue;
+    m_channelUpdatesQueue.clear();
+
+    for (const UpdateNotification &notification : notifications) {
+        LocalChannel *channel = getChannel(notification.dialogPeer.id);
+        if (!channel) {
+            qCWarning(loggingCategoryServerApi) << Q_FUNC_INFO << "Invalid channel" << notification.dialogPeer.id;
+            continue;
+        }
+        const quint64 globalMessageId = channel->getPostBox()->getMessageGlobalId(notification.messageId);
+        const MessageData *messageData = storage()->getMessage(globalMessageId);
+        if (!messageData) {
+            qCWarning(loggingCategoryServerApi) << Q_FUNC_INFO << "no message";
+            continue;
+        }
+
+        TLUpdate update;
+        update.tlType = TLValue::UpdateNewChannelMessage;
+        update.pts = notification.pts;
+        update.ptsCount = 1;
+
+        const QSet<Peer> interestingPeers = {
+            channel->toPeer(),
+            Peer::fromUserId(messageData->fromId()),
+        };
+
         TLUpdates updates;
         updates.tlType = TLValue::Updates;
         updates.date = notification.date;
+        updates.seq = 0;
 
-        QSet<Peer> interestingPeers;
-        switch (notification.type) {
-        case UpdateNotification::Type::NewMessage: {
-            TLUpdate update;
-            update.tlType = TLValue::UpdateNewMessage;
-
-            const quint64 globalMessageId = recipient->getPostBox()->getMessageGlobalId(notification.messageId);
-            const MessageData *messageData = storage()->getMessage(globalMessageId);
+        // The message is the same for all members except of the sender ('out' flag),
+        // so serialize the members view once and reuse the bytes for every session.
+        Utils::setupTLMessage(&update.message, messageData, notification.messageId, nullptr);
+        updates.updates = { update };
+        Utils::setupTLPeers(&updates, interestingPeers, this, nullptr);
 
-            if (!messageData) {
-                qWarning() << Q_FUNC_INFO << "no message";
+        QByteArray membersUpdatesData;
+        for (const quint32 userId : channel->members()) {
+            LocalUser *member = getUser(userId);
+            if (!member || !member->hasActiveSession()) {
                 continue;
             }
-            Utils::setupTLMessage(&update.message, messageData, notification.messageId, recipient);
-            update.pts = notification.pts;
-            update.ptsCount = 1;
-
-            interestingPeers.insert(messageData->toPeer());
-            if (update.message.fromId) {
-                interestingPeers.insert(Peer::fromUserId(update.message.fromId));
-            }
-
-            updates.seq = 0; // ??
-            updates.updates = { update };
-        }
-            break;
-        case UpdateNotification::Type::ReadInbox:
-        case UpdateNotification::Type::ReadOutbox:
-        {
-            TLUpdate update;
-            update.tlType = notification.type == UpdateNotification::Type::ReadInbox
-                      ? TLValue::UpdateReadHistoryInbox
-                      : TLValue::UpdateReadHistoryOutbox;
-            update.pts = notification.pts;
-            update.ptsCount = 1;
-            update.peer = Telegram::Utils::toTLPeer(notification.dialogPeer);
-            update.maxId = notification.messageId;
-
-            updates.seq = 0; // ??
-            updates.updates = { update };
-        }
-            break;
-        case UpdateNotification::Type::Invalid:
-            break;
-        }
-
-        Utils::setupTLPeers(&updates, interestingPeers, this, recipient);
-        for (Session *session : recipient->activeSessions()) {
-            if (session == notification.excludeSession) {
+            if (userId == messageData->fromId()) {
+                TLUpdates senderUpdates = updates;
+                Utils::setupTLMessage(&senderUpdates.updates.first().message, messageData, notification.messageId, member);
+                Utils::setupTLPeers(&senderUpdates, interestingPeers, this, member);
+                deliverUpdates(member, senderUpdates, notification.excludeSession);
                 continue;
             }
-            session->rpcLayer()->sendUpdates(updates);
+            if (membersUpdatesData.isEmpty()) {
+                membersUpdatesData = serializeUpdates(updates);
+            }
+            for (Session *session : member->activeSessions()) {
+                sendUpdatesData(session, membersUpdatesData, updates.updates.count());
+            }
         }
     }
+
+    qCDebug(loggingCategoryServerApi) << Q_FUNC_INFO << "Serializations per delivered update:"
+                                      << m_updatesDeliveryStats.serializationsPerUpdate();
 }
 
 void Server::insertUser(LocalUser *user)
@@ -364,11 +914,34 @@ void Server::insertUser(LocalUser *user)
     qCDebug(loggingCategoryServerApi) << Q_FUNC_INFO << user << user->phoneNumber() << user->id();
     m_users.insert(user->id(), user);
     m_phoneToUserId.insert(user->phoneNumber(), user->id());
+    user->setNameChangedCallback([this](LocalUser *renamedUser) { indexUserName(renamedUser); });
+    indexUserName(user);
     for (Session *session : user->sessions()) {
         m_authIdToSession.insert(session->authId, session);
     }
 }
 
+void Server::indexUserName(LocalUser *user)
+{
+    for (const QString &word : m_userNameWords.value(user->id())) {
+        auto it = m_userNameIndex.find(word);
+        if (it == m_userNameIndex.end()) {
+            continue;
+        }
+        it.value().remove(user->id());
+        if (it.value().isEmpty()) {
+            m_userNameIndex.erase(it);
+        }
+    }
+    const QStringList words = SearchIndex::tokenize(user->firstName()
+                                                    + QLatin1Char(' ') + user->lastName()
+                                                    + QLatin1Char(' ') + user->userName());
+    for (const QString &word : words) {
+        m_userNameIndex[word].insert(user->id());
+    }
+    m_userNameWords.insert(user->id(), words);
+}
+
 PhoneStatus Server::getPhoneStatus(const QString &identifier) const
 {
     PhoneStatus result;
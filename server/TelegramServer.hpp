@@ -9,25 +9,54 @@
 
 #include "ServerApi.hpp"
 
+QT_FORWARD_DECLARE_CLASS(QLocalServer)
 QT_FORWARD_DECLARE_CLASS(QTcpServer)
 QT_FORWARD_DECLARE_CLASS(QTcpSocket)
 QT_FORWARD_DECLARE_CLASS(QTimer)
 
 #include <QHash>
+#include <QMap>
+#include <QMultiMap>
 #include <QSet>
 #include <QVector>
 
 namespace Telegram {
 
+class BaseTransport;
+class LoopbackServer;
+
 namespace Server {
 
+class LocalChannel;
 class LocalUser;
 class Session;
 class RemoteClientConnection;
 class RemoteServerConnection;
 class AbstractUser;
+class DhWorkerPool;
 class RpcOperationFactory;
 
+struct UpdatesDeliveryStats
+{
+    qreal serializationsPerUpdate() const
+    {
+        return deliveredUpdates ? qreal(serializations) / deliveredUpdates : 0;
+    }
+
+    quint64 serializations = 0; // Serialized Updates packages
+    quint64 sentPackages = 0; // Updates packages sent to the sessions
+    quint64 deliveredUpdates = 0; // Update entries delivered to the sessions
+};
+
+struct SessionStats
+{
+    quint64 activeSessions = 0; // Sessions with a connection
+    quint64 idleSessions = 0; // Resident sessions without a connection
+    quint64 memoryUsage = 0; // Approximate size of the resident sessions in bytes
+    quint64 evictedSessions = 0; // Idle sessions removed from memory
+    quint64 droppedConnections = 0; // Connections closed due to no ping within the disconnect delay
+};
+
 class Server : public QObject, public ServerApi
 {
     Q_OBJECT
@@ -36,8 +65,19 @@ public:
 
     void setDcOption(const DcOption &option);
 
+    // Additionally accept the connections on the local socket (for the clients on the same host)
+    QString localSocketName() const { return m_localSocketName; }
+    void setLocalSocketName(const QString &name);
+
+    // Additionally accept the in-process LoopbackTransport connections (for the benchmarks)
+    QString loopbackName() const { return m_loopbackName; }
+    void setLoopbackName(const QString &name);
+
     void setServerPrivateRsaKey(const Telegram::RsaKey &key);
 
+    // Handshake crypto worker threads, pregenerated key material and the handshakes limit
+    DhWorkerPool *dhWorkerPool() const { return m_dhWorkerPool; }
+
     bool start();
     void stop();
     void loadData();
@@ -52,6 +92,12 @@ public:
     void setAuthorizationProvider(Authorization::Provider *provider);
     void setStorage(Storage *storage);
 
+    static int defaultSessionIdleTimeout();
+    // The sessions without a connection are removed from memory once idle for the timeout and restored
+    // from the auth key store on demand, so nothing is evicted unless the store is open
+    int sessionIdleTimeout() const { return m_sessionIdleTimeout; }
+    void setSessionIdleTimeout(int msecs);
+
     // ServerAPI:
     Authorization::Provider *getAuthorizationProvider() override { return m_authProvider; }
 
@@ -79,37 +125,92 @@ public:
     AbstractUser *getUser(const TLInputUser &inputUser, LocalUser *self) const override;
     AbstractUser *tryAccessUser(quint32 userId, quint64 accessHash, LocalUser *applicant) const override;
     LocalUser *addUser(const QString &identifier) override;
+    QVector<quint32> searchUsers(const QString &query, int limit) const override;
 
-    Session *createSession(quint64 authId, const QByteArray &authKey, const QString &address) override;
-    Session *getSessionByAuthId(quint64 authKeyId) const override;
+    LocalChannel *getChannel(quint32 channelId) const override;
+    LocalChannel *createChannel(LocalUser *creator, const QString &title) override;
+    bool addChannelMember(LocalChannel *channel, LocalUser *user) override;
+
+    Session *createSession(quint64 authId, const QByteArray &authKey, const QString &address,
+                           quint64 serverSalt) override;
+    Session *getSessionByAuthId(quint64 authKeyId) override;
     void bindUserSession(LocalUser *user, Session *session) override;
+    void scheduleDisconnect(Session *session, quint32 delay) override;
+    QByteArray exportAuthorization(LocalUser *user, quint32 dcId) override;
+    LocalUser *importAuthorization(quint32 userId, const QByteArray &bytes) override;
+    LocalUser *takeExportedAuthorization(quint32 userId, const QByteArray &bytes, quint32 dcId) override;
 
     void queueUpdates(const QVector<UpdateNotification> &notifications) override;
 
     void insertUser(LocalUser *user);
 
+    UpdatesDeliveryStats updatesDeliveryStats() const { return m_updatesDeliveryStats; }
+    SessionStats sessionStats() const;
+
 signals:
 
 public slots:
 
 protected slots:
     void onNewConnection();
+    void onNewLocalConnection();
+    void onNewLoopbackConnection();
+    void deliverChannelUpdates();
+    void reapSessions();
 
 protected:
+    void addClientConnection(BaseTransport *transport);
     void onClientConnectionStatusChanged();
+    Session *restoreSession(quint64 authId);
+    void persistSession(Session *session);
+    void scheduleSessionCheck(Session *session);
+    qint64 getSessionDeadline(const Session *session) const;
+    void evictSession(Session *session);
+    void updateReaperTimer();
+    void indexUserName(LocalUser *user);
+    void queueChannelUpdate(const UpdateNotification &notification);
+    bool setupTLUpdate(TLUpdate *output, QSet<Peer> *interestingPeers,
+                       const UpdateNotification &notification, const LocalUser *recipient) const;
+    QByteArray serializeUpdates(const TLUpdates &updates);
+    void deliverUpdates(const LocalUser *recipient, const TLUpdates &updates, const Session *excludeSession);
+    void sendUpdatesData(Session *session, const QByteArray &updatesData, int updatesCount);
 
 protected:
     Authorization::Provider *m_authProvider = nullptr;
     Storage *m_storage = nullptr;
 
 private:
+    struct ExportedAuthorization
+    {
+        quint32 userId = 0;
+        quint32 dcId = 0;
+        qint64 expiresAt = 0; // msecs since epoch
+    };
+
     QTcpServer *m_serverSocket;
+    QLocalServer *m_localServer;
+    LoopbackServer *m_loopbackServer;
+    DhWorkerPool *m_dhWorkerPool;
+    QTimer *m_reaperTimer;
     DcOption m_dcOption;
+    QString m_localSocketName;
+    QString m_loopbackName;
     Telegram::RsaKey m_key;
 
     QHash<QString, quint32> m_phoneToUserId;
     QHash<quint64, Session*> m_authIdToSession;
+    // A single timer checks the earliest session deadline; the deadlines are rechecked when reached
+    QMultiMap<qint64, quint64> m_sessionDeadlines; // msecs since epoch to authId
+    int m_sessionIdleTimeout = 0;
+    SessionStats m_sessionStats;
+    QHash<QByteArray, ExportedAuthorization> m_exportedAuthorizations; // bytes to authorization
     QHash<quint32, LocalUser*> m_users; // userId to User
+    QMap<QString, QSet<quint32>> m_userNameIndex; // name word to userIds (ordered for the prefix lookup)
+    QHash<quint32, QStringList> m_userNameWords; // userId to the indexed name words
+    QHash<quint32, LocalChannel*> m_channels; // channelId to Channel
+    QVector<UpdateNotification> m_channelUpdatesQueue;
+    quint32 m_lastChannelId = 0;
+    UpdatesDeliveryStats m_updatesDeliveryStats;
     QSet<RemoteClientConnection*> m_activeConnections;
     QSet<RemoteServerConnection*> m_remoteServers;
     QVector<RpcOperationFactory*> m_rpcOperationFactories;
@@ -0,0 +1,50 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include "TelegramServerChannel.hpp"
+
+#include "ApiUtils.hpp"
+
+namespace Telegram {
+
+namespace Server {
+
+LocalChannel::LocalChannel(quint32 channelId) :
+    m_id(channelId)
+{
+    m_box.setChannelId(channelId);
+    m_date = Telegram::Utils::getCurrentTime();
+}
+
+void LocalChannel::setTitle(const QString &title)
+{
+    m_title = title;
+}
+
+void LocalChannel::setCreatorId(quint32 userId)
+{
+    m_creatorId = userId;
+}
+
+void LocalChannel::setBroadcast(bool broadcast)
+{
+    m_broadcast = broadcast;
+}
+
+} // Server namespace
+
+} // Telegram namespace
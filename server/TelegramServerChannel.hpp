@@ -0,0 +1,70 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#ifndef TELEGRAM_SERVER_CHANNEL_HPP
+#define TELEGRAM_SERVER_CHANNEL_HPP
+
+#include "TelegramServerUser.hpp"
+
+namespace Telegram {
+
+namespace Server {
+
+// Megagroup or broadcast channel. All members share the single channel postbox,
+// so a message is stored once regardless of the number of the members.
+class LocalChannel : public MessageRecipient
+{
+public:
+    explicit LocalChannel(quint32 channelId);
+
+    quint32 id() const { return m_id; }
+
+    QString title() const { return m_title; }
+    void setTitle(const QString &title);
+
+    quint32 creatorId() const { return m_creatorId; }
+    void setCreatorId(quint32 userId);
+
+    quint32 date() const { return m_date; }
+
+    bool isBroadcast() const { return m_broadcast; }
+    void setBroadcast(bool broadcast);
+
+    ChannelPostBox *getPostBox() { return &m_box; }
+    const ChannelPostBox *getPostBox() const { return &m_box; }
+
+    QVector<PostBox *> postBoxes() override { return { &m_box }; }
+
+    QVector<quint32> members() const { return m_box.users(); }
+    bool hasMember(quint32 userId) const { return m_box.hasMember(userId); }
+
+    Peer toPeer() const override { return Peer::fromChannelId(m_id); }
+
+protected:
+    ChannelPostBox m_box;
+    QString m_title;
+    quint32 m_id = 0;
+    quint32 m_creatorId = 0;
+    quint32 m_date = 0;
+    bool m_broadcast = false;
+};
+
+} // Server namespace
+
+} // Telegram namespace
+
+#endif // TELEGRAM_SERVER_CHANNEL_HPP
@@ -33,6 +33,7 @@ namespace Server {
 namespace ConfigKey {
 
 static const QLatin1String c_privateKeyFile = QLatin1String("privateKeyFile");
+static const QLatin1String c_authKeysFile = QLatin1String("authKeysFile");
 static const QLatin1String c_serverConfiguration = QLatin1String("serverConfiguration");
 static const QLatin1String c_dcOptions = QLatin1String("dcOptions");
 static const QLatin1String c_address = QLatin1String("address");
@@ -56,6 +57,7 @@ Config::Config(const QString &fileName)
         Telegram::DcOption(QStringLiteral("127.0.0.3"), 11443, 3),
     };
     m_privateKeyFile = QStringLiteral("private_key.pem");
+    m_authKeysFile = QStringLiteral("auth_keys.bin");
 }
 
 void Config::setFileName(const QString &fileName)
@@ -73,6 +75,11 @@ void Config::setPrivateKeyFile(const QString &fileName)
     m_privateKeyFile = fileName;
 }
 
+void Config::setAuthKeysFile(const QString &fileName)
+{
+    m_authKeysFile = fileName;
+}
+
 bool Config::load()
 {
     QByteArray bytes;
@@ -101,6 +108,7 @@ bool Config::load()
 
     // read private key setting
     m_privateKeyFile = obj[ConfigKey::c_privateKeyFile].toString();
+    m_authKeysFile = obj[ConfigKey::c_authKeysFile].toString(m_authKeysFile);
 
     // read server configuration
     const QJsonObject &jserverConfig = obj[ConfigKey::c_serverConfiguration].toObject();
@@ -124,6 +132,7 @@ bool Config::save() const
 {
     QJsonObject jobj;
     jobj[ConfigKey::c_privateKeyFile] = m_privateKeyFile;
+    jobj[ConfigKey::c_authKeysFile] = m_authKeysFile;
 
     QJsonObject jserverConfiguration;
     QJsonArray jdcArr;
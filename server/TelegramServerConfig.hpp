@@ -37,12 +37,16 @@ public:
     QString privateKeyFile() const { return m_privateKeyFile; }
     void setPrivateKeyFile(const QString &fileName);
 
+    QString authKeysFile() const { return m_authKeysFile; }
+    void setAuthKeysFile(const QString &fileName);
+
     bool load();
     bool save() const;
 
 private:
     QString m_fileName;
     QString m_privateKeyFile;
+    QString m_authKeysFile;
     DcConfiguration m_serverConfiguration;
 };
 
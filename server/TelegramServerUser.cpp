@@ -10,6 +10,8 @@
 #include <QCryptographicHash>
 #include <QLoggingCategory>
 
+#include <algorithm>
+
 namespace Telegram {
 
 namespace Server {
@@ -17,10 +19,16 @@ namespace Server {
 quint32 PostBox::addMessage(MessageData *message)
 {
     ++m_lastMessageId;
-    ++m_pts;
 
     message->addReference(peer(), m_lastMessageId);
     m_messages.insert(m_lastMessageId, message->globalId());
+
+    QStringList searchTags = { senderTag(message->fromId()) };
+    if (m_peer.type == Peer::User) {
+        searchTags.append(dialogTag(message->getDialogPeer(m_peer.id)));
+    }
+    m_searchIndex.addEntry(m_lastMessageId, message->text(), searchTags);
+    addUpdate(PostBoxUpdate::Type::NewMessage, message->toPeer(), m_lastMessageId);
     return m_lastMessageId;
 }
 
@@ -29,11 +37,136 @@ quint64 PostBox::getMessageGlobalId(quint32 messageId) const
     return m_messages.value(messageId);
 }
 
+quint32 PostBox::getLastMessageIdBefore(quint64 globalId) const
+{
+    // The global ids grow along with the message ids
+    quint32 lowId = 0;
+    quint32 highId = m_lastMessageId;
+    while (lowId < highId) {
+        const quint32 middleId = highId - (highId - lowId) / 2;
+        if (m_messages.value(middleId) < globalId) {
+            lowId = middleId;
+        } else {
+            highId = middleId - 1;
+        }
+    }
+    return lowId;
+}
+
+QString PostBox::senderTag(quint32 userId)
+{
+    return QStringLiteral("from:%1").arg(userId);
+}
+
+QString PostBox::dialogTag(const Peer &dialogPeer)
+{
+    return QStringLiteral("dialog:%1:%2").arg(static_cast<int>(dialogPeer.type)).arg(dialogPeer.id);
+}
+
 QHash<quint32, quint64> PostBox::getAllMessageKeys() const
 {
     return m_messages;
 }
 
+quint32 PostBox::addUpdate(PostBoxUpdate::Type type, const Peer &dialogPeer, quint32 messageId)
+{
+    PostBoxUpdate update;
+    update.type = type;
+    update.dialogPeer = dialogPeer;
+    update.messageId = messageId;
+    update.pts = ++m_pts;
+    update.date = Telegram::Utils::getCurrentTime();
+    logUpdate(update);
+    return m_pts;
+}
+
+void PostBox::setUpdateLogCapacity(int capacity)
+{
+    if (m_updateLogCapacity == capacity) {
+        return;
+    }
+    QVector<PostBoxUpdate> updates;
+    getUpdates(0, &updates);
+    m_updateLogCapacity = capacity;
+    m_updateLog.clear();
+    m_updateLogStart = 0;
+    for (const PostBoxUpdate &update : updates) {
+        logUpdate(update);
+    }
+}
+
+bool PostBox::getUpdates(quint32 fromPts, QVector<PostBoxUpdate> *updates) const
+{
+    const int loggedCount = m_updateLog.count();
+    const quint32 firstLoggedPts = m_pts - static_cast<quint32>(loggedCount) + 1;
+
+    updates->clear();
+    if (fromPts >= m_pts) {
+        return true;
+    }
+    const quint32 firstPts = qMax(fromPts + 1, firstLoggedPts);
+    updates->reserve(static_cast<int>(m_pts + 1 - firstPts));
+    for (quint32 pts = firstPts; pts <= m_pts; ++pts) {
+        const int offset = static_cast<int>(pts - firstLoggedPts);
+        updates->append(m_updateLog.at((m_updateLogStart + offset) % loggedCount));
+    }
+    return fromPts + 1 >= firstLoggedPts;
+}
+
+void PostBox::logUpdate(const PostBoxUpdate &update)
+{
+    if (m_updateLogCapacity <= 0) {
+        return;
+    }
+    if (m_updateLog.count() < m_updateLogCapacity) {
+        m_updateLog.append(update);
+    } else {
+        // Overwrite the oldest update
+        m_updateLog[m_updateLogStart] = update;
+        m_updateLogStart = (m_updateLogStart + 1) % m_updateLog.count();
+    }
+}
+
+bool ChannelPostBox::addMember(quint32 userId)
+{
+    if (hasMember(userId)) {
+        return false;
+    }
+    m_members.append(userId);
+    // New members have no unread history
+    m_readInboxMaxId.insert(userId, m_lastMessageId);
+    return true;
+}
+
+quint32 ChannelPostBox::addMessage(MessageData *message)
+{
+    const quint32 messageId = PostBox::addMessage(message);
+    // The sender has read the own message
+    setReadInboxMaxId(message->fromId(), messageId);
+    return messageId;
+}
+
+bool ChannelPostBox::setReadInboxMaxId(quint32 userId, quint32 maxId)
+{
+    QHash<quint32, quint32>::iterator it = m_readInboxMaxId.find(userId);
+    if (it == m_readInboxMaxId.end()) {
+        return false;
+    }
+    maxId = qMin(maxId, m_lastMessageId);
+    if (it.value() >= maxId) {
+        return false;
+    }
+    it.value() = maxId;
+    return true;
+}
+
+quint32 ChannelPostBox::unreadCount(quint32 userId) const
+{
+    // Channel message ids are sequential, so the read pointer is enough to count unread messages
+    const quint32 readMaxId = m_readInboxMaxId.value(userId, m_lastMessageId);
+    return m_lastMessageId - qMin(readMaxId, m_lastMessageId);
+}
+
 TLPeer MessageRecipient::toTLPeer() const
 {
     const Peer p = toPeer();
@@ -80,11 +213,17 @@ void LocalUser::setPhoneNumber(const QString &phoneNumber)
 void LocalUser::setFirstName(const QString &firstName)
 {
     m_firstName = firstName;
+    if (m_nameChangedCallback) {
+        m_nameChangedCallback(this);
+    }
 }
 
 void LocalUser::setLastName(const QString &lastName)
 {
     m_lastName = lastName;
+    if (m_nameChangedCallback) {
+        m_nameChangedCallback(this);
+    }
 }
 
 bool LocalUser::isOnline() const
@@ -134,6 +273,11 @@ void LocalUser::addSession(Session *session)
     session->setUser(this);
 }
 
+void LocalUser::removeSession(Session *session)
+{
+    m_sessions.removeOne(session);
+}
+
 void LocalUser::setPlainPassword(const QString &password)
 {
     if (password.isEmpty()) {
@@ -161,6 +305,7 @@ void LocalUser::importContact(const UserContact &contact)
 
     if (contact.id) {
         m_contactList.append(contact.id);
+        m_contactListHash = Telegram::Utils::updateHash(m_contactListHash, contact.id);
     }
 }
 
@@ -181,6 +326,62 @@ void LocalUser::syncDialogTopMessage(const Peer &peer, quint32 messageId)
     dialog->topMessage = messageId;
 }
 
+void LocalUser::addUnreadMessage(const Peer &peer, const UnreadMessage &message)
+{
+    UserDialog *dialog = ensureDialog(peer);
+    if (message.messageId <= dialog->readInboxMaxId) {
+        return;
+    }
+    // Message ids are allocated incrementally, so appending keeps the vector sorted
+    dialog->unreadMessages.append(message);
+    ++dialog->unreadCount;
+    if (message.mention) {
+        ++dialog->unreadMentionsCount;
+    }
+    ++m_unreadCount;
+}
+
+bool LocalUser::readInbox(UserDialog *dialog, quint32 maxId, QVector<UnreadMessage> *lastReadMessages)
+{
+    if (maxId <= dialog->readInboxMaxId) {
+        return false;
+    }
+    dialog->readInboxMaxId = maxId;
+
+    QVector<UnreadMessage> &unread = dialog->unreadMessages;
+    const auto readEnd = std::upper_bound(unread.begin(), unread.end(), maxId,
+                                          [](quint32 id, const UnreadMessage &message) {
+        return id < message.messageId;
+    });
+    const int readCount = static_cast<int>(readEnd - unread.begin());
+    if (!readCount) {
+        return false;
+    }
+
+    quint32 readMentions = 0;
+    for (auto it = unread.begin(); it != readEnd; ++it) {
+        if (it->mention) {
+            ++readMentions;
+        }
+        // The messages are sorted, so the latest message of the sender replaces the previous one
+        auto senderIt = std::find_if(lastReadMessages->begin(), lastReadMessages->end(),
+                                     [it](const UnreadMessage &message) {
+            return message.senderId == it->senderId;
+        });
+        if (senderIt == lastReadMessages->end()) {
+            lastReadMessages->append(*it);
+        } else {
+            *senderIt = *it;
+        }
+    }
+    unread.remove(0, readCount);
+
+    dialog->unreadCount -= readCount;
+    dialog->unreadMentionsCount -= readMentions;
+    m_unreadCount -= readCount;
+    return true;
+}
+
 UserDialog *LocalUser::getDialog(const Peer &peer)
 {
     for (int i = 0; i < m_dialogs.count(); ++i) {
@@ -6,8 +6,11 @@
 #include <QHash>
 
 #include "ServerNamespace.hpp"
+#include "ServerSearchIndex.hpp"
 #include "TLTypes.hpp"
 
+#include <functional>
+
 namespace Telegram {
 
 namespace Server {
@@ -18,6 +21,23 @@ class MessageData;
 
 class AbstractUser;
 
+struct PostBoxUpdate
+{
+    enum class Type {
+        Invalid,
+        NewMessage,
+        EditMessage,
+        ReadInbox,
+        ReadOutbox,
+    };
+
+    Peer dialogPeer;
+    quint32 messageId = 0; // The message id or the max read message id
+    quint32 pts = 0;
+    quint32 date = 0;
+    Type type = Type::Invalid;
+};
+
 class PostBox
 {
 public:
@@ -25,21 +45,44 @@ public:
 
     Peer peer() const { return m_peer; }
 
-    quint32 bumpPts() { return ++m_pts; }
     quint32 pts() const { return m_pts; }
     quint32 lastMessageId() const { return m_lastMessageId; }
     virtual QVector<quint32> users() const = 0;
 
-    quint32 addMessage(MessageData *message);
+    virtual quint32 addMessage(MessageData *message);
     quint64 getMessageGlobalId(quint32 messageId) const;
+    // Returns the id of the latest message added before the message with the given global id
+    quint32 getLastMessageIdBefore(quint64 globalId) const;
 
     QHash<quint32,quint64> getAllMessageKeys() const;
 
+    // Bumps pts and records the update to the log
+    quint32 addUpdate(PostBoxUpdate::Type type, const Peer &dialogPeer, quint32 messageId);
+
+    int updateLogCapacity() const { return m_updateLogCapacity; }
+    void setUpdateLogCapacity(int capacity);
+
+    // Returns false if some of the updates after the given pts are already dropped from the log
+    bool getUpdates(quint32 fromPts, QVector<PostBoxUpdate> *updates) const;
+
+    // The messages of the box indexed by the message ids; the sender and the dialog are indexed as tags
+    const SearchIndex *searchIndex() const { return &m_searchIndex; }
+    static QString senderTag(quint32 userId);
+    static QString dialogTag(const Peer &dialogPeer);
+
 protected:
+    void logUpdate(const PostBoxUpdate &update);
+
     Peer m_peer;
     quint32 m_pts = 0;
     quint32 m_lastMessageId = 0;
     QHash<quint32,quint64> m_messages;
+    SearchIndex m_searchIndex;
+
+    // Ring buffer of the updates with the last consecutive pts values
+    QVector<PostBoxUpdate> m_updateLog;
+    int m_updateLogStart = 0; // Index of the oldest update
+    int m_updateLogCapacity = 1000;
 };
 
 class UserPostBox : public PostBox
@@ -58,6 +101,32 @@ public:
     }
 };
 
+class ChannelPostBox : public PostBox
+{
+public:
+    ChannelPostBox() = default;
+
+    QVector<quint32> users() const override { return m_members; }
+
+    quint32 addMessage(MessageData *message) override;
+
+    void setChannelId(quint32 channelId)
+    {
+        m_peer = Peer::fromChannelId(channelId);
+    }
+
+    bool hasMember(quint32 userId) const { return m_readInboxMaxId.contains(userId); }
+    bool addMember(quint32 userId);
+
+    quint32 readInboxMaxId(quint32 userId) const { return m_readInboxMaxId.value(userId); }
+    bool setReadInboxMaxId(quint32 userId, quint32 maxId);
+    quint32 unreadCount(quint32 userId) const;
+
+protected:
+    QVector<quint32> m_members;
+    QHash<quint32, quint32> m_readInboxMaxId; // Member id to the member read pointer
+};
+
 class MessageRecipient
 {
 public:
@@ -99,6 +168,9 @@ public:
     QString lastName() const { return m_lastName; }
     void setLastName(const QString &lastName);
 
+    using NameChangedCallback = std::function<void(LocalUser *user)>;
+    void setNameChangedCallback(const NameChangedCallback &callback) { m_nameChangedCallback = callback; }
+
     bool isOnline() const;
 
     quint32 dcId() const { return m_dcId; }
@@ -109,6 +181,7 @@ public:
     QVector<Session*> activeSessions() const;
     bool hasActiveSession() const;
     void addSession(Session *session);
+    void removeSession(Session *session);
 
     bool hasPassword() const { return !m_passwordSalt.isEmpty() && !m_passwordHash.isEmpty(); }
     QByteArray passwordSalt() const { return m_passwordSalt; }
@@ -126,11 +199,16 @@ public:
 
     void importContact(const UserContact &contact);
     QVector<quint32> contactList() const override { return m_contactList; }
+    quint32 contactListHash() const { return m_contactListHash; }
     const QVector<UserDialog *> dialogs() const { return m_dialogs; }
 
     QVector<UserContact> importedContacts() const { return m_importedContacts; }
 
     void syncDialogTopMessage(const Telegram::Peer &peer, quint32 messageId);
+    void addUnreadMessage(const Telegram::Peer &peer, const UnreadMessage &message);
+    // Returns the last read message of each sender (there are several senders in a chat)
+    bool readInbox(UserDialog *dialog, quint32 maxId, QVector<UnreadMessage> *lastReadMessages);
+    quint32 unreadCount() const { return m_unreadCount; }
     UserDialog *getDialog(const Telegram::Peer &peer);
 
 protected:
@@ -144,13 +222,16 @@ protected:
     QString m_firstName;
     QString m_lastName;
     QString m_userName;
+    NameChangedCallback m_nameChangedCallback;
     QByteArray m_passwordSalt;
     QByteArray m_passwordHash;
     QVector<Session*> m_sessions;
     quint32 m_dcId = 0;
+    quint32 m_unreadCount = 0;
 
     QVector<UserDialog *> m_dialogs;
     QVector<quint32> m_contactList; // Contains only registered users from the added contacts
+    quint32 m_contactListHash = 0; // Updated incrementally on m_contactList changes
     QVector<UserContact> m_importedContacts; // Contains phone + name of all added contacts (including not registered yet)
 };
 
@@ -158,4 +239,6 @@ protected:
 
 } // Telegram namespace
 
+Q_DECLARE_TYPEINFO(Telegram::Server::PostBoxUpdate, Q_MOVABLE_TYPE);
+
 #endif // TELEGRAMSERVERUSER_HPP
@@ -20,6 +20,8 @@
 #include "DcConfiguration.hpp"
 #include "LocalCluster.hpp"
 #include "Session.hpp"
+#include "ServerAuthKeyStore.hpp"
+#include "Storage.hpp"
 
 #include "Utils.hpp"
 #include <QCoreApplication>
@@ -83,7 +85,13 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    Storage storage;
+    if (!config.authKeysFile().isEmpty()) {
+        storage.authKeyStore()->open(config.authKeysFile());
+    }
+
     LocalCluster cluster;
+    cluster.setStorage(&storage);
     cluster.setServerPrivateRsaKey(key);
     cluster.setServerConfiguration(config.serverConfiguration());
 
@@ -1,19 +1,25 @@
 
 SOURCES += $$PWD/DefaultAuthorizationProvider.cpp
 SOURCES += $$PWD/LocalCluster.cpp
+SOURCES += $$PWD/ServerAuthKeyStore.cpp
 SOURCES += $$PWD/ServerDhLayer.cpp
+SOURCES += $$PWD/ServerDhWorkerPool.cpp
+SOURCES += $$PWD/ServerFileStore.cpp
 SOURCES += $$PWD/ServerMessageData.cpp
 SOURCES += $$PWD/ServerRpcLayer.cpp
 SOURCES += $$PWD/ServerRpcOperation.cpp
+SOURCES += $$PWD/ServerSearchIndex.cpp
 SOURCES += $$PWD/ServerUtils.cpp
 SOURCES += $$PWD/Session.cpp
 SOURCES += $$PWD/Storage.cpp
 SOURCES += $$PWD/RpcOperationFactory.cpp
 SOURCES += $$PWD/RpcProcessingContext.cpp
 SOURCES += $$PWD/TelegramServer.cpp
+SOURCES += $$PWD/TelegramServerChannel.cpp
 SOURCES += $$PWD/TelegramServerConfig.cpp
 SOURCES += $$PWD/TelegramServerUser.cpp
 SOURCES += $$PWD/CServerTcpTransport.cpp
+SOURCES += $$PWD/ServerLocalSocketTransport.cpp
 SOURCES += $$PWD/RemoteClientConnection.cpp
 SOURCES += $$PWD/RemoteServerConnection.cpp
 SOURCES += $$PWD/FunctionStreamOperators.cpp
@@ -22,11 +28,15 @@ HEADERS += $$PWD/AuthorizationProvider.hpp
 HEADERS += $$PWD/DefaultAuthorizationProvider.hpp
 HEADERS += $$PWD/LocalCluster.hpp
 HEADERS += $$PWD/ServerApi.hpp
+HEADERS += $$PWD/ServerAuthKeyStore.hpp
 HEADERS += $$PWD/ServerDhLayer.hpp
+HEADERS += $$PWD/ServerDhWorkerPool.hpp
+HEADERS += $$PWD/ServerFileStore.hpp
 HEADERS += $$PWD/ServerNamespace.hpp
 HEADERS += $$PWD/ServerMessageData.hpp
 HEADERS += $$PWD/ServerRpcLayer.hpp
 HEADERS += $$PWD/ServerRpcOperation.hpp
+HEADERS += $$PWD/ServerSearchIndex.hpp
 HEADERS += $$PWD/ServerUtils.hpp
 HEADERS += $$PWD/Session.hpp
 HEADERS += $$PWD/Storage.hpp
@@ -34,9 +44,11 @@ HEADERS += $$PWD/RpcOperationFactory.hpp
 HEADERS += $$PWD/RpcOperationFactory_p.hpp
 HEADERS += $$PWD/RpcProcessingContext.hpp
 HEADERS += $$PWD/TelegramServer.hpp
+HEADERS += $$PWD/TelegramServerChannel.hpp
 HEADERS += $$PWD/TelegramServerConfig.hpp
 HEADERS += $$PWD/TelegramServerUser.hpp
 HEADERS += $$PWD/CServerTcpTransport.hpp
+HEADERS += $$PWD/ServerLocalSocketTransport.hpp
 HEADERS += $$PWD/RemoteClientConnection.hpp
 HEADERS += $$PWD/RemoteServerConnection.hpp
 HEADERS += $$PWD/FunctionStreamOperators.hpp
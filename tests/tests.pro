@@ -1,5 +1,8 @@
 TEMPLATE = subdirs
 SUBDIRS += tst_all
 #SUBDIRS += tst_toOfficial
+SUBDIRS += tst_ClientBenchmarks
 SUBDIRS += tst_ConnectionApi
+SUBDIRS += tst_FilesApi
 SUBDIRS += tst_MessagesApi
+SUBDIRS += tst_ServerBenchmarks
@@ -0,0 +1,690 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include <QObject>
+
+#include "AccountStorage.hpp"
+#include "Client.hpp"
+#include "Client_p.hpp"
+#include "ClientConnection.hpp"
+#include "ClientRpcLayer.hpp"
+#include "ClientRpcScheduler.hpp"
+#include "ConnectionApi.hpp"
+#include "DataStorage.hpp"
+#include "DataStorage_p.hpp"
+#include "LocalCluster.hpp"
+#include "LocalSocketTransport.hpp"
+#include "LoopbackTransport.hpp"
+#include "MessagingApi.hpp"
+#include "PacketFraming.hpp"
+#include "RandomGenerator.hpp"
+#include "UpdatesLayer.hpp"
+#include "Utils.hpp"
+
+#include "RpcLayers/ClientRpcMessagesLayer.hpp"
+#include "RpcLayers/ClientRpcUploadLayer.hpp"
+
+#include "RemoteClientConnection.hpp"
+#include "Session.hpp"
+#include "TelegramServer.hpp"
+#include "TelegramServerUser.hpp"
+
+#include <QCoreApplication>
+#include <QTest>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+#include "keys_data.hpp"
+#include "TestAuthProvider.hpp"
+#include "TestClientUtils.hpp"
+#include "TestServerUtils.hpp"
+#include "TestUserData.hpp"
+#include "TestUtils.hpp"
+
+using namespace Telegram;
+
+Q_DECLARE_METATYPE(Telegram::PacketFraming::Mode)
+
+static const UserData c_user = []() {
+    UserData userData;
+    userData.dcId = 1;
+    userData.setName(QStringLiteral("First"), QStringLiteral("Last"));
+    userData.phoneNumber = QStringLiteral("123456");
+    return userData;
+}();
+
+// Returns the time from the timer start to the operation finish in microseconds or -1 on timeout.
+// The time is taken in the finished() handler, so it is not quantized by a polling interval.
+static qint64 waitForFinished(PendingOperation *operation, const QElapsedTimer &timer, int timeout = 5000)
+{
+    if (operation->isFinished()) {
+        return timer.nsecsElapsed() / 1000;
+    }
+    qint64 elapsed = -1;
+    QEventLoop loop;
+    QObject::connect(operation, &PendingOperation::finished, &loop, [&loop, &elapsed, &timer]() {
+        elapsed = timer.nsecsElapsed() / 1000;
+        loop.quit();
+    });
+    QTimer::singleShot(timeout, &loop, &QEventLoop::quit);
+    loop.exec();
+    return elapsed;
+}
+
+// Returns the percentile of the sorted values
+static qint64 percentile(const QVector<qint64> &sortedValues, int percent)
+{
+    const int index = qMin(sortedValues.count() - 1, sortedValues.count() * percent / 100);
+    return sortedValues.at(index);
+}
+
+class tst_ClientBenchmarks : public QObject
+{
+    Q_OBJECT
+public:
+    explicit tst_ClientBenchmarks(QObject *parent = nullptr);
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void applyUpdates_data();
+    void applyUpdates();
+    void interactiveLatency();
+    void perPeerFairness();
+    void pqFactorization();
+    void reconnectLatency();
+    void transportLatency_data();
+    void transportLatency();
+    void framingCost_data();
+    void framingCost();
+
+protected:
+    void setupClient(Client::Client *client);
+    void measureInteractiveLatency(bool scheduled, QVector<qint64> *latencies);
+};
+
+tst_ClientBenchmarks::tst_ClientBenchmarks(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void tst_ClientBenchmarks::initTestCase()
+{
+    qRegisterMetaType<UserData>();
+    QVERIFY(TestKeyData::initKeyFiles());
+}
+
+void tst_ClientBenchmarks::cleanupTestCase()
+{
+    QVERIFY(TestKeyData::cleanupKeyFiles());
+}
+
+void tst_ClientBenchmarks::applyUpdates_data()
+{
+    QTest::addColumn<bool>("batched");
+    QTest::newRow("one by one") << false;
+    QTest::newRow("batched") << true;
+}
+
+void tst_ClientBenchmarks::applyUpdates()
+{
+    QFETCH(bool, batched);
+
+    constexpr int c_updatesCount = 10000;
+    constexpr int c_dialogsCount = 10;
+    constexpr int c_readInterval = 100; // Each 100th update reads the dialog
+    constexpr quint32 c_firstUserId = 100;
+
+    Client::Client client;
+    setupClient(&client);
+    Client::UpdatesInternalApi *updatesApi = Client::ClientPrivate::get(&client)->updatesApi();
+
+    TLVector<TLUpdate> updates;
+    updates.reserve(c_updatesCount);
+    for (int i = 0; i < c_updatesCount; ++i) {
+        const quint32 userId = c_firstUserId + static_cast<quint32>(i % c_dialogsCount);
+        TLUpdate update;
+        update.pts = static_cast<quint32>(i + 1);
+        update.ptsCount = 1;
+        if ((i % c_readInterval) == c_readInterval - 1) {
+            update.tlType = TLValue::UpdateReadHistoryInbox;
+            update.peer.tlType = TLValue::PeerUser;
+            update.peer.userId = userId;
+            update.maxId = static_cast<quint32>(i);
+        } else {
+            update.tlType = TLValue::UpdateNewMessage;
+            TLMessage &message = update.message;
+            message.tlType = TLValue::Message;
+            message.id = static_cast<quint32>(i + 1);
+            message.toId.tlType = TLValue::PeerUser;
+            message.toId.userId = userId;
+            message.message = QStringLiteral("Message %1").arg(i);
+        }
+        updates.append(update);
+    }
+
+    int messageSignals = 0;
+    int messagesSignals = 0;
+    int readSignals = 0;
+    int dataChangedSignals = 0;
+    connect(Client::DataInternalApi::get(client.dataStorage()), &Client::DataInternalApi::changed,
+            this, [&dataChangedSignals]() {
+        ++dataChangedSignals;
+    });
+    Client::MessagingApi *messagingApi = client.messagingApi();
+    connect(messagingApi, &Client::MessagingApi::messageReceived, this, [&messageSignals]() {
+        ++messageSignals;
+    });
+    connect(messagingApi, &Client::MessagingApi::messagesReceived, this, [&messagesSignals]() {
+        ++messagesSignals;
+    });
+    connect(messagingApi, &Client::MessagingApi::messageReadInbox, this, [&readSignals]() {
+        ++readSignals;
+    });
+
+    QBENCHMARK_ONCE {
+        if (batched) {
+            TLUpdates updatesPackage;
+            updatesPackage.tlType = TLValue::Updates;
+            updatesPackage.updates = updates;
+            updatesApi->processUpdates(updatesPackage);
+        } else {
+            TLUpdates shortUpdate;
+            shortUpdate.tlType = TLValue::UpdateShort;
+            for (const TLUpdate &update : updates) {
+                shortUpdate.update = update;
+                updatesApi->processUpdates(shortUpdate);
+            }
+        }
+    }
+
+    const int readsCount = c_updatesCount / c_readInterval;
+    const int messagesCount = c_updatesCount - readsCount;
+    qDebug() << "messageReceived:" << messageSignals << "messagesReceived:" << messagesSignals
+             << "messageReadInbox:" << readSignals << "data changed:" << dataChangedSignals;
+    QCOMPARE(messageSignals, messagesCount);
+    QCOMPARE(updatesApi->state().pts, static_cast<quint32>(c_updatesCount));
+    if (batched) {
+        QCOMPARE(messagesSignals, c_dialogsCount);
+        QCOMPARE(readSignals, c_dialogsCount);
+        QCOMPARE(dataChangedSignals, 1);
+    } else {
+        QCOMPARE(messagesSignals, messagesCount);
+        QCOMPARE(readSignals, readsCount);
+    }
+}
+
+void tst_ClientBenchmarks::interactiveLatency()
+{
+    QVector<qint64> fifoLatencies;
+    measureInteractiveLatency(false, &fifoLatencies);
+    if (QTest::currentTestFailed()) {
+        return;
+    }
+    QVector<qint64> scheduledLatencies;
+    measureInteractiveLatency(true, &scheduledLatencies);
+    if (QTest::currentTestFailed()) {
+        return;
+    }
+
+    qDebug() << "Interactive latency (us) fifo p50:" << percentile(fifoLatencies, 50)
+             << "p99:" << percentile(fifoLatencies, 99)
+             << "scheduled p50:" << percentile(scheduledLatencies, 50)
+             << "p99:" << percentile(scheduledLatencies, 99);
+}
+
+void tst_ClientBenchmarks::measureInteractiveLatency(bool scheduled, QVector<qint64> *latencies)
+{
+    constexpr int c_bulkCount = 64;
+    constexpr int c_bulkPartSize = 128 * 1024;
+    constexpr int c_interactiveCount = 50;
+
+    const UserData userData = c_user;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::LocalUser *user = tryAddUser(&cluster, userData);
+    QVERIFY(user);
+
+    Client::Client client;
+    {
+        setupClientHelper(&client, userData, publicKey, clientDcOption);
+        Client::AuthOperation *signInOperation = nullptr;
+        signInHelper(&client, userData, &authProvider, &signInOperation);
+        TRY_VERIFY2(signInOperation->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_VERIFY(client.isSignedIn());
+
+    Client::Backend *backend = Client::ClientPrivate::get(&client);
+    Client::RpcScheduler *scheduler = backend->getDefaultConnection()->rpcLayer()->scheduler();
+    if (!scheduled) {
+        // Plain FIFO: every bulk operation goes to the wire as soon as it is issued
+        scheduler->setWindow(Client::RpcScheduler::Priority::Bulk, 0);
+        scheduler->setWindow(Client::RpcScheduler::Priority::Normal, 0);
+    }
+
+    int bulkFinished = 0;
+    const QByteArray bulkPart(c_bulkPartSize, 'x');
+    for (int i = 0; i < c_bulkCount; ++i) {
+        PendingRpcOperation *operation = backend->uploadLayer()->saveFilePart(1, static_cast<quint32>(i), bulkPart);
+        connect(operation, &PendingOperation::finished, this, [&bulkFinished]() {
+            ++bulkFinished;
+        });
+    }
+
+    const int bulkWindow = scheduler->window(Client::RpcScheduler::Priority::Bulk);
+    const int bulkInFlight = bulkWindow ? bulkWindow : c_bulkCount;
+    QCOMPARE(scheduler->inFlightCount(Client::RpcScheduler::Priority::Bulk), bulkInFlight);
+    QCOMPARE(scheduler->queuedCount(Client::RpcScheduler::Priority::Bulk), c_bulkCount - bulkInFlight);
+
+    TLInputPeer inputPeer;
+    inputPeer.tlType = TLValue::InputPeerSelf;
+    TLSendMessageAction action;
+    action.tlType = TLValue::SendMessageTypingAction;
+
+    latencies->clear();
+    latencies->reserve(c_interactiveCount);
+    QElapsedTimer timer;
+    for (int i = 0; i < c_interactiveCount; ++i) {
+        timer.start();
+        const int bulkQueued = scheduler->queuedCount(Client::RpcScheduler::Priority::Bulk);
+        const int interactiveInFlight = scheduler->inFlightCount(Client::RpcScheduler::Priority::Interactive);
+        PendingRpcOperation *operation = backend->messagesLayer()->setTyping(inputPeer, action);
+        // The interactive request is sent at once, ahead of the queued bulk ones
+        QCOMPARE(scheduler->inFlightCount(Client::RpcScheduler::Priority::Interactive), interactiveInFlight + 1);
+        QCOMPARE(scheduler->queuedCount(Client::RpcScheduler::Priority::Bulk), bulkQueued);
+        const qint64 latency = waitForFinished(operation, timer);
+        QVERIFY2(latency >= 0, "The interactive request is not finished in time");
+        latencies->append(latency);
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(bulkFinished, c_bulkCount, 30000);
+    std::sort(latencies->begin(), latencies->end());
+}
+
+void tst_ClientBenchmarks::perPeerFairness()
+{
+    constexpr int c_busyPeerCount = 8;
+
+    const UserData userData = c_user;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::LocalUser *user = tryAddUser(&cluster, userData);
+    QVERIFY(user);
+
+    Client::Client client;
+    {
+        setupClientHelper(&client, userData, publicKey, clientDcOption);
+        Client::AuthOperation *signInOperation = nullptr;
+        signInHelper(&client, userData, &authProvider, &signInOperation);
+        TRY_VERIFY2(signInOperation->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_VERIFY(client.isSignedIn());
+
+    Client::Backend *backend = Client::ClientPrivate::get(&client);
+    Client::RpcScheduler *scheduler = backend->getDefaultConnection()->rpcLayer()->scheduler();
+    // Let the requests made on sign in finish
+    QTRY_COMPARE_WITH_TIMEOUT(scheduler->inFlightCount(Client::RpcScheduler::Priority::Normal), 0, 5000);
+    scheduler->setWindow(Client::RpcScheduler::Priority::Normal, 1);
+
+    TLInputPeer busyPeer;
+    busyPeer.tlType = TLValue::InputPeerUser;
+    busyPeer.userId = user->id() + 1;
+    TLInputPeer quietPeer;
+    quietPeer.tlType = TLValue::InputPeerUser;
+    quietPeer.userId = user->id() + 2;
+
+    // The busy peer queues a number of requests before the quiet one
+    QVector<PendingRpcOperation *> operations;
+    for (int i = 0; i < c_busyPeerCount; ++i) {
+        operations.append(backend->messagesLayer()->getHistory(busyPeer, 0, 0, 0, 1, 0, 0, 0));
+    }
+    PendingRpcOperation *quietOperation = backend->messagesLayer()->getHistory(quietPeer, 0, 0, 0, 1, 0, 0, 0);
+    operations.append(quietOperation);
+
+    QVector<PendingRpcOperation *> finishedOperations;
+    for (PendingRpcOperation *operation : operations) {
+        connect(operation, &PendingOperation::finished, this, [&finishedOperations, operation]() {
+            finishedOperations.append(operation);
+        });
+    }
+    QCOMPARE(scheduler->inFlightCount(Client::RpcScheduler::Priority::Normal), 1);
+    QCOMPARE(scheduler->queuedCount(Client::RpcScheduler::Priority::Normal), c_busyPeerCount);
+
+    QTRY_COMPARE_WITH_TIMEOUT(finishedOperations.count(), c_busyPeerCount + 1, 5000);
+    // The peers take turns: the quiet peer request goes right after the next busy one
+    QCOMPARE(finishedOperations.indexOf(quietOperation), 2);
+}
+
+void tst_ClientBenchmarks::pqFactorization()
+{
+    constexpr int c_corpusSize = 256;
+
+    // Realistic pq values: the products of two 32-bit primes in [2^62, 2^63)
+    std::mt19937 engine(42);
+    const auto isPrime = [](quint32 number) {
+        for (quint32 divider = 3; divider <= number / divider; divider += 2) {
+            if (number % divider == 0) {
+                return false;
+            }
+        }
+        return true;
+    };
+    const auto generatePrime = [&engine, isPrime]() {
+        std::uniform_int_distribution<quint32> distribution(0x80000001u, 0xb5000000u);
+        quint32 candidate = 0;
+        do {
+            candidate = distribution(engine) | 1;
+        } while (!isPrime(candidate));
+        return candidate;
+    };
+
+    QVector<QPair<quint32, quint32>> corpus;
+    corpus.reserve(c_corpusSize);
+    for (int i = 0; i < c_corpusSize; ++i) {
+        const quint32 p = generatePrime();
+        const quint32 q = generatePrime();
+        corpus.append({ p, q });
+    }
+
+    DeterministicGenerator deterministicGenerator;
+    RandomGeneratorSetter generatorSetter(&deterministicGenerator);
+
+    QVector<qint64> durations;
+    durations.reserve(c_corpusSize);
+    QElapsedTimer timer;
+    for (const QPair<quint32, quint32> &factors : corpus) {
+        const quint64 pq = static_cast<quint64>(factors.first) * factors.second;
+        timer.start();
+        const quint64 divider = Utils::findDivider(pq);
+        durations.append(timer.nsecsElapsed() / 1000);
+        QVERIFY2((divider == factors.first) || (divider == factors.second),
+                 QByteArray::number(pq).constData());
+    }
+
+    std::sort(durations.begin(), durations.end());
+    const int p99Index = qMin(durations.count() - 1, durations.count() * 99 / 100);
+    qDebug() << "PQ factorization (us) p50:" << durations.at(durations.count() / 2)
+             << "p99:" << durations.at(p99Index) << "max:" << durations.last()
+             << "over" << c_corpusSize << "values;"
+             << "the work is limited by" << Utils::c_maxFactorizationSteps << "steps";
+}
+
+void tst_ClientBenchmarks::reconnectLatency()
+{
+    constexpr int c_dropsCount = 10;
+
+    const UserData userData = c_user;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::LocalUser *user = tryAddUser(&cluster, userData);
+    QVERIFY(user);
+
+    Client::Client client;
+    {
+        setupClientHelper(&client, userData, publicKey, clientDcOption);
+        Client::AuthOperation *signInOperation = nullptr;
+        signInHelper(&client, userData, &authProvider, &signInOperation);
+        TRY_VERIFY2(signInOperation->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_COMPARE(client.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+
+    Client::Backend *backend = Client::ClientPrivate::get(&client);
+    Client::Connection *connection = backend->getDefaultConnection();
+    const quint64 sessionId = connection->rpcLayer()->sessionId();
+
+    TLInputPeer inputPeer;
+    inputPeer.tlType = TLValue::InputPeerSelf;
+    TLSendMessageAction action;
+    action.tlType = TLValue::SendMessageTypingAction;
+
+    QVector<qint64> latencies;
+    latencies.reserve(c_dropsCount);
+    QElapsedTimer timer;
+    for (int i = 0; i < c_dropsCount; ++i) {
+        TRY_COMPARE(user->activeSessions().count(), 1);
+        Server::Session *session = user->activeSessions().first();
+
+        // Drop the socket from the server side and issue a request before the client notices it
+        session->getConnection()->transport()->disconnectFromHost();
+        timer.start();
+        PendingRpcOperation *operation = backend->messagesLayer()->setTyping(inputPeer, action);
+        const qint64 latency = waitForFinished(operation, timer);
+        QVERIFY2(latency >= 0, "The request is not finished in time");
+        latencies.append(latency);
+        QVERIFY2(operation->isSucceeded(), "The request is not replayed on the connection resume");
+
+        TRY_COMPARE(client.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+        // The connection is resumed, not replaced
+        QCOMPARE(backend->getDefaultConnection(), connection);
+        QCOMPARE(connection->rpcLayer()->sessionId(), sessionId);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    qDebug() << "Time to the first successful RPC after a socket drop (us) p50:"
+             << percentile(latencies, 50) << "max:" << latencies.last()
+             << "over" << c_dropsCount << "drops";
+}
+
+void tst_ClientBenchmarks::transportLatency_data()
+{
+    QTest::addColumn<int>("endpointFlags");
+    QTest::addColumn<int>("latency");
+    QTest::newRow("tcp") << 0 << 0;
+    QTest::newRow("local socket") << int(DcOption::LocalSocket) << 0;
+    QTest::newRow("loopback") << int(DcOption::Loopback) << 0;
+    QTest::newRow("loopback, 5 ms latency") << int(DcOption::Loopback) << 5;
+}
+
+void tst_ClientBenchmarks::transportLatency()
+{
+    QFETCH(int, endpointFlags);
+    QFETCH(int, latency);
+
+    constexpr int c_requestsCount = 200;
+    constexpr int c_uploadPartsCount = 32;
+    constexpr int c_uploadPartSize = 512 * 1024;
+
+    const UserData userData = c_user;
+    DcOption clientDcOption = c_localDcOptions.first();
+    DcConfiguration serverConfiguration = c_localDcConfiguration;
+    if (endpointFlags) {
+        clientDcOption.address = QStringLiteral("telegram-qt-benchmark-%1").arg(QCoreApplication::applicationPid());
+        clientDcOption.port = 0;
+        clientDcOption.flags = static_cast<quint16>(endpointFlags);
+        serverConfiguration.dcOptions.append(clientDcOption);
+    }
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(serverConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::LocalUser *user = tryAddUser(&cluster, userData);
+    QVERIFY(user);
+
+    Client::Client client;
+    {
+        setupClientHelper(&client, userData, publicKey, clientDcOption);
+        Client::AuthOperation *signInOperation = nullptr;
+        signInHelper(&client, userData, &authProvider, &signInOperation);
+        TRY_VERIFY2(signInOperation->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_COMPARE(client.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+
+    Client::Backend *backend = Client::ClientPrivate::get(&client);
+    BaseTransport *transport = backend->getDefaultConnection()->transport();
+    QCOMPARE(qobject_cast<BaseLocalSocketTransport *>(transport) != nullptr, endpointFlags == DcOption::LocalSocket);
+    QCOMPARE(qobject_cast<LoopbackTransport *>(transport) != nullptr, endpointFlags == DcOption::Loopback);
+    if (latency) {
+        // Simulate the network in both directions
+        LoopbackImpairments impairments;
+        impairments.latency = latency;
+        qobject_cast<LoopbackTransport *>(transport)->setImpairments(impairments);
+        TRY_COMPARE(user->activeSessions().count(), 1);
+        BaseTransport *serverTransport = user->activeSessions().first()->getConnection()->transport();
+        qobject_cast<LoopbackTransport *>(serverTransport)->setImpairments(impairments);
+    }
+
+    TLInputPeer inputPeer;
+    inputPeer.tlType = TLValue::InputPeerSelf;
+    TLSendMessageAction action;
+    action.tlType = TLValue::SendMessageTypingAction;
+
+    QVector<qint64> latencies;
+    latencies.reserve(c_requestsCount);
+    QElapsedTimer timer;
+    for (int i = 0; i < c_requestsCount; ++i) {
+        timer.start();
+        PendingRpcOperation *operation = backend->messagesLayer()->setTyping(inputPeer, action);
+        const qint64 requestLatency = waitForFinished(operation, timer);
+        QVERIFY2(requestLatency >= 0, "The request is not finished in time");
+        latencies.append(requestLatency);
+    }
+
+    int uploadFinished = 0;
+    const QByteArray uploadPart(c_uploadPartSize, 'x');
+    timer.start();
+    for (int i = 0; i < c_uploadPartsCount; ++i) {
+        PendingRpcOperation *operation = backend->uploadLayer()->saveFilePart(1, static_cast<quint32>(i), uploadPart);
+        connect(operation, &PendingOperation::finished, this, [&uploadFinished]() {
+            ++uploadFinished;
+        });
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(uploadFinished, c_uploadPartsCount, 30000);
+    const qint64 uploadElapsed = qMax<qint64>(1, timer.elapsed());
+    const qint64 uploadSize = qint64(c_uploadPartsCount) * c_uploadPartSize;
+
+    std::sort(latencies.begin(), latencies.end());
+    qDebug() << "Request latency (us) p50:" << percentile(latencies, 50)
+             << "p99:" << percentile(latencies, 99)
+             << "over" << c_requestsCount << "requests;"
+             << "upload:" << uploadSize / 1024 / 1024 << "MB in" << uploadElapsed << "ms"
+             << "(" << uploadSize * 1000 / uploadElapsed / 1024 / 1024 << "MB/s)";
+    if (latency) {
+        // Each request and its reply are delayed by the one-way latency
+        QVERIFY(percentile(latencies, 50) >= 2 * latency * 1000);
+    }
+}
+
+void tst_ClientBenchmarks::framingCost_data()
+{
+    QTest::addColumn<PacketFraming::Mode>("mode");
+    QTest::newRow("abridged") << PacketFraming::Mode::Abridged;
+    QTest::newRow("intermediate") << PacketFraming::Mode::Intermediate;
+    QTest::newRow("padded intermediate") << PacketFraming::Mode::PaddedIntermediate;
+}
+
+void tst_ClientBenchmarks::framingCost()
+{
+    QFETCH(PacketFraming::Mode, mode);
+
+    constexpr int c_packetsCount = 100000;
+    constexpr int c_readSize = 16 * 1024; // The data is read in chunks as from a socket
+
+    // Encrypted-like packets (auth_key_id, msg_key and 16-byte blocks) of typical sizes
+    QVector<QByteArray> packets;
+    packets.reserve(c_packetsCount);
+    std::mt19937 engine(42);
+    std::uniform_int_distribution<int> blocksDistribution(1, 64);
+    for (int i = 0; i < c_packetsCount; ++i) {
+        QByteArray packet(24 + blocksDistribution(engine) * 16, char(i));
+        packet[0] = 1; // Non-zero auth_key_id
+        packets.append(packet);
+    }
+
+    PacketFraming writeFraming;
+    writeFraming.setMode(mode);
+    QElapsedTimer timer;
+    QByteArray stream;
+    timer.start();
+    for (const QByteArray &packet : packets) {
+        writeFraming.appendPacket(&stream, packet);
+    }
+    const qint64 writeElapsed = timer.nsecsElapsed();
+
+    PacketFraming readFraming;
+    readFraming.setMode(mode);
+    QByteArray readBuffer;
+    QByteArray payload;
+    int received = 0;
+    bool valid = true;
+    timer.start();
+    for (int offset = 0; offset < stream.size(); offset += c_readSize) {
+        readBuffer.append(stream.constData() + offset, qMin(c_readSize, stream.size() - offset));
+        while (readFraming.takePacket(&readBuffer, &payload) == PacketFraming::ReadStatus::Packet) {
+            valid = valid && (payload.size() == packets.at(received).size());
+            ++received;
+        }
+    }
+    const qint64 readElapsed = timer.nsecsElapsed();
+
+    QCOMPARE(received, c_packetsCount);
+    QVERIFY(valid);
+    qDebug() << "Framing cost (ns per packet) write:" << writeElapsed / c_packetsCount
+             << "read:" << readElapsed / c_packetsCount
+             << "overhead:" << (stream.size() - std::accumulate(packets.cbegin(), packets.cend(), 0,
+                                                                [](int sum, const QByteArray &packet) {
+                                                                    return sum + packet.size();
+                                                                })) / c_packetsCount
+             << "bytes per packet";
+}
+
+void tst_ClientBenchmarks::setupClient(Client::Client *client)
+{
+    client->setAccountStorage(new Client::AccountStorage(client));
+    client->setDataStorage(new Client::InMemoryDataStorage(client));
+}
+
+QTEST_GUILESS_MAIN(tst_ClientBenchmarks)
+
+#include "tst_ClientBenchmarks.moc"
@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_ClientBenchmarks
+SOURCES += tst_ClientBenchmarks.cpp
+HEADERS += ../utils/TestAuthProvider.hpp
+
+include(../../tests/data/data.pri)
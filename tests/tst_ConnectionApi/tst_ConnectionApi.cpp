@@ -19,19 +19,27 @@
 
 #include "AccountStorage.hpp"
 #include "Client.hpp"
+#include "Client_p.hpp"
+#include "ClientConnection.hpp"
+#include "ClientRpcLayer.hpp"
 #include "ClientSettings.hpp"
 #include "ConnectionApi.hpp"
+#include "ConnectionApi_p.hpp"
 #include "DataStorage.hpp"
 #include "Utils.hpp"
 #include "TelegramNamespace.hpp"
 #include "CAppInformation.hpp"
 
 #include "Operations/ClientAuthOperation.hpp"
+#include "RpcLayers/ClientRpcMessagesLayer.hpp"
 
 #include "ContactsApi.hpp"
 #include "CTcpTransport.hpp"
 #include "CTelegramTransport.hpp"
 #include "DcConfiguration.hpp"
+#include "LoopbackTransport.hpp"
+#include "PendingRpcOperation.hpp"
+#include "RandomGenerator.hpp"
 
 // Server
 #include "TelegramServer.hpp"
@@ -40,15 +48,25 @@
 #include "ServerRpcLayer.hpp"
 #include "Session.hpp"
 #include "LocalCluster.hpp"
+#include "ServerAuthKeyStore.hpp"
+#include "Storage.hpp"
 
+#include <QCoreApplication>
 #include <QTest>
 #include <QSignalSpy>
 #include <QDebug>
+#include <QFile>
 #include <QRegularExpression>
+#include <QScopedPointer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QThread>
 
 #include "keys_data.hpp"
 #include "TestAuthProvider.hpp"
 #include "TestClientUtils.hpp"
+#include "TestDelayProxy.hpp"
 #include "TestServerUtils.hpp"
 #include "TestUserData.hpp"
 #include "TestUtils.hpp"
@@ -77,6 +95,13 @@ private slots:
     void testClientConnection_data();
     void testClientConnection();
     void reconnect();
+    void reconnectAfterServerRestart();
+    void resendExecutedRequest();
+    void idleSessionReaping();
+    void connectionRace();
+    void preferFasterEndpoint();
+    void splitSessionHeader();
+    void loopbackTransportAcrossThreads();
 };
 
 tst_ConnectionApi::tst_ConnectionApi(QObject *parent) :
@@ -129,6 +154,15 @@ void tst_ConnectionApi::testClientConnection_data()
     QTest::newRow("Obfuscated with migration") << Client::Settings::SessionType::Obfuscated
                                                << userOnDc2
                                                << opt;
+    QTest::newRow("Intermediate") << Client::Settings::SessionType::Intermediate
+                                  << userOnDc1
+                                  << opt;
+    QTest::newRow("Padded intermediate") << Client::Settings::SessionType::PaddedIntermediate
+                                         << userOnDc1
+                                         << opt;
+    QTest::newRow("Obfuscated padded intermediate") << Client::Settings::SessionType::ObfuscatedPaddedIntermediate
+                                                    << userOnDc1
+                                                    << opt;
 
     opt.id = 0;
     QTest::newRow("Migration from unknown dc (with password)") << Client::Settings::SessionType::Obfuscated
@@ -358,6 +392,410 @@ void tst_ConnectionApi::reconnect()
     }
 }
 
+void tst_ConnectionApi::reconnectAfterServerRestart()
+{
+    const UserData userData = c_userWithPassword;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    QTemporaryDir dataDir;
+    QVERIFY(dataDir.isValid());
+    const QString authKeysFile = dataDir.filePath(QStringLiteral("auth_keys.bin"));
+
+    Test::AuthProvider authProvider;
+    QScopedPointer<Server::Storage> storage(new Server::Storage());
+    QVERIFY(storage->authKeyStore()->open(authKeysFile));
+    // The auth keys are not readable by the other users
+    const QFileDevice::Permissions c_otherPermissions = QFileDevice::ReadGroup | QFileDevice::WriteGroup
+            | QFileDevice::ReadOther | QFileDevice::WriteOther;
+    QCOMPARE(QFile::permissions(authKeysFile) & c_otherPermissions, QFileDevice::Permissions());
+    QScopedPointer<Server::LocalCluster> cluster(new Server::LocalCluster());
+    cluster->setAuthorizationProvider(&authProvider);
+    cluster->setServerPrivateRsaKey(privateKey);
+    cluster->setServerConfiguration(c_localDcConfiguration);
+    cluster->setStorage(storage.data());
+    QVERIFY(cluster->start());
+    QVERIFY(tryAddUser(cluster.data(), userData));
+
+    Client::Client client;
+    setupClientHelper(&client, userData, publicKey, clientDcOption);
+    Client::AuthOperation *signInOperation = nullptr;
+    signInHelper(&client, userData, &authProvider, &signInOperation);
+    TRY_VERIFY2(signInOperation->isSucceeded(), "Unexpected sign in fail");
+    TRY_COMPARE(client.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+
+    const quint64 clientAuthId = client.accountStorage()->authId();
+    QVERIFY(clientAuthId);
+
+    // Restart the servers; the users are recreated with the same ids
+    cluster.reset();
+    storage.reset();
+
+    storage.reset(new Server::Storage());
+    QVERIFY(storage->authKeyStore()->open(authKeysFile));
+    QVERIFY(storage->authKeyStore()->contains(clientAuthId));
+    cluster.reset(new Server::LocalCluster());
+    cluster->setAuthorizationProvider(&authProvider);
+    cluster->setServerPrivateRsaKey(privateKey);
+    cluster->setServerConfiguration(c_localDcConfiguration);
+    cluster->setStorage(storage.data());
+    QVERIFY(cluster->start());
+    Server::LocalUser *user = tryAddUser(cluster.data(), userData);
+    QVERIFY(user);
+
+    // The client reconnects with the same auth key and gets the session back without a new handshake
+    TRY_COMPARE(client.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+    QCOMPARE(client.accountStorage()->authId(), clientAuthId);
+    // Wait for the session to be restored before the lookup, which would restore it on its own
+    TRY_COMPARE(user->activeSessions().count(), 1);
+    Server::Server *server = cluster->getServerInstance(userData.dcId);
+    Server::Session *session = server->getSessionByAuthId(clientAuthId);
+    QVERIFY(session);
+    QCOMPARE(session->user(), user);
+    QVERIFY(client.isSignedIn());
+}
+
+void tst_ConnectionApi::resendExecutedRequest()
+{
+    const UserData userData = c_userWithPassword;
+    DcOption clientDcOption = c_localDcOptions.first();
+    clientDcOption.address = QStringLiteral("tst_ConnectionApi-resend-%1").arg(QCoreApplication::applicationPid());
+    clientDcOption.port = 0;
+    clientDcOption.flags = DcOption::Loopback;
+    DcConfiguration serverConfiguration = c_localDcConfiguration;
+    serverConfiguration.dcOptions.append(clientDcOption);
+
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    QVERIFY2(publicKey.isValid(), "Unable to read public RSA key");
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+    QVERIFY2(privateKey.isValid(), "Unable to read private RSA key");
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(serverConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::LocalUser *user = tryAddUser(&cluster, userData);
+    QVERIFY(user);
+
+    Client::Client client;
+    {
+        setupClientHelper(&client, userData, publicKey, clientDcOption);
+        Client::AuthOperation *signInOperation = nullptr;
+        signInHelper(&client, userData, &authProvider, &signInOperation);
+        TRY_VERIFY2(signInOperation->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_COMPARE(client.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+    TRY_COMPARE(user->activeSessions().count(), 1);
+
+    Client::Backend *backend = Client::ClientPrivate::get(&client);
+    Client::Connection *connection = backend->getDefaultConnection();
+    const Server::PostBox *box = user->getPostBox();
+    const quint32 lastMessageId = box->lastMessageId();
+
+    // The server executes the request, but the reply is lost along with the connection
+    LoopbackTransport *serverTransport = qobject_cast<LoopbackTransport *>(user->activeSessions().first()->getConnection()->transport());
+    QVERIFY(serverTransport);
+    LoopbackImpairments impairments;
+    impairments.lossRate = 1;
+    serverTransport->setImpairments(impairments);
+
+    TLInputPeer inputPeer;
+    inputPeer.tlType = TLValue::InputPeerSelf;
+    PendingRpcOperation *operation = backend->messagesLayer()->sendMessage(0, inputPeer, 0, QStringLiteral("Resent message"),
+                                                                           RandomGenerator::instance()->generate<quint64>(),
+                                                                           TLReplyMarkup(), {});
+    QSignalSpy resentSpy(operation, &PendingRpcOperation::resent);
+    TRY_COMPARE(box->lastMessageId(), lastMessageId + 1);
+    QVERIFY(serverTransport->droppedPackets() > 0);
+    QVERIFY(!operation->isFinished());
+    serverTransport->disconnectFromHost();
+
+    // The client resends the request with the same message id and gets the stored reply
+    QTRY_VERIFY_WITH_TIMEOUT(operation->isFinished(), 5000);
+    QVERIFY2(operation->isSucceeded(), "The request is not replayed on the connection resume");
+    QVERIFY(resentSpy.isEmpty());
+    TRY_COMPARE(client.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+    QCOMPARE(backend->getDefaultConnection(), connection);
+    QCOMPARE(box->lastMessageId(), lastMessageId + 1);
+}
+
+void tst_ConnectionApi::idleSessionReaping()
+{
+    const UserData userData = c_userWithPassword;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    QTemporaryDir dataDir;
+    QVERIFY(dataDir.isValid());
+
+    Test::AuthProvider authProvider;
+    Server::Storage storage;
+    QVERIFY(storage.authKeyStore()->open(dataDir.filePath(QStringLiteral("auth_keys.bin"))));
+    Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    cluster.setStorage(&storage);
+    QVERIFY(cluster.start());
+    Server::LocalUser *user = tryAddUser(&cluster, userData);
+    QVERIFY(user);
+
+    Client::Client client;
+    setupClientHelper(&client, userData, publicKey, clientDcOption);
+    // Ping every 50 ms and back off up to 200 ms; ask for the disconnection after 1 s more than that
+    client.settings()->setPingInterval(50, 1000);
+    client.settings()->setMaxPingInterval(200);
+    Client::AuthOperation *signInOperation = nullptr;
+    signInHelper(&client, userData, &authProvider, &signInOperation);
+    TRY_VERIFY2(signInOperation->isSucceeded(), "Unexpected sign in fail");
+    TRY_COMPARE(client.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+
+    Server::Server *server = cluster.getServerInstance(userData.dcId);
+    const quint64 clientAuthId = client.accountStorage()->authId();
+    Server::Session *session = server->getSessionByAuthId(clientAuthId);
+    QVERIFY(session);
+    QCOMPARE(server->sessionStats().activeSessions, quint64(1));
+    QVERIFY(server->sessionStats().memoryUsage > 0);
+
+    // The delay covers the next (backed off) ping and the skipped ping check, rounded up to seconds
+    QTRY_COMPARE_WITH_TIMEOUT(session->disconnectDelay, 2000u, 1000);
+
+    // Stop asking for the disconnection and make the server think the client asked for a short delay
+    client.settings()->setPingInterval(50);
+    QTest::qWait(300);
+    server->scheduleDisconnect(session, 1);
+    TRY_COMPARE(server->sessionStats().droppedConnections, quint64(1));
+
+    // The client resumes the session on the dropped connection
+    QTRY_COMPARE_WITH_TIMEOUT(client.connectionApi()->status(), Client::ConnectionApi::StatusReady, 2000);
+    TRY_VERIFY(session->isActive());
+
+    // The idle session is removed from memory and restored from the store on demand
+    client.connectionApi()->disconnectFromServer();
+    TRY_VERIFY(!session->isActive());
+    QVERIFY(server->sessionStats().idleSessions > 0);
+    server->setSessionIdleTimeout(50);
+    TRY_COMPARE(server->sessionStats().idleSessions, quint64(0));
+    QVERIFY(server->sessionStats().evictedSessions > 0);
+    QCOMPARE(server->sessionStats().memoryUsage, quint64(0));
+    QVERIFY(user->sessions().isEmpty());
+
+    session = server->getSessionByAuthId(clientAuthId);
+    QVERIFY(session);
+    QCOMPARE(session->user(), user);
+    QCOMPARE(user->sessions().count(), 1);
+}
+
+void tst_ConnectionApi::connectionRace()
+{
+    const UserData userData = c_userWithPassword;
+    const DcOption serverDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    // Get a port which refuses the connections
+    quint16 deadPort = 0;
+    {
+        QTcpServer server;
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+        deadPort = server.serverPort();
+    }
+    const DcOption deadDcOption(QStringLiteral("127.0.0.1"), deadPort, serverDcOption.id);
+
+    Client::Client client;
+    setupClientHelper(&client, userData, publicKey, serverDcOption);
+    QVERIFY(client.settings()->setServerConfiguration({ deadDcOption, serverDcOption }));
+    Client::ConnectionApi *connectionApi = client.connectionApi();
+    QSignalSpy clientConnectionStatusSpy(connectionApi, &Client::ConnectionApi::statusChanged);
+
+    connectionApi->startAuthentication();
+    TRY_COMPARE(connectionApi->status(), Client::ConnectionApi::StatusWaitForAuthentication);
+
+    // The next endpoint is tried right after the dead one fails, without a reconnection interval
+    QCOMPARE(clientConnectionStatusSpy.count(), 3);
+    QCOMPARE(clientConnectionStatusSpy.takeFirst().first().value<int>(), static_cast<int>(Client::ConnectionApi::StatusWaitForConnection));
+    QCOMPARE(clientConnectionStatusSpy.takeFirst().first().value<int>(), static_cast<int>(Client::ConnectionApi::StatusConnecting));
+    QCOMPARE(clientConnectionStatusSpy.takeFirst().first().value<int>(), static_cast<int>(Client::ConnectionApi::StatusWaitForAuthentication));
+
+    Client::ConnectionApiPrivate *privateApi = Client::ConnectionApiPrivate::get(connectionApi);
+    QCOMPARE(privateApi->getDefaultConnection()->dcOption().port, serverDcOption.port);
+}
+
+void tst_ConnectionApi::preferFasterEndpoint()
+{
+    constexpr int c_slowDelay = 50; // ms
+    constexpr int c_timeout = 5000; // ms
+
+    const UserData userData = c_userWithPassword;
+    const DcOption serverDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Test::DelayProxy slowProxy;
+    slowProxy.setTarget(serverDcOption.address, serverDcOption.port);
+    slowProxy.setDelay(c_slowDelay);
+    QVERIFY(slowProxy.listen());
+    const DcOption slowDcOption(slowProxy.address(), slowProxy.port(), serverDcOption.id);
+
+    Test::DelayProxy fastProxy;
+    fastProxy.setTarget(serverDcOption.address, serverDcOption.port);
+    QVERIFY(fastProxy.listen());
+    const DcOption fastDcOption(fastProxy.address(), fastProxy.port(), serverDcOption.id);
+
+    Client::Client client;
+    setupClientHelper(&client, userData, publicKey, serverDcOption);
+    Client::ConnectionApiPrivate *privateApi = Client::ConnectionApiPrivate::get(client.connectionApi());
+
+    // There are no measurements yet, so the configured order wins
+    PendingOperation *connectOperation = privateApi->connectToServer({ slowDcOption, fastDcOption });
+    QTRY_VERIFY_WITH_TIMEOUT(connectOperation->isFinished(), c_timeout);
+    QVERIFY(connectOperation->isSucceeded());
+    QCOMPARE(privateApi->getDefaultConnection()->dcOption().port, slowDcOption.port);
+    QTRY_VERIFY_WITH_TIMEOUT(privateApi->roundTripTime(slowDcOption) >= 0, c_timeout);
+    QVERIFY(privateApi->roundTripTime(slowDcOption) >= c_slowDelay * 2);
+    privateApi->disconnectFromServer();
+
+    connectOperation = privateApi->connectToServer({ fastDcOption });
+    QTRY_VERIFY_WITH_TIMEOUT(connectOperation->isFinished(), c_timeout);
+    QVERIFY(connectOperation->isSucceeded());
+    QTRY_VERIFY_WITH_TIMEOUT(privateApi->roundTripTime(fastDcOption) >= 0, c_timeout);
+    QVERIFY(privateApi->roundTripTime(fastDcOption) < privateApi->roundTripTime(slowDcOption));
+    privateApi->disconnectFromServer();
+
+    // The endpoint with the lower round trip time goes first now
+    connectOperation = privateApi->connectToServer({ slowDcOption, fastDcOption });
+    QTRY_VERIFY_WITH_TIMEOUT(connectOperation->isFinished(), c_timeout);
+    QVERIFY(connectOperation->isSucceeded());
+    QCOMPARE(privateApi->getDefaultConnection()->dcOption().port, fastDcOption.port);
+}
+
+void tst_ConnectionApi::splitSessionHeader()
+{
+    const DcOption serverDcOption = c_localDcOptions.first();
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+    Server::Server *server = cluster.getServerInstance(serverDcOption.id);
+
+    const auto getServerTransport = [server]() -> BaseTcpTransport * {
+        const QSet<Server::RemoteClientConnection *> connections = server->getConnections();
+        return connections.count() == 1 ? qobject_cast<BaseTcpTransport *>((*connections.cbegin())->transport()) : nullptr;
+    };
+
+    // The server waits for the rest of the intermediate session header
+    {
+        QTcpSocket socket;
+        socket.connectToHost(serverDcOption.address, serverDcOption.port);
+        QVERIFY(socket.waitForConnected(1000));
+        TRY_VERIFY(getServerTransport());
+        BaseTcpTransport *serverTransport = getServerTransport();
+        socket.write(QByteArray(2, char(0xee)));
+        QTest::qWait(20);
+        QCOMPARE(serverTransport->sessionType(), BaseTcpTransport::Unknown);
+        QCOMPARE(socket.state(), QAbstractSocket::ConnectedState);
+        socket.write(QByteArray(2, char(0xee)));
+        TRY_COMPARE(serverTransport->sessionType(), BaseTcpTransport::Intermediate);
+        socket.disconnectFromHost();
+        TRY_VERIFY(server->getConnections().isEmpty());
+    }
+
+    // An unsupported session is dropped once the header is complete
+    {
+        QTcpSocket socket;
+        socket.connectToHost(serverDcOption.address, serverDcOption.port);
+        QVERIFY(socket.waitForConnected(1000));
+        TRY_VERIFY(getServerTransport());
+        socket.write(QByteArray(32, char(0x01)));
+        QTest::qWait(20);
+        QCOMPARE(socket.state(), QAbstractSocket::ConnectedState);
+        socket.write(QByteArray(32, char(0x01)));
+        TRY_COMPARE(socket.state(), QAbstractSocket::UnconnectedState);
+    }
+}
+
+void tst_ConnectionApi::loopbackTransportAcrossThreads()
+{
+    constexpr int c_packetsCount = 1000;
+    constexpr int c_timeout = 5000; // ms
+
+    // The server echoes the packets from its own thread
+    QThread serverThread;
+    LoopbackServer *server = new LoopbackServer();
+    QVERIFY(server->listen(QStringLiteral("tst_ConnectionApi-loopback")));
+    server->moveToThread(&serverThread);
+    connect(server, &LoopbackServer::newConnection, server, [server]() {
+        LoopbackTransport *transport = server->nextPendingConnection();
+        transport->setParent(server);
+        connect(transport, &BaseTransport::packetReceived, transport, &BaseTransport::sendPacket);
+    });
+    serverThread.start();
+
+    LoopbackTransport client;
+    client.connectToHost(server->serverName(), 0);
+    TRY_COMPARE(client.state(), QAbstractSocket::ConnectedState);
+
+    QVector<QByteArray> received;
+    connect(&client, &BaseTransport::packetReceived, this, [&received](const QByteArray &payload) {
+        received.append(payload);
+    });
+    QVector<QByteArray> sent;
+    for (int i = 0; i < c_packetsCount; ++i) {
+        const QByteArray payload = QByteArray::number(i).repeated(i % 64 + 1);
+        sent.append(payload);
+        client.sendPacket(payload);
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(received.count(), c_packetsCount, c_timeout);
+    QCOMPARE(received, sent);
+
+    // The loss is reproducible with the same seed
+    LoopbackImpairments impairments;
+    impairments.lossRate = 0.5;
+    impairments.seed = 42;
+    client.setImpairments(impairments);
+    for (int i = 0; i < c_packetsCount; ++i) {
+        client.sendPacket(sent.at(i));
+    }
+    const quint64 droppedPackets = client.droppedPackets();
+    QVERIFY(droppedPackets > 0);
+    QVERIFY(droppedPackets < quint64(c_packetsCount));
+    QTRY_COMPARE_WITH_TIMEOUT(quint64(received.count()), c_packetsCount * 2 - droppedPackets, c_timeout);
+    client.setImpairments(impairments);
+    for (int i = 0; i < c_packetsCount; ++i) {
+        client.sendPacket(sent.at(i));
+    }
+    QCOMPARE(client.droppedPackets(), droppedPackets * 2);
+
+    client.disconnectFromHost();
+    QCOMPARE(client.state(), QAbstractSocket::UnconnectedState);
+    serverThread.quit();
+    QVERIFY(serverThread.wait());
+    delete server;
+}
+
 QTEST_GUILESS_MAIN(tst_ConnectionApi)
 
 #include "tst_ConnectionApi.moc"
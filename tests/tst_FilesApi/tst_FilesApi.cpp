@@ -0,0 +1,530 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include <QObject>
+
+#include "AccountStorage.hpp"
+#include "Client.hpp"
+#include "Client_p.hpp"
+#include "ClientConnection.hpp"
+#include "ClientConnectionPool.hpp"
+#include "ClientRpcLayer.hpp"
+#include "ClientRpcScheduler.hpp"
+#include "ClientSettings.hpp"
+#include "ConnectionApi.hpp"
+#include "ConnectionApi_p.hpp"
+#include "CTelegramTransport.hpp"
+#include "DataStorage.hpp"
+#include "FilesApi.hpp"
+#include "LocalCluster.hpp"
+#include "RandomGenerator.hpp"
+#include "RpcError.hpp"
+#include "RemoteClientConnection.hpp"
+#include "ServerApi.hpp"
+#include "ServerFileStore.hpp"
+#include "Session.hpp"
+#include "Storage.hpp"
+#include "TelegramNamespace_p.hpp"
+#include "TelegramServer.hpp"
+#include "TelegramServerUser.hpp"
+
+#include "Operations/ClientAuthOperation.hpp"
+#include "Operations/ClientFileOperation.hpp"
+#include "RpcLayers/ClientRpcPhotosLayer.hpp"
+#include "RpcLayers/ClientRpcUploadLayer.hpp"
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QDebug>
+
+#include "keys_data.hpp"
+#include "TestAuthProvider.hpp"
+#include "TestClientUtils.hpp"
+#include "TestServerUtils.hpp"
+#include "TestUserData.hpp"
+#include "TestUtils.hpp"
+
+using namespace Telegram;
+
+static const UserData c_user = []() {
+    UserData userData;
+    userData.dcId = 1;
+    userData.setName(QStringLiteral("First"), QStringLiteral("Last"));
+    userData.phoneNumber = QStringLiteral("123456");
+    return userData;
+}();
+
+class tst_FilesApi : public QObject
+{
+    Q_OBJECT
+public:
+    explicit tst_FilesApi(QObject *parent = nullptr);
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void uploadAndDownload();
+    void uploadProfilePhoto();
+    void downloadPartRetry();
+    void downloadViaConnectionPool();
+};
+
+tst_FilesApi::tst_FilesApi(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void tst_FilesApi::initTestCase()
+{
+    qRegisterMetaType<UserData>();
+    QVERIFY(TestKeyData::initKeyFiles());
+}
+
+void tst_FilesApi::cleanupTestCase()
+{
+    QVERIFY(TestKeyData::cleanupKeyFiles());
+}
+
+void tst_FilesApi::uploadAndDownload()
+{
+    const UserData userData = c_user;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::ServerApi *server = cluster.getServerApiInstance(userData.dcId);
+    QVERIFY(server);
+    Server::LocalUser *user = tryAddUser(&cluster, userData);
+    QVERIFY(user);
+
+    Client::Client client;
+    {
+        setupClientHelper(&client, userData, publicKey, clientDcOption);
+        Client::AuthOperation *signInOperation = nullptr;
+        signInHelper(&client, userData, &authProvider, &signInOperation);
+        TRY_VERIFY2(signInOperation->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_VERIFY(client.isSignedIn());
+
+    Client::FilesApi *filesApi = client.filesApi();
+    filesApi->setUploadWindow(3);
+    filesApi->setDownloadWindow(3);
+
+    // Five full parts and a short one
+    const QByteArray fileData = RandomGenerator::instance()->generate(5 * 128 * 1024 + 1000);
+    const QString md5Sum = QString::fromLatin1(QCryptographicHash::hash(fileData, QCryptographicHash::Md5).toHex());
+    Server::FileStore *fileStore = server->storage()->fileStore();
+
+    Server::FileDescriptor descriptor;
+    for (int i = 0; i < 2; ++i) {
+        QBuffer input;
+        input.setData(fileData);
+        input.open(QIODevice::ReadOnly);
+        Client::FileOperation *uploadOperation = filesApi->uploadFile(&input, QStringLiteral("file.bin"));
+        QSignalSpy progressSpy(uploadOperation, &Client::FileOperation::progressChanged);
+        TRY_VERIFY(uploadOperation->isFinished());
+        QVERIFY(uploadOperation->isSucceeded());
+        QCOMPARE(progressSpy.count(), 6);
+        QCOMPARE(uploadOperation->bytesTransferred(), static_cast<quint32>(fileData.size()));
+
+        const RemoteFile uploadedFile = uploadOperation->file();
+        QCOMPARE(uploadedFile.type(), RemoteFile::Upload);
+        QCOMPARE(uploadedFile.md5Sum(), md5Sum);
+        const TLInputFile inputFile = RemoteFile::Private::get(&uploadedFile)->getInputFile();
+        QCOMPARE(inputFile.parts, 6u);
+
+        quint32 missingPart = 0;
+        QVERIFY(!fileStore->commitUpload(user->userId(), inputFile.id, inputFile.parts + 1,
+                                         inputFile.name, server->dcId(), &missingPart).isValid());
+        QCOMPARE(missingPart, inputFile.parts);
+        descriptor = fileStore->commitUpload(user->userId(), inputFile.id, inputFile.parts,
+                                             inputFile.name, server->dcId());
+        QVERIFY(descriptor.isValid());
+        QCOMPARE(descriptor.size, static_cast<quint32>(fileData.size()));
+    }
+    // The same content is stored once
+    QCOMPARE(fileStore->filesCount(), 2);
+    QCOMPARE(fileStore->contentsCount(), 1);
+
+    // The sent parts are released, so only the window of parts is kept in memory
+    Client::Backend *backend = Client::ClientPrivate::get(&client);
+    TRY_COMPARE(backend->uploadLayer()->findChildren<Client::PendingRpcOperation *>().count(), 0);
+
+    TLFileLocation location;
+    location.tlType = TLValue::FileLocation;
+    location.dcId = descriptor.dcId;
+    location.volumeId = descriptor.volumeId;
+    location.localId = descriptor.localId;
+    location.secret = descriptor.secret;
+    RemoteFile file;
+    RemoteFile::Private::get(&file)->setFileLocation(&location);
+    RemoteFile::Private::get(&file)->m_size = descriptor.size;
+
+    // Concurrent downloads of the same file
+    QBuffer output1;
+    QBuffer output2;
+    output1.open(QIODevice::WriteOnly);
+    output2.open(QIODevice::WriteOnly);
+    Client::FileOperation *downloadOperation1 = filesApi->downloadFile(file, &output1);
+    Client::FileOperation *downloadOperation2 = filesApi->downloadFile(file, &output2);
+    TRY_VERIFY(downloadOperation1->isFinished() && downloadOperation2->isFinished());
+    QVERIFY(downloadOperation1->isSucceeded());
+    QVERIFY(downloadOperation2->isSucceeded());
+    QCOMPARE(output1.data(), fileData);
+    QCOMPARE(output2.data(), fileData);
+
+    // Resume a partially downloaded file
+    QTemporaryDir dir;
+    const QString fileName = dir.filePath(QStringLiteral("file.bin"));
+    {
+        QFile partialFile(fileName);
+        QVERIFY(partialFile.open(QIODevice::WriteOnly));
+        partialFile.write(fileData.left(2 * 128 * 1024 + 500));
+    }
+    Client::FileOperation *resumeOperation = filesApi->downloadFile(file, fileName);
+    TRY_VERIFY(resumeOperation->isFinished());
+    QVERIFY(resumeOperation->isSucceeded());
+    {
+        QFile downloadedFile(fileName);
+        QVERIFY(downloadedFile.open(QIODevice::ReadOnly));
+        QCOMPARE(downloadedFile.readAll(), fileData);
+    }
+
+    // The file size is not known in advance
+    RemoteFile::Private::get(&file)->m_size = 0;
+    QBuffer output3;
+    output3.open(QIODevice::WriteOnly);
+    Client::FileOperation *unknownSizeOperation = filesApi->downloadFile(file, &output3);
+    TRY_VERIFY(unknownSizeOperation->isFinished());
+    QVERIFY(unknownSizeOperation->isSucceeded());
+    QCOMPARE(unknownSizeOperation->totalBytes(), static_cast<quint32>(fileData.size()));
+    QCOMPARE(output3.data(), fileData);
+
+    // The received parts are released once written
+    TRY_COMPARE(backend->uploadLayer()->findChildren<Client::PendingRpcOperation *>().count(), 0);
+}
+
+void tst_FilesApi::uploadProfilePhoto()
+{
+    const UserData userData = c_user;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::ServerApi *server = cluster.getServerApiInstance(userData.dcId);
+    QVERIFY(server);
+    Server::LocalUser *user = tryAddUser(&cluster, userData);
+    QVERIFY(user);
+
+    Client::Client client;
+    {
+        setupClientHelper(&client, userData, publicKey, clientDcOption);
+        Client::AuthOperation *signInOperation = nullptr;
+        signInHelper(&client, userData, &authProvider, &signInOperation);
+        TRY_VERIFY2(signInOperation->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_VERIFY(client.isSignedIn());
+
+    Client::Backend *backend = Client::ClientPrivate::get(&client);
+    Server::FileStore *fileStore = server->storage()->fileStore();
+    const QByteArray fileData = RandomGenerator::instance()->generate(2 * 128 * 1024 + 1000);
+
+    QBuffer input;
+    input.setData(fileData);
+
+    // A broken upload is reported with the missing part
+    {
+        input.open(QIODevice::ReadOnly);
+        Client::FileOperation *uploadOperation = client.filesApi()->uploadFile(&input, QStringLiteral("photo.jpg"));
+        TRY_VERIFY(uploadOperation->isFinished());
+        input.close();
+        const RemoteFile uploadedFile = uploadOperation->file();
+        TLInputFile inputFile = RemoteFile::Private::get(&uploadedFile)->getInputFile();
+        QCOMPARE(inputFile.parts, 3u);
+        ++inputFile.parts;
+        Client::PhotosRpcLayer::PendingPhotosPhoto *operation = backend->photosLayer()->uploadProfilePhoto(inputFile);
+        TRY_VERIFY(operation->isFinished());
+        QVERIFY(!operation->isSucceeded());
+        QVERIFY(operation->rpcError());
+        QCOMPARE(operation->rpcError()->reason, RpcError::FilePartXMissing);
+        QCOMPARE(operation->rpcError()->argument, 3u);
+    }
+    QCOMPARE(fileStore->uploadsCount(), 1);
+
+    input.open(QIODevice::ReadOnly);
+    Client::FileOperation *uploadOperation = client.filesApi()->uploadFile(&input, QStringLiteral("photo.jpg"));
+    TRY_VERIFY(uploadOperation->isFinished());
+    const RemoteFile uploadedFile = uploadOperation->file();
+    const TLInputFile inputFile = RemoteFile::Private::get(&uploadedFile)->getInputFile();
+    Client::PhotosRpcLayer::PendingPhotosPhoto *operation = backend->photosLayer()->uploadProfilePhoto(inputFile);
+    TRY_VERIFY(operation->isFinished());
+    TLPhotosPhoto result;
+    QVERIFY(operation->getResult(&result));
+    QCOMPARE(result.users.count(), 1);
+    QCOMPARE(result.users.first().id, user->userId());
+    QCOMPARE(result.photo.sizes.count(), 1);
+    TLFileLocation location = result.photo.sizes.first().location;
+    QCOMPARE(fileStore->filesCount(), 1);
+    // The committed upload is released, the broken one is still there
+    QCOMPARE(fileStore->uploadsCount(), 1);
+
+    RemoteFile file;
+    RemoteFile::Private::get(&file)->setFileLocation(&location);
+    RemoteFile::Private::get(&file)->m_size = result.photo.sizes.first().size;
+    QBuffer output;
+    output.open(QIODevice::WriteOnly);
+    Client::FileOperation *downloadOperation = client.filesApi()->downloadFile(file, &output);
+    TRY_VERIFY(downloadOperation->isFinished());
+    QVERIFY(downloadOperation->isSucceeded());
+    QCOMPARE(output.data(), fileData);
+
+    // The upload which is never committed expires
+    fileStore->setUploadTimeout(50);
+    QTRY_COMPARE_WITH_TIMEOUT(fileStore->uploadsCount(), 0, 1000);
+    QVERIFY(QDir(fileStore->directory() + QStringLiteral("/uploads")).entryList(QDir::Files).isEmpty());
+}
+
+void tst_FilesApi::downloadPartRetry()
+{
+    const UserData userData = c_user;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::ServerApi *server = cluster.getServerApiInstance(userData.dcId);
+    QVERIFY(server);
+    Server::LocalUser *user = tryAddUser(&cluster, userData);
+    QVERIFY(user);
+
+    Client::Client client;
+    {
+        setupClientHelper(&client, userData, publicKey, clientDcOption);
+        Client::AuthOperation *signInOperation = nullptr;
+        signInHelper(&client, userData, &authProvider, &signInOperation);
+        TRY_VERIFY2(signInOperation->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_VERIFY(client.isSignedIn());
+
+    const QByteArray fileData = RandomGenerator::instance()->generate(5 * 128 * 1024 + 1000);
+    QBuffer input;
+    input.setData(fileData);
+    input.open(QIODevice::ReadOnly);
+    Client::FileOperation *uploadOperation = client.filesApi()->uploadFile(&input, QStringLiteral("file.bin"));
+    TRY_VERIFY(uploadOperation->isFinished());
+    QVERIFY(uploadOperation->isSucceeded());
+    const RemoteFile uploadedFile = uploadOperation->file();
+    const TLInputFile inputFile = RemoteFile::Private::get(&uploadedFile)->getInputFile();
+    const Server::FileDescriptor descriptor = server->storage()->fileStore()->commitUpload(
+                user->userId(), inputFile.id, inputFile.parts, inputFile.name, server->dcId());
+    QVERIFY(descriptor.isValid());
+
+    TLFileLocation location;
+    location.tlType = TLValue::FileLocation;
+    location.dcId = descriptor.dcId;
+    location.volumeId = descriptor.volumeId;
+    location.localId = descriptor.localId;
+    location.secret = descriptor.secret;
+    RemoteFile file;
+    RemoteFile::Private::get(&file)->setFileLocation(&location);
+    RemoteFile::Private::get(&file)->m_size = descriptor.size;
+
+    // The parts of the home DC files are requested via the default upload layer;
+    // the injected failures finish the requests without sending them
+    Client::Backend *backend = Client::ClientPrivate::get(&client);
+    int requestsCount = 0;
+    QSet<int> failedRequests;
+    backend->uploadLayer()->setRpcProcessingMethod([&](Client::PendingRpcOperation *operation) {
+        if (failedRequests.contains(requestsCount++)) {
+            operation->setDelayedFinishedWithError({{ PendingOperation::c_text(), QStringLiteral("Injected failure") }});
+            return;
+        }
+        operation->setPriority(Client::PendingRpcOperation::Priority::Bulk);
+        backend->getDefaultConnection()->rpcLayer()->scheduler()->schedule(operation);
+    });
+    // One part in flight makes the order of the requests predictable
+    client.filesApi()->setDownloadWindow(1);
+
+    // The second part fails twice and then it is received
+    failedRequests = { 1, 2 };
+    QBuffer output;
+    output.open(QIODevice::WriteOnly);
+    Client::FileOperation *downloadOperation = client.filesApi()->downloadFile(file, &output);
+    QSignalSpy progressSpy(downloadOperation, &Client::FileOperation::progressChanged);
+    TRY_VERIFY(downloadOperation->isFinished());
+    QVERIFY(downloadOperation->isSucceeded());
+    QCOMPARE(output.data(), fileData);
+    QCOMPARE(progressSpy.count(), 6);
+    QCOMPARE(requestsCount, 8);
+
+    // The download fails once a part is retried for the maximum number of times
+    requestsCount = 0;
+    failedRequests = { 0, 1, 2, 3 };
+    QBuffer failedOutput;
+    failedOutput.open(QIODevice::WriteOnly);
+    Client::FileOperation *failedOperation = client.filesApi()->downloadFile(file, &failedOutput);
+    TRY_VERIFY(failedOperation->isFinished());
+    QVERIFY(failedOperation->isFailed());
+    QCOMPARE(requestsCount, 4);
+    QVERIFY(failedOutput.data().isEmpty());
+
+    // The owned file is parented to the operation even if the operation fails right away
+    QTemporaryDir dir;
+    Client::FileOperation *invalidOperation = client.filesApi()->downloadFile(RemoteFile(), dir.filePath(QStringLiteral("file.bin")));
+    QFile *invalidOutput = invalidOperation->findChild<QFile *>();
+    QVERIFY(invalidOutput);
+    TRY_VERIFY(invalidOperation->isFinished());
+    QVERIFY(invalidOperation->isFailed());
+}
+
+void tst_FilesApi::downloadViaConnectionPool()
+{
+    const UserData userData = c_user;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+    const quint32 fileDcId = 2;
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::LocalUser *user = tryAddUser(&cluster, userData);
+    QVERIFY(user);
+
+    Client::Client client;
+    {
+        setupClientHelper(&client, userData, publicKey, clientDcOption);
+        client.settings()->setStandbyMediaConnectionCount(1);
+        Client::AuthOperation *signInOperation = nullptr;
+        signInHelper(&client, userData, &authProvider, &signInOperation);
+        TRY_VERIFY2(signInOperation->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_COMPARE(client.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+
+    // The media connections to the other DCs are authorized ahead of the first request
+    Client::ConnectionApiPrivate *privateApi = Client::ConnectionApiPrivate::get(client.connectionApi());
+    const ConnectionSpec mediaSpec(fileDcId, ConnectionSpec::RequestFlag::MediaOnly);
+    Client::ConnectionPool *pool = privateApi->ensureConnectionPool(mediaSpec);
+    QTRY_COMPARE_WITH_TIMEOUT(pool->signedCount(), 1, 5000);
+    QTRY_COMPARE_WITH_TIMEOUT(privateApi->ensureConnectionPool(ConnectionSpec(3, ConnectionSpec::RequestFlag::MediaOnly))->signedCount(), 1, 5000);
+    QCOMPARE(privateApi->ensureConnectionPool(ConnectionSpec(fileDcId))->count(), 0);
+    QVERIFY(!privateApi->ensureConnection(ConnectionSpec(clientDcOption.id, ConnectionSpec::RequestFlag::MediaOnly)));
+
+    bool hasImportedSession = false;
+    for (Server::RemoteClientConnection *connection : cluster.getServerInstance(fileDcId)->getConnections()) {
+        if (connection->session() && (connection->session()->user() == user)) {
+            hasImportedSession = true;
+        }
+    }
+    QVERIFY(hasImportedSession);
+    // The updates go only to the sessions of the user home DC
+    QCOMPARE(user->activeSessions().count(), 1);
+
+    Client::Connection *mediaConnection = privateApi->ensureConnection(mediaSpec);
+    QVERIFY(mediaConnection);
+    QCOMPARE(mediaConnection->status(), Client::Connection::Status::Signed);
+
+    const QByteArray fileData = RandomGenerator::instance()->generate(3 * 128 * 1024);
+    QBuffer input;
+    input.setData(fileData);
+    input.open(QIODevice::ReadOnly);
+    Client::FileOperation *uploadOperation = client.filesApi()->uploadFile(&input, QStringLiteral("file.bin"));
+    TRY_VERIFY(uploadOperation->isFinished());
+    QVERIFY(uploadOperation->isSucceeded());
+    const RemoteFile uploadedFile = uploadOperation->file();
+    const TLInputFile inputFile = RemoteFile::Private::get(&uploadedFile)->getInputFile();
+    const Server::FileDescriptor descriptor = cluster.getServerApiInstance(fileDcId)->storage()->fileStore()->commitUpload(
+                user->userId(), inputFile.id, inputFile.parts, inputFile.name, fileDcId);
+    QVERIFY(descriptor.isValid());
+
+    TLFileLocation location;
+    location.tlType = TLValue::FileLocation;
+    location.dcId = descriptor.dcId;
+    location.volumeId = descriptor.volumeId;
+    location.localId = descriptor.localId;
+    location.secret = descriptor.secret;
+    RemoteFile file;
+    RemoteFile::Private::get(&file)->setFileLocation(&location);
+    RemoteFile::Private::get(&file)->m_size = descriptor.size;
+
+    // The parts are requested right away via the warm connection
+    QSignalSpy mediaPacketsSpy(mediaConnection->transport(), &BaseTransport::packetSent);
+    QBuffer output;
+    output.open(QIODevice::WriteOnly);
+    Client::FileOperation *downloadOperation = client.filesApi()->downloadFile(file, &output);
+    TRY_VERIFY(downloadOperation->isFinished());
+    QVERIFY(downloadOperation->isSucceeded());
+    QCOMPARE(output.data(), fileData);
+    QVERIFY(mediaPacketsSpy.count() >= 3);
+
+    // The connections over the standby count are closed once idle
+    pool->setStandbyCount(0);
+    pool->setIdleTimeout(50);
+    QTRY_COMPARE_WITH_TIMEOUT(pool->count(), 0, 1000);
+
+    // The pool connects again on demand and the requests wait for the connection instead of going to the main one
+    pool->setIdleTimeout(Client::Settings::defaultIdleConnectionTimeout());
+    Client::Backend *backend = Client::ClientPrivate::get(&client);
+    int defaultRequests = 0;
+    backend->uploadLayer()->setRpcProcessingMethod([&defaultRequests](Client::PendingRpcOperation *operation) {
+        ++defaultRequests;
+        operation->setDelayedFinishedWithError({{ PendingOperation::c_text(), QStringLiteral("Unexpected request") }});
+    });
+    QBuffer coldOutput;
+    coldOutput.open(QIODevice::WriteOnly);
+    Client::FileOperation *coldDownloadOperation = client.filesApi()->downloadFile(file, &coldOutput);
+    QCOMPARE(pool->count(), 1);
+    QVERIFY(pool->pendingCount() > 0);
+    QTRY_VERIFY_WITH_TIMEOUT(coldDownloadOperation->isFinished(), 5000);
+    QVERIFY(coldDownloadOperation->isSucceeded());
+    QCOMPARE(coldOutput.data(), fileData);
+    QCOMPARE(defaultRequests, 0);
+    QCOMPARE(pool->pendingCount(), 0);
+    QVERIFY(privateApi->ensureConnection(mediaSpec));
+}
+
+QTEST_GUILESS_MAIN(tst_FilesApi)
+
+#include "tst_FilesApi.moc"
@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_FilesApi
+SOURCES += tst_FilesApi.cpp
+HEADERS += ../utils/TestAuthProvider.hpp
+
+include(../../tests/data/data.pri)
@@ -18,7 +18,12 @@
 #include <QObject>
 
 #include "AccountStorage.hpp"
+#include "ApiUtils.hpp"
 #include "Client.hpp"
+#include "Client_p.hpp"
+#include "ClientConnection.hpp"
+#include "ClientRpcLayer.hpp"
+#include "ClientRpcScheduler.hpp"
 #include "ClientSettings.hpp"
 #include "ConnectionApi.hpp"
 #include "DataStorage.hpp"
@@ -29,22 +34,36 @@
 #include "Operations/ClientAuthOperation.hpp"
 #include "Operations/ClientMessagesOperation.hpp"
 #include "Operations/PendingContactsOperation.hpp"
+#include "RpcLayers/ClientRpcChannelsLayer.hpp"
+#include "RpcLayers/ClientRpcMessagesLayer.hpp"
+#include "RpcLayers/ClientRpcUsersLayer.hpp"
 
 #include "ContactList.hpp"
 #include "ContactsApi.hpp"
 #include "DialogList.hpp"
+#include "CTelegramTransport.hpp"
 #include "RemoteClientConnection.hpp"
+#include "TelegramServer.hpp"
+#include "TelegramServerChannel.hpp"
 #include "TelegramServerUser.hpp"
 #include "ServerApi.hpp"
+#include "ServerMessageData.hpp"
 #include "ServerRpcLayer.hpp"
+#include "ServerSearchIndex.hpp"
+#include "Session.hpp"
+#include "Storage.hpp"
 #include "DcConfiguration.hpp"
 #include "LocalCluster.hpp"
 #include "MessagingApi.hpp"
 
+#include <QPointer>
 #include <QTest>
 #include <QSignalSpy>
 #include <QDebug>
 #include <QRegularExpression>
+#include <QTemporaryDir>
+
+#include <algorithm>
 
 #include "keys_data.hpp"
 #include "TestAuthProvider.hpp"
@@ -75,6 +94,17 @@ static const UserData c_user2 = []() {
     return userData;
 }();
 
+static QVector<Server::LocalUser *> addServerUsers(Server::Server *server, int count)
+{
+    QVector<Server::LocalUser *> users;
+    users.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const QString phoneNumber = QStringLiteral("555%1").arg(i, 7, 10, QLatin1Char('0'));
+        users.append(server->addUser(phoneNumber));
+    }
+    return users;
+}
+
 class tst_MessagesApi : public QObject
 {
     Q_OBJECT
@@ -86,6 +116,14 @@ private slots:
     void cleanupTestCase();
     void getDialogs();
     void getMessage();
+    void updatesGapRecovery();
+    void dataStorageCache();
+    void messageCacheEviction();
+    void historyCache();
+    void peerInfoBatching();
+    void messageSearchIndex();
+    void postBoxUpdateLog();
+    void channelSharedBox();
 };
 
 tst_MessagesApi::tst_MessagesApi(QObject *parent) :
@@ -443,6 +481,11 @@ void tst_MessagesApi::getMessage()
         QCOMPARE(message.flags, TelegramNamespace::MessageFlagNone);
     }
 
+    Server::UserDialog *user2Dialog = user2->getDialog(user1->toPeer());
+    QVERIFY(user2Dialog);
+    QCOMPARE(user2Dialog->unreadCount, 1u);
+    QCOMPARE(user2->unreadCount(), 1u);
+
     QSignalSpy client1MessageReadSpy(client1.messagingApi(), &Client::MessagingApi::messageReadOutbox);
 
     client2.messagingApi()->readHistory(client1AsClient2Peer, client2Message1Id);
@@ -450,7 +493,735 @@ void tst_MessagesApi::getMessage()
     // Check message marked read for client 1
     {
         TRY_COMPARE(client1MessageReadSpy.count(), 1);
+        QCOMPARE(user2Dialog->unreadCount, 0u);
+        QCOMPARE(user2Dialog->readInboxMaxId, client2Message1Id);
+        QCOMPARE(user2->unreadCount(), 0u);
+        Server::UserDialog *user1Dialog = user1->getDialog(user2->toPeer());
+        QVERIFY(user1Dialog);
+        QCOMPARE(user1Dialog->readOutboxMaxId, client1Message1Id);
+    }
+
+    // Each Updates package is serialized once and sent to a single session here
+    const Server::UpdatesDeliveryStats deliveryStats = cluster.getServerInstance(user1Data.dcId)->updatesDeliveryStats();
+    QVERIFY(deliveryStats.serializations > 0);
+    QVERIFY(deliveryStats.serializations <= deliveryStats.sentPackages);
+    QVERIFY(deliveryStats.sentPackages <= deliveryStats.deliveredUpdates);
+}
+
+void tst_MessagesApi::updatesGapRecovery()
+{
+    const UserData user1Data = c_userWithPassword;
+    const UserData user2Data = c_user2;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+    QVERIFY(publicKey.isValid() && privateKey.isPrivate()); // Sanity check
+
+    // Prepare server
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::ServerApi *server = cluster.getServerApiInstance(user1Data.dcId);
+    QVERIFY(server);
+
+    Server::LocalUser *user1 = tryAddUser(&cluster, user1Data);
+    Server::LocalUser *user2 = tryAddUser(&cluster, user2Data);
+    QVERIFY(user1 && user2);
+
+    // Prepare client
+    Client::Client client1;
+    {
+        setupClientHelper(&client1, user1Data, publicKey, clientDcOption);
+        Client::AuthOperation *signInOperation1 = nullptr;
+        signInHelper(&client1, user1Data, &authProvider, &signInOperation1);
+        TRY_VERIFY2(signInOperation1->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_COMPARE(client1.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+    QCOMPARE(client1.accountStorage()->updatesState().pts, user1->getPostBox()->pts());
+
+    // Adds the message to the boxes without notifying the recipient, like if the update is lost
+    const auto addMessage = [server, user1, user2](const QString &text) {
+        Server::MessageData *messageData = server->storage()->addMessage(user2->id(), user1->toPeer(), text);
+        user2->getPostBox()->addMessage(messageData);
+        return user1->getPostBox()->addMessage(messageData);
+    };
+
+    QSignalSpy messageReceivedSpy(client1.messagingApi(), &Client::MessagingApi::messageReceived);
+
+    // The update of the first message is lost and the second update reveals the gap
+    const quint32 lostMessageId = addMessage(QStringLiteral("Lost"));
+    const quint32 notifiedMessageId = addMessage(QStringLiteral("Notified"));
+    {
+        Server::UpdateNotification notification;
+        notification.type = Server::UpdateNotification::Type::NewMessage;
+        notification.userId = user1->id();
+        notification.dialogPeer = user2->toPeer();
+        notification.messageId = notifiedMessageId;
+        notification.pts = user1->getPostBox()->pts();
+        notification.date = Telegram::Utils::getCurrentTime();
+        server->queueUpdates({ notification });
+    }
+
+    TRY_COMPARE(messageReceivedSpy.count(), 2);
+    QCOMPARE(messageReceivedSpy.at(0).last().toUInt(), lostMessageId);
+    QCOMPARE(messageReceivedSpy.at(1).last().toUInt(), notifiedMessageId);
+    QCOMPARE(client1.accountStorage()->updatesState().pts, user1->getPostBox()->pts());
+    messageReceivedSpy.clear();
+
+    // The lost update without any following one is delivered by the difference on reconnect
+    const quint32 offlineMessageId = addMessage(QStringLiteral("Offline"));
+    QCOMPARE(user1->activeSessions().count(), 1);
+    QSignalSpy connectionStatusSpy(client1.connectionApi(), &Client::ConnectionApi::statusChanged);
+    Telegram::BaseTransport *serverSideTransport = user1->activeSessions().first()->getConnection()->transport();
+    serverSideTransport->disconnectFromHost();
+    TRY_VERIFY(!connectionStatusSpy.isEmpty());
+    TRY_COMPARE(client1.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+    TRY_COMPARE(messageReceivedSpy.count(), 1);
+    QCOMPARE(messageReceivedSpy.first().last().toUInt(), offlineMessageId);
+    QCOMPARE(client1.accountStorage()->updatesState().pts, user1->getPostBox()->pts());
+
+    // The gap is beyond the server updates log, so the client is told to refetch the data
+    QSignalSpy historyOutdatedSpy(client1.messagingApi(), &Client::MessagingApi::historyOutdated);
+    user1->getPostBox()->setUpdateLogCapacity(2);
+    for (int i = 0; i < 4; ++i) {
+        addMessage(QStringLiteral("Missed %1").arg(i));
+    }
+    connectionStatusSpy.clear();
+    serverSideTransport = user1->activeSessions().first()->getConnection()->transport();
+    serverSideTransport->disconnectFromHost();
+    TRY_VERIFY(!connectionStatusSpy.isEmpty());
+    TRY_COMPARE(client1.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+    TRY_COMPARE(historyOutdatedSpy.count(), 1);
+    QCOMPARE(client1.accountStorage()->updatesState().pts, user1->getPostBox()->pts());
+}
+
+void tst_MessagesApi::dataStorageCache()
+{
+    const UserData user1Data = c_userWithPassword;
+    const UserData user2Data = c_user2;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+    QVERIFY(publicKey.isValid() && privateKey.isPrivate()); // Sanity check
+
+    // Prepare server
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::ServerApi *server = cluster.getServerApiInstance(user1Data.dcId);
+    QVERIFY(server);
+
+    Server::LocalUser *user1 = tryAddUser(&cluster, user1Data);
+    Server::LocalUser *user2 = tryAddUser(&cluster, user2Data);
+    QVERIFY(user1 && user2);
+
+    QTemporaryDir cacheDir;
+    QVERIFY(cacheDir.isValid());
+    const QString cacheFileName = cacheDir.filePath(QStringLiteral("data"));
+
+    // Prepare client
+    Client::Client client1;
+    Client::FileDataStorage *dataStorage = nullptr;
+    {
+        setupClientHelper(&client1, user1Data, publicKey, clientDcOption);
+        dataStorage = new Client::FileDataStorage(&client1);
+        dataStorage->setFileName(cacheFileName);
+        dataStorage->setFlushInterval(100);
+        client1.setDataStorage(dataStorage);
+        Client::AuthOperation *signInOperation1 = nullptr;
+        signInHelper(&client1, user1Data, &authProvider, &signInOperation1);
+        TRY_VERIFY2(signInOperation1->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_COMPARE(client1.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+
+    QSignalSpy messageReceivedSpy(client1.messagingApi(), &Client::MessagingApi::messageReceived);
+    QSignalSpy dataSyncedSpy(dataStorage, &Client::FileDataStorage::synced);
+
+    const QString c_firstMessageText = QStringLiteral("First");
+    const QString c_messageText = QStringLiteral("Cached");
+    QVector<quint32> messageIds;
+    for (const QString &text : { c_firstMessageText, c_messageText }) {
+        Server::MessageData *messageData = server->storage()->addMessage(user2->id(), user1->toPeer(), text);
+        user2->getPostBox()->addMessage(messageData);
+        messageIds.append(user1->getPostBox()->addMessage(messageData));
+
+        Server::UpdateNotification notification;
+        notification.type = Server::UpdateNotification::Type::NewMessage;
+        notification.userId = user1->id();
+        notification.dialogPeer = user2->toPeer();
+        notification.messageId = messageIds.last();
+        notification.pts = user1->getPostBox()->pts();
+        notification.date = Telegram::Utils::getCurrentTime();
+        server->queueUpdates({ notification });
+    }
+    const quint32 firstMessageId = messageIds.first();
+    const quint32 messageId = messageIds.last();
+    TRY_COMPARE(messageReceivedSpy.count(), 2);
+
+    // The received data is written behind without an explicit sync
+    TRY_VERIFY(!dataSyncedSpy.isEmpty());
+
+    // A fresh storage provides the data without any connection
+    Client::FileDataStorage cachedStorage;
+    cachedStorage.setFileName(cacheFileName);
+    QVERIFY(cachedStorage.fileExists());
+    QVERIFY(cachedStorage.loadData());
+    QCOMPARE(cachedStorage.selfUserId(), user1->id());
+    QVERIFY(cachedStorage.dialogs().contains(user2->toPeer()));
+
+    DialogInfo dialogInfo;
+    QVERIFY(cachedStorage.getDialogInfo(&dialogInfo, user2->toPeer()));
+    QCOMPARE(dialogInfo.lastMessageId(), messageId);
+
+    Telegram::Message message;
+    QVERIFY(cachedStorage.getMessage(&message, user2->toPeer(), messageId));
+    QCOMPARE(message.text, c_messageText);
+
+    UserInfo selfInfo;
+    QVERIFY(cachedStorage.getUserInfo(&selfInfo, user1->id()));
+    QCOMPARE(selfInfo.phone(), user1Data.phoneNumber);
+
+    // An evicted message stays in the file after the next write and is reloaded from there
+    QVERIFY(cachedStorage.getMessage(&message, user2->toPeer(), messageId));
+    cachedStorage.setMessageCacheLimit(1);
+    QCOMPARE(cachedStorage.messageCacheStats().evictions, quint64(1));
+    QVERIFY(cachedStorage.sync());
+    QVERIFY(cachedStorage.getMessage(&message, user2->toPeer(), firstMessageId));
+    QCOMPARE(message.text, c_firstMessageText);
+    QCOMPARE(cachedStorage.messageCacheStats().reloads, quint64(1));
+}
+
+void tst_MessagesApi::messageCacheEviction()
+{
+    const UserData user1Data = c_userWithPassword;
+    const UserData user2Data = c_user2;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+    QVERIFY(publicKey.isValid() && privateKey.isPrivate()); // Sanity check
+
+    // Prepare server
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::ServerApi *server = cluster.getServerApiInstance(user1Data.dcId);
+    QVERIFY(server);
+
+    Server::LocalUser *user1 = tryAddUser(&cluster, user1Data);
+    Server::LocalUser *user2 = tryAddUser(&cluster, user2Data);
+    QVERIFY(user1 && user2);
+
+    // Prepare client
+    Client::Client client1;
+    {
+        setupClientHelper(&client1, user1Data, publicKey, clientDcOption);
+        Client::AuthOperation *signInOperation1 = nullptr;
+        signInHelper(&client1, user1Data, &authProvider, &signInOperation1);
+        TRY_VERIFY2(signInOperation1->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_COMPARE(client1.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+
+    constexpr int c_messagesCount = 20;
+    QSignalSpy messageReceivedSpy(client1.messagingApi(), &Client::MessagingApi::messageReceived);
+    QVector<quint32> messageIds;
+    QVector<Server::UpdateNotification> notifications;
+    for (int i = 0; i < c_messagesCount; ++i) {
+        const QString text = QStringLiteral("Message %1").arg(i);
+        Server::MessageData *messageData = server->storage()->addMessage(user2->id(), user1->toPeer(), text);
+        user2->getPostBox()->addMessage(messageData);
+        messageIds.append(user1->getPostBox()->addMessage(messageData));
+
+        Server::UpdateNotification notification;
+        notification.type = Server::UpdateNotification::Type::NewMessage;
+        notification.userId = user1->id();
+        notification.dialogPeer = user2->toPeer();
+        notification.messageId = messageIds.last();
+        notification.pts = user1->getPostBox()->pts();
+        notification.date = Telegram::Utils::getCurrentTime();
+        notifications.append(notification);
+    }
+    server->queueUpdates(notifications);
+    TRY_COMPARE(messageReceivedSpy.count(), c_messagesCount);
+
+    Client::DataStorage *dataStorage = client1.dataStorage();
+    Client::DataStorage::MessageCacheStats stats = dataStorage->messageCacheStats();
+    QCOMPARE(stats.count, c_messagesCount);
+    QCOMPARE(stats.evictions, quint64(0));
+
+    // Keep about a quarter of the messages
+    const quint64 cacheLimit = stats.size / 4;
+    dataStorage->setMessageCacheLimit(cacheLimit);
+    stats = dataStorage->messageCacheStats();
+    QVERIFY(stats.size <= cacheLimit);
+    QVERIFY(stats.count < c_messagesCount / 4);
+    QCOMPARE(stats.evictions, quint64(c_messagesCount - stats.count));
+
+    // The dialog top message is kept
+    Telegram::Message message;
+    QVERIFY(dataStorage->getMessage(&message, user2->toPeer(), messageIds.last()));
+    QCOMPARE(dataStorage->messageCacheStats().hits, stats.hits + 1);
+
+    // The least recently used message is evicted and fetched from the server on demand
+    QSignalSpy messagesFetchedSpy(client1.messagingApi(), &Client::MessagingApi::messagesFetched);
+    QVERIFY(!dataStorage->getMessage(&message, user2->toPeer(), messageIds.first()));
+    stats = dataStorage->messageCacheStats();
+    QCOMPARE(stats.refetches, quint64(1));
+    TRY_COMPARE(messagesFetchedSpy.count(), 1);
+    const QList<QVariant> fetchedArgs = messagesFetchedSpy.takeFirst();
+    QCOMPARE(fetchedArgs.at(0).value<Telegram::Peer>(), user2->toPeer());
+    QCOMPARE(fetchedArgs.at(1).value<QVector<quint32>>(), QVector<quint32>({ messageIds.first() }));
+    QVERIFY(dataStorage->getMessage(&message, user2->toPeer(), messageIds.first()));
+    QCOMPARE(message.text, QStringLiteral("Message 0"));
+    QVERIFY(dataStorage->messageCacheStats().size <= cacheLimit);
+}
+
+void tst_MessagesApi::historyCache()
+{
+    const UserData user1Data = c_userWithPassword;
+    const UserData user2Data = c_user2;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+    QVERIFY(publicKey.isValid() && privateKey.isPrivate()); // Sanity check
+
+    // Prepare server
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::ServerApi *server = cluster.getServerApiInstance(user1Data.dcId);
+    QVERIFY(server);
+
+    Server::LocalUser *user1 = tryAddUser(&cluster, user1Data);
+    Server::LocalUser *user2 = tryAddUser(&cluster, user2Data);
+    QVERIFY(user1 && user2);
+
+    // Prepare client
+    Client::Client client1;
+    {
+        setupClientHelper(&client1, user1Data, publicKey, clientDcOption);
+        Client::AuthOperation *signInOperation1 = nullptr;
+        signInHelper(&client1, user1Data, &authProvider, &signInOperation1);
+        TRY_VERIFY2(signInOperation1->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_COMPARE(client1.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+
+    constexpr int c_messagesCount = 5;
+    QSignalSpy messageReceivedSpy(client1.messagingApi(), &Client::MessagingApi::messageReceived);
+    QVector<quint32> messageIds;
+    QVector<Server::UpdateNotification> notifications;
+    for (int i = 0; i < c_messagesCount; ++i) {
+        const QString text = QStringLiteral("Message %1").arg(i);
+        Server::MessageData *messageData = server->storage()->addMessage(user2->id(), user1->toPeer(), text);
+        user2->getPostBox()->addMessage(messageData);
+        messageIds.append(user1->getPostBox()->addMessage(messageData));
+
+        Server::UpdateNotification notification;
+        notification.type = Server::UpdateNotification::Type::NewMessage;
+        notification.userId = user1->id();
+        notification.dialogPeer = user2->toPeer();
+        notification.messageId = messageIds.last();
+        notification.pts = user1->getPostBox()->pts();
+        notification.date = Telegram::Utils::getCurrentTime();
+        notifications.append(notification);
+    }
+    server->queueUpdates(notifications);
+    TRY_COMPARE(messageReceivedSpy.count(), c_messagesCount);
+
+    Client::MessagingApi *messagingApi = client1.messagingApi();
+
+    // The cached slice is returned right away and confirmed by the server
+    Client::MessagesOperation *cachedOperation = messagingApi->getHistory(user2->toPeer(), Client::MessageFetchOptions::useLimit(3));
+    QSignalSpy cachedRefreshedSpy(cachedOperation, &Client::MessagesOperation::messagesRefreshed);
+    QCOMPARE(cachedOperation->messages(), QVector<quint32>({ messageIds.at(4), messageIds.at(3), messageIds.at(2) }));
+    TRY_VERIFY(cachedOperation->isFinished());
+    QVERIFY(cachedOperation->isSucceeded());
+
+    // Not enough cached messages; the request goes to the server
+    Client::MessagesOperation *remoteOperation = messagingApi->getHistory(user2->toPeer(), Client::MessageFetchOptions::useLimit(10));
+    QVERIFY(remoteOperation->messages().isEmpty());
+    TRY_VERIFY(remoteOperation->isFinished());
+    QVERIFY(remoteOperation->isSucceeded());
+    QCOMPARE(remoteOperation->messages().count(), c_messagesCount);
+    // The server replied NotModified to the first request
+    QCOMPARE(cachedRefreshedSpy.count(), 0);
+
+    // The older slice is cached along the links between the messages
+    Client::MessageFetchOptions offsetOptions = Client::MessageFetchOptions::useLimit(2);
+    offsetOptions.offsetId = messageIds.at(3);
+    Client::MessagesOperation *offsetOperation = messagingApi->getHistory(user2->toPeer(), offsetOptions);
+    QCOMPARE(offsetOperation->messages(), QVector<quint32>({ messageIds.at(2), messageIds.at(1) }));
+    TRY_VERIFY(offsetOperation->isFinished());
+    QVERIFY(offsetOperation->isSucceeded());
+
+    // The slice reaches beyond the first message; the request goes to the server
+    offsetOptions.offsetId = messageIds.at(1);
+    Client::MessagesOperation *incompleteOperation = messagingApi->getHistory(user2->toPeer(), offsetOptions);
+    QVERIFY(incompleteOperation->messages().isEmpty());
+    TRY_VERIFY(incompleteOperation->isFinished());
+    QCOMPARE(incompleteOperation->messages(), QVector<quint32>({ messageIds.at(0) }));
+
+    // The server has a message unknown to the client; the cached slice is refreshed
+    {
+        Server::MessageData *messageData = server->storage()->addMessage(user2->id(), user1->toPeer(), QStringLiteral("Silent"));
+        user2->getPostBox()->addMessage(messageData);
+        messageIds.append(user1->getPostBox()->addMessage(messageData));
+    }
+    Client::MessagesOperation *outdatedOperation = messagingApi->getHistory(user2->toPeer(), Client::MessageFetchOptions::useLimit(3));
+    QSignalSpy outdatedRefreshedSpy(outdatedOperation, &Client::MessagesOperation::messagesRefreshed);
+    QCOMPARE(outdatedOperation->messages(), QVector<quint32>({ messageIds.at(4), messageIds.at(3), messageIds.at(2) }));
+    TRY_COMPARE(outdatedRefreshedSpy.count(), 1);
+    QVERIFY(outdatedOperation->isSucceeded());
+    QCOMPARE(outdatedOperation->messages(), QVector<quint32>({ messageIds.at(5), messageIds.at(4), messageIds.at(3) }));
+
+    // The contact list is seeded from the cache and confirmed by the contacts hash
+    {
+        Telegram::Client::ContactsApi::ContactInfo user2ContactInfo;
+        user2ContactInfo.phoneNumber = user2->phoneNumber();
+        user2ContactInfo.firstName   = user2->firstName();
+        user2ContactInfo.lastName    = user2->lastName();
+        Telegram::Client::PendingContactsOperation *addContactOperation = client1.contactsApi()->addContacts({user2ContactInfo});
+        TRY_VERIFY(addContactOperation->isFinished());
+        QVERIFY(addContactOperation->isSucceeded());
+    }
+    Client::ContactList *contactList = client1.contactsApi()->getContactList();
+    PendingOperation *contactListReadyOperation = contactList->becomeReady();
+    TRY_VERIFY(contactListReadyOperation->isFinished());
+    QVERIFY(contactListReadyOperation->isSucceeded());
+    QCOMPARE(contactList->peers(), Telegram::PeerList({ user2->toPeer() }));
+
+    Client::ContactList cachedContactList(client1.contactsApi());
+    PendingOperation *cachedContactListOperation = cachedContactList.becomeReady();
+    QCOMPARE(cachedContactList.peers(), Telegram::PeerList({ user2->toPeer() }));
+    TRY_VERIFY(cachedContactListOperation->isFinished());
+    QVERIFY(cachedContactListOperation->isSucceeded());
+    QCOMPARE(cachedContactList.peers(), Telegram::PeerList({ user2->toPeer() }));
+}
+
+void tst_MessagesApi::peerInfoBatching()
+{
+    const UserData user1Data = c_userWithPassword;
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+    QVERIFY(publicKey.isValid() && privateKey.isPrivate()); // Sanity check
+
+    // Prepare server
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::LocalUser *user1 = tryAddUser(&cluster, user1Data);
+    QVERIFY(user1);
+
+    constexpr int c_usersCount = 5;
+    QVector<Server::LocalUser *> users;
+    for (int i = 0; i < c_usersCount; ++i) {
+        UserData userData;
+        userData.dcId = 1;
+        userData.setName(QStringLiteral("Batched%1").arg(i), QStringLiteral("User"));
+        userData.phoneNumber = QStringLiteral("12350%1").arg(i);
+        Server::LocalUser *user = tryAddUser(&cluster, userData);
+        QVERIFY(user);
+        users.append(user);
+    }
+
+    // Prepare client
+    Client::Client client1;
+    {
+        setupClientHelper(&client1, user1Data, publicKey, clientDcOption);
+        Client::AuthOperation *signInOperation1 = nullptr;
+        signInHelper(&client1, user1Data, &authProvider, &signInOperation1);
+        TRY_VERIFY2(signInOperation1->isSucceeded(), "Unexpected sign in fail");
+    }
+    TRY_COMPARE(client1.connectionApi()->status(), Client::ConnectionApi::StatusReady);
+
+    Server::ServerApi *server = cluster.getServerApiInstance(user1Data.dcId);
+    constexpr int c_channelsCount = 3;
+    QVector<Server::LocalChannel *> channels;
+    for (int i = 0; i < c_channelsCount; ++i) {
+        Server::LocalChannel *channel = server->createChannel(users.first(), QStringLiteral("Batched channel %1").arg(i));
+        QVERIFY(channel);
+        channels.append(channel);
+    }
+
+    // Count the lookup requests on their way to the connection
+    Client::Backend *backend = Client::ClientPrivate::get(&client1);
+    QHash<quint32, int> requestsCount;
+    const auto countingMethod = [backend, &requestsCount](Client::PendingRpcOperation *operation) {
+        const TLValue function = TLValue::firstFromArray(operation->requestData());
+        ++requestsCount[function];
+        operation->setPriority(Client::RpcScheduler::priorityForRequest(function));
+        backend->getDefaultConnection()->rpcLayer()->scheduler()->schedule(operation);
+    };
+    backend->usersLayer()->setRpcProcessingMethod(countingMethod);
+    backend->messagesLayer()->setRpcProcessingMethod(countingMethod);
+    backend->channelsLayer()->setRpcProcessingMethod(countingMethod);
+
+    // The lookups are deleted once finished, so the results are tracked by the signals
+    QSet<Peer> succeededPeers;
+    QSet<Peer> failedPeers;
+    QVector<QPointer<PendingOperation>> operations;
+    const auto lookUp = [&](const Peer &peer) {
+        PendingOperation *operation = peer.type == Peer::User ? client1.contactsApi()->getUserInfo(peer.id)
+                                                              : client1.messagingApi()->getChatInfo(peer);
+        connect(operation, &PendingOperation::succeeded, this, [&succeededPeers, peer]() {
+            succeededPeers.insert(peer);
+        });
+        connect(operation, &PendingOperation::failed, this, [&failedPeers, peer]() {
+            failedPeers.insert(peer);
+        });
+        operations.append(operation);
+        return operation;
+    };
+
+    UserInfo userInfo;
+    ChatInfo chatInfo;
+    for (const Server::LocalUser *user : users) {
+        QVERIFY(!client1.dataStorage()->getUserInfo(&userInfo, user->id()));
+        PendingOperation *operation = lookUp(user->toPeer());
+        // Duplicated lookups share the operation
+        QCOMPARE(client1.contactsApi()->getUserInfo(user->id()), operation);
+    }
+    for (const Server::LocalChannel *channel : channels) {
+        QVERIFY(!client1.dataStorage()->getChatInfo(&chatInfo, channel->toPeer()));
+        lookUp(channel->toPeer());
+    }
+    const Peer unknownUser = Peer::fromUserId(users.last()->id() + 1000);
+    const Peer unknownChat = Peer::fromChatId(channels.last()->id() + 2000);
+    const Peer unknownChannel = Peer::fromChannelId(channels.last()->id() + 1000);
+    for (const Peer &peer : { unknownUser, unknownChat, unknownChannel }) {
+        lookUp(peer);
+    }
+
+    TRY_COMPARE(succeededPeers.count() + failedPeers.count(), c_usersCount + c_channelsCount + 3);
+    QCOMPARE(failedPeers, QSet<Peer>({ unknownUser, unknownChat, unknownChannel }));
+    QCOMPARE(requestsCount.value(TLValue::UsersGetUsers), 1);
+    QCOMPARE(requestsCount.value(TLValue::MessagesGetChats), 1);
+    QCOMPARE(requestsCount.value(TLValue::ChannelsGetChannels), 1);
+    for (const QPointer<PendingOperation> &operation : operations) {
+        TRY_VERIFY(!operation);
+    }
+
+    for (int i = 0; i < c_usersCount; ++i) {
+        QVERIFY(client1.dataStorage()->getUserInfo(&userInfo, users.at(i)->id()));
+        QCOMPARE(userInfo.firstName(), QStringLiteral("Batched%1").arg(i));
+    }
+    for (int i = 0; i < c_channelsCount; ++i) {
+        QVERIFY(client1.dataStorage()->getChatInfo(&chatInfo, channels.at(i)->toPeer()));
+        QCOMPARE(chatInfo.title(), QStringLiteral("Batched channel %1").arg(i));
+    }
+
+    // The known peers are resolved without a request
+    succeededPeers.clear();
+    lookUp(users.first()->toPeer());
+    lookUp(channels.first()->toPeer());
+    TRY_COMPARE(succeededPeers.count(), 2);
+    QCOMPARE(requestsCount.value(TLValue::UsersGetUsers), 1);
+    QCOMPARE(requestsCount.value(TLValue::ChannelsGetChannels), 1);
+}
+
+void tst_MessagesApi::channelSharedBox()
+{
+    Server::Server server;
+    Server::Storage storage;
+    server.setStorage(&storage);
+
+    const QVector<Server::LocalUser *> users = addServerUsers(&server, 3);
+    Server::LocalUser *creator = users.at(0);
+    Server::LocalUser *member1 = users.at(1);
+    Server::LocalUser *member2 = users.at(2);
+
+    Server::LocalChannel *channel = server.createChannel(creator, QStringLiteral("Test channel"));
+    QVERIFY(channel);
+    QCOMPARE(server.getChannel(channel->id()), channel);
+    QVERIFY(server.addChannelMember(channel, member1));
+    QVERIFY(server.addChannelMember(channel, member2));
+    QVERIFY(!server.addChannelMember(channel, member2));
+    QCOMPARE(channel->members().count(), 3);
+    QVERIFY(member1->getDialog(channel->toPeer()));
+
+    Server::LocalUser *outsider = server.addUser(QStringLiteral("5559999999"));
+    QCOMPARE(server.getRecipient(channel->toPeer(), member1), static_cast<Server::MessageRecipient *>(channel));
+    QVERIFY(!server.getRecipient(channel->toPeer(), outsider));
+
+    Server::ChannelPostBox *box = channel->getPostBox();
+    Server::MessageData *messageData = storage.addMessage(creator->id(), channel->toPeer(), QStringLiteral("Hello"));
+    const quint32 messageId = box->addMessage(messageData);
+    QCOMPARE(messageId, 1u);
+    QCOMPARE(box->pts(), 1u);
+    QCOMPARE(messageData->getReference(channel->toPeer()), messageId);
+    QCOMPARE(messageData->getReference(member1->toPeer()), 0u);
+    QCOMPARE(member1->getPostBox()->lastMessageId(), 0u);
+
+    QCOMPARE(box->unreadCount(creator->id()), 0u);
+    QCOMPARE(box->unreadCount(member1->id()), 1u);
+    QCOMPARE(box->unreadCount(member2->id()), 1u);
+    QVERIFY(box->setReadInboxMaxId(member1->id(), messageId));
+    QVERIFY(!box->setReadInboxMaxId(member1->id(), messageId));
+    QCOMPARE(box->unreadCount(member1->id()), 0u);
+    QCOMPARE(box->unreadCount(member2->id()), 1u);
+
+    // The sender does not get the own messages as unread
+    messageData = storage.addMessage(member2->id(), channel->toPeer(), QStringLiteral("Reply"));
+    const quint32 replyId = box->addMessage(messageData);
+    QCOMPARE(box->readInboxMaxId(member2->id()), replyId);
+    QCOMPARE(box->unreadCount(member2->id()), 0u);
+    QCOMPARE(box->unreadCount(member1->id()), 1u);
+    QCOMPARE(box->unreadCount(creator->id()), 1u);
+}
+
+void tst_MessagesApi::postBoxUpdateLog()
+{
+    Server::Server server;
+    Server::Storage storage;
+    server.setStorage(&storage);
+
+    const QVector<Server::LocalUser *> users = addServerUsers(&server, 2);
+    Server::LocalUser *sender = users.at(0);
+    Server::LocalUser *recipient = users.at(1);
+    Server::PostBox *box = recipient->getPostBox();
+    box->setUpdateLogCapacity(4);
+
+    for (int i = 0; i < 3; ++i) {
+        Server::MessageData *messageData = storage.addMessage(sender->id(), recipient->toPeer(), QStringLiteral("Message"));
+        box->addMessage(messageData);
+    }
+    QCOMPARE(box->addUpdate(Server::PostBoxUpdate::Type::ReadInbox, sender->toPeer(), 3), 4u);
+
+    QVector<Server::PostBoxUpdate> updates;
+    QVERIFY(box->getUpdates(0, &updates));
+    QCOMPARE(updates.count(), 4);
+    QVERIFY(box->getUpdates(2, &updates));
+    QCOMPARE(updates.count(), 2);
+    QCOMPARE(updates.first().pts, 3u);
+    QVERIFY(updates.first().type == Server::PostBoxUpdate::Type::NewMessage);
+    QCOMPARE(updates.last().pts, 4u);
+    QVERIFY(updates.last().type == Server::PostBoxUpdate::Type::ReadInbox);
+    QCOMPARE(updates.last().messageId, 3u);
+    QVERIFY(box->getUpdates(4, &updates));
+    QVERIFY(updates.isEmpty());
+
+    // Overflow the log
+    for (int i = 0; i < 3; ++i) {
+        Server::MessageData *messageData = storage.addMessage(sender->id(), recipient->toPeer(), QStringLiteral("Message"));
+        box->addMessage(messageData);
+    }
+    QCOMPARE(box->pts(), 7u);
+    QVERIFY(!box->getUpdates(1, &updates));
+    QVERIFY(box->getUpdates(3, &updates));
+    QCOMPARE(updates.count(), 4);
+    for (int i = 0; i < updates.count(); ++i) {
+        QCOMPARE(updates.at(i).pts, 4u + i);
+    }
+
+    box->setUpdateLogCapacity(2);
+    QVERIFY(!box->getUpdates(4, &updates));
+    QVERIFY(box->getUpdates(5, &updates));
+    QCOMPARE(updates.count(), 2);
+    QCOMPARE(updates.first().pts, 6u);
+    QCOMPARE(updates.last().pts, 7u);
+}
+
+void tst_MessagesApi::messageSearchIndex()
+{
+    const QStringList words = Server::SearchIndex::tokenize(QStringLiteral("Hello, World! Привет мир hello 42"));
+    QCOMPARE(words, QStringList({
+                                    QStringLiteral("hello"),
+                                    QStringLiteral("world"),
+                                    QStringLiteral("привет"),
+                                    QStringLiteral("мир"),
+                                    QStringLiteral("42"),
+                                }));
+
+    Server::SearchIndex index;
+    index.addEntry(1, QStringLiteral("Hello world"));
+    index.addEntry(2, QStringLiteral("Hello there"));
+    index.addEntry(300, QStringLiteral("Worldwide hello"), { QStringLiteral("from:1") });
+    index.addEntry(200, QStringLiteral("Out of order hello"), { QStringLiteral("from:1") });
+    QCOMPARE(index.entriesCount(), 4ull);
+
+    const auto search = [&index](const QString &query, const QStringList &tags, quint64 maxId, int limit) {
+        QVector<quint64> ids;
+        index.search(query, tags, maxId, [&ids, limit](quint64 id) {
+            ids.append(id);
+            return ids.count() < limit;
+        });
+        return ids;
+    };
+    QCOMPARE(search(QStringLiteral("HELLO"), {}, 0, 10), QVector<quint64>({300, 200, 2, 1}));
+    QCOMPARE(search(QStringLiteral("hello"), {}, 300, 10), QVector<quint64>({200, 2, 1}));
+    QCOMPARE(search(QStringLiteral("hello"), {}, 0, 2), QVector<quint64>({300, 200}));
+    QCOMPARE(search(QStringLiteral("hello world"), {}, 0, 10), QVector<quint64>({300, 1}));
+    QCOMPARE(search(QStringLiteral("world hello"), {}, 0, 10), QVector<quint64>({1}));
+    QCOMPARE(search(QStringLiteral("order"), {}, 0, 10), QVector<quint64>({200}));
+    QCOMPARE(search(QStringLiteral("!!!"), {}, 0, 10), QVector<quint64>());
+    QCOMPARE(search(QStringLiteral("hello"), { QStringLiteral("from:1") }, 0, 10), QVector<quint64>({300, 200}));
+    QCOMPARE(search(QStringLiteral("hello"), { QStringLiteral("from:2") }, 0, 10), QVector<quint64>());
+    QCOMPARE(search(QStringLiteral("from"), {}, 0, 10), QVector<quint64>());
+
+    // Several blocks of postings; the out of order ids go to the middle blocks
+    Server::SearchIndex bigIndex;
+    const int entriesCount = Server::SearchIndex::c_blockSize * 4;
+    for (int i = 1; i <= entriesCount; ++i) {
+        bigIndex.addEntry(static_cast<quint64>(i) * 2, QStringLiteral("common %1").arg(i % 2 ? QStringLiteral("odd") : QStringLiteral("even")));
+    }
+    for (int i = 1; i <= entriesCount; ++i) {
+        bigIndex.addEntry(static_cast<quint64>(i) * 2 + 1, QStringLiteral("common late"));
     }
+    const auto bigSearch = [&bigIndex](const QString &query, quint64 maxId) {
+        QVector<quint64> ids;
+        bigIndex.search(query, maxId, [&ids](quint64 id) {
+            ids.append(id);
+            return true;
+        });
+        return ids;
+    };
+    const QVector<quint64> commonIds = bigSearch(QStringLiteral("common"), 0);
+    QCOMPARE(commonIds.count(), entriesCount * 2);
+    QCOMPARE(commonIds.first(), quint64(entriesCount * 2 + 1));
+    QCOMPARE(commonIds.last(), 2ull);
+    QVERIFY(std::is_sorted(commonIds.crbegin(), commonIds.crend()));
+    QCOMPARE(bigSearch(QStringLiteral("late"), 0).count(), entriesCount);
+    QCOMPARE(bigSearch(QStringLiteral("common late"), 8), QVector<quint64>({7, 5, 3}));
+    QCOMPARE(bigSearch(QStringLiteral("even common"), 9), QVector<quint64>({8, 4}));
+    QCOMPARE(bigSearch(QStringLiteral("odd late"), 0), QVector<quint64>());
+
+    // The user names are indexed on insertion and reindexed on rename
+    Server::Server server;
+    const QVector<Server::LocalUser *> users = addServerUsers(&server, 3);
+    users.at(0)->setFirstName(QStringLiteral("Alice"));
+    users.at(0)->setLastName(QStringLiteral("Smith"));
+    users.at(1)->setFirstName(QStringLiteral("Alan"));
+    users.at(2)->setFirstName(QStringLiteral("Bob"));
+    const QVector<quint32> alUsers = server.searchUsers(QStringLiteral("al"), 10);
+    QCOMPARE(alUsers.count(), 2);
+    QVERIFY(alUsers.contains(users.at(0)->id()));
+    QVERIFY(alUsers.contains(users.at(1)->id()));
+    QCOMPARE(server.searchUsers(QStringLiteral("al"), 1).count(), 1);
+    QCOMPARE(server.searchUsers(QStringLiteral("sm al"), 10), QVector<quint32>({ users.at(0)->id() }));
+    QCOMPARE(server.searchUsers(QStringLiteral("bob"), 10), QVector<quint32>({ users.at(2)->id() }));
+    users.at(2)->setFirstName(QStringLiteral("Alex"));
+    QCOMPARE(server.searchUsers(QStringLiteral("bob"), 10), QVector<quint32>());
+    QCOMPARE(server.searchUsers(QStringLiteral("al"), 10).count(), 3);
 }
 
 QTEST_GUILESS_MAIN(tst_MessagesApi)
@@ -0,0 +1,332 @@
+/*
+   Copyright (C) 2019 Alexandr Akulich <akulichalexander@gmail.com>
+
+   This file is a part of TelegramQt library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+ */
+
+#include <QObject>
+
+#include "Client.hpp"
+#include "ConnectionApi.hpp"
+#include "CTelegramTransport.hpp"
+#include "LocalCluster.hpp"
+#include "RandomGenerator.hpp"
+#include "RemoteClientConnection.hpp"
+#include "ServerApi.hpp"
+#include "ServerDhWorkerPool.hpp"
+#include "ServerMessageData.hpp"
+#include "ServerSearchIndex.hpp"
+#include "Storage.hpp"
+#include "TelegramServer.hpp"
+#include "TelegramServerChannel.hpp"
+#include "TelegramServerUser.hpp"
+#include "Session.hpp"
+
+#include <QCoreApplication>
+#include <QTest>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include "keys_data.hpp"
+#include "TestAuthProvider.hpp"
+#include "TestClientUtils.hpp"
+#include "TestServerUtils.hpp"
+#include "TestUserData.hpp"
+#include "TestUtils.hpp"
+
+using namespace Telegram;
+
+static const UserData c_user = []() {
+    UserData userData;
+    userData.dcId = 1;
+    userData.setName(QStringLiteral("First"), QStringLiteral("Last"));
+    userData.phoneNumber = QStringLiteral("123456");
+    return userData;
+}();
+
+// Drops the sent packets; the server side of the connection is all the benchmarks need
+class SinkTransport : public BaseTransport
+{
+public:
+    explicit SinkTransport(QObject *parent = nullptr) :
+        BaseTransport(parent)
+    {
+        setState(QAbstractSocket::ConnectedState);
+    }
+
+    void connectToHost(const QString &ipAddress, quint16 port) override
+    {
+        Q_UNUSED(ipAddress)
+        Q_UNUSED(port)
+    }
+    void disconnectFromHost() override { }
+    QString remoteAddress() const override { return QStringLiteral("127.0.0.1"); }
+
+protected:
+    void sendPacketImplementation(const QByteArray &payload) override
+    {
+        Q_UNUSED(payload)
+    }
+};
+
+class tst_ServerBenchmarks : public QObject
+{
+    Q_OBJECT
+public:
+    explicit tst_ServerBenchmarks(QObject *parent = nullptr);
+
+private slots:
+    void messageSearchThroughput_data();
+    void messageSearchThroughput();
+    void channelMessageThroughput_data();
+    void channelMessageThroughput();
+    void perMemberMessageThroughput_data();
+    void perMemberMessageThroughput();
+    void handshakeRate_data();
+    void handshakeRate();
+
+protected:
+    QVector<Server::LocalUser *> addUsers(Server::Server *server, int count);
+    void addActiveSession(Server::Server *server, Server::LocalUser *user);
+};
+
+tst_ServerBenchmarks::tst_ServerBenchmarks(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void tst_ServerBenchmarks::messageSearchThroughput_data()
+{
+    QTest::addColumn<int>("messagesCount");
+    QTest::newRow("10000 messages") << 10000;
+    QTest::newRow("100000 messages") << 100000;
+}
+
+void tst_ServerBenchmarks::messageSearchThroughput()
+{
+    QFETCH(int, messagesCount);
+    Server::Server server;
+    Server::Storage storage;
+    server.setStorage(&storage);
+
+    const QVector<Server::LocalUser *> users = addUsers(&server, 2);
+    Server::LocalUser *sender = users.at(0);
+    Server::LocalUser *recipient = users.at(1);
+    for (int i = 0; i < messagesCount; ++i) {
+        const QString text = QStringLiteral("message %1 about topic%2").arg(i).arg(i % 100);
+        Server::MessageData *messageData = storage.addMessage(sender->id(), recipient->toPeer(), text);
+        recipient->getPostBox()->addMessage(messageData);
+    }
+
+    const Server::PostBox *box = recipient->getPostBox();
+    int found = 0;
+    QBENCHMARK {
+        found = 0;
+        box->searchIndex()->search(QStringLiteral("about topic42"), 0, [&](quint64 messageId) {
+            if (storage.getMessage(box->getMessageGlobalId(static_cast<quint32>(messageId)))) {
+                ++found;
+            }
+            return found < 30;
+        });
+    }
+    QCOMPARE(found, 30);
+}
+
+void tst_ServerBenchmarks::channelMessageThroughput_data()
+{
+    QTest::addColumn<int>("membersCount");
+    QTest::newRow("100 members") << 100;
+    QTest::newRow("1000 members") << 1000;
+    QTest::newRow("10000 members") << 10000;
+}
+
+void tst_ServerBenchmarks::channelMessageThroughput()
+{
+    QFETCH(int, membersCount);
+
+    Server::Server server;
+    Server::Storage storage;
+    server.setStorage(&storage);
+
+    const QVector<Server::LocalUser *> users = addUsers(&server, membersCount);
+    Server::LocalUser *sender = users.first();
+    Server::LocalChannel *channel = server.createChannel(sender, QStringLiteral("Benchmark"));
+    for (Server::LocalUser *user : users) {
+        server.addChannelMember(channel, user);
+        addActiveSession(&server, user);
+    }
+    const Peer channelPeer = channel->toPeer();
+    Server::PostBox *box = channel->getPostBox();
+
+    quint64 sentPackages = server.updatesDeliveryStats().sentPackages;
+    QBENCHMARK {
+        Server::MessageData *messageData = storage.addMessage(sender->id(), channelPeer, QStringLiteral("Message"));
+        Server::UpdateNotification notification;
+        notification.type = Server::UpdateNotification::Type::NewMessage;
+        notification.userId = sender->id();
+        notification.dialogPeer = channelPeer;
+        notification.messageId = box->addMessage(messageData);
+        notification.pts = box->pts();
+        server.queueUpdates({notification});
+        QCoreApplication::processEvents();
+
+        // Every member session gets the message
+        QCOMPARE(server.updatesDeliveryStats().sentPackages - sentPackages, quint64(membersCount));
+        sentPackages = server.updatesDeliveryStats().sentPackages;
+    }
+}
+
+void tst_ServerBenchmarks::perMemberMessageThroughput_data()
+{
+    channelMessageThroughput_data();
+}
+
+void tst_ServerBenchmarks::perMemberMessageThroughput()
+{
+    // The legacy group delivery scheme: a message copy and an update per member
+    QFETCH(int, membersCount);
+
+    Server::Server server;
+    Server::Storage storage;
+    server.setStorage(&storage);
+
+    const QVector<Server::LocalUser *> users = addUsers(&server, membersCount);
+    Server::LocalUser *sender = users.first();
+    const Peer chatPeer = Peer::fromChatId(1);
+    for (Server::LocalUser *user : users) {
+        addActiveSession(&server, user);
+    }
+
+    quint64 sentPackages = server.updatesDeliveryStats().sentPackages;
+    QBENCHMARK {
+        Server::MessageData *messageData = storage.addMessage(sender->id(), chatPeer, QStringLiteral("Message"));
+        QVector<Server::UpdateNotification> notifications;
+        notifications.reserve(users.count());
+        for (Server::LocalUser *user : users) {
+            Server::PostBox *box = user->getPostBox();
+            Server::UpdateNotification notification;
+            notification.type = Server::UpdateNotification::Type::NewMessage;
+            notification.userId = user->id();
+            notification.dialogPeer = chatPeer;
+            notification.messageId = box->addMessage(messageData);
+            notification.pts = box->pts();
+            user->syncDialogTopMessage(chatPeer, notification.messageId);
+            notifications.append(notification);
+        }
+        server.queueUpdates(notifications);
+
+        QCOMPARE(server.updatesDeliveryStats().sentPackages - sentPackages, quint64(membersCount));
+        sentPackages = server.updatesDeliveryStats().sentPackages;
+    }
+}
+
+void tst_ServerBenchmarks::handshakeRate_data()
+{
+    QTest::addColumn<int>("maxConcurrentHandshakes");
+    QTest::addColumn<int>("pregeneratedCount");
+    QTest::newRow("unlimited") << 0 << 0;
+    QTest::newRow("pregenerated") << 0 << 64;
+    QTest::newRow("limited") << 4 << 64;
+}
+
+void tst_ServerBenchmarks::handshakeRate()
+{
+    QFETCH(int, maxConcurrentHandshakes);
+    QFETCH(int, pregeneratedCount);
+
+    constexpr int c_clientsCount = 32;
+
+    const DcOption clientDcOption = c_localDcOptions.first();
+    const RsaKey publicKey = RsaKey::fromFile(TestKeyData::publicKeyFileName());
+    const RsaKey privateKey = RsaKey::fromFile(TestKeyData::privateKeyFileName());
+
+    Test::AuthProvider authProvider;
+    Telegram::Server::LocalCluster cluster;
+    cluster.setAuthorizationProvider(&authProvider);
+    cluster.setServerPrivateRsaKey(privateKey);
+    cluster.setServerConfiguration(c_localDcConfiguration);
+    QVERIFY(cluster.start());
+
+    Server::DhWorkerPool *workerPool = cluster.getServerInstance(clientDcOption.id)->dhWorkerPool();
+    workerPool->setMaxConcurrentHandshakes(maxConcurrentHandshakes);
+    workerPool->setPregeneratedCount(pregeneratedCount);
+    workerPool->pregenerate();
+    TRY_COMPARE(workerPool->availableKeyPairs(), pregeneratedCount);
+
+    int maxActiveHandshakes = 0;
+    QTimer sampleTimer;
+    connect(&sampleTimer, &QTimer::timeout, this, [workerPool, &maxActiveHandshakes]() {
+        maxActiveHandshakes = qMax(maxActiveHandshakes, workerPool->activeHandshakes());
+    });
+    sampleTimer.start(1);
+
+    QVector<Client::Client *> clients;
+    for (int i = 0; i < c_clientsCount; ++i) {
+        Client::Client *client = new Client::Client(this);
+        setupClientHelper(client, c_user, publicKey, clientDcOption);
+        clients.append(client);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for (Client::Client *client : clients) {
+        client->connectionApi()->startAuthentication();
+    }
+    for (Client::Client *client : clients) {
+        TRY_COMPARE(client->connectionApi()->status(), Client::ConnectionApi::StatusWaitForAuthentication);
+    }
+    const qint64 elapsed = qMax<qint64>(1, timer.elapsed());
+
+    qDebug() << "Handshakes:" << c_clientsCount << "in" << elapsed << "ms"
+             << "(" << c_clientsCount * 1000 / elapsed << "per second);"
+             << "max active:" << maxActiveHandshakes;
+    if (maxConcurrentHandshakes) {
+        QVERIFY(maxActiveHandshakes <= maxConcurrentHandshakes);
+    }
+    QCOMPARE(workerPool->activeHandshakes(), 0);
+    QCOMPARE(workerPool->pendingHandshakes(), 0);
+    qDeleteAll(clients);
+}
+
+QVector<Server::LocalUser *> tst_ServerBenchmarks::addUsers(Server::Server *server, int count)
+{
+    QVector<Server::LocalUser *> users;
+    users.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const QString phoneNumber = QStringLiteral("555%1").arg(i, 7, 10, QLatin1Char('0'));
+        users.append(server->addUser(phoneNumber));
+    }
+    return users;
+}
+
+void tst_ServerBenchmarks::addActiveSession(Server::Server *server, Server::LocalUser *user)
+{
+    // The connection is owned by the server, so the sessions live as long as the server
+    Server::RemoteClientConnection *connection = new Server::RemoteClientConnection(server);
+    connection->setTransport(new SinkTransport(connection));
+    connection->setServerApi(server);
+    QByteArray authKey(256, Qt::Uninitialized);
+    RandomGenerator::instance()->generate(&authKey);
+    connection->setAuthKey(authKey);
+
+    Server::Session *session = server->createSession(connection->authId(), authKey,
+                                                     connection->transport()->remoteAddress(), 1);
+    server->bindUserSession(user, session);
+    connection->setSession(session);
+}
+
+QTEST_GUILESS_MAIN(tst_ServerBenchmarks)
+
+#include "tst_ServerBenchmarks.moc"
@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_ServerBenchmarks
+SOURCES += tst_ServerBenchmarks.cpp
+HEADERS += ../utils/TestAuthProvider.hpp
+
+include(../../tests/data/data.pri)
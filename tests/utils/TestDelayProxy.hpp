@@ -0,0 +1,81 @@
+#ifndef TEST_DELAY_PROXY_HPP
+#define TEST_DELAY_PROXY_HPP
+
+#include <QPointer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+namespace Telegram {
+
+namespace Test {
+
+// Forwards the accepted TCP connections to the target server and delays the data in both directions
+class DelayProxy : public QObject
+{
+public:
+    explicit DelayProxy(QObject *parent = nullptr) :
+        QObject(parent),
+        m_server(new QTcpServer(this))
+    {
+        connect(m_server, &QTcpServer::newConnection, this, [this]() {
+            onNewConnection();
+        });
+    }
+
+    void setTarget(const QString &address, quint16 port)
+    {
+        m_targetAddress = address;
+        m_targetPort = port;
+    }
+
+    int delay() const { return m_delay; }
+    void setDelay(int msecs) { m_delay = msecs; }
+
+    bool listen()
+    {
+        return m_server->listen(QHostAddress::LocalHost);
+    }
+
+    QString address() const { return m_server->serverAddress().toString(); }
+    quint16 port() const { return m_server->serverPort(); }
+
+protected:
+    void onNewConnection()
+    {
+        while (QTcpSocket *incoming = m_server->nextPendingConnection()) {
+            QTcpSocket *outgoing = new QTcpSocket(incoming);
+            forward(incoming, outgoing);
+            forward(outgoing, incoming);
+            connect(incoming, &QTcpSocket::disconnected, outgoing, &QTcpSocket::disconnectFromHost);
+            connect(outgoing, &QTcpSocket::disconnected, incoming, &QTcpSocket::disconnectFromHost);
+            connect(incoming, &QTcpSocket::disconnected, incoming, &QObject::deleteLater);
+            outgoing->connectToHost(m_targetAddress, m_targetPort);
+        }
+    }
+
+    void forward(QTcpSocket *source, QTcpSocket *destination)
+    {
+        QPointer<QTcpSocket> destinationPointer = destination;
+        connect(source, &QTcpSocket::readyRead, this, [this, source, destinationPointer]() {
+            const QByteArray data = source->readAll();
+            // The timers with the same interval fire in order, so the data is not reordered
+            QTimer::singleShot(m_delay, this, [destinationPointer, data]() {
+                if (destinationPointer) {
+                    destinationPointer->write(data);
+                }
+            });
+        });
+    }
+
+    QTcpServer *m_server = nullptr;
+    QString m_targetAddress;
+    quint16 m_targetPort = 0;
+    int m_delay = 0;
+};
+
+} // Test namespace
+
+} // Telegram namespace
+
+#endif // TEST_DELAY_PROXY_HPP